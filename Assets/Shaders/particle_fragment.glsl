@@ -0,0 +1,15 @@
+#version 330 core
+
+in vec2 corner;
+in vec4 particleColor;
+
+out vec4 FragColor;
+
+void main()
+{
+    // soft round particle
+    float distance2 = dot(corner, corner);
+    if (distance2 > 1.0)
+        discard;
+    FragColor = vec4(particleColor.rgb, particleColor.a * (1.0 - distance2));
+}
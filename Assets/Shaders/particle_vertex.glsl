@@ -0,0 +1,32 @@
+#version 330 core
+
+// same block as scene_vertex.glsl
+layout (std140) uniform SceneBlock
+{
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 light_view_proj_matrix;
+    vec3 light_color;
+    vec3 light_position;
+    vec3 light_direction;
+    vec3 view_position;
+};
+
+// per instance, the quad's corners come from gl_VertexID
+layout (location = 0) in vec4 positionSize;   // xyz, w is the half width
+layout (location = 1) in vec4 color;
+
+out vec2 corner;
+out vec4 particleColor;
+
+void main()
+{
+    corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    particleColor = color;
+
+    // the camera's right and up axes are the first two rows of the view matrix
+    vec3 right = vec3(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0]);
+    vec3 up = vec3(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1]);
+    vec3 position = positionSize.xyz + (corner.x * right + corner.y * up) * positionSize.w;
+    gl_Position = projectionMatrix * viewMatrix * vec4(position, 1.0);
+}
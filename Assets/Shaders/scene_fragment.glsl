@@ -1,38 +1,81 @@
 #version 330 core
 
-
-
-		
-
-
+// Compiled with any combination of SHADOWS, SPOTLIGHT, TEXTURED and INSTANCED (or INDIRECT, or SKINNED) defined,
+// see ShaderPermutations.h. The shading strengths can be overridden with SHADING_*_STRENGTH defines.
 
 const float PI = 3.1415926535897932384626433832795;
 
-uniform vec3 light_color;
-uniform vec3 light_position;
-uniform vec3 light_direction;
-
+// same block as scene_vertex.glsl
+layout (std140) uniform SceneBlock
+{
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 light_view_proj_matrix;
+    vec3 light_color;
+    vec3 light_position;
+    vec3 light_direction;
+    vec3 view_position;
+};
+
+#ifdef INSTANCED
 uniform vec3 objectColor;
-
-const float shading_ambient_strength    = 0.3;
-const float shading_diffuse_strength    = 0.9;
-const float shading_specular_strength   = 0.3;
-
+#elif defined(INDIRECT)
+// the color and texture layer of the draw come from the vertex shader
+flat in vec3 drawColor;
+flat in float drawTextureLayer;
+#define objectColor drawColor
+#define textureLayer drawTextureLayer
+#elif defined(SKINNED)
+// the color comes from the vertices, see scene_vertex.glsl
+in vec3 skinnedColor;
+#define objectColor skinnedColor
+#else
+// same block as scene_vertex.glsl
+layout (std140) uniform DrawBlock
+{
+    mat4 worldMatrix;
+    vec4 drawColorLayer;
+};
+#define objectColor drawColorLayer.rgb
+#define textureLayer drawColorLayer.w
+#endif
+
+#ifndef SHADING_AMBIENT_STRENGTH
+#define SHADING_AMBIENT_STRENGTH 0.3
+#endif
+#ifndef SHADING_DIFFUSE_STRENGTH
+#define SHADING_DIFFUSE_STRENGTH 0.9
+#endif
+#ifndef SHADING_SPECULAR_STRENGTH
+#define SHADING_SPECULAR_STRENGTH 0.3
+#endif
+
+const float shading_ambient_strength    = SHADING_AMBIENT_STRENGTH;
+const float shading_diffuse_strength    = SHADING_DIFFUSE_STRENGTH;
+const float shading_specular_strength   = SHADING_SPECULAR_STRENGTH;
+
+#ifdef SPOTLIGHT
 uniform float light_cutoff_outer;
 uniform float light_cutoff_inner;
-uniform float light_near_plane;
-uniform float light_far_plane;
-
-uniform vec3 view_position;
+#endif
 
+#ifdef SHADOWS
 uniform sampler2D shadow_map;
+in vec4 fragment_position_light_space;
+#endif
+
+#ifdef TEXTURED
+// all the scene textures are layers of one array, the material picks its layer
+uniform sampler2DArray textureSampler;
+#ifdef INSTANCED
+uniform float textureLayer;
+#endif
+in vec2 vertexUV;
+#endif
 
 in vec3 fragment_position;
-in vec4 fragment_position_light_space;
 in vec3 fragment_normal;
 
-in vec4 gl_FragCoord;
-
 out vec4 result;
 
 vec3 ambient_color(vec3 light_color_arg) {
@@ -51,6 +94,7 @@ vec3 specular_color(vec3 light_color_arg, vec3 light_position_arg) {
     return shading_specular_strength * light_color_arg * pow(max(dot(reflect_light_direction, view_direction), 0.0f),32);
 }
 
+#ifdef SHADOWS
 float shadow_scalar() {
     // this function returns 1.0 when the surface receives light, and 0.0 when it is in a shadow
     // perform perspective divide
@@ -65,7 +109,9 @@ float shadow_scalar() {
     float bias = 0;  // bias applied in depth map: see shadow_vertex.glsl
     return ((current_depth - bias) < closest_depth) ? 1.0 : 0.0;
 }
+#endif
 
+#ifdef SPOTLIGHT
 float spotlight_scalar() {
     float theta = dot(normalize(fragment_position - light_position), light_direction);
     
@@ -77,6 +123,7 @@ float spotlight_scalar() {
         return 0.0;
     }
 }
+#endif
 
 void main()
 {
@@ -84,13 +131,21 @@ void main()
     vec3 diffuse = vec3(0.0f);
     vec3 specular = vec3(0.0f);
 
-    float scalar = shadow_scalar() * spotlight_scalar();
+    float scalar = 1.0;
+#ifdef SHADOWS
+    scalar *= shadow_scalar();
+#endif
+#ifdef SPOTLIGHT
+    scalar *= spotlight_scalar();
+#endif
     ambient = ambient_color(light_color);
     diffuse = scalar * diffuse_color(light_color, light_position);
     specular = scalar * specular_color(light_color, light_position);
     
-    vec3 color = (specular + diffuse + ambient) * objectColor ;
+    vec3 color = (specular + diffuse + ambient) * objectColor;
+#ifdef TEXTURED
+    color *= texture(textureSampler, vec3(vertexUV, textureLayer)).rgb;
+#endif
     
     result = vec4(color, 1.0f);
 }
-
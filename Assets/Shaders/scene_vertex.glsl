@@ -1,27 +1,97 @@
 #version 330 core
 
-uniform vec3 view_position;
+#ifdef INDIRECT
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
+// per frame constants, written once a frame into the FrameRingBuffer, see SceneBlock in ShaderPermutations.h
+layout (std140) uniform SceneBlock
+{
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 light_view_proj_matrix;
+    vec3 light_color;
+    vec3 light_position;
+    vec3 light_direction;
+    vec3 view_position;
+};
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normals;
 layout (location = 2) in vec2 aUV;
 
-uniform mat4 worldMatrix;
-uniform mat4 viewMatrix  = mat4(1.0);
-uniform mat4 projectionMatrix  = mat4(1.0);
-uniform mat4 light_view_proj_matrix;
+#ifdef INSTANCED
+layout (location = 3) in mat4 instanceWorldMatrix; // uses locations 3 to 6
+#elif defined(INDIRECT)
+// one entry per draw of the frame, see MultiDrawIndirect.h
+struct DrawData
+{
+    mat4 worldMatrix;
+    vec4 colorLayer;   // object color, texture layer in w
+};
+layout (std430) readonly buffer DrawDataBuffer
+{
+    DrawData draws[];
+};
+uniform int drawBase;   // first draw of the multi draw call, gl_DrawIDARB restarts at 0 for every call
+flat out vec3 drawColor;
+flat out float drawTextureLayer;
+#elif defined(SKINNED)
+// the character's range of the FrameRingBuffer, see JointBlock in SkinnedMesh.h
+layout (std140) uniform JointBlock
+{
+    mat4 characterMatrix;
+    mat4 joints[32];   // MAX_JOINTS in Animation.h
+};
+layout (location = 3) in uvec4 jointIndices;
+layout (location = 4) in vec4 jointWeights;
+layout (location = 5) in vec3 vertexColor;
+out vec3 skinnedColor;
+#else
+// the draw's range of the FrameRingBuffer, see DrawBlock in ShaderPermutations.h
+layout (std140) uniform DrawBlock
+{
+    mat4 worldMatrix;
+    vec4 drawColorLayer;   // object color, texture layer in w
+};
+#endif
 
 out vec3 fragment_normal;
 out vec3 fragment_position;
+
+#ifdef SHADOWS
 out vec4 fragment_position_light_space;
+#endif
+
+#ifdef TEXTURED
 out vec2 vertexUV;
+#endif
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 worldMatrix = instanceWorldMatrix;
+#elif defined(INDIRECT)
+    DrawData draw = draws[drawBase + gl_DrawIDARB];
+    mat4 worldMatrix = draw.worldMatrix;
+    drawColor = draw.colorLayer.rgb;
+    drawTextureLayer = draw.colorLayer.w;
+#elif defined(SKINNED)
+    // linear blend of the joints, the weights add up to one
+    mat4 skin = jointWeights.x * joints[jointIndices.x] + jointWeights.y * joints[jointIndices.y]
+        + jointWeights.z * joints[jointIndices.z] + jointWeights.w * joints[jointIndices.w];
+    mat4 worldMatrix = characterMatrix * skin;
+    skinnedColor = vertexColor;
+#endif
     fragment_normal = mat3(worldMatrix) * normals;
 	fragment_position = vec3(worldMatrix* vec4(position, 1.0));
+#ifdef SHADOWS
 	fragment_position_light_space = light_view_proj_matrix * vec4(fragment_position, 1.0);
+#endif
 	mat4 modelViewProjection = projectionMatrix * viewMatrix * worldMatrix;
     gl_Position = modelViewProjection * vec4(position, 1.0);
+#ifdef TEXTURED
 	vertexUV = aUV;
+#endif
 }
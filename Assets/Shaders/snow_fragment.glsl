@@ -0,0 +1,12 @@
+#version 330 core
+
+out vec4 FragColor;
+
+void main()
+{
+    // round flakes out of the square point sprites
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    if (dot(offset, offset) > 1.0)
+        discard;
+    FragColor = vec4(0.95, 0.97, 1.0, 1.0);
+}
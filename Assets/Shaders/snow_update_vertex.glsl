@@ -0,0 +1,66 @@
+#version 330 core
+
+// One snowflake per vertex, written back through transform feedback into the other buffer, see SnowSystem.h.
+// SnowReference::updateScalar is the CPU version of the same step, keep them in sync.
+
+layout (location = 0) in vec4 position;   // xyz, w is the flake's phase in [0, 1)
+layout (location = 1) in vec4 velocity;   // xyz
+
+uniform float dt;
+uniform vec3 wind;
+uniform float gravity;
+uniform float drag;
+uniform float groundHeight;
+uniform float spawnHeight;
+uniform float extent;   // half size of the snowing area
+uniform uint step;      // seeds the respawn positions
+
+out vec4 outPosition;
+out vec4 outVelocity;
+
+uint hash(uint x)
+{
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+float random01(uint id, uint seed, uint k)
+{
+    return float(hash(id * 4u + k + hash(seed)) >> 8u) / 16777216.0;
+}
+
+void main()
+{
+    vec3 p = position.xyz;
+    vec3 v = velocity.xyz;
+
+    // light flakes follow the wind more closely, the drag also caps the fall speed
+    float flakeDrag = drag * (0.75 + 0.5 * position.w);
+    v += ((wind - v) * flakeDrag + vec3(0.0, gravity, 0.0)) * dt;
+    p += v * dt;
+
+    // the area wraps around horizontally
+    if (p.x > extent)
+        p.x -= 2.0 * extent;
+    else if (p.x < -extent)
+        p.x += 2.0 * extent;
+    if (p.z > extent)
+        p.z -= 2.0 * extent;
+    else if (p.z < -extent)
+        p.z += 2.0 * extent;
+
+    // a flake reaching the ground starts again from the top
+    if (p.y < groundHeight)
+    {
+        uint id = uint(gl_VertexID);
+        p = vec3((random01(id, step, 0u) * 2.0 - 1.0) * extent, spawnHeight, (random01(id, step, 1u) * 2.0 - 1.0) * extent);
+        v = vec3(0.0);
+    }
+
+    outPosition = vec4(p, position.w);
+    outVelocity = vec4(v, 0.0);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+// same block as scene_vertex.glsl
+layout (std140) uniform SceneBlock
+{
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 light_view_proj_matrix;
+    vec3 light_color;
+    vec3 light_position;
+    vec3 light_direction;
+    vec3 view_position;
+};
+
+layout (location = 0) in vec4 position;   // xyz, w is the flake's phase in [0, 1)
+
+uniform float pointScale;   // pixels of a flake at a distance of 1
+
+void main()
+{
+    gl_Position = projectionMatrix * viewMatrix * vec4(position.xyz, 1.0);
+    gl_PointSize = clamp(pointScale * (0.6 + 0.8 * position.w) / gl_Position.w, 1.0, 32.0);
+}
@@ -0,0 +1,61 @@
+#ifndef ALIGNEDARRAY_H
+#define ALIGNEDARRAY_H
+
+// Fixed size array of plain values starting on a 64 byte boundary (a cache line, and a multiple of any SIMD register),
+// for the structure of arrays data the SIMD loops load with aligned loads.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+template <class T>
+class AlignedArray
+{
+public:
+	static const size_t ALIGNMENT = 64;
+
+	AlignedArray() : block(NULL), values(NULL), count(0)
+	{
+	}
+
+	explicit AlignedArray(size_t size) : block(NULL), values(NULL), count(0)
+	{
+		resize(size);
+	}
+
+	~AlignedArray()
+	{
+		free(block);
+	}
+
+	// the content is lost, new values are zero
+	void resize(size_t size)
+	{
+		free(block);
+		block = NULL;
+		values = NULL;
+		count = size;
+		if (size == 0)
+			return;
+
+		block = malloc(size * sizeof(T) + ALIGNMENT - 1);
+		values = (T*)(((uintptr_t)block + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1));
+		memset(values, 0, size * sizeof(T));
+	}
+
+	T& operator[](size_t i) { return values[i]; }
+	const T& operator[](size_t i) const { return values[i]; }
+	T* data() { return values; }
+	const T* data() const { return values; }
+	size_t size() const { return count; }
+
+private:
+	AlignedArray(const AlignedArray&);
+	AlignedArray& operator=(const AlignedArray&);
+
+	void* block;
+	T* values;
+	size_t count;
+};
+
+#endif
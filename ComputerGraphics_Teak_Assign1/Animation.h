@@ -0,0 +1,501 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+// Skeletal animation on the CPU: a joint hierarchy, clips of rotation and translation keys, and the sampling that
+// turns a clip at a time into the skinning matrices SkinnedMesh uploads (model space pose times inverse bind pose).
+// Clips are keyed at a fixed rate for every joint, so finding the keys of a time is a multiply, not a search, and
+// many characters at different times can be sampled together: AnimationBatch samples eight characters per AVX2
+// register, the keys gathered from the clip's component arrays, and splits the characters over the JobSystem.
+// Rotations are blended with a normalized lerp along the shorter arc on both paths, so they agree to rounding.
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <math.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <ImageResize.h>
+#include <JobSystem.h>
+#include <Profiler.h>
+
+// the size of the joint array of JointBlock in scene_vertex.glsl (the SKINNED variant)
+const int MAX_JOINTS = 32;
+
+enum AnimationPath
+{
+	ANIMATION_SCALAR,
+	ANIMATION_AVX2
+};
+
+// rest pose of a joint, relative to its parent
+struct Joint
+{
+	std::string name;
+	int parent;   // -1 for the root, always before the joint itself
+	glm::vec3 translation;
+	glm::quat rotation;
+};
+
+struct JointPose
+{
+	glm::quat rotation;
+	glm::vec3 translation;
+};
+
+class Skeleton
+{
+public:
+	// returns the index of the joint, -1 if the parent does not exist yet or the skeleton is full
+	int addJoint(const std::string& name, int parent, const glm::vec3& translation, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f))
+	{
+		if (parent >= (int)joints.size() || (int)joints.size() >= MAX_JOINTS)
+		{
+			std::cerr << "Error::Skeleton cannot add joint " << name << std::endl;
+			return -1;
+		}
+
+		Joint joint;
+		joint.name = name;
+		joint.parent = parent;
+		joint.translation = translation;
+		joint.rotation = rotation;
+		joints.push_back(joint);
+
+		glm::mat4 local = glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation);
+		bindPose.push_back(parent < 0 ? local : bindPose[parent] * local);
+		inverseBindPose.push_back(glm::inverse(bindPose.back()));
+		return (int)joints.size() - 1;
+	}
+
+	int findJoint(const std::string& name) const
+	{
+		for (size_t i = 0; i < joints.size(); i++)
+			if (joints[i].name == name)
+				return (int)i;
+		return -1;
+	}
+
+	int getJointCount() const { return (int)joints.size(); }
+	const Joint& getJoint(int joint) const { return joints[joint]; }
+	// model space rest pose, and its inverse which brings the mesh from the rest pose into joint space
+	const glm::mat4& getBindPose(int joint) const { return bindPose[joint]; }
+	const glm::mat4& getInverseBindPose(int joint) const { return inverseBindPose[joint]; }
+
+private:
+	std::vector<Joint> joints;
+	std::vector<glm::mat4> bindPose;
+	std::vector<glm::mat4> inverseBindPose;
+};
+
+// a key for every joint at every frame, the last frame closes the loop
+class AnimationClip
+{
+public:
+	AnimationClip() : sampleRate(30.0f), frameCount(0), jointCount(0)
+	{
+	}
+
+	AnimationClip(float keysPerSecond, int frames, int joints)
+		: sampleRate(keysPerSecond), frameCount(frames), jointCount(joints)
+	{
+		size_t keyCount = (size_t)frames * joints;
+		rx.assign(keyCount, 0.0f);
+		ry.assign(keyCount, 0.0f);
+		rz.assign(keyCount, 0.0f);
+		rw.assign(keyCount, 1.0f);
+		tx.assign(keyCount, 0.0f);
+		ty.assign(keyCount, 0.0f);
+		tz.assign(keyCount, 0.0f);
+	}
+
+	void setKey(int frame, int joint, const glm::quat& rotation, const glm::vec3& translation)
+	{
+		size_t key = (size_t)frame * jointCount + joint;
+		glm::quat r = glm::normalize(rotation);
+		rx[key] = r.x;
+		ry[key] = r.y;
+		rz[key] = r.z;
+		rw[key] = r.w;
+		tx[key] = translation.x;
+		ty[key] = translation.y;
+		tz[key] = translation.z;
+	}
+
+	JointPose getKey(int frame, int joint) const
+	{
+		size_t key = (size_t)frame * jointCount + joint;
+		JointPose pose;
+		pose.rotation = glm::quat(rw[key], rx[key], ry[key], rz[key]);
+		pose.translation = glm::vec3(tx[key], ty[key], tz[key]);
+		return pose;
+	}
+
+	float getSampleRate() const { return sampleRate; }
+	int getFrameCount() const { return frameCount; }
+	int getJointCount() const { return jointCount; }
+	float getDuration() const { return frameCount > 1 ? (frameCount - 1) / sampleRate : 0.0f; }
+	size_t getMemorySize() const { return rx.size() * 7 * sizeof(float); }
+
+	// the keys split by component, index frame * jointCount + joint
+	std::vector<float> rx, ry, rz, rw;
+	std::vector<float> tx, ty, tz;
+
+private:
+	float sampleRate;
+	int frameCount;
+	int jointCount;
+};
+
+// the first frame and how far to the next one of a time, looping over the clip
+inline void findClipFrame(const AnimationClip& clip, float time, int& frame, float& fraction)
+{
+	float duration = clip.getDuration();
+	if (duration <= 0.0f)
+	{
+		frame = 0;
+		fraction = 0.0f;
+		return;
+	}
+	time -= floorf(time / duration) * duration;
+	float position = time * clip.getSampleRate();
+	frame = std::min((int)position, clip.getFrameCount() - 2);
+	fraction = std::min(1.0f, position - frame);
+}
+
+// joint space poses of every joint of the clip at a time
+inline void sampleClip(const AnimationClip& clip, float time, JointPose* poses)
+{
+	int frame;
+	float fraction;
+	findClipFrame(clip, time, frame, fraction);
+	int nextFrame = std::min(frame + 1, clip.getFrameCount() - 1);
+	for (int j = 0; j < clip.getJointCount(); j++)
+	{
+		JointPose from = clip.getKey(frame, j), to = clip.getKey(nextFrame, j);
+		float sign = glm::dot(from.rotation, to.rotation) < 0.0f ? -1.0f : 1.0f;
+		poses[j].rotation = glm::normalize(from.rotation * (1.0f - fraction) + to.rotation * (fraction * sign));
+		poses[j].translation = glm::mix(from.translation, to.translation, fraction);
+	}
+}
+
+// skinning matrices of the poses, the model space pose times the inverse bind pose
+inline void computeSkinMatrices(const Skeleton& skeleton, const JointPose* poses, glm::mat4* skinMatrices)
+{
+	glm::mat4 model[MAX_JOINTS];
+	for (int j = 0; j < skeleton.getJointCount(); j++)
+	{
+		glm::mat4 local = glm::mat4_cast(poses[j].rotation);
+		local[3] = glm::vec4(poses[j].translation, 1.0f);
+		int parent = skeleton.getJoint(j).parent;
+		model[j] = parent < 0 ? local : model[parent] * local;
+		skinMatrices[j] = model[j] * skeleton.getInverseBindPose(j);
+	}
+}
+
+// Olaf's joints, rest pose where the rigid parts of the scene are drawn
+inline Skeleton makeOlafSkeleton()
+{
+	Skeleton skeleton;
+	int root = skeleton.addJoint("root", -1, glm::vec3(0.0f));
+	int hips = skeleton.addJoint("hips", root, glm::vec3(0.0f, 0.6f, 0.0f));
+	int chest = skeleton.addJoint("chest", hips, glm::vec3(0.0f, 0.4f, 0.0f));
+	skeleton.addJoint("head", chest, glm::vec3(0.0f, 0.4f, 0.0f));
+	int leftShoulder = skeleton.addJoint("leftShoulder", chest, glm::vec3(-0.1f, 0.2f, 0.0f));
+	skeleton.addJoint("leftElbow", leftShoulder, glm::vec3(-0.4f, 0.0f, 0.0f));
+	int rightShoulder = skeleton.addJoint("rightShoulder", chest, glm::vec3(0.1f, 0.2f, 0.0f));
+	skeleton.addJoint("rightElbow", rightShoulder, glm::vec3(0.4f, 0.0f, 0.0f));
+	skeleton.addJoint("leftFoot", root, glm::vec3(-0.15f, 0.1f, 0.0f));
+	skeleton.addJoint("rightFoot", root, glm::vec3(0.15f, 0.1f, 0.0f));
+	return skeleton;
+}
+
+// two seconds of Olaf waving and bobbing, keyed at 30 frames per second
+inline AnimationClip makeOlafWaveClip(const Skeleton& skeleton)
+{
+	const float sampleRate = 30.0f;
+	const int frameCount = 61;
+	const float pi = 3.14159265f;
+	AnimationClip clip(sampleRate, frameCount, skeleton.getJointCount());
+
+	for (int frame = 0; frame < frameCount; frame++)
+	{
+		// one turn of every periodic motion over the clip, so the last frame is the first
+		float phase = 2.0f * pi * frame / (frameCount - 1);
+		for (int j = 0; j < skeleton.getJointCount(); j++)
+		{
+			const Joint& joint = skeleton.getJoint(j);
+			glm::quat rotation = joint.rotation;
+			glm::vec3 translation = joint.translation;
+			float side = joint.name.find("left") == 0 ? 1.0f : -1.0f;
+
+			if (joint.name == "hips")
+			{
+				translation.y += 0.03f * fabsf(sinf(phase));
+				rotation = glm::angleAxis(glm::radians(8.0f * sinf(phase)), glm::vec3(0.0f, 1.0f, 0.0f)) * rotation;
+			}
+			else if (joint.name == "chest")
+				rotation = glm::angleAxis(glm::radians(5.0f * sinf(2.0f * phase)), glm::vec3(0.0f, 0.0f, 1.0f)) * rotation;
+			else if (joint.name == "head")
+				rotation = glm::angleAxis(glm::radians(10.0f * sinf(2.0f * phase + 1.0f)), glm::vec3(1.0f, 0.0f, 0.0f)) * rotation;
+			else if (joint.name == "leftShoulder" || joint.name == "rightShoulder")
+				rotation = glm::angleAxis(glm::radians(-side * (30.0f + 25.0f * sinf(2.0f * phase))), glm::vec3(0.0f, 0.0f, 1.0f)) * rotation;
+			else if (joint.name == "leftElbow" || joint.name == "rightElbow")
+				rotation = glm::angleAxis(glm::radians(-side * (20.0f + 20.0f * sinf(2.0f * phase + 0.5f))), glm::vec3(0.0f, 0.0f, 1.0f)) * rotation;
+			else if (joint.name == "leftFoot" || joint.name == "rightFoot")
+				rotation = glm::angleAxis(glm::radians(side * 15.0f * sinf(phase)), glm::vec3(1.0f, 0.0f, 0.0f)) * rotation;
+
+			clip.setKey(frame, j, rotation, translation);
+		}
+	}
+	return clip;
+}
+
+// samples many characters of one skeleton, each at its own time in a clip
+class AnimationBatch
+{
+public:
+	// characters per job, a multiple of the SIMD width
+	static const int GRAIN = 64;
+
+	// skinMatrices holds jointCount matrices per character, character after character
+	static void sample(const Skeleton& skeleton, const AnimationClip& clip, const float* times, int characterCount, glm::mat4* skinMatrices,
+		AnimationPath path = getBestPath(), JobSystem* jobs = &JobSystem::shared())
+	{
+		PROFILE_SCOPE(sampleScope, "Animation sample");
+		std::function<void(int, int)> body = [&skeleton, &clip, times, skinMatrices, path](int begin, int end) {
+			sampleRange(skeleton, clip, times, skinMatrices, path, begin, end);
+		};
+		if (jobs != NULL)
+			jobs->parallelFor(characterCount, body, GRAIN);
+		else
+			body(0, characterCount);
+	}
+
+	static bool isPathSupported(AnimationPath path)
+	{
+		return path == ANIMATION_SCALAR || ImageResize::isAVX2Supported();
+	}
+
+	static AnimationPath getBestPath()
+	{
+		static const AnimationPath best = isPathSupported(ANIMATION_AVX2) ? ANIMATION_AVX2 : ANIMATION_SCALAR;
+		return best;
+	}
+
+	static const char* getPathName(AnimationPath path)
+	{
+		return path == ANIMATION_AVX2 ? "AVX2" : "scalar";
+	}
+
+private:
+	static void sampleRange(const Skeleton& skeleton, const AnimationClip& clip, const float* times, glm::mat4* skinMatrices, AnimationPath path, int begin, int end)
+	{
+#if defined(IMAGERESIZE_X86)
+		if (path == ANIMATION_AVX2)
+			begin = sampleAVX2(skeleton, clip, times, skinMatrices, begin, end);
+#endif
+		JointPose poses[MAX_JOINTS];
+		int jointCount = skeleton.getJointCount();
+		for (int c = begin; c < end; c++)
+		{
+			sampleClip(clip, times[c], poses);
+			computeSkinMatrices(skeleton, poses, &skinMatrices[(size_t)c * jointCount]);
+		}
+	}
+
+#if defined(IMAGERESIZE_X86)
+	// eight characters per register, the poses composed as rotation and translation down the hierarchy,
+	// returns where the scalar loop takes over
+	IMAGERESIZE_AVX2_TARGET static int sampleAVX2(const Skeleton& skeleton, const AnimationClip& clip, const float* times, glm::mat4* skinMatrices, int begin, int end)
+	{
+		const int jointCount = skeleton.getJointCount();
+		const float duration = clip.getDuration();
+		if (duration <= 0.0f)
+			return begin;
+
+		const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f);
+		const __m256 signBit = _mm256_set1_ps(-0.0f);
+		const __m256 durationVector = _mm256_set1_ps(duration), inverseDuration = _mm256_set1_ps(1.0f / duration);
+		const __m256 sampleRate = _mm256_set1_ps(clip.getSampleRate());
+		const __m256i lastFrame = _mm256_set1_epi32(clip.getFrameCount() - 2);
+		const __m256i joints = _mm256_set1_epi32(jointCount);
+
+		// model space rotation and translation of every joint of the eight characters
+		__m256 qx[MAX_JOINTS], qy[MAX_JOINTS], qz[MAX_JOINTS], qw[MAX_JOINTS];
+		__m256 px[MAX_JOINTS], py[MAX_JOINTS], pz[MAX_JOINTS];
+		float matrices[12][8];
+
+		int c = begin;
+		for (; c + 8 <= end; c += 8)
+		{
+			__m256 time = _mm256_loadu_ps(&times[c]);
+			time = _mm256_sub_ps(time, _mm256_mul_ps(_mm256_floor_ps(_mm256_mul_ps(time, inverseDuration)), durationVector));
+			__m256 position = _mm256_mul_ps(time, sampleRate);
+			__m256i frame = _mm256_min_epi32(_mm256_cvttps_epi32(position), lastFrame);
+			__m256 fraction = _mm256_min_ps(one, _mm256_sub_ps(position, _mm256_cvtepi32_ps(frame)));
+			__m256 remaining = _mm256_sub_ps(one, fraction);
+			__m256i key = _mm256_mullo_epi32(frame, joints);
+			__m256i nextKey = _mm256_add_epi32(key, joints);
+
+			for (int j = 0; j < jointCount; j++)
+			{
+				__m256i from = _mm256_add_epi32(key, _mm256_set1_epi32(j)), to = _mm256_add_epi32(nextKey, _mm256_set1_epi32(j));
+				__m256 ax = _mm256_i32gather_ps(&clip.rx[0], from, 4), ay = _mm256_i32gather_ps(&clip.ry[0], from, 4);
+				__m256 az = _mm256_i32gather_ps(&clip.rz[0], from, 4), aw = _mm256_i32gather_ps(&clip.rw[0], from, 4);
+				__m256 bx = _mm256_i32gather_ps(&clip.rx[0], to, 4), by = _mm256_i32gather_ps(&clip.ry[0], to, 4);
+				__m256 bz = _mm256_i32gather_ps(&clip.rz[0], to, 4), bw = _mm256_i32gather_ps(&clip.rw[0], to, 4);
+
+				// normalized lerp, the second key flipped onto the first one's side
+				__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_add_ps(_mm256_mul_ps(az, bz), _mm256_mul_ps(aw, bw)));
+				__m256 weight = _mm256_xor_ps(fraction, _mm256_and_ps(_mm256_cmp_ps(dot, zero, _CMP_LT_OQ), signBit));
+				__m256 lx = _mm256_add_ps(_mm256_mul_ps(ax, remaining), _mm256_mul_ps(bx, weight));
+				__m256 ly = _mm256_add_ps(_mm256_mul_ps(ay, remaining), _mm256_mul_ps(by, weight));
+				__m256 lz = _mm256_add_ps(_mm256_mul_ps(az, remaining), _mm256_mul_ps(bz, weight));
+				__m256 lw = _mm256_add_ps(_mm256_mul_ps(aw, remaining), _mm256_mul_ps(bw, weight));
+				__m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_add_ps(_mm256_mul_ps(lz, lz), _mm256_mul_ps(lw, lw))));
+				lx = _mm256_div_ps(lx, length);
+				ly = _mm256_div_ps(ly, length);
+				lz = _mm256_div_ps(lz, length);
+				lw = _mm256_div_ps(lw, length);
+
+				__m256 tx = lerp(_mm256_i32gather_ps(&clip.tx[0], from, 4), _mm256_i32gather_ps(&clip.tx[0], to, 4), fraction);
+				__m256 ty = lerp(_mm256_i32gather_ps(&clip.ty[0], from, 4), _mm256_i32gather_ps(&clip.ty[0], to, 4), fraction);
+				__m256 tz = lerp(_mm256_i32gather_ps(&clip.tz[0], from, 4), _mm256_i32gather_ps(&clip.tz[0], to, 4), fraction);
+
+				int parent = skeleton.getJoint(j).parent;
+				if (parent < 0)
+				{
+					qx[j] = lx; qy[j] = ly; qz[j] = lz; qw[j] = lw;
+					px[j] = tx; py[j] = ty; pz[j] = tz;
+				}
+				else
+				{
+					// rotation: parent * local, translation: parent's plus the local one turned by the parent's rotation
+					const __m256 sx = qx[parent], sy = qy[parent], sz = qz[parent], sw = qw[parent];
+					qw[j] = _mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(sw, lw), _mm256_mul_ps(sx, lx)), _mm256_add_ps(_mm256_mul_ps(sy, ly), _mm256_mul_ps(sz, lz)));
+					qx[j] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sw, lx), _mm256_mul_ps(sx, lw)), _mm256_sub_ps(_mm256_mul_ps(sy, lz), _mm256_mul_ps(sz, ly)));
+					qy[j] = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(sw, ly), _mm256_mul_ps(sx, lz)), _mm256_add_ps(_mm256_mul_ps(sy, lw), _mm256_mul_ps(sz, lx)));
+					qz[j] = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(sw, lz), _mm256_mul_ps(sy, lx)), _mm256_add_ps(_mm256_mul_ps(sx, ly), _mm256_mul_ps(sz, lw)));
+
+					// v + w * t + cross(q, t) with t = 2 * cross(q, v)
+					__m256 cx = _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(sy, tz), _mm256_mul_ps(sz, ty)));
+					__m256 cy = _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(sz, tx), _mm256_mul_ps(sx, tz)));
+					__m256 cz = _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(sx, ty), _mm256_mul_ps(sy, tx)));
+					px[j] = _mm256_add_ps(px[parent], _mm256_add_ps(_mm256_add_ps(tx, _mm256_mul_ps(sw, cx)), _mm256_sub_ps(_mm256_mul_ps(sy, cz), _mm256_mul_ps(sz, cy))));
+					py[j] = _mm256_add_ps(py[parent], _mm256_add_ps(_mm256_add_ps(ty, _mm256_mul_ps(sw, cy)), _mm256_sub_ps(_mm256_mul_ps(sz, cx), _mm256_mul_ps(sx, cz))));
+					pz[j] = _mm256_add_ps(pz[parent], _mm256_add_ps(_mm256_add_ps(tz, _mm256_mul_ps(sw, cz)), _mm256_sub_ps(_mm256_mul_ps(sx, cy), _mm256_mul_ps(sy, cx))));
+				}
+
+				// the rotation as a matrix, r[row][column]
+				const __m256 x = qx[j], y = qy[j], z = qz[j], w = qw[j];
+				__m256 r[3][3];
+				r[0][0] = _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(y, y), _mm256_mul_ps(z, z))));
+				r[0][1] = _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(x, y), _mm256_mul_ps(w, z)));
+				r[0][2] = _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(x, z), _mm256_mul_ps(w, y)));
+				r[1][0] = _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(x, y), _mm256_mul_ps(w, z)));
+				r[1][1] = _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(z, z))));
+				r[1][2] = _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(y, z), _mm256_mul_ps(w, x)));
+				r[2][0] = _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(x, z), _mm256_mul_ps(w, y)));
+				r[2][1] = _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(y, z), _mm256_mul_ps(w, x)));
+				r[2][2] = _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y))));
+				const __m256 t[3] = { px[j], py[j], pz[j] };
+
+				// times the inverse bind pose, an affine matrix the same for every character
+				const glm::mat4& inverseBind = skeleton.getInverseBindPose(j);
+				for (int column = 0; column < 4; column++)
+				{
+					const __m256 b0 = _mm256_set1_ps(inverseBind[column][0]), b1 = _mm256_set1_ps(inverseBind[column][1]), b2 = _mm256_set1_ps(inverseBind[column][2]);
+					for (int row = 0; row < 3; row++)
+					{
+						__m256 value = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r[row][0], b0), _mm256_mul_ps(r[row][1], b1)), _mm256_mul_ps(r[row][2], b2));
+						if (column == 3)
+							value = _mm256_add_ps(value, t[row]);
+						_mm256_storeu_ps(matrices[column * 3 + row], value);
+					}
+				}
+				for (int k = 0; k < 8; k++)
+				{
+					glm::mat4& skin = skinMatrices[(size_t)(c + k) * jointCount + j];
+					for (int column = 0; column < 4; column++)
+						skin[column] = glm::vec4(matrices[column * 3][k], matrices[column * 3 + 1][k], matrices[column * 3 + 2][k], column == 3 ? 1.0f : 0.0f);
+				}
+			}
+		}
+		return c;
+	}
+
+	IMAGERESIZE_AVX2_TARGET static __m256 lerp(__m256 from, __m256 to, __m256 fraction)
+	{
+		return _mm256_add_ps(from, _mm256_mul_ps(_mm256_sub_ps(to, from), fraction));
+	}
+#endif
+};
+
+// characters sampled per ms on every path, single threaded and over the JobSystem, --bench-animation [characters] [frames]
+inline int benchmarkAnimation(int characterCount, int frames)
+{
+	Skeleton skeleton = makeOlafSkeleton();
+	AnimationClip clip = makeOlafWaveClip(skeleton);
+	int jointCount = skeleton.getJointCount();
+
+	std::vector<float> times(characterCount);
+	for (int c = 0; c < characterCount; c++)
+		times[c] = clip.getDuration() * (c * 0.618034f - floorf(c * 0.618034f));
+	std::vector<glm::mat4> reference((size_t)characterCount * jointCount), skinMatrices((size_t)characterCount * jointCount);
+
+	std::cout << "Animation benchmark, " << characterCount << " characters of " << jointCount << " joints, " << frames << " frames, "
+		<< JobSystem::shared().getThreadCount() + 1 << " threads" << std::endl;
+
+	AnimationPath paths[] = { ANIMATION_SCALAR, ANIMATION_AVX2 };
+	for (int p = 0; p < 2; p++)
+	{
+		if (!AnimationBatch::isPathSupported(paths[p]))
+		{
+			std::cout << AnimationBatch::getPathName(paths[p]) << " : not supported" << std::endl;
+			continue;
+		}
+
+		for (int threaded = 0; threaded < 2; threaded++)
+		{
+			JobSystem* jobs = threaded ? &JobSystem::shared() : NULL;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int frame = 0; frame < frames; frame++)
+			{
+				for (int c = 0; c < characterCount; c++)
+					times[c] += 1.0f / 60.0f;
+				AnimationBatch::sample(skeleton, clip, &times[0], characterCount, &skinMatrices[0], paths[p], jobs);
+			}
+			double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			std::cout << std::fixed << std::setprecision(3) << AnimationBatch::getPathName(paths[p]) << (threaded ? ", all threads : " : ", 1 thread : ")
+				<< elapsed / frames << " ms per frame, " << std::setprecision(1) << characterCount * (double)frames / elapsed << " characters per ms" << std::endl;
+		}
+	}
+
+	// both paths at the same times
+	AnimationBatch::sample(skeleton, clip, &times[0], characterCount, &reference[0], ANIMATION_SCALAR, NULL);
+	AnimationBatch::sample(skeleton, clip, &times[0], characterCount, &skinMatrices[0]);
+	float maxDifference = 0.0f;
+	for (size_t i = 0; i < reference.size(); i++)
+		for (int column = 0; column < 4; column++)
+		{
+			glm::vec4 difference = glm::abs(reference[i][column] - skinMatrices[i][column]);
+			maxDifference = std::max(maxDifference, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+		}
+	std::cout << std::setprecision(7) << "Largest difference from the scalar path : " << maxDifference << std::endl;
+	if (maxDifference > 1e-4f)
+	{
+		std::cerr << "Error::AnimationBatch the " << AnimationBatch::getPathName(AnimationBatch::getBestPath()) << " path is off by " << maxDifference << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+#endif
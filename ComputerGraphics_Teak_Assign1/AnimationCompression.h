@@ -0,0 +1,542 @@
+#ifndef ANIMATIONCOMPRESSION_H
+#define ANIMATIONCOMPRESSION_H
+
+// Compressed animation clips for crowds, where the key memory and the cache misses of reading it cost the most.
+// - Rotations are quantized to 48 bits, the smallest three: the largest component is dropped (it follows from the
+//   others, made positive by flipping the quaternion) and the other three, within +-1/sqrt(2), take 15 bits each.
+// - Translations are quantized to 16 bits per component over the range of their track.
+// - Each track (rotation or translation of a joint) keeps only the keys the linear interpolation of its neighbours
+//   cannot replace within the error bounds, the bounds checked against the quantized keys.
+// - The keys of every track are interleaved in one stream sorted by the frame they are first needed at, which is the
+//   frame of the track's previous key. A sampler going forward in time reads the stream strictly forward, keeping the
+//   two keys around the time for every track; going back (the clip looping) starts the stream over.
+// - A sampler keeps every track decoded, which is more than a character's float keys, so the characters share them:
+//   CompressedClipCrowd samples the characters of a clip in time order, each group of them by one sampler.
+// Both the rotation and the translation keys are 6 bytes, with their frame and track 10 bytes per key.
+
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <Animation.h>
+
+struct ClipCompressionSettings
+{
+	float rotationTolerance;      // radians
+	float translationTolerance;   // model units
+
+	ClipCompressionSettings() : rotationTolerance(0.002f), translationTolerance(0.0005f)
+	{
+	}
+};
+
+// a key of the stream
+struct ClipKey
+{
+	uint16_t frame;
+	uint16_t track;      // joint * 2, plus one for the translation
+	uint16_t value[3];   // smallest three rotation, or quantized translation
+};
+
+inline void packQuaternion(glm::quat q, uint16_t* packed)
+{
+	float components[4] = { q.x, q.y, q.z, q.w };
+	int largest = 0;
+	for (int i = 1; i < 4; i++)
+		if (fabsf(components[i]) > fabsf(components[largest]))
+			largest = i;
+	float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	// 2 bits of which one is dropped, then 15 bits for each of the other three
+	uint64_t bits = (uint64_t)largest;
+	for (int i = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		float unit = glm::clamp(components[i] * sign * 0.70710678f + 0.5f, 0.0f, 1.0f);
+		bits = (bits << 15) | (uint64_t)(unit * 32767.0f + 0.5f);
+	}
+	packed[0] = (uint16_t)(bits >> 32);
+	packed[1] = (uint16_t)(bits >> 16);
+	packed[2] = (uint16_t)bits;
+}
+
+inline glm::quat unpackQuaternion(const uint16_t* packed)
+{
+	uint64_t bits = ((uint64_t)packed[0] << 32) | ((uint64_t)packed[1] << 16) | packed[2];
+	int largest = (int)(bits >> 45) & 3;
+	float components[4];
+	float sum = 0.0f;
+	for (int i = 3, shift = 0; i >= 0; i--)
+	{
+		if (i == largest)
+			continue;
+		float unit = (float)((bits >> shift) & 0x7fff) / 32767.0f;
+		components[i] = (unit - 0.5f) * 1.41421356f;
+		sum += components[i] * components[i];
+		shift += 15;
+	}
+	components[largest] = sqrtf(std::max(0.0f, 1.0f - sum));
+	return glm::quat(components[3], components[0], components[1], components[2]);
+}
+
+// angle between two rotations, from the rotation taking one to the other (an acos of their dot loses the small angles)
+inline float getRotationError(const glm::quat& a, const glm::quat& b)
+{
+	glm::quat difference = glm::conjugate(a) * b;
+	return 2.0f * atan2f(glm::length(glm::vec3(difference.x, difference.y, difference.z)), fabsf(difference.w));
+}
+
+inline glm::quat nlerp(const glm::quat& from, const glm::quat& to, float fraction)
+{
+	float sign = glm::dot(from, to) < 0.0f ? -1.0f : 1.0f;
+	return glm::normalize(from * (1.0f - fraction) + to * (fraction * sign));
+}
+
+class CompressedClip
+{
+public:
+	CompressedClip() : sampleRate(30.0f), frameCount(0), jointCount(0)
+	{
+	}
+
+	static CompressedClip compress(const AnimationClip& clip, const ClipCompressionSettings& settings = ClipCompressionSettings())
+	{
+		CompressedClip compressed;
+		compressed.sampleRate = clip.getSampleRate();
+		compressed.frameCount = clip.getFrameCount();
+		compressed.jointCount = clip.getJointCount();
+		compressed.translationMin.resize(clip.getJointCount());
+		compressed.translationStep.resize(clip.getJointCount());
+		if (clip.getFrameCount() < 2 || clip.getFrameCount() > 65535)
+		{
+			std::cerr << "Error::CompressedClip cannot compress a clip of " << clip.getFrameCount() << " frames" << std::endl;
+			return compressed;
+		}
+
+		// every kept key with the frame of the track's previous key, which is when the sampler needs it
+		std::vector<std::pair<int, ClipKey> > needed;
+		std::vector<glm::quat> rotations(clip.getFrameCount()), quantizedRotations(clip.getFrameCount());
+		std::vector<glm::vec3> translations(clip.getFrameCount()), quantizedTranslations(clip.getFrameCount());
+		std::vector<ClipKey> quantized(clip.getFrameCount());
+		for (int j = 0; j < clip.getJointCount(); j++)
+		{
+			// rotations, quantized then fitted
+			for (int frame = 0; frame < clip.getFrameCount(); frame++)
+			{
+				rotations[frame] = clip.getKey(frame, j).rotation;
+				ClipKey& key = quantized[frame];
+				key.frame = (uint16_t)frame;
+				key.track = (uint16_t)(j * 2);
+				packQuaternion(rotations[frame], key.value);
+				quantizedRotations[frame] = unpackQuaternion(key.value);
+			}
+			std::vector<int> kept = fitKeys(clip.getFrameCount(), [&](int from, int to, int frame) {
+				return getRotationError(nlerp(quantizedRotations[from], quantizedRotations[to], (float)(frame - from) / (to - from)), rotations[frame]) <= settings.rotationTolerance;
+			});
+			for (size_t k = 0; k < kept.size(); k++)
+				needed.push_back(std::make_pair(k == 0 ? -1 : kept[k - 1], quantized[kept[k]]));
+
+			// translations over the range of the track
+			glm::vec3 low(1e30f), high(-1e30f);
+			for (int frame = 0; frame < clip.getFrameCount(); frame++)
+			{
+				translations[frame] = clip.getKey(frame, j).translation;
+				low = glm::min(low, translations[frame]);
+				high = glm::max(high, translations[frame]);
+			}
+			compressed.translationMin[j] = low;
+			compressed.translationStep[j] = (high - low) / 65535.0f;
+			for (int frame = 0; frame < clip.getFrameCount(); frame++)
+			{
+				ClipKey& key = quantized[frame];
+				key.frame = (uint16_t)frame;
+				key.track = (uint16_t)(j * 2 + 1);
+				for (int c = 0; c < 3; c++)
+				{
+					float step = compressed.translationStep[j][c];
+					key.value[c] = step > 0.0f ? (uint16_t)((translations[frame][c] - low[c]) / step + 0.5f) : 0;
+				}
+				quantizedTranslations[frame] = compressed.decodeTranslation(key);
+			}
+			kept = fitKeys(clip.getFrameCount(), [&](int from, int to, int frame) {
+				glm::vec3 interpolated = glm::mix(quantizedTranslations[from], quantizedTranslations[to], (float)(frame - from) / (to - from));
+				return glm::length(interpolated - translations[frame]) <= settings.translationTolerance;
+			});
+			for (size_t k = 0; k < kept.size(); k++)
+				needed.push_back(std::make_pair(k == 0 ? -1 : kept[k - 1], quantized[kept[k]]));
+		}
+
+		// by the frame they are needed at, the tracks in order within a frame
+		std::stable_sort(needed.begin(), needed.end(), [](const std::pair<int, ClipKey>& a, const std::pair<int, ClipKey>& b) {
+			return a.first < b.first;
+		});
+		compressed.keys.reserve(needed.size());
+		for (size_t i = 0; i < needed.size(); i++)
+			compressed.keys.push_back(needed[i].second);
+		return compressed;
+	}
+
+	glm::vec3 decodeTranslation(const ClipKey& key) const
+	{
+		int joint = key.track / 2;
+		return translationMin[joint] + glm::vec3(key.value[0], key.value[1], key.value[2]) * translationStep[joint];
+	}
+
+	float getSampleRate() const { return sampleRate; }
+	int getFrameCount() const { return frameCount; }
+	int getJointCount() const { return jointCount; }
+	int getTrackCount() const { return jointCount * 2; }
+	float getDuration() const { return frameCount > 1 ? (frameCount - 1) / sampleRate : 0.0f; }
+	int getKeyCount() const { return (int)keys.size(); }
+	const ClipKey* getKeys() const { return keys.empty() ? NULL : &keys[0]; }
+	size_t getMemorySize() const { return keys.size() * sizeof(ClipKey) + jointCount * 2 * sizeof(glm::vec3); }
+
+private:
+	// the frames kept: from each kept key, the furthest next key every frame in between can be interpolated to
+	template <class Fits>
+	static std::vector<int> fitKeys(int frameCount, Fits fits)
+	{
+		std::vector<int> kept(1, 0);
+		int from = 0;
+		while (from < frameCount - 1)
+		{
+			int to = from + 1;
+			for (int candidate = from + 2; candidate < frameCount; candidate++)
+			{
+				bool fitting = true;
+				for (int frame = from + 1; frame < candidate && fitting; frame++)
+					fitting = fits(from, candidate, frame);
+				if (!fitting)
+					break;
+				to = candidate;
+			}
+			kept.push_back(to);
+			from = to;
+		}
+		return kept;
+	}
+
+	float sampleRate;
+	int frameCount;
+	int jointCount;
+	std::vector<ClipKey> keys;
+	std::vector<glm::vec3> translationMin;
+	std::vector<glm::vec3> translationStep;
+};
+
+// reads a CompressedClip forward, shared by the characters sampled in time order (see CompressedClipCrowd)
+class CompressedClipSampler
+{
+public:
+	CompressedClipSampler() : clip(NULL), cursor(0), lastPosition(0.0f), restarts(0)
+	{
+	}
+
+	explicit CompressedClipSampler(const CompressedClip& compressedClip) : clip(NULL), cursor(0), lastPosition(0.0f), restarts(0)
+	{
+		setClip(compressedClip);
+	}
+
+	void setClip(const CompressedClip& compressedClip)
+	{
+		clip = &compressedClip;
+		tracks.resize(clip->getTrackCount());
+		reset();
+	}
+
+	// back to the start of the stream
+	void reset()
+	{
+		cursor = 0;
+		lastPosition = 0.0f;
+		for (size_t i = 0; i < tracks.size(); i++)
+		{
+			tracks[i].fromFrame = tracks[i].toFrame = -1.0f;
+			tracks[i].inverseSpan = 0.0f;
+			tracks[i].from = tracks[i].to = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+	}
+
+	// joint space poses of every joint at a time, looping over the clip
+	void sample(float time, JointPose* poses)
+	{
+		if (!seek(time))
+			return;
+
+		for (int j = 0; j < clip->getJointCount(); j++)
+		{
+			const TrackState& rotation = tracks[j * 2];
+			const TrackState& translation = tracks[j * 2 + 1];
+			glm::quat from(rotation.from.w, rotation.from.x, rotation.from.y, rotation.from.z);
+			glm::quat to(rotation.to.w, rotation.to.x, rotation.to.y, rotation.to.z);
+			poses[j].rotation = nlerp(from, to, getFraction(rotation, lastPosition));
+			poses[j].translation = glm::mix(glm::vec3(translation.from), glm::vec3(translation.to), getFraction(translation, lastPosition));
+		}
+	}
+
+	// reads the stream up to a time without sampling, false for an empty clip
+	bool seek(float time)
+	{
+		float duration = clip->getDuration();
+		if (duration <= 0.0f || clip->getKeyCount() == 0)
+			return false;
+		time -= floorf(time / duration) * duration;
+		float position = std::min(time * clip->getSampleRate(), (float)(clip->getFrameCount() - 1));
+		if (position < lastPosition)
+		{
+			reset();
+			restarts++;
+		}
+		lastPosition = position;
+
+		// every key needed by now: the next key of a track is needed once the time passes the track's current key
+		const ClipKey* keys = clip->getKeys();
+		int keyCount = clip->getKeyCount();
+		while (cursor < keyCount && tracks[keys[cursor].track].toFrame <= position)
+		{
+			const ClipKey& key = keys[cursor++];
+			TrackState& track = tracks[key.track];
+			track.fromFrame = track.toFrame;
+			track.from = track.to;
+			track.toFrame = key.frame;
+			track.inverseSpan = track.toFrame > track.fromFrame ? 1.0f / (track.toFrame - track.fromFrame) : 0.0f;
+			if (key.track & 1)
+				track.to = glm::vec4(clip->decodeTranslation(key), 0.0f);
+			else
+			{
+				glm::quat rotation = unpackQuaternion(key.value);
+				track.to = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+			}
+		}
+		return true;
+	}
+
+	long long getRestartCount() const { return restarts; }
+
+private:
+	// the two keys around the time, decoded
+	struct TrackState
+	{
+		float fromFrame;
+		float toFrame;
+		float inverseSpan;   // 0 until the track has two keys
+		glm::vec4 from;   // a rotation as xyzw, or a translation
+		glm::vec4 to;
+	};
+
+	static float getFraction(const TrackState& track, float position)
+	{
+		return track.inverseSpan > 0.0f ? std::min(1.0f, (position - track.fromFrame) * track.inverseSpan) : 1.0f;
+	}
+
+	const CompressedClip* clip;
+	std::vector<TrackState> tracks;
+	int cursor;
+	float lastPosition;
+	long long restarts;
+};
+
+// Characters playing one compressed clip, each at its own offset from a shared time. The characters are sorted by
+// their offset within the clip and split in groups; every frame a group samples its characters in time order with a
+// copy of the group's sampler, so the group reads the stream once and a sampler (880 bytes for Olaf) is kept a group.
+// The group's own sampler follows the group's earliest time, which only goes back to the start of the clip.
+class CompressedClipCrowd
+{
+public:
+	static const int GROUP_SIZE = 64;
+
+	CompressedClipCrowd() : clip(NULL)
+	{
+	}
+
+	void setClip(const CompressedClip& compressedClip, const float* offsets, int characterCount)
+	{
+		clip = &compressedClip;
+		float duration = clip->getDuration();
+		characters.resize(characterCount);
+		for (int c = 0; c < characterCount; c++)
+		{
+			float phase = duration > 0.0f ? offsets[c] - floorf(offsets[c] / duration) * duration : 0.0f;
+			characters[c].phase = phase < duration ? phase : 0.0f;
+			characters[c].index = c;
+		}
+		std::stable_sort(characters.begin(), characters.end(), [](const Character& a, const Character& b) { return a.phase < b.phase; });
+
+		groups.resize((characterCount + GROUP_SIZE - 1) / GROUP_SIZE);
+		for (size_t g = 0; g < groups.size(); g++)
+		{
+			groups[g].sampler.setClip(compressedClip);
+			groups[g].walker.setClip(compressedClip);
+		}
+	}
+
+	int getGroupCount() const { return (int)groups.size(); }
+
+	// calls visit(character, poses) for every character of a group at the time plus the character's offset, groups
+	// can be sampled in parallel
+	template <class Visit>
+	void sampleGroup(int group, float time, Visit visit)
+	{
+		float duration = clip->getDuration();
+		if (duration <= 0.0f)
+			return;
+		float shift = time - floorf(time / duration) * duration;
+		int begin = group * GROUP_SIZE;
+		int count = std::min((int)characters.size() - begin, (int)GROUP_SIZE);
+		const Character* members = &characters[begin];
+
+		// the characters past the end of the clip wrapped to its start and come first
+		int first = 0;
+		while (first < count && members[first].phase + shift < duration)
+			first++;
+		if (first == count)
+			first = 0;
+
+		Group& state = groups[group];
+		state.sampler.seek(getTime(members[first], shift, duration));
+		state.walker = state.sampler;
+		JointPose poses[MAX_JOINTS];
+		for (int i = 0; i < count; i++)
+		{
+			const Character& character = members[(first + i) % count];
+			state.walker.sample(getTime(character, shift, duration), poses);
+			visit(character.index, (const JointPose*)poses);
+		}
+	}
+
+private:
+	struct Character
+	{
+		float phase;   // offset within the clip
+		int index;
+	};
+
+	struct Group
+	{
+		CompressedClipSampler sampler;   // at the group's earliest time
+		CompressedClipSampler walker;    // through the group's characters
+	};
+
+	static float getTime(const Character& character, float shift, float duration)
+	{
+		float time = character.phase + shift;
+		return time < duration ? time : time - duration;
+	}
+
+	const CompressedClip* clip;
+	std::vector<Character> characters;
+	std::vector<Group> groups;
+};
+
+// size, error and sampling speed of compressed clips against the float keys, --bench-clip-compression [characters] [frames] [clips].
+// The characters are spread over clips different in memory (the wave started at another frame), as a crowd playing
+// many clips would be, which is where the smaller keys pay
+inline int benchmarkClipCompression(int characterCount, int frames, int clipCount)
+{
+	Skeleton skeleton = makeOlafSkeleton();
+	AnimationClip clip = makeOlafWaveClip(skeleton);
+	int jointCount = skeleton.getJointCount();
+	std::cout << "Clip compression benchmark, " << jointCount << " joints, " << clip.getFrameCount() << " frames, float keys "
+		<< clip.getMemorySize() << " bytes a clip, " << characterCount << " characters over " << clipCount << " clips" << std::endl;
+
+	std::vector<AnimationClip> clips(clipCount);
+	for (int i = 0; i < clipCount; i++)
+	{
+		int offset = i % (clip.getFrameCount() - 1);
+		clips[i] = AnimationClip(clip.getSampleRate(), clip.getFrameCount(), jointCount);
+		for (int frame = 0; frame < clip.getFrameCount(); frame++)
+			for (int j = 0; j < jointCount; j++)
+			{
+				JointPose key = clip.getKey((frame + offset) % (clip.getFrameCount() - 1), j);
+				clips[i].setKey(frame, j, key.rotation, key.translation);
+			}
+	}
+
+	std::vector<float> times(characterCount);
+	for (int c = 0; c < characterCount; c++)
+		times[c] = clip.getDuration() * (c * 0.618034f - floorf(c * 0.618034f));
+	std::vector<JointPose> expected(jointCount), poses(jointCount);
+
+	// the float keys
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++)
+		for (int c = 0; c < characterCount; c++)
+			sampleClip(clips[c % clipCount], times[c] + frame / 60.0f, &expected[0]);
+	double floatTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	double samples = (double)characterCount * frames;
+	std::cout << std::fixed << std::setprecision(0) << "Float keys : " << clip.getMemorySize() * clipCount << " bytes, "
+		<< samples / floatTime << " characters sampled per ms" << std::endl;
+
+	// the tolerances: quantization only, the default, and coarse
+	ClipCompressionSettings settings[3];
+	settings[0].rotationTolerance = 0.0f;
+	settings[0].translationTolerance = 0.0f;
+	settings[2].rotationTolerance = 0.01f;
+	settings[2].translationTolerance = 0.005f;
+
+	int result = 0;
+	for (int s = 0; s < 3; s++)
+	{
+		std::vector<CompressedClip> compressed(clipCount);
+		size_t compressedSize = 0;
+		for (int i = 0; i < clipCount; i++)
+		{
+			compressed[i] = CompressedClip::compress(clips[i], settings[s]);
+			compressedSize += compressed[i].getMemorySize();
+		}
+
+		// the largest error over every frame and half frame of the first clip, sampled forward
+		CompressedClipSampler sampler(compressed[0]);
+		float rotationError = 0.0f, translationError = 0.0f;
+		for (int step = 0; step < (clip.getFrameCount() - 1) * 2; step++)
+		{
+			float time = step * 0.5f / clip.getSampleRate();
+			sampleClip(clips[0], time, &expected[0]);
+			sampler.sample(time, &poses[0]);
+			for (int j = 0; j < jointCount; j++)
+			{
+				rotationError = std::max(rotationError, getRotationError(expected[j].rotation, poses[j].rotation));
+				translationError = std::max(translationError, glm::length(expected[j].translation - poses[j].translation));
+			}
+		}
+
+		// the characters of a clip sampled in time order
+		std::vector<CompressedClipCrowd> crowds(clipCount);
+		for (int i = 0; i < clipCount; i++)
+		{
+			std::vector<float> offsets;
+			for (int c = i; c < characterCount; c += clipCount)
+				offsets.push_back(times[c]);
+			crowds[i].setClip(compressed[i], offsets.empty() ? NULL : &offsets[0], (int)offsets.size());
+		}
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+			for (int i = 0; i < clipCount; i++)
+				for (int g = 0; g < crowds[i].getGroupCount(); g++)
+					crowds[i].sampleGroup(g, frame / 60.0f, [&poses](int, const JointPose* sampled) { poses[0] = sampled[0]; });
+		double compressedTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << std::setprecision(4) << "Tolerance " << settings[s].rotationTolerance << " rad, " << settings[s].translationTolerance << " : "
+			<< compressed[0].getKeyCount() << " of " << clip.getFrameCount() * jointCount * 2 << " keys, " << compressedSize << " bytes, ratio "
+			<< std::setprecision(2) << (double)clip.getMemorySize() * clipCount / compressedSize << ", largest error " << std::setprecision(5)
+			<< rotationError << " rad, " << translationError << ", " << std::setprecision(0) << samples / compressedTime << " characters sampled per ms" << std::endl;
+
+		// the fit bounds the error at the frames, the quantization of the kept keys adds a little
+		if (rotationError > settings[s].rotationTolerance + 0.001f || translationError > settings[s].translationTolerance + 0.0001f)
+		{
+			std::cerr << "Error::CompressedClip the error is over the tolerance" << std::endl;
+			result = -1;
+		}
+	}
+	return result;
+}
+
+#endif
@@ -34,9 +34,40 @@
 
 #include <string.h>
 
+// stb_image turns its SSE2 IDCT and YCbCr paths on by itself on x86, the NEON ones have to be asked for
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define STBI_NEON
+#endif
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #include <shaderloader.h>
+#include <ShaderPermutations.h>
+#include <TextureArray.h>
+#include <TextureData.h>
+#include <TextureCompression.h>
+#include <TextureStreamer.h>
+#include <TextureCache.h>
+#include <ImageResize.h>
+#include <HeadlessRenderer.h>
+#include <InputScript.h>
+#include <InputActions.h>
+#include <GLStateCache.h>
+#include <FrameBenchmark.h>
+#include <GeometryPool.h>
+#include <RenderQueue.h>
+#include <FrameRingBuffer.h>
+#include <MultiDrawIndirect.h>
+#include <GpuProfiler.h>
+#include <FramePacer.h>
+#include <Simulation.h>
+#include <SnowSystem.h>
+#include <ParticleSystem.h>
+#include <Animation.h>
+#include <AnimationCompression.h>
+#include <SkinnedMesh.h>
+#include <map>
+#include <chrono>
+#include <random>
 
 
 
@@ -46,25 +77,62 @@ using namespace std;
 
 
 
-// shader variable setters
+// shader variable setters, the program stays bound (the state cache skips binding it again)
 void SetUniformMat4(GLuint shader_id, const char* uniform_name, mat4 uniform_value)
 {
-	glUseProgram(shader_id);
+	useProgram(shader_id);
 	glUniformMatrix4fv(glGetUniformLocation(shader_id, uniform_name), 1, GL_FALSE, &uniform_value[0][0]);
 }
 
 void SetUniformVec3(GLuint shader_id, const char* uniform_name, vec3 uniform_value)
 {
-	glUseProgram(shader_id);
+	useProgram(shader_id);
 	glUniform3fv(glGetUniformLocation(shader_id, uniform_name), 1, value_ptr(uniform_value));
 }
 
 template <class T>
 void SetUniform1Value(GLuint shader_id, const char* uniform_name, T uniform_value)
 {
-	glUseProgram(shader_id);
+	useProgram(shader_id);
 	glUniform1i(glGetUniformLocation(shader_id, uniform_name), uniform_value);
-	glUseProgram(0);
+}
+
+// Per frame constants shared by every scene shader variant
+struct SceneUniforms
+{
+	mat4 projectionMatrix;
+	mat4 viewMatrix;
+	mat4 lightViewProjMatrix;
+	vec3 lightPosition;
+	vec3 lightDirection;
+	vec3 lightColor;
+};
+
+// Writes the frame constants into the frame's ring buffer, every variant reads them from the SceneBlock range
+RingAllocation writeSceneBlock(FrameRingBuffer& frameData, const SceneUniforms& scene)
+{
+	RingAllocation allocation = frameData.allocate(sizeof(SceneBlock));
+	if (allocation.data == NULL)
+		return allocation;
+
+	SceneBlock block;
+	block.viewMatrix = scene.viewMatrix;
+	block.projectionMatrix = scene.projectionMatrix;
+	block.lightViewProjMatrix = scene.lightViewProjMatrix;
+	block.lightColor = vec4(scene.lightColor, 0.0f);
+	block.lightPosition = vec4(scene.lightPosition, 0.0f);
+	block.lightDirection = vec4(scene.lightDirection, 0.0f);
+	block.viewPosition = vec4(0.0f);
+	memcpy(allocation.data, &block, sizeof(block));
+	return allocation;
+}
+
+// Binds the variant matching a material
+const ShaderVariant& useSceneVariant(ShaderPermutations& permutations, unsigned int features)
+{
+	const ShaderVariant& variant = permutations.get(features);
+	useProgram(variant.program);
+	return variant;
 }
 
 
@@ -301,7 +369,8 @@ bool loadOBJ2(
 }
 
 
-GLuint setupModelEBO(string path, int& vertexCount)
+// Loads an OBJ model into the geometry pool, every model shares the pool's vertex array
+bool setupModelMesh(GeometryPool& geometry, string path, PoolMesh& mesh)
 {
 	vector<int> vertexIndices;
 	//The contiguous sets of three indices of vertices, normals and UVs, used to make a triangle
@@ -309,58 +378,23 @@ GLuint setupModelEBO(string path, int& vertexCount)
 	vector<glm::vec3> normals;
 	vector<glm::vec2> UVs;
 
-	//read the vertices from the cube.obj file
-	//We won't be needing the normals or UVs for this program
-	loadOBJ2(path.c_str(), vertexIndices, vertices, normals, UVs);
-
-	GLuint VAO;
-	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO); //Becomes active VAO
-							// Bind the Vertex Array Object first, then bind and set vertex buffer(s) and attribute pointer(s).
-
-							//Vertex VBO setup
-	GLuint vertices_VBO;
-	glGenBuffers(1, &vertices_VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, vertices_VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices.front(), GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(0);
-
-	//Normals VBO setup
-	GLuint normals_VBO;
-	glGenBuffers(1, &normals_VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, normals_VBO);
-	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals.front(), GL_STATIC_DRAW);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(1);
-
-	//UVs VBO setup
-	GLuint uvs_VBO;
-	glGenBuffers(1, &uvs_VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, uvs_VBO);
-	glBufferData(GL_ARRAY_BUFFER, UVs.size() * sizeof(glm::vec2), &UVs.front(), GL_STATIC_DRAW);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(2);
-
-	//EBO setup
-	GLuint EBO;
-	glGenBuffers(1, &EBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, vertexIndices.size() * sizeof(int), &vertexIndices.front(), GL_STATIC_DRAW);
-
-	unsigned int lightVAO;
-	glGenVertexArrays(1, &lightVAO);
-	glBindVertexArray(lightVAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vertices_VBO);
-	// note that we update the lamp's position attribute's stride to reflect the updated buffer data
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+	//read the vertices from the .obj file
+	if (!loadOBJ2(path.c_str(), vertexIndices, vertices, normals, UVs))
+	{
+		std::cerr << "Error::Model could not load model file:" << path << std::endl;
+		return false;
+	}
 
-	glBindVertexArray(0);
-	// Unbind VAO (it's always a good thing to unbind any buffer/array to prevent strange bugs), remember: do NOT unbind the EBO, keep it bound to this VAO
-	vertexCount = vertexIndices.size();
-	return VAO;
+	// interleave the attributes, the loader leaves the normals and UVs of some models short
+	vector<PoolVertex> poolVertices(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		poolVertices[i].position = vertices[i];
+		poolVertices[i].normal = i < normals.size() ? normals[i] : glm::vec3(0.0f);
+		poolVertices[i].uv = i < UVs.size() ? UVs[i] : glm::vec2(0.0f);
+	}
+	vector<GLuint> indices(vertexIndices.begin(), vertexIndices.end());
+	return geometry.add(poolVertices, indices, mesh);
 }
 
 int lightVAO()
@@ -699,17 +733,672 @@ int createVertexBufferObjectAxis() // for the grid
 }
 
 
-GLuint loadTexture(const char *filename);
+// Executes the queued scene draws, the DrawBlock of each one is written into the frame's ring buffer first
+struct SceneDrawExecutor
+{
+	ShaderPermutations& permutations;
+	FrameRingBuffer& frameData;
+	unsigned int boundFeatures;
+	RingAllocation drawBlocks;
+	size_t stride;      // DrawBlock size rounded up to the binding alignment
+	size_t drawIndex;
+
+	SceneDrawExecutor(ShaderPermutations& permutations, FrameRingBuffer& frameData)
+		: permutations(permutations), frameData(frameData), boundFeatures(~0u), stride(0), drawIndex(0)
+	{
+		drawBlocks.data = NULL;
+	}
+
+	// writes the blocks in the order the queue executes, before the frame data is flushed
+	void prepare(const RenderQueue& queue)
+	{
+		boundFeatures = ~0u;
+		drawIndex = 0;
+		stride = (sizeof(DrawBlock) + frameData.getAlignment() - 1) / frameData.getAlignment() * frameData.getAlignment();
+		drawBlocks = frameData.allocate(queue.getSize() * stride);
+		if (drawBlocks.data == NULL)
+			return;
+
+		const vector<RenderQueueItem>& items = queue.getItems();
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			const DrawCommand& command = queue.getCommand(items[i]);
+			DrawBlock block = { command.worldMatrix, vec4(command.color, command.textureLayer) };
+			memcpy((char*)drawBlocks.data + i * stride, &block, sizeof(block));
+		}
+	}
+
+	void operator()(const DrawCommand& command)
+	{
+		if (drawBlocks.data == NULL)
+			return;
+
+		if (command.features != boundFeatures)
+		{
+			useSceneVariant(permutations, command.features);
+			boundFeatures = command.features;
+		}
+		bindVertexArray(command.vertexArray);
+		RingAllocation block = { NULL, (GLintptr)(drawBlocks.offset + drawIndex * stride), sizeof(DrawBlock) };
+		frameData.bindRange(GL_UNIFORM_BUFFER, DRAW_BLOCK_BINDING, block);
+		drawIndex++;
+		drawElementsBaseVertex(command.mode, command.indexCount, command.firstIndex, command.baseVertex);
+	}
+};
+
+// Binds the state of a multi draw group: the SHADER_INDIRECT variant of its features, its vertex array and its first draw
+struct SceneDrawGroupBinder
+{
+	ShaderPermutations& permutations;
+
+	explicit SceneDrawGroupBinder(ShaderPermutations& permutations) : permutations(permutations)
+	{
+	}
+
+	void operator()(const IndirectDrawGroup& group)
+	{
+		const ShaderVariant& variant = useSceneVariant(permutations, group.command->features | SHADER_INDIRECT);
+		bindVertexArray(group.command->vertexArray);
+		glUniform1i(variant.drawBaseLocation, group.firstDraw);
+	}
+};
+
+// CPU particles of the scene: Olaf's footprints, sparkles where he respawns and, with --cpu-snow, the snowfall
+struct SceneParticles
+{
+	ParticleSystem footprints;
+	ParticleSystem sparkles;
+	ParticleSystem snow;
+	SnowSettings snowSettings;
+	bool snowEnabled;
+	float snowLifetime;   // seconds from the spawn height to melting on the ground
+	float snowOwed;       // flakes to spawn, carried over between frames
+	glm::vec3 lastStep;
+	glm::vec3 lastPosition;
+	bool leftFoot;
+	bool started;
+
+	SceneParticles(const SnowSettings& settings, bool cpuSnow)
+		: footprints(getFootprintSettings()), sparkles(getSparkleSettings()), snow(getSnowSettings(settings, cpuSnow)),
+		snowSettings(settings), snowEnabled(cpuSnow && settings.flakeCount > 0), snowOwed(0.0f), lastStep(0.0f), lastPosition(0.0f),
+		leftFoot(true), started(false)
+	{
+		// the flakes fall at gravity / drag, and lie on the ground for two more seconds
+		snowLifetime = (settings.spawnHeight - settings.groundHeight) * settings.drag / -settings.gravity + 2.0f;
+		if (snowEnabled)
+		{
+			// already snowing: the first flakes are spread over the whole height and the whole lifetime
+			ParticleSpawn spawn = getSnowSpawn();
+			spawn.position.y = (settings.spawnHeight + settings.groundHeight) * 0.5f;
+			spawn.positionSpread.y = (settings.spawnHeight - settings.groundHeight) * 0.5f;
+			spawn.lifetime = snowLifetime * 0.5f;
+			spawn.lifetimeSpread = snowLifetime * 0.5f;
+			snow.emit(settings.flakeCount, spawn);
+		}
+	}
+
+	static ParticleSettings getFootprintSettings()
+	{
+		ParticleSettings settings;
+		settings.capacity = 4096;
+		settings.gravity = glm::vec3(0.0f);
+		settings.color = glm::vec3(0.45f, 0.5f, 0.6f);
+		settings.seed = 1;
+		return settings;
+	}
+
+	static ParticleSettings getSparkleSettings()
+	{
+		ParticleSettings settings;
+		settings.capacity = 16384;
+		settings.gravity = glm::vec3(0.0f, -3.0f, 0.0f);
+		settings.drag = 1.5f;
+		settings.color = glm::vec3(1.0f, 0.85f, 0.3f);
+		settings.seed = 2;
+		return settings;
+	}
+
+	// the wind is where the drag pulls the flakes to, so it goes into the constant acceleration
+	static ParticleSettings getSnowSettings(const SnowSettings& snow, bool enabled)
+	{
+		ParticleSettings settings;
+		settings.capacity = enabled ? snow.flakeCount + snow.flakeCount / 4 : 0;
+		settings.gravity = glm::vec3(snow.wind.x * snow.drag, snow.gravity, snow.wind.z * snow.drag);
+		settings.drag = snow.drag;
+		settings.groundHeight = snow.groundHeight;
+		settings.color = glm::vec3(0.95f, 0.97f, 1.0f);
+		settings.seed = 3;
+		return settings;
+	}
+
+	ParticleSpawn getSnowSpawn() const
+	{
+		ParticleSpawn spawn;
+		spawn.position = glm::vec3(0.0f, snowSettings.spawnHeight, 0.0f);
+		spawn.positionSpread = glm::vec3(snowSettings.extent, 0.0f, snowSettings.extent);
+		spawn.velocity = glm::vec3(snowSettings.wind.x, snowSettings.gravity / snowSettings.drag, snowSettings.wind.z);
+		spawn.lifetime = snowLifetime;
+		spawn.size = snowSettings.flakeSize;
+		spawn.sizeSpread = snowSettings.flakeSize * 0.4f;
+		return spawn;
+	}
+
+	void update(const OlafState& olaf, float dt)
+	{
+		if (!started)
+		{
+			lastStep = lastPosition = olaf.position;
+			started = true;
+		}
+
+		// a respawn is a jump no walking covers in a frame
+		if (glm::length(olaf.position - lastPosition) > 1.0f)
+		{
+			ParticleSpawn spawn;
+			spawn.position = olaf.position + glm::vec3(0.0f, 0.5f, 0.0f);
+			spawn.positionSpread = glm::vec3(0.3f, 0.4f, 0.3f);
+			spawn.velocity = glm::vec3(0.0f, 1.5f, 0.0f);
+			spawn.velocitySpread = glm::vec3(1.5f, 1.5f, 1.5f);
+			spawn.lifetime = 1.2f;
+			spawn.lifetimeSpread = 0.4f;
+			spawn.size = 0.03f;
+			spawn.sizeSpread = 0.015f;
+			sparkles.emit(400, spawn);
+			lastStep = olaf.position;
+		}
+
+		// a print every step, one foot then the other
+		glm::vec3 walked = olaf.position - lastStep;
+		walked.y = 0.0f;
+		if (glm::length(walked) > 0.35f)
+		{
+			float yaw = glm::radians(olaf.yaw);
+			glm::vec3 side(cos(yaw), 0.0f, -sin(yaw));
+			ParticleSpawn spawn;
+			spawn.position = glm::vec3(olaf.position.x, 0.0f, olaf.position.z) + side * (leftFoot ? -0.15f : 0.15f);
+			spawn.lifetime = 6.0f;
+			spawn.size = 0.12f;
+			footprints.emit(1, spawn);
+			leftFoot = !leftFoot;
+			lastStep = olaf.position;
+		}
+		lastPosition = olaf.position;
+
+		if (snowEnabled)
+		{
+			snowOwed += std::min(dt, 0.1f) * snowSettings.flakeCount / snowLifetime;
+			int flakes = (int)snowOwed;
+			snowOwed -= flakes;
+			snow.emit(flakes, getSnowSpawn());
+		}
+
+		footprints.update(dt);
+		sparkles.update(dt);
+		if (snowEnabled)
+			snow.update(std::min(dt, 0.1f));
+	}
+
+	void draw(ParticleRenderer& renderer)
+	{
+		renderer.draw(footprints);
+		renderer.draw(snow);
+		renderer.draw(sparkles);
+	}
+
+	void printStats()
+	{
+		footprints.printStats("footprints");
+		sparkles.printStats("sparkles");
+		if (snowEnabled)
+			snow.printStats("snow");
+	}
+};
+
+// Olaf skinned and animated instead of drawn from rigid parts (--skinned-olaf), and a crowd of skinned Olafs
+// waving behind him (--crowd <n>). Every character is sampled by one AnimationBatch call a frame, from the float keys:
+// the compressed clips of AnimationCompression.h are smaller but not yet faster to sample, see --bench-clip-compression
+struct SceneCharacters
+{
+	// a JointBlock takes over 2 KB of the frame's ring buffer
+	static const int MAX_CROWD = 1024;
+
+	Skeleton skeleton;
+	AnimationClip clip;
+	SkinnedMesh mesh;
+	bool olafEnabled;
+	int crowdCount;
+	float time;
+	std::vector<float> times;
+	std::vector<glm::mat4> characterMatrices;
+	std::vector<glm::mat4> skinMatrices;
+
+	SceneCharacters(bool skinnedOlaf, int crowd)
+		: skeleton(makeOlafSkeleton()), olafEnabled(skinnedOlaf), crowdCount(std::min(std::max(crowd, 0), (int)MAX_CROWD)), time(0.0f)
+	{
+		clip = makeOlafWaveClip(skeleton);
+		if (crowd > MAX_CROWD)
+			std::cerr << "Error::SceneCharacters the crowd is limited to " << MAX_CROWD << " Olafs" << std::endl;
+
+		int count = getCharacterCount();
+		times.resize(count);
+		characterMatrices.resize(count);
+		skinMatrices.resize((size_t)count * skeleton.getJointCount());
+
+		// rows of Olafs behind the origin, the Olaf of the scene comes first
+		int columns = std::max(1, (int)ceil(sqrt((double)crowdCount)));
+		int first = olafEnabled ? 1 : 0;
+		for (int i = 0; i < crowdCount; i++)
+		{
+			float x = (i % columns - (columns - 1) * 0.5f) * 1.5f;
+			float z = -3.0f - (i / columns) * 1.5f;
+			characterMatrices[first + i] = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
+		}
+	}
+
+	int getCharacterCount() const { return (olafEnabled ? 1 : 0) + crowdCount; }
+	bool isEnabled() const { return getCharacterCount() > 0; }
+
+	// bakes the parts of the rigid Olaf onto the skeleton, needs the context to be current
+	bool create(const string& cubePath, const string& spherePath)
+	{
+		if (!isEnabled())
+			return true;
+
+		vector<int> cubeIndices, sphereIndices;
+		vector<glm::vec3> cubePositions, cubeNormals, spherePositions, sphereNormals;
+		vector<glm::vec2> cubeUVs, sphereUVs;
+		if (!loadOBJ2(cubePath.c_str(), cubeIndices, cubePositions, cubeNormals, cubeUVs)
+			|| !loadOBJ2(spherePath.c_str(), sphereIndices, spherePositions, sphereNormals, sphereUVs))
+		{
+			std::cerr << "Error::SceneCharacters could not load the Olaf models" << std::endl;
+			return false;
+		}
+		vector<GLuint> cube(cubeIndices.begin(), cubeIndices.end()), sphere(sphereIndices.begin(), sphereIndices.end());
+
+		const glm::vec3 white(1.0f), carrot(1.0f, 0.64f, 0.0f), coal(0.1f, 0.1f, 0.1f);
+		auto part = [](const glm::vec3& position, const glm::vec3& size) {
+			return glm::translate(glm::mat4(1.0f), position) * glm::scale(glm::mat4(1.0f), size);
+		};
+		int hips = skeleton.findJoint("hips"), chest = skeleton.findJoint("chest"), head = skeleton.findJoint("head");
+
+		mesh.addPart(cubePositions, cubeNormals, cubeUVs, cube, part(glm::vec3(-0.15f, 0.1f, 0.0f), glm::vec3(0.2f, -0.2f, 0.175f)), white, skeleton.findJoint("leftFoot"));
+		mesh.addPart(cubePositions, cubeNormals, cubeUVs, cube, part(glm::vec3(0.15f, 0.1f, 0.0f), glm::vec3(0.2f, -0.2f, 0.175f)), white, skeleton.findJoint("rightFoot"));
+		// the top of the body bends with the chest
+		mesh.addPart(spherePositions, sphereNormals, sphereUVs, sphere, part(glm::vec3(0.0f, 0.6f, 0.0f), glm::vec3(0.02f)), white, hips,
+			chest, glm::vec3(0.0f, 0.7f, 0.0f), glm::vec3(0.0f, 0.9f, 0.0f));
+		mesh.addPart(spherePositions, sphereNormals, sphereUVs, sphere, part(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.01f)), white, chest);
+		mesh.addPart(spherePositions, sphereNormals, sphereUVs, sphere, part(glm::vec3(0.0f, 1.4f, 0.0f), glm::vec3(0.005f)), white, head);
+		mesh.addPart(cubePositions, cubeNormals, cubeUVs, cube, part(glm::vec3(0.0f, 1.4f, 0.1f), glm::vec3(0.05f, 0.05f, 0.5f)), carrot, head);
+		mesh.addPart(cubePositions, cubeNormals, cubeUVs, cube, part(glm::vec3(0.0f, 1.6f, 0.0f), glm::vec3(0.1f, -0.25f, 0.1f)), coal, head);
+		// the arms bend at the elbow
+		mesh.addPart(cubePositions, cubeNormals, cubeUVs, cube, part(glm::vec3(-0.4f, 1.2f, 0.0f), glm::vec3(1.0f, -0.075f, 0.1f)), white,
+			skeleton.findJoint("leftShoulder"), skeleton.findJoint("leftElbow"), glm::vec3(-0.35f, 1.2f, 0.0f), glm::vec3(-0.65f, 1.2f, 0.0f));
+		mesh.addPart(cubePositions, cubeNormals, cubeUVs, cube, part(glm::vec3(0.4f, 1.2f, 0.0f), glm::vec3(1.0f, -0.075f, 0.1f)), white,
+			skeleton.findJoint("rightShoulder"), skeleton.findJoint("rightElbow"), glm::vec3(0.35f, 1.2f, 0.0f), glm::vec3(0.65f, 1.2f, 0.0f));
+		return mesh.create();
+	}
+
+	// every Olaf of the crowd is at its own point of the clip
+	void update(const glm::mat4& bodyMatrix, float dt)
+	{
+		if (!isEnabled())
+			return;
+
+		time += dt;
+		for (size_t i = 0; i < times.size(); i++)
+			times[i] = time + clip.getDuration() * (i * 0.618034f - floorf(i * 0.618034f));
+		if (olafEnabled)
+			characterMatrices[0] = bodyMatrix;
+		AnimationBatch::sample(skeleton, clip, &times[0], (int)times.size(), &skinMatrices[0]);
+	}
+
+	void draw(ShaderPermutations& sceneShaders, FrameRingBuffer& frameData, GLenum mode)
+	{
+		if (isEnabled())
+			mesh.draw(sceneShaders, frameData, mode, &characterMatrices[0], &skinMatrices[0], skeleton.getJointCount(), getCharacterCount());
+	}
+};
+
+// Layers of the scene texture array
+struct SceneTextureLayers
+{
+	int grass;
+	int snow;
+	int carrot;
+};
+
+const char* sceneTexturePack = "../Assets/Textures/scene_textures.ktx";
+
+SceneTextureLayers addSceneTextures(TextureArray& textures)
+{
+	SceneTextureLayers layers;
+	layers.grass = textures.add("../Assets/Textures/grass.jpg");
+	layers.snow = textures.add("../Assets/Textures/snow.jpg");
+	layers.carrot = textures.add("../Assets/Textures/cement.jpg");
+	return layers;
+}
+
+// Decode and resize throughput over the texture assets, in megapixels of source image per second
+int benchmarkTextureIngestion(int maxSize)
+{
+	const char* files[] = { "../Assets/Textures/brick.jpg", "../Assets/Textures/cement.jpg", "../Assets/Textures/grass.jpg",
+		"../Assets/Textures/moon.jpg", "../Assets/Textures/snow.jpg" };
+	const int fileCount = sizeof(files) / sizeof(files[0]);
+	const double minimumSeconds = 0.25;
+
+	std::cout << "Texture ingestion benchmark, resize to " << maxSize << " max, " << JobSystem::shared().getThreadCount() + 1 << " threads" << std::endl;
+	double totalPixels = 0.0, totalDecode = 0.0, totalResize[3] = { 0.0, 0.0, 0.0 };
+	for (int f = 0; f < fileCount; f++)
+	{
+		// read the file once, only the decoding is timed
+		std::ifstream file(files[f], std::ios::binary);
+		std::vector<unsigned char> encoded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		int width, height, nrChannels;
+		unsigned char* data = encoded.empty() ? NULL : stbi_load_from_memory(&encoded[0], (int)encoded.size(), &width, &height, &nrChannels, 4);
+		if (!data)
+		{
+			std::cerr << "Error::Texture could not load texture file:" << files[f] << std::endl;
+			return -1;
+		}
+
+		int iterations = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		double decodeSeconds = 0.0;
+		while (decodeSeconds < minimumSeconds)
+		{
+			stbi_image_free(stbi_load_from_memory(&encoded[0], (int)encoded.size(), &width, &height, &nrChannels, 4));
+			iterations++;
+			decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		double pixels = (double)width * height;
+		double decodeTime = decodeSeconds / iterations;
+		std::cout << files[f] << " " << width << "x" << height << " decode " << std::fixed << std::setprecision(1) << pixels / decodeTime / 1e6 << " MPix/s";
+		totalPixels += pixels;
+		totalDecode += decodeTime;
+
+		int fitWidth, fitHeight;
+		ImageResize::fitToMaxSize(width, height, maxSize, fitWidth, fitHeight);
+		std::vector<unsigned char> resized((size_t)fitWidth * fitHeight * 4);
+		for (int path = RESIZE_SCALAR; path <= RESIZE_AVX2; path++)
+		{
+			if (!ImageResize::isPathSupported((ResizePath)path))
+				continue;
+
+			iterations = 0;
+			start = std::chrono::steady_clock::now();
+			double resizeSeconds = 0.0;
+			while (resizeSeconds < minimumSeconds)
+			{
+				ImageResize::resize(data, width, height, &resized[0], fitWidth, fitHeight, (ResizePath)path);
+				iterations++;
+				resizeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+			totalResize[path] += resizeSeconds / iterations;
+			std::cout << ", resize " << ImageResize::getPathName((ResizePath)path) << " " << pixels * iterations / resizeSeconds / 1e6 << " MPix/s";
+		}
+		std::cout << std::endl;
+		stbi_image_free(data);
+	}
+
+	ResizePath best = ImageResize::getBestPath();
+	std::cout << "Total decode " << totalPixels / totalDecode / 1e6 << " MPix/s, decode + resize (" << ImageResize::getPathName(best) << ") "
+		<< totalPixels / (totalDecode + totalResize[best]) / 1e6 << " MPix/s" << std::endl;
+	return 0;
+}
+
+// counts the state a draw loop would change, standing in for the GL calls
+struct StateChangeCounter
+{
+	unsigned int program, material;
+	GLuint vertexArray;
+	int changes;
+	float checksum;
+
+	StateChangeCounter() : program(~0u), material(~0u), vertexArray(~0u), changes(0), checksum(0.0f) {}
+
+	void operator()(const DrawCommand& command)
+	{
+		changes += (command.features != program) + ((unsigned int)command.textureLayer != material) + (command.vertexArray != vertexArray);
+		program = command.features;
+		material = (unsigned int)command.textureLayer;
+		vertexArray = command.vertexArray;
+		checksum += command.worldMatrix[3][2];
+	}
+};
+
+// CPU cost of queueing, sorting and walking a frame of random draws, and the state changes sorting saves
+int benchmarkRenderQueue(int drawCount)
+{
+	const int programCount = 8, materialCount = 64, vertexArrayCount = 16;
+	const int iterations = 20;
+	std::mt19937 random(1234);
+	std::vector<DrawCommand> draws(drawCount);
+	std::vector<float> depths(drawCount);
+	for (int i = 0; i < drawCount; i++)
+	{
+		draws[i].vertexArray = random() % vertexArrayCount + 1;
+		draws[i].mode = GL_TRIANGLES;
+		draws[i].indexCount = 36;
+		draws[i].firstIndex = 0;
+		draws[i].baseVertex = 0;
+		draws[i].features = random() % programCount;
+		draws[i].textureLayer = (float)(random() % materialCount);
+		draws[i].color = vec3(1.0f);
+		depths[i] = std::uniform_real_distribution<float>(0.0f, 1.0f)(random);
+		draws[i].worldMatrix = glm::translate(mat4(1.0f), vec3(0.0f, 0.0f, -100.0f * depths[i]));
+	}
+
+	std::cout << "Render queue benchmark, " << drawCount << " draws, " << programCount << " programs, " << materialCount << " materials, "
+		<< vertexArrayCount << " vertex arrays" << std::endl;
+	RenderQueue queue;
+	StateChangeCounter unsorted, sorted;
+	double submitTime = 0.0, radixTime = 0.0, stdSortTime = 0.0, executeTime = 0.0;
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		queue.clear();
+		for (int i = 0; i < drawCount; i++)
+			queue.submit(RenderQueue::makeKey(RENDER_PASS_OPAQUE, draws[i].features, (unsigned int)draws[i].textureLayer, draws[i].vertexArray, depths[i]), draws[i]);
+		std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+
+		// the same keys through std::sort, for comparison
+		std::vector<RenderQueueItem> items(queue.getItems());
+		std::chrono::steady_clock::time_point copied = std::chrono::steady_clock::now();
+		std::sort(items.begin(), items.end(), [](const RenderQueueItem& a, const RenderQueueItem& b) { return a.key < b.key; });
+		std::chrono::steady_clock::time_point stdSorted = std::chrono::steady_clock::now();
+
+		if (iteration == 0)
+			queue.execute(unsorted);
+		std::chrono::steady_clock::time_point radixStart = std::chrono::steady_clock::now();
+		queue.sort();
+		std::chrono::steady_clock::time_point radixSorted = std::chrono::steady_clock::now();
+		sorted = StateChangeCounter();
+		queue.execute(sorted);
+		std::chrono::steady_clock::time_point executed = std::chrono::steady_clock::now();
+
+		submitTime += std::chrono::duration<double, std::milli>(submitted - start).count();
+		stdSortTime += std::chrono::duration<double, std::milli>(stdSorted - copied).count();
+		radixTime += std::chrono::duration<double, std::milli>(radixSorted - radixStart).count();
+		executeTime += std::chrono::duration<double, std::milli>(executed - radixSorted).count();
+
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			if (items[i].key != queue.getItems()[i].key)
+			{
+				std::cerr << "Error::RenderQueue radix sort order differs from std::sort at " << i << std::endl;
+				return -1;
+			}
+		}
+	}
+
+	std::cout << std::fixed << std::setprecision(3) << "Submit " << submitTime / iterations << " ms, radix sort " << radixTime / iterations
+		<< " ms (std::sort " << stdSortTime / iterations << " ms), execute " << executeTime / iterations << " ms, total "
+		<< (submitTime + radixTime + executeTime) / iterations << " ms per frame" << std::endl;
+	std::cout << "State changes " << unsorted.changes << " unsorted, " << sorted.changes << " sorted (checksum " << sorted.checksum << ")" << std::endl;
+	return 0;
+}
+
+// The SimulationKey an action moves the Olaf with, 0 for the other actions
+unsigned int getSimulationKey(int action)
+{
+	switch (action)
+	{
+	case ACTION_OLAF_LEFT: return SIM_KEY_LEFT;
+	case ACTION_OLAF_RIGHT: return SIM_KEY_RIGHT;
+	case ACTION_OLAF_BACKWARD: return SIM_KEY_BACKWARD;
+	case ACTION_OLAF_FORWARD: return SIM_KEY_FORWARD;
+	case ACTION_OLAF_TURN_LEFT: return SIM_KEY_TURN_LEFT;
+	case ACTION_OLAF_TURN_RIGHT: return SIM_KEY_TURN_RIGHT;
+	case ACTION_OLAF_RESPAWN: return SIM_KEY_RESPAWN;
+	case ACTION_OLAF_GROW: return SIM_KEY_GROW;
+	case ACTION_OLAF_SHRINK: return SIM_KEY_SHRINK;
+	default: return 0;
+	}
+}
+
+// Hands the Olaf key events of the frame to the simulation, with the time they happened
+void forwardSimulationEvents(const InputScript& input, const InputActionMap& actions, Simulation& simulation)
+{
+	const std::vector<InputEvent>& events = input.getEvents();
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		unsigned int key = getSimulationKey(actions.getAction(events[i].key));
+		if (key != 0)
+			simulation.pushEvent(events[i].time, key, events[i].down);
+	}
+}
 
 int main(int argc, char*argv[])
 {
+	// Offline texture packing, run once after changing the scene textures so startup only reads the packed file
+	if (argc > 1 && strcmp(argv[1], "--pack-textures") == 0)
+	{
+		TextureArray textures;
+		addSceneTextures(textures);
+		return textures.pack() && textures.save(sceneTexturePack) ? 0 : -1;
+	}
 
-	int cubeVertices;
-	GLuint cubeVAO;
-	int sphereVertices;
-	GLuint sphereVAO;
-	int cylinderVertices;
-	GLuint cylinderVAO;
+	// Decode and resize throughput, --bench-textures [max size]
+	if (argc > 1 && strcmp(argv[1], "--bench-textures") == 0)
+		return benchmarkTextureIngestion(argc > 2 ? atoi(argv[2]) : 256);
+
+	// Render queue submit, sort and execute cost, --bench-render-queue [draws]
+	if (argc > 1 && strcmp(argv[1], "--bench-render-queue") == 0)
+		return benchmarkRenderQueue(argc > 2 ? std::max(1, atoi(argv[2])) : 100000);
+
+	// CPU reference of the snowfall, scalar against AVX2, --bench-snow [flakes] [steps]
+	if (argc > 1 && strcmp(argv[1], "--bench-snow") == 0)
+		return benchmarkSnow(argc > 2 ? std::max(1, atoi(argv[2])) : 1000000, argc > 3 ? std::max(1, atoi(argv[3])) : 100);
+
+	// Batched skeletal animation sampling, scalar against AVX2, --bench-animation [characters] [frames]
+	if (argc > 1 && strcmp(argv[1], "--bench-animation") == 0)
+		return benchmarkAnimation(argc > 2 ? std::max(1, atoi(argv[2])) : 10000, argc > 3 ? std::max(1, atoi(argv[3])) : 100);
+
+	// Compressed clips against float keys: size, error and sampling speed, --bench-clip-compression [characters] [frames] [clips]
+	if (argc > 1 && strcmp(argv[1], "--bench-clip-compression") == 0)
+		return benchmarkClipCompression(argc > 2 ? std::max(1, atoi(argv[2])) : 10000, argc > 3 ? std::max(1, atoi(argv[3])) : 100,
+			argc > 4 ? std::max(1, atoi(argv[4])) : 64);
+
+	// CPU particle update throughput over the SIMD paths and thread counts, --bench-particles [particles] [steps]
+	if (argc > 1 && strcmp(argv[1], "--bench-particles") == 0)
+		return benchmarkParticles(argc > 2 ? std::max(1, atoi(argv[2])) : 1000000, argc > 3 ? std::max(1, atoi(argv[3])) : 100);
+
+	// Video memory the texture cache may use before it evicts unused textures, --texture-budget <MB>
+	// Largest side of the streamed textures, bigger images are scaled down when loaded, --max-texture-size <pixels>
+	size_t textureBudget = 256 * 1024 * 1024;
+	int maxTextureSize = 0;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--texture-budget") == 0)
+			textureBudget = (size_t)atoi(argv[i + 1]) * 1024 * 1024;
+		if (strcmp(argv[i], "--max-texture-size") == 0)
+			maxTextureSize = atoi(argv[i + 1]);
+	}
+
+	// Offscreen rendering of a fixed number of frames, for machines without a display, see HeadlessRenderer.h
+	HeadlessOptions headless = parseHeadlessOptions(argc, argv);
+
+	// Swap interval, -1 for adaptive vsync, and frame rate limit, --swap-interval <n> --fps <target>, see FramePacer.h
+	FramePacingOptions pacing = parseFramePacingOptions(argc, argv);
+
+	// Tick rate of the Olaf simulation, --tick-rate <ticks per second>, see Simulation.h
+	SimulationOptions simulationOptions = parseSimulationOptions(argc, argv);
+
+	// Repeatable benchmark run replaying an input script, --benchmark <script> [report.json], see InputScript.h
+	// Record a script from a live session, --record-input <script>
+	// Seed of the random generator, the script seed wins when replaying, --seed <n>
+	string benchmarkScript, benchmarkReport = "benchmark.json", recordScript;
+	unsigned int seed = static_cast <unsigned> (time(0));
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--benchmark") == 0)
+		{
+			benchmarkScript = argv[i + 1];
+			if (i + 2 < argc && argv[i + 2][0] != '-')
+				benchmarkReport = argv[i + 2];
+		}
+		if (strcmp(argv[i], "--record-input") == 0)
+			recordScript = argv[i + 1];
+		if (strcmp(argv[i], "--seed") == 0)
+			seed = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+	}
+	// CPU and GPU timings of the frame sections, written as a Chrome trace on exit, --profile [trace.json]
+	string profileTrace;
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--profile") == 0)
+			profileTrace = i + 1 < argc && argv[i + 1][0] != '-' ? argv[i + 1] : "trace.json";
+	if (!profileTrace.empty())
+	{
+		Profiler::get().setThreadName("Main");
+		Profiler::get().setEnabled(true);
+	}
+
+	// Snowfall simulated on the GPU, --snow <flakes> (0 turns it off), --snow-check [steps] compares it with the CPU reference, see SnowSystem.h
+	// --cpu-snow simulates it with the CPU particles instead, see ParticleSystem.h
+	SnowSettings snowSettings;
+	int snowCheckSteps = 0;
+	bool cpuSnow = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--snow") == 0 && i + 1 < argc)
+			snowSettings.flakeCount = std::max(0, atoi(argv[i + 1]));
+		if (strcmp(argv[i], "--snow-check") == 0)
+			snowCheckSteps = i + 1 < argc && argv[i + 1][0] != '-' ? std::max(1, atoi(argv[i + 1])) : 120;
+		if (strcmp(argv[i], "--cpu-snow") == 0)
+			cpuSnow = true;
+	}
+
+	// Skeletal animation, --skinned-olaf draws Olaf skinned instead of rigid, --crowd <n> adds n skinned Olafs, see SkinnedMesh.h
+	bool skinnedOlaf = false;
+	int crowdCount = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--skinned-olaf") == 0)
+			skinnedOlaf = true;
+		if (strcmp(argv[i], "--crowd") == 0 && i + 1 < argc)
+			crowdCount = std::max(0, atoi(argv[i + 1]));
+	}
+
+	// GL 4.3 core context, so the scene can be drawn with multi draw indirect, --gl43
+	bool requestGL43 = false;
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--gl43") == 0)
+			requestGL43 = true;
+
+	InputScript input;
+	InputActionMap actions = InputActionMap::getDefault();
+	if (!benchmarkScript.empty())
+	{
+		if (!input.load(benchmarkScript))
+			return -1;
+		seed = input.getSeed();
+	}
+
+	// every model lives in one geometry pool and is drawn through its vertex array, see GeometryPool.h
+	GeometryPool geometry;
+	PoolMesh cubeMesh;
+	PoolMesh sphereMesh;
+	PoolMesh cylinderMesh;
 
 
 
@@ -720,19 +1409,29 @@ int main(int argc, char*argv[])
 	// Initialize GLFW and OpenGL version
 	glfwInit();
 
+	if (requestGL43)
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	}
+	else
+	{
 #if defined(PLATFORM_OSX)
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #else
-	// On windows, we set OpenGL version to 2.1, to support more hardware
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+		// On windows, we set OpenGL version to 2.1, to support more hardware
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
 #endif
+	}
 
 	// Create Window and rendering context using GLFW, resolution is 800x600
-	GLFWwindow* window = glfwCreateWindow(1024, 768, "Olaafff", NULL, NULL);
+	GLFWwindow* window = headless.enabled ? createHeadlessWindow(headless, "Olaafff") : glfwCreateWindow(1024, 768, "Olaafff", NULL, NULL);
 	if (window == NULL)
 	{
 		std::cerr << "Failed to create GLFW window" << std::endl;
@@ -740,6 +1439,12 @@ int main(int argc, char*argv[])
 		return -1;
 	}
 	glfwMakeContextCurrent(window);
+	FramePacer pacer;
+	if (!headless.enabled)
+		pacer.start(pacing);
+	input.attach(window);
+	if (!recordScript.empty() && !input.isReplaying())
+		input.record(recordScript, seed);
 
 	// @TODO 3 - Disable mouse cursor
 	// ...
@@ -752,12 +1457,70 @@ int main(int argc, char*argv[])
 		return -1;
 	}
 
+	// In headless mode the frames go to a framebuffer object instead of the hidden window
+	HeadlessRenderer headlessRenderer(headless);
+	if (headless.enabled && !headlessRenderer.create())
+	{
+		glfwTerminate();
+		return -1;
+	}
+
+	FrameBenchmark benchmark;
+	if (input.isReplaying())
+		benchmark.start();
+	GpuProfiler gpuProfiler;
+	if (!profileTrace.empty())
+		gpuProfiler.start();
+	// The scene goes out in a few multi draw indirect calls when the context has them, see MultiDrawIndirect.h
+	MultiDrawIndirect multiDraw;
+	if (requestGL43 || MultiDrawIndirect::isSupported())
+		multiDraw.create();
+	// Per frame constants and per draw data go through one ring buffer, persistently mapped where the context allows it
+	FrameRingBuffer frameData;
+	frameData.create(4 * 1024 * 1024);
+
 	// Black background
 	glClearColor(0.3f, 0.1f, 0.6f, 1.0f);
+
+#if defined(PLATFORM_OSX)
+	std::string shaderPathPrefix = "Shaders/";
+#else
+	std::string shaderPathPrefix = "../Assets/Shaders/";
+#endif
+
+	// Submit every shader program first, the driver compiles them while we load the meshes and textures below
+	ShaderBatch shaders;
+	ShaderPermutations sceneShaders(shaders, shaderPathPrefix + "scene_vertex.glsl", shaderPathPrefix + "scene_fragment.glsl");
+	GLuint shaderShadow = shaders.submit(shaderPathPrefix + "shadow_vertex.glsl", shaderPathPrefix + "shadow_fragment.glsl");
+
+	// No shadow map is bound and the spotlight cutoffs are never set, so the scene only needs the plain and textured variants
+	sceneShaders.prefetch(multiDraw.isEnabled() ? SHADER_INDIRECT : 0);
+	sceneShaders.prefetch(multiDraw.isEnabled() ? SHADER_TEXTURED | SHADER_INDIRECT : SHADER_TEXTURED);
 	
-	cubeVAO = setupModelEBO(cubePath, cubeVertices);
-	sphereVAO = setupModelEBO(spherePath, sphereVertices);
-	cylinderVAO = setupModelEBO(cylinderPath, cylinderVertices);
+	if (!geometry.create() || !setupModelMesh(geometry, cubePath, cubeMesh) || !setupModelMesh(geometry, spherePath, sphereMesh)
+		|| !setupModelMesh(geometry, cylinderPath, cylinderMesh))
+	{
+		glfwTerminate();
+		return -1;
+	}
+
+	SnowSystem snow;
+	if (snowSettings.flakeCount > 0 && !cpuSnow)
+		snow.create(shaders, shaderPathPrefix, snowSettings);
+	if (snowCheckSteps > 0 && !snow.verify(snowCheckSteps, 1.0f / 60.0f))
+	{
+		glfwTerminate();
+		return -1;
+	}
+	SceneParticles particles(snowSettings, cpuSnow);
+	SceneCharacters characters(skinnedOlaf, crowdCount);
+	if (!characters.create(cubePath, spherePath))
+	{
+		glfwTerminate();
+		return -1;
+	}
+	ParticleRenderer particleRenderer;
+	particleRenderer.create(shaders, shaderPathPrefix);
 
 	// Compile and link shaders here ...
 	//int shaderGrid = compileAndLinkShaders();
@@ -768,21 +1531,23 @@ int main(int argc, char*argv[])
 
 	//ahhh
 	
-	GLuint grassTextureID = loadTexture("../Assets/Textures/grass.jpg");
-	GLuint snowTextureID = loadTexture("../Assets/Textures/snow.jpg");
-	GLuint carrotTextureID = loadTexture("../Assets/Textures/cement.jpg");
-
-#if defined(PLATFORM_OSX)
-	std::string shaderPathPrefix = "Shaders/";
-#else
-	std::string shaderPathPrefix = "../Assets/Shaders/";
-#endif
-
-	GLuint shaderProgram = loadSHADER(shaderPathPrefix + "scene_vertex.glsl", shaderPathPrefix + "scene_fragment.glsl");
-	GLuint shaderShadow = loadSHADER(shaderPathPrefix + "shadow_vertex.glsl", shaderPathPrefix + "shadow_fragment.glsl");
-	GLuint shaderGrid = loadSHADER(shaderPathPrefix + "grid_vertex.glsl", shaderPathPrefix + "grid_fragment.glsl");
-
-	glUseProgram(shaderProgram);
+	// All the scene textures live in one texture array, materials pick a layer instead of binding a texture.
+	// It is loaded (or packed) in the background and shows a grey placeholder until its mips are uploaded
+	TextureArray sceneTextures;
+	SceneTextureLayers textureLayers = addSceneTextures(sceneTextures);
+	TextureStreamer textureStreamer;
+	textureStreamer.setMaxTextureSize(maxTextureSize);
+	TextureCache textureCache(textureStreamer, textureBudget);
+	bool compressedTextures = GLEW_EXT_texture_compression_s3tc != 0;
+	TextureHandle sceneTexturesHandle = textureCache.acquire(sceneTexturePack, GL_TEXTURE_2D_ARRAY, sceneTextures.getLayerCount(), [&sceneTextures, compressedTextures](TextureData& texture) {
+		bool success = sceneTextures.prepare(sceneTexturePack, compressedTextures);
+		texture = sceneTextures.takeTextureData();
+		return success || texture.getLevelCount() > 0;
+	});
+	GLuint sceneTexturesID = sceneTexturesHandle.getId();
+
+	// First use of the scene program, this is where we wait for the compiler if it is not done yet
+	sceneShaders.get(0);
 	
 	/*
 	// Setup texture and framebuffer for creating shadow map
@@ -858,17 +1623,9 @@ int main(int argc, char*argv[])
 	//glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
 
 	
-	// Set projection matrix on both shaders
-	SetUniformMat4(shaderProgram, "projectionMatrix", projectionMatrix);
-
-	// Set view matrix on both shaders
-	SetUniformMat4(shaderProgram, "viewMatrix", viewMatrix);
-
-	// Set light color on scene shader
-	SetUniformVec3(shaderProgram, "light_color", vec3(1.0, 1.0, 1.0));
-
-	// Set object color on scene shader
-	SetUniformVec3(shaderProgram, "objectColor", vec3(1.0, 1.0, 1.0));
+	// Projection, view and light are written once a frame into the SceneBlock every shader variant reads
+	SceneUniforms scene;
+	scene.lightColor = vec3(1.0, 1.0, 1.0);
 	
 
 	// Define and upload geometry to the GPU here ...
@@ -892,17 +1649,43 @@ int main(int argc, char*argv[])
 
 	// Other OpenGL states to set once
 	// Enable Backface culling
-	glEnable(GL_CULL_FACE);
+	GLStateCache::get().enable(GL_CULL_FACE);
 
 	// @TODO 1 - Enable Depth Test
 	// ...
-	glEnable(GL_DEPTH_TEST); 
+	GLStateCache::get().enable(GL_DEPTH_TEST);
 
 
 	
 	
 
-	GLuint colorLocation = glGetUniformLocation(shaderProgram, "objectColor");
+	// Draws are queued with their state and executed sorted, see RenderQueue.h.
+	// The depth in the key is the view space distance over the far plane
+	RenderQueue renderQueue;
+	auto queueDraw = [&renderQueue, &scene, &geometry](const PoolMesh& mesh, GLenum mode, unsigned int features, int textureLayer, vec3 color, const mat4& worldMatrix)
+	{
+		DrawCommand command;
+		command.vertexArray = geometry.getVertexArray();
+		command.mode = mode;
+		command.indexCount = mesh.indexCount;
+		command.firstIndex = mesh.firstIndex;
+		command.baseVertex = mesh.baseVertex;
+		command.features = features;
+		command.textureLayer = (float)textureLayer;
+		command.color = color;
+		command.worldMatrix = worldMatrix;
+		float depth = -(scene.viewMatrix * worldMatrix[3]).z / 100.0f;
+		unsigned int material = features & SHADER_TEXTURED ? textureLayer + 1 : 0;
+		renderQueue.submit(RenderQueue::makeKey(RENDER_PASS_OPAQUE, features, material, command.vertexArray, depth), command);
+	};
+	// Olaf's rigid parts, the skinned Olaf replaces them
+	auto queueOlafPart = [&queueDraw, &characters](const PoolMesh& mesh, GLenum mode, unsigned int features, int textureLayer, vec3 color, const mat4& worldMatrix)
+	{
+		if (!characters.olafEnabled)
+			queueDraw(mesh, mode, features, textureLayer, color, worldMatrix);
+	};
+	SceneDrawExecutor executeDraw(sceneShaders, frameData);
+	SceneDrawGroupBinder bindDrawGroup(sceneShaders);
 
 
 	// the position of each piece is computed using hierarchical modeling
@@ -919,7 +1702,22 @@ int main(int argc, char*argv[])
 	glm::mat4 bodyMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
 	glm::mat4 centerMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
 
-	srand(static_cast <unsigned> (time(0)));
+	// The Olaf moves at a fixed tick rate, on its own thread or stepped by the fixed frame time of headless and replayed runs
+	// Seeded so a replayed script puts the Olaf at the same places
+	Simulation simulation(simulationOptions, seed);
+	bool steppedSimulation = headless.enabled || input.isReplaying();
+
+	// The shadow program is first used in the main loop
+	shaders.resolve(shaderShadow);
+
+	// Key states of the first frame, the next ones are read after each glfwPollEvents
+	input.beginFrame();
+	pacer.markInput();
+	if (input.getCamera(cameraPosition, cameraLookAt))
+		viewMatrix = lookAt(cameraPosition, cameraPosition + cameraLookAt, cameraUp);
+	forwardSimulationEvents(input, actions, simulation);
+	if (!steppedSimulation)
+		simulation.start();
 
 	
 	// Entering Main Loop
@@ -931,8 +1729,25 @@ int main(int argc, char*argv[])
 
 		// @TODO 1 - Clear Depth Buffer Bit as well
 		// ...
+		GLStateCache::get().beginFrame();
+		frameData.beginFrame();
+		if (headless.enabled)
+			headlessRenderer.beginFrame();
+		benchmark.beginFrame();
+		Profiler::get().collect();
+		gpuProfiler.beginFrame();
+		PROFILE_SCOPE(frameScope, "Frame");
+		PROFILE_GPU_SCOPE(section, "Clear and streaming");
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		// Upload what the texture loaders finished, within the frame budget, then evict unused textures if over the memory budget
+		textureStreamer.update();
+		textureCache.update();
+		GLStateCache::get().invalidateTextures();
+
+		// The only texture bind of the frame
+		bindTexture(GL_TEXTURE_2D_ARRAY, sceneTexturesID);
+
 		
 		
 		
@@ -940,12 +1755,24 @@ int main(int argc, char*argv[])
 
 		
 		
-		// Frame time calculation
-		float dt = glfwGetTime() - lastFrameTime;
+		// Frame time calculation, headless and benchmark runs advance by a fixed step so they are repeatable,
+		// or by the frame times of the recorded session they replay
+		float dt = headless.enabled || input.isReplaying() ? headless.frameTime : glfwGetTime() - lastFrameTime;
+		input.getFrameTime(dt);
+		input.recordFrameTime(dt);
 		lastFrameTime += dt;
 
+		// The Olaf between the two latest simulation ticks
+		if (steppedSimulation)
+			simulation.advance(dt);
+		OlafState olaf = simulation.sample();
+		bodyMatrix = olaf.getBodyMatrix();
+		particles.update(olaf, dt);
+		characters.update(bodyMatrix, dt);
+
 		
 		/*************************** LIGHTING ********************************/
+		PROFILE_GPU_NEXT(section, "Light setup");
 		
 		// light parameters
 		vec3 lightPosition = vec3(0.0f, 3.0f, 0.0f); // the location of the light in 3D space
@@ -962,11 +1789,15 @@ int main(int argc, char*argv[])
 
 		// Set light space matrix on both shaders
 		SetUniformMat4(shaderShadow, "light_view_proj_matrix", lightSpaceMatrix);
-		SetUniformMat4(shaderProgram, "light_view_proj_matrix", lightSpaceMatrix);
+		scene.lightViewProjMatrix = lightSpaceMatrix;
 		// Set light position on scene shader
-		SetUniformVec3(shaderProgram, "light_position", lightPosition);
+		scene.lightPosition = lightPosition;
 		// Set light direction on scene shader
-		SetUniformVec3(shaderProgram, "light_direction", lightDirection);
+		scene.lightDirection = lightDirection;
+
+		scene.projectionMatrix = projectionMatrix;
+		scene.viewMatrix = viewMatrix;
+		RingAllocation sceneBlock = writeSceneBlock(frameData, scene);
 
 		/*
 		// Render shadow in 2 passes: 1- Render depth map, 2- Render scene
@@ -1014,44 +1845,13 @@ int main(int argc, char*argv[])
 
 		
 		// light source 
-		glBindVertexArray(cubeVAO);
-
-	
+		PROFILE_NEXT(section, "Light cube");
 		mat4 worldMatrixcube = mat4(1.0f);
 		worldMatrixcube = glm::translate(worldMatrixcube, lightPosition);
 		worldMatrixcube = glm::scale(worldMatrixcube, glm::vec3(0.2f));
-		SetUniformVec3(shaderProgram, "objectColor", vec3(1.0, 1.0, 1.0));
-		SetUniformMat4(shaderProgram, "worldMatrix", worldMatrixcube);
-
-		glDrawElements(GL_TRIANGLES, cubeVertices, GL_UNSIGNED_INT, 0);
+		queueDraw(cubeMesh, GL_TRIANGLES, 0, 0, glm::vec3(1.0, 1.0, 1.0), worldMatrixcube);
 		
 
-		glBindVertexArray(cubeVAO);
-
-		// Pressing the spacebar should re-position the Olaf at a random location on the grid. 
-		if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-		{
-			
-			bodyMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(-5.0f + static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / (10.0f))), 0.0f, -5.0f + static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / (10.0f)))));
-		}
-
-		//The user can incrementally size up the Olaf by pressing ‘U’ for scale-up and ‘I’ for scale-down. Each key press should result in a small size change.
-		if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS)
-		{
-
-			bodyMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(1.00f,1.01f, 1.00f)) * bodyMatrix;
-		}
-
-		//The user can incrementally size up the Olaf by pressing ‘U’ for scale-up and ‘I’ for scale-down. Each key press should result in a small size change.
-		if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)
-		{
-
-			bodyMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(1.00f, 0.99f, 1.00f)) * bodyMatrix;
-		}
-
-	
-
-
 		// finally we actually compute the world matrix using this!
 		// note that matrix composition notation is the reverse of the way we form sentences in english! "apply part matrix then group matrix" means "group matrix * part matrix"
 		glm::mat4 worldMatrix = bodyMatrix * partMatrix;
@@ -1060,13 +1860,13 @@ int main(int argc, char*argv[])
 		// the way the maths extend is pretty simple: we go from "worldMatrix = parentMatrix * childMatrix" to "worldMatrix = ... grandParentMatrix * parentMatrix * childMatrix * grandChildMatrix ..."
 
 		GLenum mode = GL_TRIANGLES;
-		if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
+		if (actions.isActive(input, ACTION_DRAW_LINES))
 		{
 
 			mode = GL_LINES;
 
 		}
-		if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS)
+		if (actions.isActive(input, ACTION_DRAW_POINTS))
 		{
 
 			mode = GL_POINTS;
@@ -1074,138 +1874,103 @@ int main(int argc, char*argv[])
 		}
 		
 		
-		GLuint worldMatrixLocation = glGetUniformLocation(shaderProgram, "worldMatrix");
+		// Textured materials only need the texture variant while 'T' is held
+		unsigned int texturedMaterial = actions.isActive(input, ACTION_TEXTURES) ? SHADER_TEXTURED : 0;
 		
 		glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(-0.15f, 0.1f, 0.0f));
 		// drawing the feet left
+		PROFILE_NEXT(section, "Olaf left foot");
 		glm::mat4 scalingMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.2f, -0.2f, 0.175f));
 		glm::mat4 translationMatrix_lfeet = glm::translate(glm::mat4(1.0f), glm::vec3(-0.15f, 0.1f, 0.0f));
 		
 		partMatrix = translationMatrix_lfeet * scalingMatrix;
 		worldMatrix = bodyMatrix * partMatrix;
-		glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
-		glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
-
-		glDrawElements(mode, cubeVertices, GL_UNSIGNED_INT, 0);
+		queueOlafPart(cubeMesh, mode, 0, 0, glm::vec3(1.0, 1.0, 1.0), worldMatrix);
 		
 
 		// drawing the feet right
+		PROFILE_NEXT(section, "Olaf right foot");
 		scalingMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.2f, -0.2f, 0.175f));
 		glm::mat4 translationMatrix_rfeet = glm::translate(glm::mat4(1.0f), glm::vec3(0.15f, 0.1f, 0.0f));
 
 		partMatrix = translationMatrix_rfeet * scalingMatrix;
 		worldMatrix = bodyMatrix * partMatrix;
-		glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
-		glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
-
-		glDrawElements(mode, cubeVertices, GL_UNSIGNED_INT, 0);
+		queueOlafPart(cubeMesh, mode, 0, 0, glm::vec3(1.0, 1.0, 1.0), worldMatrix);
 
 
 
 		// drawing the body
-		glBindVertexArray(sphereVAO);
+		PROFILE_NEXT(section, "Olaf body");
 
 		scalingMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.02f, 0.02f, 0.02f));
 		translationMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.6f, 0.0f));
 
 		partMatrix = translationMatrix * scalingMatrix;
 		worldMatrix = bodyMatrix * partMatrix;
-		glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
-		glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
-
-		glDrawElements(mode, sphereVertices, GL_UNSIGNED_INT, 0);
+		queueOlafPart(sphereMesh, mode, 0, 0, glm::vec3(1.0, 1.0, 1.0), worldMatrix);
 
 
-		glBindVertexArray(sphereVAO);
+		PROFILE_NEXT(section, "Olaf upper body");
 		// drawing the body upper
 		scalingMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.01f, 0.01f, 0.01f));
 		translationMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
 		partMatrix = translationMatrix * scalingMatrix;
 		worldMatrix = bodyMatrix * partMatrix;
-		glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
-		glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
+		queueOlafPart(sphereMesh, mode, 0, 0, glm::vec3(1.0, 1.0, 1.0), worldMatrix);
 
-		glDrawElements(mode, sphereVertices, GL_UNSIGNED_INT, 0);
 
-
-		glBindVertexArray(sphereVAO);
+		PROFILE_NEXT(section, "Olaf head");
 		// drawing the head
 		scalingMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.005f, 0.005f, 0.005f));
 		translationMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.4f, 0.0f));
 
 		partMatrix = translationMatrix * scalingMatrix;
 		worldMatrix = bodyMatrix * partMatrix;
-		glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
-		glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
-
-		glDrawElements(mode, sphereVertices, GL_UNSIGNED_INT, 0);
+		queueOlafPart(sphereMesh, mode, 0, 0, glm::vec3(1.0, 1.0, 1.0), worldMatrix);
 
 
-		glBindVertexArray(cubeVAO);
+		PROFILE_NEXT(section, "Olaf nose");
 		// drawing the nose
 		scalingMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.05f, 0.05f, 0.5f));
 		translationMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.4f, 0.1f));
 
 		partMatrix = translationMatrix * scalingMatrix;
 		worldMatrix = bodyMatrix * partMatrix;
-		glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
-		glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(1.0, 0.0, 1.0)));
-		if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
-		{
-
-			glBindTexture(GL_TEXTURE_2D, carrotTextureID);
-			glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(1.0, 0.64, 0.0)));
-
-		}
-		glDrawElements(mode, cubeVertices, GL_UNSIGNED_INT, 0);
+		queueOlafPart(cubeMesh, mode, texturedMaterial, textureLayers.carrot, texturedMaterial ? glm::vec3(1.0, 0.64, 0.0) : glm::vec3(1.0, 0.0, 1.0), worldMatrix);
 
 		// drawing the hat
+		PROFILE_NEXT(section, "Olaf hat");
 		scalingMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.1f, -0.25f, 0.1f));
 		translationMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.6f, 0.0f));
 
 		partMatrix = translationMatrix * scalingMatrix;
 		worldMatrix = bodyMatrix * partMatrix;
-		glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
-		glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(0.0, 0.0, 0.0)));
-		if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
-		{
-
-			glBindTexture(GL_TEXTURE_2D, carrotTextureID);
-			glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(0.70, 0.71, 0.62)));
-
-		}
-
-		glDrawElements(mode, cubeVertices, GL_UNSIGNED_INT, 0);
+		queueOlafPart(cubeMesh, mode, texturedMaterial, textureLayers.carrot, texturedMaterial ? glm::vec3(0.70, 0.71, 0.62) : glm::vec3(0.0, 0.0, 0.0), worldMatrix);
 
 		// drawing the left arm
+		PROFILE_NEXT(section, "Olaf left arm");
 		scalingMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -0.075f, 0.1f));
 		translationMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(-0.4f, 1.2f, 0.0f));
 
 		partMatrix = translationMatrix * scalingMatrix;
 		worldMatrix = bodyMatrix * partMatrix;
-		glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
-		glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
-
-		glDrawElements(mode, cubeVertices, GL_UNSIGNED_INT, 0);
+		queueOlafPart(cubeMesh, mode, 0, 0, glm::vec3(1.0, 1.0, 1.0), worldMatrix);
 
 		// drawing the right arm
+		PROFILE_NEXT(section, "Olaf right arm");
 		scalingMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -0.075f, 0.1f));
 		translationMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.4f, 1.2f, 0.0f));
 
 		partMatrix = translationMatrix * scalingMatrix;
 		worldMatrix = bodyMatrix * partMatrix;
-		glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
-		glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
-
-		glDrawElements(mode, cubeVertices, GL_UNSIGNED_INT, 0);
+		queueOlafPart(cubeMesh, mode, 0, 0, glm::vec3(1.0, 1.0, 1.0), worldMatrix);
 
 		
 		//Ground
+		PROFILE_NEXT(section, "Ground");
 		
 		
-		glBindVertexArray(cubeVAO);
-
 
 		mat4 ground = mat4(1.0f);
 
@@ -1213,22 +1978,47 @@ int main(int argc, char*argv[])
 		ground = glm::translate(ground, vec3(0.0f,-0.02f,0.0f));
 		ground = glm::scale(ground, glm::vec3(25.0f,0.02f,25.0f));
 		
-		glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(0.0, 1.0, 0.0)));
-		if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
+		queueDraw(cubeMesh, GL_TRIANGLES, texturedMaterial, textureLayers.snow, texturedMaterial ? glm::vec3(1.0, 1.0, 1.0) : glm::vec3(0.0, 1.0, 0.0), ground);
+
+		// Everything is queued, draw it sorted by state and front to back
+		PROFILE_GPU_NEXT(section, "Render queue");
+		renderQueue.sort();
+		if (multiDraw.isEnabled())
+			multiDraw.build(renderQueue, frameData);
+		else
+			executeDraw.prepare(renderQueue);
+		frameData.flush();
+		if (sceneBlock.data != NULL)
 		{
+			frameData.bindRange(GL_UNIFORM_BUFFER, SCENE_BLOCK_BINDING, sceneBlock);
+			if (multiDraw.isEnabled())
+				multiDraw.execute(bindDrawGroup, frameData);
+			else
+				renderQueue.execute(executeDraw);
+		}
 
-			glBindTexture(GL_TEXTURE_2D, snowTextureID);
-			glUniform3fv(colorLocation, 1, glm::value_ptr(glm::vec3(1.0, 1.0, 1.0)));
+		// Skinned characters, their joint blocks go into the frame data after the queue's
+		if (characters.isEnabled() && sceneBlock.data != NULL)
+		{
+			PROFILE_GPU_NEXT(section, "Skinned characters");
+			characters.draw(sceneShaders, frameData, mode);
+		}
 
+		// Snowfall, one transform feedback step then the flakes over the scene
+		if (snow.isEnabled())
+		{
+			PROFILE_GPU_NEXT(section, "Snowfall");
+			snow.update(dt);
+			if (sceneBlock.data != NULL)
+				snow.draw(headless.enabled ? headless.height : 768);
 		}
-		
-		
-		
-		
-		glUniformMatrix4fv(worldMatrixLocation, 1, GL_FALSE, &ground[0][0]);
-		
-		glDrawElements(GL_TRIANGLES, cubeVertices, GL_UNSIGNED_INT, 0);
-		glBindTexture(GL_TEXTURE_2D, 0);
+
+		// CPU particles, blended over everything else
+		PROFILE_GPU_NEXT(section, "Particles");
+		if (sceneBlock.data != NULL)
+			particles.draw(particleRenderer);
+		frameData.endFrame();
+		renderQueue.clear();
 
 
 
@@ -1326,128 +2116,93 @@ int main(int argc, char*argv[])
 
 
 		// End Frame
-		glfwSwapBuffers(window);
-		
-
-		// Detect inputs
-		glfwPollEvents();
-
-		//Handle inputs
-		if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+		PROFILE_NEXT(section, "Swap");
+		benchmark.endFrame();
+		if (input.isDone())
 			glfwSetWindowShouldClose(window, true);
-
-
-		//The user can control the Olaf position and orientation using keyboard input i.e. 
-	//A → move left, D → move right, W → move up, S → move down, a → rotate left 5 degrees about Y axis, d → rotate right 5 degrees about Y axis. You may add other rotations about other axis, if you want. 
-		if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+		if (headless.enabled)
 		{
-
-			bodyMatrix = bodyMatrix * glm::translate(glm::mat4(1.0f), glm::vec3(-0.05f, 0.0f, 0.0f));
-			
-			
+			headlessRenderer.endFrame();
+			if (headlessRenderer.isDone())
+				glfwSetWindowShouldClose(window, true);
 		}
-		if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+		else
 		{
-
-			bodyMatrix = bodyMatrix * glm::translate(glm::mat4(1.0f), glm::vec3(0.05f, 0.0f, 0.0f));
+			glfwSwapBuffers(window);
+			pacer.markPresent();
+			pacer.waitForNextFrame();
 		}
-		if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		{
+		
 
-			bodyMatrix = bodyMatrix * glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.05f));
-		}
-		if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS)
-		{
+		// Detect inputs
+		PROFILE_NEXT(section, "Input");
+		glfwPollEvents();
+		pacer.markInput();
 
-			bodyMatrix = bodyMatrix * glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -0.05f));
-		}
-		if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS)
-		{
+		// Key states of the next frame, live or from the script
+		input.beginFrame();
+		input.getCamera(cameraPosition, cameraLookAt);
 
-			bodyMatrix = bodyMatrix * glm::rotate(glm::mat4(1.0f), glm::radians(5.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		}
-		if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS)
-		{
+		//Handle inputs, the keyboard can stop a replay too
+		if (actions.isActive(input, ACTION_QUIT) || input.isLivePressed(GLFW_KEY_ESCAPE))
+			glfwSetWindowShouldClose(window, true);
 
-			bodyMatrix = bodyMatrix * glm::rotate(glm::mat4(1.0f), glm::radians(5.0f), glm::vec3(0.0f, -1.0f, 0.0f));
-		}
+
+		// The Olaf keys go to the simulation
+		forwardSimulationEvents(input, actions, simulation);
 
 
 		// World Transform
 	
 
-		if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) // move world Wx
+		if (actions.isActive(input, ACTION_WORLD_TILT_LEFT)) // move world Wx
 		{
 			projectionMatrix = projectionMatrix * glm::rotate(mat4(1.0f), glm::radians(0.1f), glm::vec3(0.001f, 0.0f, 0.0f));
-
-			GLuint projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
-			glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 		}
 
-		if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) // move world W-x
+		if (actions.isActive(input, ACTION_WORLD_TILT_RIGHT)) // move world W-x
 		{
 			projectionMatrix = projectionMatrix * glm::rotate(mat4(1.0f), glm::radians(0.1f), glm::vec3(-0.001f, 0.0f, 0.0f));
-
-			GLuint projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
-			glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 		}
 
-		if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) // move world Wy
+		if (actions.isActive(input, ACTION_WORLD_TILT_UP)) // move world Wy
 		{
 			projectionMatrix = projectionMatrix * glm::rotate(mat4(1.0f), glm::radians(0.1f), glm::vec3(0.0f, 0.001f, 0.0f));
-
-			GLuint projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
-			glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 		}
 
-		if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) // move world W-y
+		if (actions.isActive(input, ACTION_WORLD_TILT_DOWN)) // move world W-y
 		{
 			
 			projectionMatrix = projectionMatrix * glm::rotate(mat4(1.0f), glm::radians(0.1f), glm::vec3(0.0f, -0.001f, 0.0f));
-
-			GLuint projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
-			glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 		}
 
-		if (glfwGetKey(window, GLFW_KEY_V== GLFW_PRESS)) // reset cam
+		if (actions.isActive(input, ACTION_WORLD_STRETCH)) // stretch the depth of the projection
 		{
 			projectionMatrix = glm::scale(projectionMatrix, glm::vec3(1.0f, 1.0f, 1.01f));;
-
-			GLuint projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
-			glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 		}
 
-		if (glfwGetKey(window, GLFW_KEY_B == GLFW_PRESS)) // reset cam
+		if (actions.wasTriggered(input, ACTION_CAMERA_STEP_BACK)) // step the camera back, once per press
 		{
-			viewMatrix = viewMatrix * glm::translate(mat4(1.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-
-			GLuint viewMatrixLocation = glGetUniformLocation(shaderProgram, "viewMatrix");
-			glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
+			cameraPosition -= normalize(cameraLookAt);
 		}
 		
 		// Projection Transform
-		if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+		if (actions.isActive(input, ACTION_PERSPECTIVE))
 		{
 			projectionMatrix = glm::perspective(70.0f,            // field of view in degrees
 				1024.0f / 768.0f,  // aspect ratio
 				0.01f, 100.0f);   // near and far (near > 0)
-
-			GLuint projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
-			glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 		}
 		
 
-		if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
+		if (actions.isActive(input, ACTION_ORTHOGRAPHIC))
 		{
-			glm::mat4 projectionMatrix = glm::ortho(-4.0f, 4.0f,    // left/right
+			projectionMatrix = glm::ortho(-4.0f, 4.0f,    // left/right
 				-3.0f, 3.0f,    // bottom/top
 				-100.0f, 100.0f);  // near/far (near == 0 is ok for ortho)
-
-			GLuint projectionMatrixLocation = glGetUniformLocation(shaderProgram, "projectionMatrix");
-			glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 		}
 
-		bool fastCam = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS;
+		bool fastCam = actions.isActive(input, ACTION_CAMERA_FAST);
 		float currentCameraSpeed = (fastCam) ? cameraFastSpeed : cameraSpeed;
 
 		/*
@@ -1475,30 +2230,27 @@ int main(int argc, char*argv[])
 
 		*/
 
-		if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) // move camera backward
+		if (actions.isActive(input, ACTION_CAMERA_BACKWARD)) // move camera backward
 		{
 			cameraPosition.z -= currentCameraSpeed * dt;
 		}
 
-		if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS) // move camera forward
+		if (actions.isActive(input, ACTION_CAMERA_FORWARD)) // move camera forward
 		{
 			cameraPosition.z += currentCameraSpeed * dt;
 		}
 
-		if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) // move camera left
+		if (actions.isActive(input, ACTION_CAMERA_LOOK_LEFT)) // move camera left
 		{
 			cameraLookAt.x -= currentCameraSpeed * dt;
 		}
 
-		if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) // move camera right
+		if (actions.isActive(input, ACTION_CAMERA_LOOK_RIGHT)) // move camera right
 		{
 			cameraLookAt.x += currentCameraSpeed * dt;
 		}
 
-		mat4 viewMatrix = lookAt(cameraPosition, cameraPosition + cameraLookAt, cameraUp);
-
-		GLuint viewMatrixLocation = glGetUniformLocation(shaderProgram, "viewMatrix");
-		glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
+		viewMatrix = lookAt(cameraPosition, cameraPosition + cameraLookAt, cameraUp);
 
 
 		
@@ -1507,6 +2259,39 @@ int main(int argc, char*argv[])
 	}
 
 	
+	simulation.stop();
+	simulation.printStats();
+
+	// Release the textures while the context is still alive
+	textureCache.printStats();
+	GLStateCache::get().printStats();
+	sceneTexturesHandle = TextureHandle();
+	textureCache.clear();
+	textureStreamer.shutdown();
+	frameData.printStats();
+	pacer.printStats();
+	frameData.release();
+	snow.release();
+	particles.printStats();
+	particleRenderer.release();
+	characters.mesh.release();
+	geometry.printStats();
+	geometry.release();
+	if (input.isReplaying())
+	{
+		benchmark.writeReport(benchmarkReport, benchmarkScript, seed, headless.frameTime);
+		benchmark.release();
+	}
+	if (!profileTrace.empty())
+	{
+		gpuProfiler.release();
+		Profiler::get().writeTrace(profileTrace);
+	}
+	if (headless.enabled)
+	{
+		headlessRenderer.writeTimings();
+		headlessRenderer.release();
+	}
 
 	// Shutdown GLFW
 	glfwTerminate();
@@ -1514,46 +2299,3 @@ int main(int argc, char*argv[])
 	return 0;
 }
 
-
-GLuint loadTexture(const char *filename)
-{
-	// Step1 Create and bind textures
-	GLuint textureId = 0;
-	glGenTextures(1, &textureId);
-	assert(textureId != 0);
-	
-
-	glBindTexture(GL_TEXTURE_2D, textureId);
-
-	// Step2 Set filter parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	// Step3 Load Textures with dimension data
-	int width, height, nrChannels;
-	unsigned char *data = stbi_load(filename, &width, &height, &nrChannels, 0);
-	if (!data)
-	{
-		std::cerr << "Error::Texture could not load texture file:" << filename << std::endl;
-		return 0;
-	}
-
-	// Step4 Upload the texture to the PU
-	GLenum format = 0;
-	if (nrChannels == 1)
-		format = GL_RED;
-	else if (nrChannels == 3)
-		format = GL_RGB;
-	else if (nrChannels == 4)
-		format = GL_RGBA;
-	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height,
-		0, format, GL_UNSIGNED_BYTE, data);
-
-	// Step5 Free resources
-	stbi_image_free(data);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	return textureId;
-}
-
@@ -0,0 +1,277 @@
+#ifndef FRAMEBENCHMARK_H
+#define FRAMEBENCHMARK_H
+
+// Per frame measurements of a benchmark run and their JSON report.
+// The render loop goes through the counted draw and bind helpers below, so every frame knows its draw calls,
+// state changes (and the redundant ones the GLStateCache filtered out) and triangles. The GPU time of a frame comes from a pair of GL_TIMESTAMP queries read back a few frames
+// later, so measuring never waits for the GPU. Timestamps do not conflict with the profiler's GL_TIME_ELAPSED queries.
+// Include after GL/glew.h.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+
+#include <GLStateCache.h>
+
+// what the render loop submitted in the current frame
+struct RenderStats
+{
+	int drawCalls;
+	long long triangles;
+
+	RenderStats() : drawCalls(0), triangles(0) {}
+};
+
+inline RenderStats& renderStats()
+{
+	static RenderStats stats;
+	return stats;
+}
+
+inline void drawElements(GLenum mode, GLsizei count)
+{
+	RenderStats& stats = renderStats();
+	stats.drawCalls++;
+	if (mode == GL_TRIANGLES)
+		stats.triangles += count / 3;
+	glDrawElements(mode, count, GL_UNSIGNED_INT, 0);
+}
+
+inline void drawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	RenderStats& stats = renderStats();
+	stats.drawCalls++;
+	if (mode == GL_TRIANGLES)
+		stats.triangles += count / 3;
+	glDrawArrays(mode, first, count);
+}
+
+// instanceCount copies of vertices [0, count) of the bound vertex array
+inline void drawArraysInstanced(GLenum mode, GLsizei count, GLsizei instanceCount)
+{
+	RenderStats& stats = renderStats();
+	stats.drawCalls++;
+	if (mode == GL_TRIANGLES)
+		stats.triangles += (long long)count / 3 * instanceCount;
+	else if (mode == GL_TRIANGLE_STRIP && count > 2)
+		stats.triangles += (long long)(count - 2) * instanceCount;
+	glDrawArraysInstanced(mode, 0, count, instanceCount);
+}
+
+// draws count indices of the bound vertex array from firstIndex on, baseVertex is added to each index
+inline void drawElementsBaseVertex(GLenum mode, GLsizei count, GLuint firstIndex, GLint baseVertex)
+{
+	RenderStats& stats = renderStats();
+	stats.drawCalls++;
+	if (mode == GL_TRIANGLES)
+		stats.triangles += count / 3;
+	glDrawElementsBaseVertex(mode, count, GL_UNSIGNED_INT, (void*)(firstIndex * sizeof(GLuint)), baseVertex);
+}
+
+// one call drawing drawCount commands of the bound GL_DRAW_INDIRECT_BUFFER, indexCount is the total over the commands
+inline void multiDrawElementsIndirect(GLenum mode, size_t offset, GLsizei drawCount, long long indexCount)
+{
+	RenderStats& stats = renderStats();
+	stats.drawCalls++;
+	if (mode == GL_TRIANGLES)
+		stats.triangles += indexCount / 3;
+	glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, (const void*)offset, drawCount, 0);
+}
+
+inline void useProgram(GLuint program)
+{
+	GLStateCache::get().useProgram(program);
+}
+
+inline void bindVertexArray(GLuint vertexArray)
+{
+	GLStateCache::get().bindVertexArray(vertexArray);
+}
+
+inline void bindTexture(GLenum target, GLuint texture)
+{
+	GLStateCache::get().bindTexture(target, texture);
+}
+
+class FrameBenchmark
+{
+public:
+	FrameBenchmark() : running(false), queriesSupported(false), nextQuery(0)
+	{
+		for (int i = 0; i < QUERY_COUNT; i++)
+		{
+			queries[i][0] = queries[i][1] = 0;
+			queryFrames[i] = -1;
+		}
+	}
+
+	~FrameBenchmark()
+	{
+		release();
+	}
+
+	// needs the context to be current, the GPU times are left out if the driver has no timer queries
+	void start()
+	{
+		running = true;
+		queriesSupported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+		if (queriesSupported)
+			glGenQueries(QUERY_COUNT * 2, &queries[0][0]);
+		else
+			std::cerr << "Error::Benchmark timer queries are not supported, the report has no GPU times" << std::endl;
+	}
+
+	// deletes the queries, call before the GL context goes away
+	void release()
+	{
+		if (queries[0][0] != 0)
+			glDeleteQueries(QUERY_COUNT * 2, &queries[0][0]);
+		for (int i = 0; i < QUERY_COUNT; i++)
+			queries[i][0] = queries[i][1] = 0;
+	}
+
+	void beginFrame()
+	{
+		if (!running)
+			return;
+
+		renderStats() = RenderStats();
+		frameStart = std::chrono::steady_clock::now();
+		if (queriesSupported)
+		{
+			// the oldest query is reused, its frame has to be read back first
+			collect(nextQuery, true);
+			glQueryCounter(queries[nextQuery][0], GL_TIMESTAMP);
+			queryFrames[nextQuery] = (int)cpuTimes.size();
+		}
+	}
+
+	// call once the frame is submitted, before the swap
+	void endFrame()
+	{
+		if (!running)
+			return;
+
+		cpuTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+		gpuTimes.push_back(-1.0);
+		const RenderStats& stats = renderStats();
+		GLStateCacheStats stateStats = GLStateCache::get().getFrameStats();
+		drawCalls.push_back(stats.drawCalls);
+		stateChanges.push_back(stateStats.issued);
+		redundantCalls.push_back(stateStats.redundant);
+		triangles.push_back((double)stats.triangles);
+
+		if (queriesSupported)
+		{
+			glQueryCounter(queries[nextQuery][1], GL_TIMESTAMP);
+			nextQuery = (nextQuery + 1) % QUERY_COUNT;
+			for (int i = 0; i < QUERY_COUNT; i++)
+				collect(i, false);
+		}
+	}
+
+	int getFrameCount() const { return (int)cpuTimes.size(); }
+
+	// waits for the queries still in flight, then writes p50/p95/p99 of every measure
+	bool writeReport(const std::string& filename, const std::string& script, unsigned int seed, float frameTime)
+	{
+		for (int i = 0; i < QUERY_COUNT; i++)
+			collect(i, true);
+
+		std::ofstream file(filename.c_str());
+		if (!file)
+		{
+			std::cerr << "Error::Benchmark could not write report:" << filename << std::endl;
+			return false;
+		}
+
+		std::vector<double> measuredGpuTimes;
+		for (size_t i = 0; i < gpuTimes.size(); i++)
+			if (gpuTimes[i] >= 0.0)
+				measuredGpuTimes.push_back(gpuTimes[i]);
+
+		file << std::fixed << std::setprecision(4);
+		file << "{\n";
+		std::string escapedScript;
+		for (size_t i = 0; i < script.size(); i++)
+			escapedScript += script[i] == '\\' || script[i] == '"' ? std::string("\\") + script[i] : std::string(1, script[i]);
+		file << "  \"script\": \"" << escapedScript << "\",\n";
+		file << "  \"seed\": " << seed << ",\n";
+		file << "  \"frame_time\": " << frameTime << ",\n";
+		file << "  \"frames\": " << cpuTimes.size() << ",\n";
+		writePercentiles(file, "cpu_ms", cpuTimes, ",");
+		writePercentiles(file, "gpu_ms", measuredGpuTimes, ",");
+		writePercentiles(file, "draw_calls", drawCalls, ",");
+		writePercentiles(file, "state_changes", stateChanges, ",");
+		writePercentiles(file, "redundant_calls", redundantCalls, ",");
+		writePercentiles(file, "triangles", triangles, "");
+		file << "}\n";
+
+		std::cout << "Benchmark : " << cpuTimes.size() << " frames, cpu p50 " << std::fixed << std::setprecision(3) << getPercentile(cpuTimes, 50.0)
+			<< " ms, p99 " << getPercentile(cpuTimes, 99.0) << " ms";
+		if (!measuredGpuTimes.empty())
+			std::cout << ", gpu p50 " << getPercentile(measuredGpuTimes, 50.0) << " ms, p99 " << getPercentile(measuredGpuTimes, 99.0) << " ms";
+		std::cout << ", report in " << filename << std::endl;
+		return true;
+	}
+
+	// nearest rank percentile, 0 for no values
+	static double getPercentile(std::vector<double> values, double percentile)
+	{
+		if (values.empty())
+			return 0.0;
+		std::sort(values.begin(), values.end());
+		size_t rank = (size_t)(percentile / 100.0 * values.size() + 0.999999);
+		return values[std::min(values.size(), std::max((size_t)1, rank)) - 1];
+	}
+
+private:
+	// reads a finished query back into the frame it measured
+	void collect(int query, bool wait)
+	{
+		if (queryFrames[query] < 0)
+			return;
+
+		GLint available = 0;
+		if (!wait)
+		{
+			glGetQueryObjectiv(queries[query][1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				return;
+		}
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(queries[query][0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(queries[query][1], GL_QUERY_RESULT, &end);
+		gpuTimes[queryFrames[query]] = (end - begin) / 1e6;
+		queryFrames[query] = -1;
+	}
+
+	static void writePercentiles(std::ofstream& file, const char* name, const std::vector<double>& values, const char* separator)
+	{
+		file << "  \"" << name << "\": { \"p50\": " << getPercentile(values, 50.0) << ", \"p95\": " << getPercentile(values, 95.0)
+			<< ", \"p99\": " << getPercentile(values, 99.0) << ", \"samples\": " << values.size() << " }" << separator << "\n";
+	}
+
+	// frames a query can stay in flight before beginFrame has to wait for it
+	static const int QUERY_COUNT = 4;
+
+	bool running;
+	bool queriesSupported;
+	GLuint queries[QUERY_COUNT][2];   // timestamps at the start and the end of a frame
+	int queryFrames[QUERY_COUNT];   // frame measured by each query, -1 once read back
+	int nextQuery;
+	std::chrono::steady_clock::time_point frameStart;
+	std::vector<double> cpuTimes;
+	std::vector<double> gpuTimes;   // -1 until the query is read back
+	std::vector<double> drawCalls;
+	std::vector<double> stateChanges;
+	std::vector<double> redundantCalls;
+	std::vector<double> triangles;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+// Frame pacing: the swap interval (vsync, or adaptive vsync with -1), a frame limiter holding a target frame rate,
+// and the input to present latency of every frame.
+// The limiter waits after the swap and before the input is read, so the wait does not add to the latency. It sleeps
+// for most of the wait and spins the rest, the spin margin follows how late the sleeps wake up (a few hundred
+// microseconds on Linux, up to a scheduler tick on Windows).
+// The latency runs from the glfwPollEvents the frame's input came from to the return of its glfwSwapBuffers. With
+// vsync the swap returns once the frame is queued for display, so it is a lower bound of what the user sees.
+// Include after GL/glew.h and GLFW/glfw3.h.
+
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+
+#include <Profiler.h>
+#include <FrameBenchmark.h>
+
+struct FramePacingOptions
+{
+	bool setSwapInterval;   // the driver's default is kept otherwise
+	int swapInterval;       // 0 off, 1 every vertical blank, -1 adaptive (tears when late instead of waiting a whole blank)
+	double targetFps;       // 0 does not limit
+
+	FramePacingOptions() : setSwapInterval(false), swapInterval(1), targetFps(0.0)
+	{
+	}
+};
+
+// --swap-interval <n>, --fps <target frames per second>
+inline FramePacingOptions parseFramePacingOptions(int argc, char* argv[])
+{
+	FramePacingOptions options;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--swap-interval") == 0)
+		{
+			options.setSwapInterval = true;
+			options.swapInterval = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--fps") == 0)
+		{
+			options.targetFps = std::max(0.0, atof(argv[++i]));
+		}
+	}
+	return options;
+}
+
+class FramePacer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	FramePacer() : spinMargin(std::chrono::microseconds(1000)), started(false), sleptSeconds(0.0)
+	{
+	}
+
+	// sets the swap interval of the current context, adaptive vsync falls back to 1 without the swap control tear extension
+	void start(const FramePacingOptions& pacing)
+	{
+		options = pacing;
+		if (options.setSwapInterval)
+		{
+			if (options.swapInterval < 0 && !glfwExtensionSupported("WGL_EXT_swap_control_tear") && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+			{
+				std::cerr << "Error::FramePacer adaptive vsync is not supported, using a swap interval of 1" << std::endl;
+				options.swapInterval = 1;
+			}
+			glfwSwapInterval(options.swapInterval);
+		}
+		if (options.targetFps > 0.0)
+			period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.targetFps));
+		startTime = Clock::now();
+	}
+
+	// call right after glfwPollEvents, the next frame is built from this input
+	void markInput()
+	{
+		inputTime = Clock::now();
+	}
+
+	// call right after glfwSwapBuffers
+	void markPresent()
+	{
+		Clock::time_point now = Clock::now();
+		if (started)
+			frameIntervals.push_back(std::chrono::duration<double, std::milli>(now - lastPresent).count());
+		latencies.push_back(std::chrono::duration<double, std::milli>(now - inputTime).count());
+		lastPresent = now;
+		started = true;
+	}
+
+	// waits until the next frame is due, call between the swap and glfwPollEvents
+	void waitForNextFrame()
+	{
+		if (options.targetFps <= 0.0)
+			return;
+
+		PROFILE_SCOPE(limiterScope, "Frame limiter");
+		Clock::time_point now = Clock::now();
+		if (deadline == Clock::time_point())
+			deadline = now;
+		deadline += period;
+		// a frame that ran over a whole period starts a new schedule instead of rushing to catch up
+		if (now > deadline)
+		{
+			deadline = now;
+			return;
+		}
+
+		Clock::time_point sleepUntil = deadline - spinMargin;
+		if (now < sleepUntil)
+		{
+			std::this_thread::sleep_until(sleepUntil);
+			Clock::time_point woke = Clock::now();
+			sleptSeconds += std::chrono::duration<double>(woke - now).count();
+
+			// the margin moves a quarter of the way toward twice the latest oversleep, within 0.2 to 20 ms
+			Clock::duration oversleep = woke > sleepUntil ? woke - sleepUntil : Clock::duration::zero();
+			spinMargin += (oversleep * 2 - spinMargin) / 4;
+			spinMargin = std::max<Clock::duration>(std::chrono::microseconds(200), std::min<Clock::duration>(std::chrono::milliseconds(20), spinMargin));
+		}
+		while (Clock::now() < deadline)
+			std::this_thread::yield();
+	}
+
+	void printStats() const
+	{
+		if (frameIntervals.empty())
+			return;
+
+		double total = std::chrono::duration<double>(lastPresent - startTime).count();
+		std::cout << "Frame pacing : " << std::fixed << std::setprecision(2) << frameIntervals.size() / total << " fps";
+		if (options.targetFps > 0.0)
+			std::cout << " (target " << options.targetFps << ", " << 100.0 * sleptSeconds / total << "% of the time asleep)";
+		std::cout << ", frame interval p50 " << FrameBenchmark::getPercentile(frameIntervals, 50.0) << " ms p99 " << FrameBenchmark::getPercentile(frameIntervals, 99.0)
+			<< " ms, input to present latency p50 " << FrameBenchmark::getPercentile(latencies, 50.0) << " ms p99 " << FrameBenchmark::getPercentile(latencies, 99.0) << " ms" << std::endl;
+	}
+
+private:
+	FramePacingOptions options;
+	Clock::duration period;
+	Clock::duration spinMargin;
+	Clock::time_point deadline;
+	Clock::time_point startTime;
+	Clock::time_point inputTime;
+	Clock::time_point lastPresent;
+	bool started;
+	double sleptSeconds;
+	std::vector<double> frameIntervals;   // milliseconds between presents
+	std::vector<double> latencies;        // milliseconds from input to present
+};
+
+#endif
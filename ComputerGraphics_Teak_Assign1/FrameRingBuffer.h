@@ -0,0 +1,217 @@
+#ifndef FRAMERINGBUFFER_H
+#define FRAMERINGBUFFER_H
+
+// Per frame dynamic data (scene constants, per draw data, indirect commands) written linearly into one buffer and
+// bound by offset as uniform or shader storage ranges, so uploading costs a copy per byte instead of a GL call per value.
+// With GL 4.4 (or ARB_buffer_storage) the buffer holds three frames and stays mapped, persistent and coherent:
+// the CPU writes a frame while the GPU reads the two before it, and a fence per frame tells when a third of the
+// buffer is free again. The CPU only waits if it gets three frames ahead, the waits are counted.
+// Older contexts get one frame of buffer, orphaned at the start of every frame and filled from a CPU copy by flush().
+// Allocations are valid until the end of the frame, write them before flush() and draw after it.
+// Include after GL/glew.h.
+
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+#include <Profiler.h>
+
+struct RingAllocation
+{
+	void* data;          // where the CPU writes, NULL when the frame is out of space
+	GLintptr offset;     // in the buffer
+	GLsizeiptr size;
+};
+
+class FrameRingBuffer
+{
+public:
+	static const int FRAME_COUNT = 3;
+
+	FrameRingBuffer()
+		: buffer(0), persistent(false), mapped(NULL), frameSize(0), alignment(256), frame(0), head(0), flushed(0),
+		overflowed(false), waits(0), waitTime(0.0), peakSize(0)
+	{
+		for (int i = 0; i < FRAME_COUNT; i++)
+			fences[i] = 0;
+	}
+
+	~FrameRingBuffer()
+	{
+		release();
+	}
+
+	// needs the context to be current, frameSize is the most a frame can write
+	bool create(size_t size)
+	{
+		GLint uniformAlignment = 0, storageAlignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+		if (GLEW_VERSION_4_3 || GLEW_ARB_shader_storage_buffer_object)
+			glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+		alignment = std::max(16, std::max(uniformAlignment, storageAlignment));
+		frameSize = (size + alignment - 1) / alignment * alignment;
+
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * FRAME_COUNT, NULL, flags);
+			mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * FRAME_COUNT, flags);
+			if (mapped == NULL)
+			{
+				std::cerr << "Error::FrameRingBuffer could not map the buffer persistently, orphaning instead" << std::endl;
+				glDeleteBuffers(1, &buffer);
+				glGenBuffers(1, &buffer);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+				persistent = false;
+			}
+		}
+		if (!persistent)
+		{
+			glBufferData(GL_COPY_WRITE_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+			staging.resize(frameSize);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return true;
+	}
+
+	// deletes the buffer and the fences, call before the GL context goes away
+	void release()
+	{
+		for (int i = 0; i < FRAME_COUNT; i++)
+		{
+			if (fences[i] != 0)
+				glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+		if (buffer != 0)
+		{
+			if (mapped != NULL)
+			{
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+				glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			}
+			glDeleteBuffers(1, &buffer);
+		}
+		buffer = 0;
+		mapped = NULL;
+		staging.clear();
+	}
+
+	// starts writing the next third of the buffer, once the GPU is done with it, or orphans the buffer
+	void beginFrame()
+	{
+		frame++;
+		head = 0;
+		flushed = 0;
+		overflowed = false;
+		if (persistent)
+		{
+			GLsync& fence = fences[frame % FRAME_COUNT];
+			if (fence != 0)
+			{
+				if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+				{
+					PROFILE_SCOPE(waitScope, "Ring buffer wait");
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+						;
+					waits++;
+					waitTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				}
+				glDeleteSync(fence);
+				fence = 0;
+			}
+		}
+		else
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+	}
+
+	// size bytes aligned for binding as a uniform or shader storage range
+	RingAllocation allocate(size_t size)
+	{
+		RingAllocation allocation = { NULL, 0, (GLsizeiptr)size };
+		size_t start = (head + alignment - 1) / alignment * alignment;
+		if (start + size > frameSize)
+		{
+			if (!overflowed)
+				std::cerr << "Error::FrameRingBuffer frame data over " << frameSize << " bytes, the rest of the frame is dropped" << std::endl;
+			overflowed = true;
+			return allocation;
+		}
+
+		head = start + size;
+		peakSize = std::max(peakSize, head);
+		if (persistent)
+		{
+			allocation.offset = (GLintptr)((frame % FRAME_COUNT) * frameSize + start);
+			allocation.data = mapped + allocation.offset;
+		}
+		else
+		{
+			allocation.offset = (GLintptr)start;
+			allocation.data = &staging[start];
+		}
+		return allocation;
+	}
+
+	// makes what was written since the last flush visible to the GPU, nothing to do for a coherent mapping
+	void flush()
+	{
+		if (persistent || head == flushed)
+			return;
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, flushed, head - flushed, &staging[flushed]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		flushed = head;
+	}
+
+	// call once the draws reading this frame's data are submitted
+	void endFrame()
+	{
+		if (persistent)
+			fences[frame % FRAME_COUNT] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	void bindRange(GLenum target, GLuint index, const RingAllocation& allocation) const
+	{
+		glBindBufferRange(target, index, buffer, allocation.offset, allocation.size);
+	}
+
+	GLuint getBuffer() const { return buffer; }
+	size_t getAlignment() const { return alignment; }
+	bool isPersistent() const { return persistent; }
+
+	void printStats() const
+	{
+		std::cout << "Frame ring buffer : " << (persistent ? "persistent mapping, " : "orphaning, ") << peakSize << " / " << frameSize
+			<< " bytes peak per frame, " << waits << " waits on the GPU (" << waitTime << " ms)" << std::endl;
+	}
+
+private:
+	GLuint buffer;
+	bool persistent;
+	char* mapped;                // the whole buffer, persistent mapping only
+	std::vector<char> staging;   // CPU copy of the frame, orphaning only
+	size_t frameSize;
+	size_t alignment;
+	int frame;
+	size_t head;                 // next free byte of the frame
+	size_t flushed;              // bytes of the frame already uploaded, orphaning only
+	bool overflowed;
+	GLsync fences[FRAME_COUNT];
+	int waits;
+	double waitTime;
+	size_t peakSize;
+};
+
+#endif
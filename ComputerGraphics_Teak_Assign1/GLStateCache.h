@@ -0,0 +1,217 @@
+#ifndef GLSTATECACHE_H
+#define GLSTATECACHE_H
+
+// Shadow copy of the GL state the render loop changes: program, vertex array, texture units, framebuffers and
+// capabilities. A call setting the state it already has is not sent to the driver, only counted as redundant.
+// Code changing that state with direct GL calls must tell the cache with one of the invalidate functions.
+// There is one cache for the one GL context of the application.
+// Include after GL/glew.h.
+
+#include <iostream>
+
+struct GLStateCacheStats
+{
+	int issued;      // calls sent to the driver
+	int redundant;   // calls filtered out
+};
+
+class GLStateCache
+{
+public:
+	static GLStateCache& get()
+	{
+		static GLStateCache cache;
+		return cache;
+	}
+
+	// resets the per frame counters
+	void beginFrame()
+	{
+		frameStats.issued = 0;
+		frameStats.redundant = 0;
+	}
+
+	void useProgram(GLuint newProgram)
+	{
+		if (check(program == newProgram))
+			return;
+		program = newProgram;
+		glUseProgram(newProgram);
+	}
+
+	void bindVertexArray(GLuint newVertexArray)
+	{
+		if (check(vertexArray == newVertexArray))
+			return;
+		vertexArray = newVertexArray;
+		glBindVertexArray(newVertexArray);
+	}
+
+	// binds a texture on a unit, switching the active unit only when needed
+	void bindTexture(GLenum target, GLuint texture, int unit = 0)
+	{
+		int slot = getTargetSlot(target);
+		if (slot < 0 || unit < 0 || unit >= TEXTURE_UNIT_COUNT)
+		{
+			check(false);
+			activeTexture(unit);
+			glBindTexture(target, texture);
+			return;
+		}
+
+		if (check(textures[unit][slot] == texture))
+			return;
+		activeTexture(unit);
+		textures[unit][slot] = texture;
+		glBindTexture(target, texture);
+	}
+
+	// GL_FRAMEBUFFER binds both the draw and the read framebuffers
+	void bindFramebuffer(GLenum target, GLuint framebuffer)
+	{
+		bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+		bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+		if (check((!draw || drawFramebuffer == framebuffer) && (!read || readFramebuffer == framebuffer)))
+			return;
+		if (draw)
+			drawFramebuffer = framebuffer;
+		if (read)
+			readFramebuffer = framebuffer;
+		glBindFramebuffer(target, framebuffer);
+	}
+
+	void enable(GLenum capability) { setCapability(capability, true); }
+	void disable(GLenum capability) { setCapability(capability, false); }
+
+	void invalidateProgram() { program = UNKNOWN; }
+	void invalidateVertexArray() { vertexArray = UNKNOWN; }
+
+	void invalidateTextures()
+	{
+		activeUnit = -1;
+		for (int unit = 0; unit < TEXTURE_UNIT_COUNT; unit++)
+			for (int slot = 0; slot < TARGET_COUNT; slot++)
+				textures[unit][slot] = UNKNOWN;
+	}
+
+	void invalidateFramebuffers()
+	{
+		drawFramebuffer = UNKNOWN;
+		readFramebuffer = UNKNOWN;
+	}
+
+	// after code outside the cache changed any of the tracked state
+	void invalidate()
+	{
+		invalidateProgram();
+		invalidateVertexArray();
+		invalidateTextures();
+		invalidateFramebuffers();
+		for (int i = 0; i < CAPABILITY_COUNT; i++)
+			capabilities[i] = -1;
+	}
+
+	GLStateCacheStats getFrameStats() const { return frameStats; }
+	GLStateCacheStats getTotalStats() const { return totalStats; }
+
+	void printStats() const
+	{
+		int total = totalStats.issued + totalStats.redundant;
+		std::cout << "GL state cache : " << totalStats.issued << " calls issued, " << totalStats.redundant << " redundant calls filtered ("
+			<< (total > 0 ? 100 * totalStats.redundant / total : 0) << "%)" << std::endl;
+	}
+
+private:
+	GLStateCache()
+	{
+		frameStats.issued = frameStats.redundant = 0;
+		totalStats.issued = totalStats.redundant = 0;
+		invalidate();
+	}
+
+	// counts the call, returns true when it would not change anything
+	bool check(bool redundant)
+	{
+		if (redundant)
+		{
+			frameStats.redundant++;
+			totalStats.redundant++;
+		}
+		else
+		{
+			frameStats.issued++;
+			totalStats.issued++;
+		}
+		return redundant;
+	}
+
+	void activeTexture(int unit)
+	{
+		if (activeUnit == unit)
+			return;
+		activeUnit = unit;
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+
+	static int getTargetSlot(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_TEXTURE_2D: return 0;
+		case GL_TEXTURE_2D_ARRAY: return 1;
+		case GL_TEXTURE_CUBE_MAP: return 2;
+		case GL_TEXTURE_BUFFER: return 3;
+		default: return -1;
+		}
+	}
+
+	static int getCapabilitySlot(GLenum capability)
+	{
+		switch (capability)
+		{
+		case GL_DEPTH_TEST: return 0;
+		case GL_CULL_FACE: return 1;
+		case GL_BLEND: return 2;
+		case GL_SCISSOR_TEST: return 3;
+		case GL_STENCIL_TEST: return 4;
+		case GL_PROGRAM_POINT_SIZE: return 5;
+		case GL_RASTERIZER_DISCARD: return 6;
+		default: return -1;
+		}
+	}
+
+	void setCapability(GLenum capability, bool value)
+	{
+		int slot = getCapabilitySlot(capability);
+		if (slot >= 0)
+		{
+			if (check(capabilities[slot] == (value ? 1 : 0)))
+				return;
+			capabilities[slot] = value ? 1 : 0;
+		}
+		else
+			check(false);
+
+		if (value)
+			glEnable(capability);
+		else
+			glDisable(capability);
+	}
+
+	static const GLuint UNKNOWN = 0xffffffffu;
+	static const int TEXTURE_UNIT_COUNT = 16;
+	static const int TARGET_COUNT = 4;
+	static const int CAPABILITY_COUNT = 7;
+
+	GLuint program;
+	GLuint vertexArray;
+	int activeUnit;
+	GLuint textures[TEXTURE_UNIT_COUNT][TARGET_COUNT];
+	GLuint drawFramebuffer;
+	GLuint readFramebuffer;
+	int capabilities[CAPABILITY_COUNT];   // -1 unknown, 0 disabled, 1 enabled
+	GLStateCacheStats frameStats;
+	GLStateCacheStats totalStats;
+};
+
+#endif
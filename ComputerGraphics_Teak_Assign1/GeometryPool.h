@@ -0,0 +1,263 @@
+#ifndef GEOMETRYPOOL_H
+#define GEOMETRYPOOL_H
+
+// Every mesh in one vertex buffer and one index buffer, drawn through a single vertex array with base vertex draws,
+// so going from one mesh to the next changes no state. A mesh gets a vertex range and an index range from a
+// RangeAllocator, a first fit free list that merges neighbouring free ranges when a mesh is removed.
+// A range that does not fit grows its buffer, the old content is copied over on the GPU.
+// The indices of a mesh stay relative to its first vertex, the draws add baseVertex.
+// Include after GL/glew.h.
+
+#include <map>
+#include <vector>
+#include <iterator>
+#include <iostream>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include <GLStateCache.h>
+
+// interleaved vertex of the pool, attributes 0 to 2 of the scene shaders
+struct PoolVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 uv;
+};
+
+// free ranges of a buffer, offsets and sizes in elements
+class RangeAllocator
+{
+public:
+	static const size_t INVALID = (size_t)-1;
+
+	RangeAllocator() : capacity(0), used(0)
+	{
+	}
+
+	// first free range big enough, INVALID if there is none
+	size_t allocate(size_t size)
+	{
+		for (std::map<size_t, size_t>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it)
+		{
+			if (it->second < size)
+				continue;
+
+			size_t offset = it->first;
+			size_t remaining = it->second - size;
+			freeRanges.erase(it);
+			if (remaining > 0)
+				freeRanges[offset + size] = remaining;
+			used += size;
+			return offset;
+		}
+		return INVALID;
+	}
+
+	void free(size_t offset, size_t size)
+	{
+		if (size == 0)
+			return;
+
+		used -= size;
+		std::map<size_t, size_t>::iterator next = freeRanges.lower_bound(offset);
+		if (next != freeRanges.begin())
+		{
+			std::map<size_t, size_t>::iterator previous = std::prev(next);
+			if (previous->first + previous->second == offset)
+			{
+				offset = previous->first;
+				size += previous->second;
+				freeRanges.erase(previous);
+			}
+		}
+		if (next != freeRanges.end() && offset + size == next->first)
+		{
+			size += next->second;
+			freeRanges.erase(next);
+		}
+		freeRanges[offset] = size;
+	}
+
+	// adds the new space at the end as a free range
+	void grow(size_t newCapacity)
+	{
+		if (newCapacity <= capacity)
+			return;
+
+		size_t oldCapacity = capacity;
+		used += newCapacity - oldCapacity;
+		capacity = newCapacity;
+		free(oldCapacity, newCapacity - oldCapacity);
+	}
+
+	size_t getCapacity() const { return capacity; }
+	size_t getUsed() const { return used; }
+	size_t getFreeRangeCount() const { return freeRanges.size(); }
+
+private:
+	size_t capacity;
+	size_t used;
+	std::map<size_t, size_t> freeRanges;   // offset to size
+};
+
+// where a mesh lives in the pool, what its draws need
+struct PoolMesh
+{
+	GLint baseVertex;
+	GLsizei vertexCount;
+	GLuint firstIndex;
+	GLsizei indexCount;
+
+	PoolMesh() : baseVertex(0), vertexCount(0), firstIndex(0), indexCount(0) {}
+};
+
+class GeometryPool
+{
+public:
+	GeometryPool() : vertexArray(0), vertexBuffer(0), indexBuffer(0)
+	{
+	}
+
+	~GeometryPool()
+	{
+		release();
+	}
+
+	// needs the context to be current, the capacities are in vertices and indices and grow as needed
+	bool create(size_t vertexCapacity = 64 * 1024, size_t indexCapacity = 256 * 1024)
+	{
+		if (!GLEW_VERSION_3_2 && !GLEW_ARB_draw_elements_base_vertex)
+		{
+			std::cerr << "Error::GeometryPool base vertex draws are not supported" << std::endl;
+			return false;
+		}
+
+		glGenVertexArrays(1, &vertexArray);
+		vertexBuffer = createBuffer(vertexCapacity * sizeof(PoolVertex));
+		indexBuffer = createBuffer(indexCapacity * sizeof(GLuint));
+		vertices.grow(vertexCapacity);
+		indices.grow(indexCapacity);
+		setupVertexArray();
+		return true;
+	}
+
+	// deletes the buffers, call before the GL context goes away
+	void release()
+	{
+		if (vertexArray != 0)
+		{
+			glDeleteVertexArrays(1, &vertexArray);
+			GLStateCache::get().invalidateVertexArray();
+		}
+		if (vertexBuffer != 0)
+			glDeleteBuffers(1, &vertexBuffer);
+		if (indexBuffer != 0)
+			glDeleteBuffers(1, &indexBuffer);
+		vertexArray = 0;
+		vertexBuffer = 0;
+		indexBuffer = 0;
+		vertices = RangeAllocator();
+		indices = RangeAllocator();
+	}
+
+	// copies a mesh into the pool, its indices are relative to its first vertex
+	bool add(const std::vector<PoolVertex>& meshVertices, const std::vector<GLuint>& meshIndices, PoolMesh& mesh)
+	{
+		if (vertexArray == 0 || meshVertices.empty() || meshIndices.empty())
+			return false;
+
+		size_t vertexOffset = allocate(vertices, vertexBuffer, sizeof(PoolVertex), meshVertices.size());
+		size_t indexOffset = allocate(indices, indexBuffer, sizeof(GLuint), meshIndices.size());
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * sizeof(PoolVertex), meshVertices.size() * sizeof(PoolVertex), &meshVertices[0]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset * sizeof(GLuint), meshIndices.size() * sizeof(GLuint), &meshIndices[0]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		mesh.baseVertex = (GLint)vertexOffset;
+		mesh.vertexCount = (GLsizei)meshVertices.size();
+		mesh.firstIndex = (GLuint)indexOffset;
+		mesh.indexCount = (GLsizei)meshIndices.size();
+		return true;
+	}
+
+	// gives the ranges of the mesh back, its draws must be gone
+	void remove(PoolMesh& mesh)
+	{
+		vertices.free(mesh.baseVertex, mesh.vertexCount);
+		indices.free(mesh.firstIndex, mesh.indexCount);
+		mesh = PoolMesh();
+	}
+
+	GLuint getVertexArray() const { return vertexArray; }
+
+	void printStats() const
+	{
+		std::cout << "Geometry pool : " << vertices.getUsed() << " / " << vertices.getCapacity() << " vertices, "
+			<< indices.getUsed() << " / " << indices.getCapacity() << " indices, "
+			<< vertices.getFreeRangeCount() + indices.getFreeRangeCount() << " free ranges" << std::endl;
+	}
+
+private:
+	static GLuint createBuffer(size_t size)
+	{
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return buffer;
+	}
+
+	// a range of count elements, the buffer doubles until it fits
+	size_t allocate(RangeAllocator& allocator, GLuint& buffer, size_t elementSize, size_t count)
+	{
+		size_t offset = allocator.allocate(count);
+		if (offset != RangeAllocator::INVALID)
+			return offset;
+
+		size_t oldCapacity = allocator.getCapacity();
+		size_t newCapacity = oldCapacity > 0 ? oldCapacity : 1;
+		while (newCapacity < oldCapacity + count)
+			newCapacity *= 2;
+
+		GLuint newBuffer = createBuffer(newCapacity * elementSize);
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCapacity * elementSize);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+		buffer = newBuffer;
+		setupVertexArray();
+
+		allocator.grow(newCapacity);
+		return allocator.allocate(count);
+	}
+
+	// points the vertex array at the current buffers, the element buffer binding is part of it
+	void setupVertexArray()
+	{
+		GLStateCache::get().bindVertexArray(vertexArray);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PoolVertex), (GLvoid*)offsetof(PoolVertex, position));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(PoolVertex), (GLvoid*)offsetof(PoolVertex, normal));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PoolVertex), (GLvoid*)offsetof(PoolVertex, uv));
+		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	GLuint vertexArray;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	RangeAllocator vertices;
+	RangeAllocator indices;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+// GPU side of the profiler: PROFILE_GPU_SCOPE sections are timed with GL_TIME_ELAPSED queries as well.
+// The queries of a frame are read back two frames later (one set of queries per frame, two sets), by then the GPU
+// is done with them and reading does not stall. GL_TIME_ELAPSED queries cannot nest, only the outermost GPU
+// section is timed. The trace places each GPU section after the previous one, starting no earlier than its CPU submit.
+// Include after GL/glew.h.
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include <Profiler.h>
+
+class GpuProfiler : public ProfilerGpuTimer
+{
+public:
+	GpuProfiler() : supported(false), frame(0), active(false), gpuTime(0)
+	{
+	}
+
+	~GpuProfiler()
+	{
+		release();
+	}
+
+	// needs the context to be current, the GPU track stays empty if the driver has no timer queries
+	void start()
+	{
+		supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+		if (!supported)
+		{
+			std::cerr << "Error::Profiler timer queries are not supported, the trace has no GPU times" << std::endl;
+			return;
+		}
+		Profiler::get().setGpuTimer(this);
+	}
+
+	// reads the pending queries back and deletes them, call before the GL context goes away
+	void release()
+	{
+		if (Profiler::get().getGpuTimer() == this)
+			Profiler::get().setGpuTimer(NULL);
+		for (int i = 1; i <= FRAME_COUNT; i++)
+		{
+			QuerySet& set = sets[(frame + i) % FRAME_COUNT];   // oldest first
+			readBack(set);
+			if (!set.queries.empty())
+				glDeleteQueries((GLsizei)set.queries.size(), &set.queries[0]);
+			set.queries.clear();
+			set.sections.clear();
+		}
+	}
+
+	// call at the start of the frame, before the first GPU section
+	void beginFrame()
+	{
+		frame++;
+		readBack(sets[frame % FRAME_COUNT]);
+	}
+
+	virtual bool begin(const char* name, int64_t cpuStart)
+	{
+		if (!supported || active)
+			return false;
+
+		QuerySet& set = sets[frame % FRAME_COUNT];
+		if (set.used == set.queries.size())
+		{
+			GLuint query;
+			glGenQueries(1, &query);
+			set.queries.push_back(query);
+			set.sections.push_back(Section());
+		}
+
+		Section& section = set.sections[set.used];
+		section.name = name;
+		section.cpuStart = cpuStart;
+		glBeginQuery(GL_TIME_ELAPSED, set.queries[set.used]);
+		set.used++;
+		active = true;
+		return true;
+	}
+
+	virtual void end()
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		active = false;
+	}
+
+private:
+	struct Section
+	{
+		const char* name;
+		int64_t cpuStart;
+	};
+
+	struct QuerySet
+	{
+		std::vector<GLuint> queries;
+		std::vector<Section> sections;
+		size_t used;
+
+		QuerySet() : used(0) {}
+	};
+
+	void readBack(QuerySet& set)
+	{
+		for (size_t i = 0; i < set.used; i++)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(set.queries[i], GL_QUERY_RESULT, &elapsed);
+			int64_t start = std::max(gpuTime, set.sections[i].cpuStart);
+			gpuTime = start + (int64_t)elapsed;
+			Profiler::get().addEvent(set.sections[i].name, start, gpuTime, Profiler::GPU_TRACK);
+		}
+		set.used = 0;
+	}
+
+	static const int FRAME_COUNT = 2;
+
+	bool supported;
+	int frame;
+	bool active;           // a GL_TIME_ELAPSED query is running
+	int64_t gpuTime;       // end of the last GPU section in the trace
+	QuerySet sets[FRAME_COUNT];
+};
+
+#endif
@@ -0,0 +1,271 @@
+#ifndef HEADLESSRENDERER_H
+#define HEADLESSRENDERER_H
+
+// Offscreen rendering for the render and CI nodes that have no display or GPU.
+// The window stays hidden and its context comes from OSMesa (software rendering) or EGL. The scene is drawn
+// into a framebuffer object for a fixed number of frames, then the frame timings (and the frames, if asked for)
+// are written to disk.
+// A GLFW built with GLFW_USE_OSMESA uses its null platform and needs no window system at all. Other builds
+// still open a hidden window on the display server, the context API hint only picks the driver behind it.
+// Include after GL/glew.h and GLFW/glfw3.h.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#endif
+
+#include <GLStateCache.h>
+
+struct HeadlessOptions
+{
+	bool enabled;
+	int frames;
+	std::string outputDirectory;
+	int saveEvery;        // writes every Nth frame as a PPM image, 0 writes none
+	int contextApi;       // GLFW_OSMESA_CONTEXT_API or GLFW_EGL_CONTEXT_API, the other one is tried if it fails
+	int width;
+	int height;
+	float frameTime;      // the scene advances by this many seconds per frame, so runs are repeatable
+
+	HeadlessOptions()
+		: enabled(false), frames(300), outputDirectory("headless"), saveEvery(0), contextApi(GLFW_OSMESA_CONTEXT_API),
+		width(1024), height(768), frameTime(1.0f / 60.0f)
+	{
+	}
+};
+
+// --headless [frames] [output directory], --headless-api <osmesa|egl>, --save-frames <every N frames>
+inline HeadlessOptions parseHeadlessOptions(int argc, char* argv[])
+{
+	HeadlessOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+		{
+			options.enabled = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				options.frames = std::max(1, atoi(argv[++i]));
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				options.outputDirectory = argv[++i];
+		}
+		else if (strcmp(argv[i], "--headless-api") == 0 && i + 1 < argc)
+		{
+			i++;
+			options.contextApi = strcmp(argv[i], "egl") == 0 ? GLFW_EGL_CONTEXT_API : GLFW_OSMESA_CONTEXT_API;
+		}
+		else if (strcmp(argv[i], "--save-frames") == 0 && i + 1 < argc)
+		{
+			options.saveEvery = std::max(0, atoi(argv[++i]));
+		}
+	}
+	return options;
+}
+
+inline const char* getContextApiName(int contextApi)
+{
+	return contextApi == GLFW_EGL_CONTEXT_API ? "EGL" : contextApi == GLFW_OSMESA_CONTEXT_API ? "OSMesa" : "native";
+}
+
+// hidden window whose context comes from the requested API, then the other offscreen one, then the native one.
+// the version hints set by the caller are kept
+inline GLFWwindow* createHeadlessWindow(const HeadlessOptions& options, const char* title)
+{
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	int apis[] = { options.contextApi, options.contextApi == GLFW_EGL_CONTEXT_API ? GLFW_OSMESA_CONTEXT_API : GLFW_EGL_CONTEXT_API, GLFW_NATIVE_CONTEXT_API };
+	for (int i = 0; i < 3; i++)
+	{
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, apis[i]);
+		GLFWwindow* window = glfwCreateWindow(options.width, options.height, title, NULL, NULL);
+		if (window != NULL)
+		{
+			std::cout << "Headless context : " << getContextApiName(apis[i]) << std::endl;
+			return window;
+		}
+		std::cerr << "Error::Headless could not create a " << getContextApiName(apis[i]) << " context" << std::endl;
+	}
+	return NULL;
+}
+
+class HeadlessRenderer
+{
+public:
+	explicit HeadlessRenderer(const HeadlessOptions& options)
+		: options(options), framebuffer(0), colorBuffer(0), depthBuffer(0), frame(0)
+	{
+	}
+
+	~HeadlessRenderer()
+	{
+		release();
+	}
+
+	// creates the framebuffer the frames are drawn into, needs the context to be current
+	bool create()
+	{
+		if (!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object)
+		{
+			std::cerr << "Error::Headless framebuffer objects are not supported" << std::endl;
+			return false;
+		}
+
+		glGenRenderbuffers(1, &colorBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, options.width, options.height);
+
+		glGenRenderbuffers(1, &depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, options.width, options.height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLStateCache::get().invalidateFramebuffers();
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cerr << "Error::Headless framebuffer is incomplete: 0x" << std::hex << status << std::dec << std::endl;
+			release();
+			return false;
+		}
+
+		if (!makeDirectory(options.outputDirectory))
+		{
+			std::cerr << "Error::Headless could not create the output directory:" << options.outputDirectory << std::endl;
+			release();
+			return false;
+		}
+		return true;
+	}
+
+	// deletes the framebuffer, call before the GL context goes away
+	void release()
+	{
+		if (framebuffer != 0)
+			glDeleteFramebuffers(1, &framebuffer);
+		if (colorBuffer != 0)
+			glDeleteRenderbuffers(1, &colorBuffer);
+		if (depthBuffer != 0)
+			glDeleteRenderbuffers(1, &depthBuffer);
+		framebuffer = 0;
+		colorBuffer = 0;
+		depthBuffer = 0;
+	}
+
+	// call before the frame is cleared
+	void beginFrame()
+	{
+		GLStateCache::get().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, options.width, options.height);
+		frameStart = std::chrono::steady_clock::now();
+	}
+
+	// call once the frame is submitted. waits for the GPU so the frame time covers the rendering, then saves the frame if asked to
+	void endFrame()
+	{
+		std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+		glFinish();
+		std::chrono::steady_clock::time_point finished = std::chrono::steady_clock::now();
+		submitTimes.push_back(std::chrono::duration<double, std::milli>(submitted - frameStart).count());
+		frameTimes.push_back(std::chrono::duration<double, std::milli>(finished - frameStart).count());
+
+		if (options.saveEvery > 0 && frame % options.saveEvery == 0)
+		{
+			std::ostringstream filename;
+			filename << options.outputDirectory << "/frame_" << std::setw(5) << std::setfill('0') << frame << ".ppm";
+			writeFrame(filename.str());
+		}
+		GLStateCache::get().bindFramebuffer(GL_FRAMEBUFFER, 0);
+		frame++;
+	}
+
+	bool isDone() const { return frame >= options.frames; }
+	int getFrame() const { return frame; }
+	float getFrameTime() const { return options.frameTime; }
+
+	// reads the color buffer back and writes it as a binary PPM, top row first
+	bool writeFrame(const std::string& filename) const
+	{
+		int rowSize = options.width * 3;
+		std::vector<unsigned char> pixels((size_t)rowSize * options.height);
+		GLStateCache::get().bindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, options.width, options.height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+		std::ofstream file(filename.c_str(), std::ios::binary);
+		if (!file)
+		{
+			std::cerr << "Error::Headless could not write frame:" << filename << std::endl;
+			return false;
+		}
+		file << "P6\n" << options.width << " " << options.height << "\n255\n";
+		for (int y = options.height - 1; y >= 0; y--)
+			file.write((const char*)&pixels[(size_t)y * rowSize], rowSize);
+		return true;
+	}
+
+	// per frame submit and total (GPU finished) times in milliseconds, and their summary on the console
+	bool writeTimings() const
+	{
+		std::string filename = options.outputDirectory + "/timings.csv";
+		std::ofstream file(filename.c_str());
+		if (!file)
+		{
+			std::cerr << "Error::Headless could not write timings:" << filename << std::endl;
+			return false;
+		}
+		file << "frame,submit_ms,frame_ms\n";
+		for (size_t i = 0; i < frameTimes.size(); i++)
+			file << i << "," << submitTimes[i] << "," << frameTimes[i] << "\n";
+
+		if (!frameTimes.empty())
+		{
+			std::vector<double> sorted(frameTimes);
+			std::sort(sorted.begin(), sorted.end());
+			double total = 0.0;
+			for (size_t i = 0; i < sorted.size(); i++)
+				total += sorted[i];
+			std::cout << "Headless : " << sorted.size() << " frames at " << options.width << "x" << options.height << ", frame time avg "
+				<< std::fixed << std::setprecision(3) << total / sorted.size() << " ms, min " << sorted.front() << " ms, median "
+				<< sorted[sorted.size() / 2] << " ms, max " << sorted.back() << " ms, timings in " << filename << std::endl;
+		}
+		return true;
+	}
+
+private:
+	static bool makeDirectory(const std::string& path)
+	{
+		struct stat info;
+		if (stat(path.c_str(), &info) == 0)
+			return (info.st_mode & S_IFDIR) != 0;
+#if defined(_WIN32)
+		return _mkdir(path.c_str()) == 0;
+#else
+		return mkdir(path.c_str(), 0755) == 0;
+#endif
+	}
+
+	HeadlessOptions options;
+	GLuint framebuffer;
+	GLuint colorBuffer;
+	GLuint depthBuffer;
+	int frame;
+	std::chrono::steady_clock::time_point frameStart;
+	std::vector<double> submitTimes;
+	std::vector<double> frameTimes;
+};
+
+#endif
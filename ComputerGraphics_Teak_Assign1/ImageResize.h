@@ -0,0 +1,352 @@
+#ifndef IMAGERESIZE_H
+#define IMAGERESIZE_H
+
+// Separable Lanczos3 resize of RGBA8 images, used to bring the source textures down to a maximum size
+// before their mips are built.
+// The weight tables follow CWeightsTable in FreeImageToolkit/Resize.cpp (same filter, support and
+// normalization); the filter loops have scalar, SSE2 and AVX2/FMA versions picked at runtime.
+
+#include <vector>
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IMAGERESIZE_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC compiles AVX2 intrinsics anywhere, GCC and Clang need the functions using them to be marked
+#if defined(IMAGERESIZE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define IMAGERESIZE_AVX2_TARGET __attribute__((target("avx2,fma")))
+#define IMAGERESIZE_SSE2_TARGET __attribute__((target("sse2")))
+#else
+#define IMAGERESIZE_AVX2_TARGET
+#define IMAGERESIZE_SSE2_TARGET
+#endif
+
+#include <JobSystem.h>
+
+enum ResizePath
+{
+	RESIZE_SCALAR,
+	RESIZE_SSE2,
+	RESIZE_AVX2
+};
+
+namespace ImageResize
+{
+	// per destination pixel: first source pixel and weights, padded with zeros to the same tap count for every pixel
+	struct ResizeWeights
+	{
+		int taps;
+		std::vector<int> left;
+		std::vector<float> weights;  // taps per destination pixel
+	};
+
+	inline double lanczos3(double x)
+	{
+		const double pi = 3.1415926535897932384626433833;
+		x = fabs(x);
+		if (x >= 3.0)
+			return 0.0;
+		if (x == 0.0)
+			return 1.0;
+		return (sin(pi * x) / (pi * x)) * (sin(pi * x / 3.0) / (pi * x / 3.0));
+	}
+
+	inline void buildWeights(int srcSize, int dstSize, ResizeWeights& table)
+	{
+		const double filterWidth = 3.0;
+		double scale = (double)dstSize / srcSize;
+		double width = scale < 1.0 ? filterWidth / scale : filterWidth;
+		double filterScale = scale < 1.0 ? scale : 1.0;
+		double offset = 0.5 / scale;
+
+		// every window fits in the source, the short ones near the edges are moved inside and padded
+		int taps = 2 * (int)ceil(width) + 1;
+		if (taps > srcSize)
+			taps = srcSize;
+
+		table.taps = taps;
+		table.left.assign(dstSize, 0);
+		table.weights.assign((size_t)dstSize * taps, 0.0f);
+
+		std::vector<double> weights(2 * (int)ceil(width) + 2);
+		for (int u = 0; u < dstSize; u++)
+		{
+			double center = u / scale + offset;
+			int left = (int)(center - width + 0.5);
+			if (left < 0) left = 0;
+			int right = (int)(center + width + 0.5);
+			if (right > srcSize) right = srcSize;
+
+			double total = 0.0;
+			for (int src = left; src < right; src++)
+			{
+				weights[src - left] = filterScale * lanczos3(filterScale * (src + 0.5 - center));
+				total += weights[src - left];
+			}
+
+			int start = left + taps <= srcSize ? left : srcSize - taps;
+			table.left[u] = start;
+			for (int src = left; src < right && src - start < taps; src++)
+			{
+				double weight = weights[src - left];
+				if (total > 0.0)
+					weight /= total;
+				table.weights[(size_t)u * taps + (src - start)] = (float)weight;
+			}
+		}
+	}
+
+#if defined(IMAGERESIZE_X86)
+	inline bool isAVX2Supported()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool fma = (info[2] & (1 << 12)) != 0;
+		if (!osxsave || !fma || (_xgetbv(0) & 6) != 6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	}
+#else
+	inline bool isAVX2Supported() { return false; }
+#endif
+
+	inline bool isPathSupported(ResizePath path)
+	{
+#if defined(IMAGERESIZE_X86)
+		return path != RESIZE_AVX2 || isAVX2Supported();
+#else
+		return path == RESIZE_SCALAR;
+#endif
+	}
+
+	inline ResizePath getBestPath()
+	{
+		static const ResizePath best = isPathSupported(RESIZE_AVX2) ? RESIZE_AVX2 : (isPathSupported(RESIZE_SSE2) ? RESIZE_SSE2 : RESIZE_SCALAR);
+		return best;
+	}
+
+	inline const char* getPathName(ResizePath path)
+	{
+		return path == RESIZE_AVX2 ? "AVX2" : (path == RESIZE_SSE2 ? "SSE2" : "scalar");
+	}
+
+	inline unsigned char toByte(float value)
+	{
+		int v = (int)(value + 0.5f);
+		return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+	}
+
+	// horizontal pass: one RGBA8 source row into dstWidth RGBA float pixels
+	inline void filterRowScalar(const unsigned char* src, float* dst, const ResizeWeights& table, int dstWidth)
+	{
+		for (int x = 0; x < dstWidth; x++)
+		{
+			const unsigned char* pixel = src + (size_t)table.left[x] * 4;
+			const float* weights = &table.weights[(size_t)x * table.taps];
+			float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+			for (int k = 0; k < table.taps; k++, pixel += 4)
+			{
+				r += weights[k] * pixel[0];
+				g += weights[k] * pixel[1];
+				b += weights[k] * pixel[2];
+				a += weights[k] * pixel[3];
+			}
+			dst[x * 4 + 0] = r;
+			dst[x * 4 + 1] = g;
+			dst[x * 4 + 2] = b;
+			dst[x * 4 + 3] = a;
+		}
+	}
+
+	// vertical pass: taps float rows of the intermediate image into one RGBA8 row
+	inline void filterColumnScalar(const float* rows, size_t rowStride, const float* weights, int taps, unsigned char* dst, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < taps; k++)
+				sum += weights[k] * rows[k * rowStride + i];
+			dst[i] = toByte(sum);
+		}
+	}
+
+#if defined(IMAGERESIZE_X86)
+	// one pixel per register, the four channels side by side
+	IMAGERESIZE_SSE2_TARGET inline void filterRowSSE2(const unsigned char* src, float* dst, const ResizeWeights& table, int dstWidth)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		for (int x = 0; x < dstWidth; x++)
+		{
+			const unsigned char* pixel = src + (size_t)table.left[x] * 4;
+			const float* weights = &table.weights[(size_t)x * table.taps];
+			__m128 sum = _mm_setzero_ps();
+			for (int k = 0; k < table.taps; k++, pixel += 4)
+			{
+				int packed;
+				memcpy(&packed, pixel, 4);
+				__m128i bytes = _mm_cvtsi32_si128(packed);
+				__m128 value = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+				sum = _mm_add_ps(sum, _mm_mul_ps(value, _mm_set1_ps(weights[k])));
+			}
+			_mm_storeu_ps(dst + x * 4, sum);
+		}
+	}
+
+	IMAGERESIZE_SSE2_TARGET inline void filterColumnSSE2(const float* rows, size_t rowStride, const float* weights, int taps, unsigned char* dst, int count)
+	{
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+			for (int k = 0; k < taps; k++)
+			{
+				__m128 weight = _mm_set1_ps(weights[k]);
+				const float* row = rows + k * rowStride + i;
+				sum0 = _mm_add_ps(sum0, _mm_mul_ps(weight, _mm_loadu_ps(row)));
+				sum1 = _mm_add_ps(sum1, _mm_mul_ps(weight, _mm_loadu_ps(row + 4)));
+			}
+			// saturating packs clamp to [0, 255]
+			__m128i words = _mm_packs_epi32(_mm_cvtps_epi32(sum0), _mm_cvtps_epi32(sum1));
+			_mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(words, words));
+		}
+		filterColumnScalar(rows + i, rowStride, weights, taps, dst + i, count - i);
+	}
+
+	// two taps per register: the low half accumulates the even taps, the high half the odd ones
+	IMAGERESIZE_AVX2_TARGET inline void filterRowAVX2(const unsigned char* src, float* dst, const ResizeWeights& table, int dstWidth)
+	{
+		for (int x = 0; x < dstWidth; x++)
+		{
+			const unsigned char* pixel = src + (size_t)table.left[x] * 4;
+			const float* weights = &table.weights[(size_t)x * table.taps];
+			__m256 sum = _mm256_setzero_ps();
+			int k = 0;
+			for (; k + 2 <= table.taps; k += 2, pixel += 8)
+			{
+				__m256 value = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)pixel)));
+				__m256 weight = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(weights[k])), _mm_set1_ps(weights[k + 1]), 1);
+				sum = _mm256_fmadd_ps(value, weight, sum);
+			}
+			__m128 total = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+			if (k < table.taps)
+			{
+				int packed;
+				memcpy(&packed, pixel, 4);
+				__m128 value = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+				total = _mm_fmadd_ps(value, _mm_set1_ps(weights[k]), total);
+			}
+			_mm_storeu_ps(dst + x * 4, total);
+		}
+	}
+
+	IMAGERESIZE_AVX2_TARGET inline void filterColumnAVX2(const float* rows, size_t rowStride, const float* weights, int taps, unsigned char* dst, int count)
+	{
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+			for (int k = 0; k < taps; k++)
+			{
+				__m256 weight = _mm256_set1_ps(weights[k]);
+				const float* row = rows + k * rowStride + i;
+				sum0 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(row), sum0);
+				sum1 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(row + 8), sum1);
+			}
+			// the 256 bit packs work per 128 bit lane, pack the halves in order instead
+			__m256i ints0 = _mm256_cvtps_epi32(sum0), ints1 = _mm256_cvtps_epi32(sum1);
+			__m128i words0 = _mm_packs_epi32(_mm256_castsi256_si128(ints0), _mm256_extracti128_si256(ints0, 1));
+			__m128i words1 = _mm_packs_epi32(_mm256_castsi256_si128(ints1), _mm256_extracti128_si256(ints1, 1));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(words0, words1));
+		}
+		filterColumnScalar(rows + i, rowStride, weights, taps, dst + i, count - i);
+	}
+#endif
+
+	inline void filterRow(ResizePath path, const unsigned char* src, float* dst, const ResizeWeights& table, int dstWidth)
+	{
+#if defined(IMAGERESIZE_X86)
+		if (path == RESIZE_AVX2)
+			return filterRowAVX2(src, dst, table, dstWidth);
+		if (path == RESIZE_SSE2)
+			return filterRowSSE2(src, dst, table, dstWidth);
+#endif
+		filterRowScalar(src, dst, table, dstWidth);
+	}
+
+	inline void filterColumn(ResizePath path, const float* rows, size_t rowStride, const float* weights, int taps, unsigned char* dst, int count)
+	{
+#if defined(IMAGERESIZE_X86)
+		if (path == RESIZE_AVX2)
+			return filterColumnAVX2(rows, rowStride, weights, taps, dst, count);
+		if (path == RESIZE_SSE2)
+			return filterColumnSSE2(rows, rowStride, weights, taps, dst, count);
+#endif
+		filterColumnScalar(rows, rowStride, weights, taps, dst, count);
+	}
+
+	// resizes an RGBA8 image, the rows of both passes are spread over the job system
+	inline void resize(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int dstHeight,
+		ResizePath path = getBestPath(), JobSystem& jobs = JobSystem::shared())
+	{
+		if (!isPathSupported(path))
+			path = RESIZE_SCALAR;
+
+		ResizeWeights horizontal, vertical;
+		buildWeights(srcWidth, dstWidth, horizontal);
+		buildWeights(srcHeight, dstHeight, vertical);
+
+		// horizontal pass over the source rows the vertical pass reads
+		size_t rowStride = (size_t)dstWidth * 4;
+		std::vector<float> intermediate(rowStride * srcHeight);
+		jobs.parallelFor(srcHeight, [&](int begin, int end) {
+			for (int y = begin; y < end; y++)
+				filterRow(path, src + (size_t)y * srcWidth * 4, &intermediate[y * rowStride], horizontal, dstWidth);
+		}, 16);
+
+		jobs.parallelFor(dstHeight, [&](int begin, int end) {
+			for (int y = begin; y < end; y++)
+				filterColumn(path, &intermediate[vertical.left[y] * rowStride], rowStride, &vertical.weights[(size_t)y * vertical.taps], vertical.taps,
+					dst + y * rowStride, (int)rowStride);
+		}, 16);
+	}
+
+	// size of an image scaled down (never up) so its largest side is at most maxSize, keeping the aspect ratio
+	inline void fitToMaxSize(int width, int height, int maxSize, int& fitWidth, int& fitHeight)
+	{
+		fitWidth = width;
+		fitHeight = height;
+		if (maxSize <= 0 || (width <= maxSize && height <= maxSize))
+			return;
+
+		if (width >= height)
+		{
+			fitWidth = maxSize;
+			fitHeight = (int)((double)height * maxSize / width + 0.5);
+		}
+		else
+		{
+			fitHeight = maxSize;
+			fitWidth = (int)((double)width * maxSize / height + 0.5);
+		}
+		if (fitWidth < 1) fitWidth = 1;
+		if (fitHeight < 1) fitHeight = 1;
+	}
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef INPUTACTIONS_H
+#define INPUTACTIONS_H
+
+// What the keys do, so the render loop asks for an action instead of a key.
+// Every action has a list of keys, and every key triggers at most one action, binding a key again moves it.
+// Include after GLFW/glfw3.h.
+
+#include <vector>
+#include <algorithm>
+
+#include <InputScript.h>
+
+enum InputAction
+{
+	ACTION_QUIT,
+	// the Olaf, moved by the simulation
+	ACTION_OLAF_LEFT,
+	ACTION_OLAF_RIGHT,
+	ACTION_OLAF_BACKWARD,
+	ACTION_OLAF_FORWARD,
+	ACTION_OLAF_TURN_LEFT,
+	ACTION_OLAF_TURN_RIGHT,
+	ACTION_OLAF_RESPAWN,
+	ACTION_OLAF_GROW,
+	ACTION_OLAF_SHRINK,
+	// rendering
+	ACTION_DRAW_LINES,
+	ACTION_DRAW_POINTS,
+	ACTION_TEXTURES,
+	// world and projection
+	ACTION_WORLD_TILT_LEFT,
+	ACTION_WORLD_TILT_RIGHT,
+	ACTION_WORLD_TILT_UP,
+	ACTION_WORLD_TILT_DOWN,
+	ACTION_WORLD_STRETCH,
+	ACTION_PERSPECTIVE,
+	ACTION_ORTHOGRAPHIC,
+	// camera
+	ACTION_CAMERA_STEP_BACK,
+	ACTION_CAMERA_FAST,
+	ACTION_CAMERA_BACKWARD,
+	ACTION_CAMERA_FORWARD,
+	ACTION_CAMERA_LOOK_LEFT,
+	ACTION_CAMERA_LOOK_RIGHT,
+	ACTION_COUNT
+};
+
+class InputActionMap
+{
+public:
+	InputActionMap() : actionOfKey(GLFW_KEY_LAST + 1, -1), keysOfAction(ACTION_COUNT)
+	{
+	}
+
+	// the keys of the assignment
+	static InputActionMap getDefault()
+	{
+		InputActionMap map;
+		map.bind(ACTION_QUIT, GLFW_KEY_ESCAPE);
+		map.bind(ACTION_OLAF_LEFT, GLFW_KEY_A);
+		map.bind(ACTION_OLAF_RIGHT, GLFW_KEY_D);
+		map.bind(ACTION_OLAF_BACKWARD, GLFW_KEY_S);
+		map.bind(ACTION_OLAF_FORWARD, GLFW_KEY_Z);
+		map.bind(ACTION_OLAF_TURN_LEFT, GLFW_KEY_X);
+		map.bind(ACTION_OLAF_TURN_RIGHT, GLFW_KEY_C);
+		map.bind(ACTION_OLAF_RESPAWN, GLFW_KEY_SPACE);
+		map.bind(ACTION_OLAF_GROW, GLFW_KEY_U);
+		map.bind(ACTION_OLAF_SHRINK, GLFW_KEY_I);
+		map.bind(ACTION_DRAW_LINES, GLFW_KEY_L);
+		map.bind(ACTION_DRAW_POINTS, GLFW_KEY_M);
+		map.bind(ACTION_TEXTURES, GLFW_KEY_T);
+		map.bind(ACTION_WORLD_TILT_LEFT, GLFW_KEY_LEFT);
+		map.bind(ACTION_WORLD_TILT_RIGHT, GLFW_KEY_RIGHT);
+		map.bind(ACTION_WORLD_TILT_UP, GLFW_KEY_UP);
+		map.bind(ACTION_WORLD_TILT_DOWN, GLFW_KEY_DOWN);
+		map.bind(ACTION_WORLD_STRETCH, GLFW_KEY_V);
+		map.bind(ACTION_PERSPECTIVE, GLFW_KEY_3);
+		map.bind(ACTION_ORTHOGRAPHIC, GLFW_KEY_4);
+		map.bind(ACTION_CAMERA_STEP_BACK, GLFW_KEY_B);
+		map.bind(ACTION_CAMERA_FAST, GLFW_KEY_LEFT_SHIFT);
+		map.bind(ACTION_CAMERA_FAST, GLFW_KEY_RIGHT_SHIFT);
+		map.bind(ACTION_CAMERA_BACKWARD, GLFW_KEY_H);
+		map.bind(ACTION_CAMERA_FORWARD, GLFW_KEY_Y);
+		map.bind(ACTION_CAMERA_LOOK_LEFT, GLFW_KEY_G);
+		map.bind(ACTION_CAMERA_LOOK_RIGHT, GLFW_KEY_J);
+		return map;
+	}
+
+	void bind(InputAction action, int key)
+	{
+		if (key < 0 || key > GLFW_KEY_LAST)
+			return;
+
+		if (actionOfKey[key] >= 0)
+		{
+			std::vector<int>& previous = keysOfAction[actionOfKey[key]];
+			previous.erase(std::remove(previous.begin(), previous.end(), key), previous.end());
+		}
+		actionOfKey[key] = action;
+		keysOfAction[action].push_back(key);
+	}
+
+	// -1 for a key without action
+	int getAction(int key) const
+	{
+		return key >= 0 && key <= GLFW_KEY_LAST ? actionOfKey[key] : -1;
+	}
+
+	// one of its keys is held, or was pressed since the last frame
+	bool isActive(const InputScript& input, InputAction action) const
+	{
+		const std::vector<int>& keys = keysOfAction[action];
+		for (size_t i = 0; i < keys.size(); i++)
+			if (input.isPressed(keys[i]))
+				return true;
+		return false;
+	}
+
+	// one of its keys went down since the last frame
+	bool wasTriggered(const InputScript& input, InputAction action) const
+	{
+		const std::vector<int>& keys = keysOfAction[action];
+		for (size_t i = 0; i < keys.size(); i++)
+			if (input.wasPressed(keys[i]))
+				return true;
+		return false;
+	}
+
+private:
+	std::vector<int> actionOfKey;
+	std::vector<std::vector<int> > keysOfAction;
+};
+
+#endif
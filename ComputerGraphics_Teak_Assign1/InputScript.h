@@ -0,0 +1,308 @@
+#ifndef INPUTSCRIPT_H
+#define INPUTSCRIPT_H
+
+// Keyboard input of the render loop, either live from GLFW or replayed from a script so benchmark runs are repeatable.
+// Live keys come from a glfwSetKeyCallback: every press and release is queued with its time during glfwPollEvents,
+// and beginFrame() applies the queue to the key bitset. A key pressed and released between two frames still counts as
+// pressed for the frame, and getEvents() hands the events themselves to the simulation, see Simulation.h.
+// A script is a text file, one event per line:
+//   seed <n>                         seed of the random generator (spacebar repositioning)
+//   frames <n>                       length of the run
+//   <frame> <key> down|up            key state from that frame on, keys are GLFW names without GLFW_KEY_ (A, SPACE, LEFT_SHIFT...)
+//   <frame> camera px py pz lx ly lz camera position and look at direction from that frame on
+//   <frame> dt <seconds>             frame time from that frame on, a script without one runs at the fixed frame time
+// Lines starting with # are comments. --record-input writes the live session in the same format, with the frame time
+// of every frame so the camera and the Olaf, which move by the frame time, replay where they went live.
+// Include after GLFW/glfw3.h.
+
+#include <string>
+#include <vector>
+#include <bitset>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <stdlib.h>
+
+#include <glm/glm.hpp>
+
+struct InputScriptEvent
+{
+	int frame;
+	int key;        // -1 for a camera event, -2 for a frame time event
+	bool down;
+	glm::vec3 cameraPosition;
+	glm::vec3 cameraLookAt;
+	float frameTime;
+};
+
+// a key press or release, timed when GLFW reported it
+struct InputEvent
+{
+	std::chrono::steady_clock::time_point time;
+	int key;
+	bool down;
+};
+
+// GLFW_KEY_ names of the keys a script may use, letters and digits are their own character
+inline int getKeyFromName(const std::string& name)
+{
+	if (name.size() == 1 && (isupper(name[0]) || isdigit(name[0])))
+		return name[0];
+
+	static const struct { const char* name; int key; } keys[] = {
+		{ "SPACE", GLFW_KEY_SPACE }, { "ESCAPE", GLFW_KEY_ESCAPE }, { "LEFT", GLFW_KEY_LEFT }, { "RIGHT", GLFW_KEY_RIGHT },
+		{ "UP", GLFW_KEY_UP }, { "DOWN", GLFW_KEY_DOWN }, { "LEFT_SHIFT", GLFW_KEY_LEFT_SHIFT }, { "RIGHT_SHIFT", GLFW_KEY_RIGHT_SHIFT }
+	};
+	for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+		if (name == keys[i].name)
+			return keys[i].key;
+	return -1;
+}
+
+inline std::string getKeyName(int key)
+{
+	if ((key >= GLFW_KEY_A && key <= GLFW_KEY_Z) || (key >= GLFW_KEY_0 && key <= GLFW_KEY_9))
+		return std::string(1, (char)key);
+
+	const char* names[] = { "SPACE", "ESCAPE", "LEFT", "RIGHT", "UP", "DOWN", "LEFT_SHIFT", "RIGHT_SHIFT" };
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		if (getKeyFromName(names[i]) == key)
+			return names[i];
+	return std::string();
+}
+
+class InputScript
+{
+public:
+	InputScript() : window(NULL), replaying(false), seed(0), frameCount(0), frame(-1), nextEvent(0), cameraChanged(false),
+		hasFrameTime(false), frameTime(0.0f)
+	{
+	}
+
+	~InputScript()
+	{
+		if (recording.is_open())
+			recording << "frames " << frame + 1 << "\n";
+	}
+
+	// listens to the key events of the window, the window's user pointer is this script
+	void attach(GLFWwindow* window)
+	{
+		this->window = window;
+		glfwSetWindowUserPointer(window, this);
+		glfwSetKeyCallback(window, keyCallback);
+	}
+
+	bool load(const std::string& filename)
+	{
+		std::ifstream file(filename.c_str());
+		if (!file)
+		{
+			std::cerr << "Error::InputScript could not open script:" << filename << std::endl;
+			return false;
+		}
+
+		events.clear();
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(file, line))
+		{
+			lineNumber++;
+			std::istringstream stream(line);
+			std::string first, second;
+			if (!(stream >> first) || first[0] == '#')
+				continue;
+
+			if (first == "seed")
+				stream >> seed;
+			else if (first == "frames")
+				stream >> frameCount;
+			else
+			{
+				InputScriptEvent event;
+				event.frame = atoi(first.c_str());
+				event.key = -1;
+				event.down = false;
+				event.frameTime = 0.0f;
+				stream >> second;
+				bool valid = true;
+				if (second == "camera")
+				{
+					glm::vec3& p = event.cameraPosition;
+					glm::vec3& l = event.cameraLookAt;
+					valid = (bool)(stream >> p.x >> p.y >> p.z >> l.x >> l.y >> l.z);
+				}
+				else if (second == "dt")
+				{
+					event.key = -2;
+					valid = (bool)(stream >> event.frameTime) && event.frameTime > 0.0f;
+				}
+				else
+				{
+					std::string state;
+					stream >> state;
+					event.key = getKeyFromName(second);
+					event.down = state == "down";
+					valid = event.key >= 0 && (state == "down" || state == "up");
+				}
+
+				if (!valid)
+				{
+					std::cerr << "Error::InputScript " << filename << ":" << lineNumber << " is not an event: " << line << std::endl;
+					return false;
+				}
+				events.push_back(event);
+			}
+		}
+
+		// events of the same frame keep their file order
+		std::stable_sort(events.begin(), events.end(), [](const InputScriptEvent& a, const InputScriptEvent& b) { return a.frame < b.frame; });
+		if (frameCount <= 0)
+			frameCount = events.empty() ? 1 : events.back().frame + 1;
+		replaying = true;
+		return true;
+	}
+
+	// writes every key change and frame time of a live session, with the seed it ran with
+	bool record(const std::string& filename, unsigned int seed)
+	{
+		recording.open(filename.c_str());
+		if (!recording)
+		{
+			std::cerr << "Error::InputScript could not write script:" << filename << std::endl;
+			return false;
+		}
+		recording << "# recorded input, <frame> <key> down|up and <frame> dt <seconds>\n" << "seed " << seed << "\n" << std::setprecision(9);
+		this->seed = seed;
+		return true;
+	}
+
+	// call at the start of each frame, applies (or records) the events of the new frame
+	void beginFrame()
+	{
+		frame++;
+		cameraChanged = false;
+		pressedKeys.reset();
+		frameEvents.clear();
+
+		if (!replaying)
+		{
+			frameEvents.swap(pendingEvents);
+			if (recording.is_open())
+				for (size_t i = 0; i < frameEvents.size(); i++)
+					if (!getKeyName(frameEvents[i].key).empty())
+						recording << frame << " " << getKeyName(frameEvents[i].key) << (frameEvents[i].down ? " down" : " up") << "\n";
+		}
+		else
+		{
+			pendingEvents.clear();
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			for (; nextEvent < events.size() && events[nextEvent].frame <= frame; nextEvent++)
+			{
+				const InputScriptEvent& event = events[nextEvent];
+				if (event.key >= 0)
+				{
+					InputEvent keyEvent = { now, event.key, event.down };
+					frameEvents.push_back(keyEvent);
+				}
+				else if (event.key == -2)
+				{
+					frameTime = event.frameTime;
+					hasFrameTime = true;
+				}
+				else
+				{
+					cameraPosition = event.cameraPosition;
+					cameraLookAt = event.cameraLookAt;
+					cameraChanged = true;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < frameEvents.size(); i++)
+		{
+			keys[frameEvents[i].key] = frameEvents[i].down;
+			if (frameEvents[i].down)
+				pressedKeys[frameEvents[i].key] = true;
+		}
+	}
+
+	// held, or pressed since the last frame
+	bool isPressed(int key) const { return key >= 0 && key <= GLFW_KEY_LAST && (keys[key] || pressedKeys[key]); }
+	// went down since the last frame
+	bool wasPressed(int key) const { return key >= 0 && key <= GLFW_KEY_LAST && pressedKeys[key]; }
+	// the keyboard itself, also while replaying
+	bool isLivePressed(int key) const { return key >= 0 && key <= GLFW_KEY_LAST && liveKeys[key]; }
+
+	// the key presses and releases applied by the last beginFrame, in order
+	const std::vector<InputEvent>& getEvents() const { return frameEvents; }
+
+	// a camera event was applied this frame
+	bool getCamera(glm::vec3& position, glm::vec3& lookAt) const
+	{
+		if (cameraChanged)
+		{
+			position = cameraPosition;
+			lookAt = cameraLookAt;
+		}
+		return cameraChanged;
+	}
+
+	// the frame time of the frame when the script has one, which the replay then runs at instead of the fixed one
+	bool getFrameTime(float& dt) const
+	{
+		if (hasFrameTime)
+			dt = frameTime;
+		return hasFrameTime;
+	}
+
+	// writes the frame time of the live frame when recording
+	void recordFrameTime(float dt)
+	{
+		if (recording.is_open() && !replaying)
+			recording << frame << " dt " << dt << "\n";
+	}
+
+	bool isReplaying() const { return replaying; }
+	bool isDone() const { return replaying && frame + 1 >= frameCount; }
+	unsigned int getSeed() const { return seed; }
+	int getFrameCount() const { return frameCount; }
+	int getFrame() const { return frame; }
+
+private:
+	static void keyCallback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/)
+	{
+		InputScript* input = (InputScript*)glfwGetWindowUserPointer(window);
+		if (input == NULL || key < 0 || key > GLFW_KEY_LAST || action == GLFW_REPEAT)
+			return;
+
+		InputEvent event = { std::chrono::steady_clock::now(), key, action == GLFW_PRESS };
+		input->liveKeys[key] = event.down;
+		input->pendingEvents.push_back(event);
+	}
+
+	GLFWwindow* window;
+	bool replaying;
+	unsigned int seed;
+	int frameCount;
+	int frame;
+	std::vector<InputScriptEvent> events;
+	size_t nextEvent;
+	std::bitset<GLFW_KEY_LAST + 1> keys;          // of the frame, live or replayed
+	std::bitset<GLFW_KEY_LAST + 1> pressedKeys;   // went down during the frame
+	std::bitset<GLFW_KEY_LAST + 1> liveKeys;
+	std::vector<InputEvent> pendingEvents;        // since the last beginFrame, live only
+	std::vector<InputEvent> frameEvents;
+	bool cameraChanged;
+	glm::vec3 cameraPosition;
+	glm::vec3 cameraLookAt;
+	bool hasFrameTime;
+	float frameTime;
+	std::ofstream recording;
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+// Small pool of worker threads shared by the CPU side systems (texture processing, streaming, particles...).
+// submit() queues a job, parallelFor() splits a range over the workers and the calling thread.
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+
+#include <Profiler.h>
+
+class JobSystem
+{
+public:
+	// threadCount = 0 uses one worker per hardware thread, minus the calling thread
+	explicit JobSystem(int threadCount = 0) : stopping(false), pendingJobs(0)
+	{
+		if (threadCount <= 0)
+		{
+			threadCount = (int)std::thread::hardware_concurrency() - 1;
+			if (threadCount < 1)
+				threadCount = 1;
+		}
+
+		for (int i = 0; i < threadCount; i++)
+			workers.push_back(std::thread(&JobSystem::workerLoop, this));
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		queueCondition.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	// pool used by default by everything that does not need its own
+	static JobSystem& shared()
+	{
+		static JobSystem jobs;
+		return jobs;
+	}
+
+	void submit(const std::function<void()>& job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			jobs.push_back(job);
+			pendingJobs++;
+		}
+		queueCondition.notify_one();
+	}
+
+	// waits for every submitted job, the caller helps running them
+	void wait()
+	{
+		while (true)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				if (pendingJobs == 0)
+					return;
+				if (jobs.empty())
+				{
+					doneCondition.wait(lock);
+					continue;
+				}
+				job = jobs.front();
+				jobs.pop_front();
+			}
+			run(job);
+		}
+	}
+
+	// calls body(begin, end) on chunks of [0, count) of at most grain items, returns when all of them are done
+	void parallelFor(int count, const std::function<void(int, int)>& body, int grain = 1)
+	{
+		if (count <= 0)
+			return;
+		if (grain < 1)
+			grain = 1;
+
+		int chunkCount = (count + grain - 1) / grain;
+		if (chunkCount == 1 || workers.empty())
+		{
+			body(0, count);
+			return;
+		}
+
+		// shared with the helper jobs, which may start after this call returned
+		std::shared_ptr<ParallelForState> state(new ParallelForState());
+		state->body = body;
+		state->count = count;
+		state->grain = grain;
+		state->chunkCount = chunkCount;
+		state->nextChunk = 0;
+		state->doneChunks = 0;
+
+		int helpers = chunkCount - 1 < (int)workers.size() ? chunkCount - 1 : (int)workers.size();
+		for (int i = 0; i < helpers; i++)
+			submit([state]() { runChunks(*state); });
+
+		runChunks(*state);
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		while (state->doneChunks < chunkCount)
+			state->condition.wait(lock);
+	}
+
+	int getThreadCount() const { return (int)workers.size(); }
+
+private:
+	struct ParallelForState
+	{
+		std::function<void(int, int)> body;
+		int count;
+		int grain;
+		int chunkCount;
+		std::atomic<int> nextChunk;
+		int doneChunks;
+		std::mutex mutex;
+		std::condition_variable condition;
+	};
+
+	static void runChunks(ParallelForState& state)
+	{
+		int done = 0;
+		for (int chunk = state.nextChunk++; chunk < state.chunkCount; chunk = state.nextChunk++)
+		{
+			int begin = chunk * state.grain;
+			int end = begin + state.grain < state.count ? begin + state.grain : state.count;
+			state.body(begin, end);
+			done++;
+		}
+
+		if (done > 0)
+		{
+			std::lock_guard<std::mutex> lock(state.mutex);
+			state.doneChunks += done;
+			if (state.doneChunks == state.chunkCount)
+				state.condition.notify_all();
+		}
+	}
+
+	void run(const std::function<void()>& job)
+	{
+		job();
+
+		std::lock_guard<std::mutex> lock(queueMutex);
+		pendingJobs--;
+		if (pendingJobs == 0)
+			doneCondition.notify_all();
+	}
+
+	void workerLoop()
+	{
+		Profiler::get().setThreadName("Job worker");
+		while (true)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				while (!stopping && jobs.empty())
+					queueCondition.wait(lock);
+				if (stopping && jobs.empty())
+					return;
+				job = jobs.front();
+				jobs.pop_front();
+			}
+			run(job);
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > jobs;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	std::condition_variable doneCondition;
+	bool stopping;
+	int pendingJobs;
+};
+
+#endif
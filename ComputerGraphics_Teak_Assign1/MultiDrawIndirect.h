@@ -0,0 +1,128 @@
+#ifndef MULTIDRAWINDIRECT_H
+#define MULTIDRAWINDIRECT_H
+
+// Submits the sorted render queue with glMultiDrawElementsIndirect, one call per run of draws sharing a shader
+// variant, a vertex array and a primitive mode. The draw commands and the per draw data (DrawBlock: world matrix,
+// color, texture layer) are written into the FrameRingBuffer, the data bound as a shader storage range read by the
+// SHADER_INDIRECT variants through drawBase + gl_DrawIDARB. Materials only differ by their data, so they do not split the calls.
+// Needs GL 4.3 (or the multi draw indirect and shader storage extensions) and ARB_shader_draw_parameters.
+// Include after GL/glew.h, ShaderPermutations.h, RenderQueue.h, FrameBenchmark.h and FrameRingBuffer.h.
+
+#include <vector>
+#include <iostream>
+
+#include <glm/glm.hpp>
+
+// layout fixed by GL
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// draws of one multi draw call
+struct IndirectDrawGroup
+{
+	const DrawCommand* command;   // first draw of the group, its state is the state of the group
+	GLsizei firstDraw;
+	GLsizei drawCount;
+	long long indexCount;
+};
+
+class MultiDrawIndirect
+{
+public:
+	MultiDrawIndirect() : enabled(false)
+	{
+		commands.data = NULL;
+		draws.data = NULL;
+	}
+
+	static bool isSupported()
+	{
+		return (GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_storage_buffer_object))
+			&& GLEW_ARB_shader_draw_parameters;
+	}
+
+	// needs the context to be current
+	bool create()
+	{
+		enabled = isSupported();
+		if (!enabled)
+			std::cerr << "Error::MultiDrawIndirect needs GL 4.3 and ARB_shader_draw_parameters, drawing one call per object" << std::endl;
+		return enabled;
+	}
+
+	bool isEnabled() const { return enabled; }
+
+	// groups the sorted queue into multi draw calls and writes their commands and draw data for this frame
+	void build(const RenderQueue& queue, FrameRingBuffer& frameData)
+	{
+		groups.clear();
+		size_t count = queue.getSize();
+		if (count == 0)
+			return;
+		commands = frameData.allocate(count * sizeof(DrawElementsIndirectCommand));
+		draws = frameData.allocate(count * sizeof(DrawBlock));
+		if (commands.data == NULL || draws.data == NULL)
+			return;
+
+		// the ring may be write combined memory, written in order and never read
+		DrawElementsIndirectCommand* commandData = (DrawElementsIndirectCommand*)commands.data;
+		DrawBlock* drawData = (DrawBlock*)draws.data;
+		const std::vector<RenderQueueItem>& items = queue.getItems();
+		for (size_t i = 0; i < count; i++)
+		{
+			const DrawCommand& command = queue.getCommand(items[i]);
+			if (groups.empty() || !isSameState(*groups.back().command, command))
+			{
+				IndirectDrawGroup group = { &command, (GLsizei)i, 0, 0 };
+				groups.push_back(group);
+			}
+			groups.back().drawCount++;
+			groups.back().indexCount += command.indexCount;
+
+			DrawElementsIndirectCommand indirect = { (GLuint)command.indexCount, 1, command.firstIndex, command.baseVertex, (GLuint)i };
+			commandData[i] = indirect;
+			DrawBlock block = { command.worldMatrix, glm::vec4(command.color, command.textureLayer) };
+			drawData[i] = block;
+		}
+	}
+
+	// for every group, bind(group) sets the program (and its drawBase), the vertex array, then the group is drawn in one call.
+	// the frame data has to be flushed first
+	template <class Binder>
+	void execute(Binder& bind, const FrameRingBuffer& frameData) const
+	{
+		if (groups.empty())
+			return;
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, frameData.getBuffer());
+		frameData.bindRange(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, draws);
+		for (size_t i = 0; i < groups.size(); i++)
+		{
+			const IndirectDrawGroup& group = groups[i];
+			bind(group);
+			multiDrawElementsIndirect(group.command->mode, commands.offset + group.firstDraw * sizeof(DrawElementsIndirectCommand), group.drawCount, group.indexCount);
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	size_t getGroupCount() const { return groups.size(); }
+
+private:
+	static bool isSameState(const DrawCommand& a, const DrawCommand& b)
+	{
+		return a.features == b.features && a.vertexArray == b.vertexArray && a.mode == b.mode;
+	}
+
+	bool enabled;
+	RingAllocation commands;
+	RingAllocation draws;
+	std::vector<IndirectDrawGroup> groups;
+};
+
+#endif
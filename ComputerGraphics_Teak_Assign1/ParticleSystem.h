@@ -0,0 +1,499 @@
+#ifndef PARTICLESYSTEM_H
+#define PARTICLESYSTEM_H
+
+// CPU particles, for the effects that do not need the GPU to simulate them (sparkles, footprints) and for snow on
+// contexts without transform feedback.
+// A ParticleSystem keeps positions, velocities, ages, lifetimes and sizes in separate 64 byte aligned arrays and steps
+// them with a scalar, an SSE2 or an AVX2 loop (picked like ImageResize does), split over the JobSystem.
+// The live particles are always [0, count): spawning appends, the particles dying in a step are collected by the
+// update and removed afterwards by moving the last live particle into their slot, so the free slots stay one block
+// at the end and no loop ever skips dead particles.
+// ParticleRenderer draws a system as camera facing quads, one instance per particle from a streamed instance buffer.
+// Include after GL/glew.h.
+
+#include <string>
+#include <vector>
+#include <random>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+#include <AlignedArray.h>
+#include <ImageResize.h>
+#include <JobSystem.h>
+#include <FrameBenchmark.h>
+#include <ShaderPermutations.h>
+#include <shaderloader.h>
+
+enum ParticlePath
+{
+	PARTICLES_SCALAR,
+	PARTICLES_SSE2,
+	PARTICLES_AVX2
+};
+
+struct ParticleSettings
+{
+	int capacity;
+	glm::vec3 gravity;
+	float drag;            // per second
+	float groundHeight;    // particles stop on the ground and stay until their lifetime is over
+	glm::vec3 color;
+	unsigned int seed;
+
+	ParticleSettings()
+		: capacity(65536), gravity(0.0f, -9.8f, 0.0f), drag(0.0f), groundHeight(-0.02f), color(1.0f), seed(1)
+	{
+	}
+};
+
+// where and how a batch of particles starts, each value is picked uniformly in [value - spread, value + spread]
+struct ParticleSpawn
+{
+	glm::vec3 position;
+	glm::vec3 positionSpread;
+	glm::vec3 velocity;
+	glm::vec3 velocitySpread;
+	float lifetime;
+	float lifetimeSpread;
+	float size;
+	float sizeSpread;
+
+	ParticleSpawn()
+		: position(0.0f), positionSpread(0.0f), velocity(0.0f), velocitySpread(0.0f), lifetime(1.0f), lifetimeSpread(0.0f),
+		size(0.05f), sizeSpread(0.0f)
+	{
+	}
+};
+
+// what ParticleRenderer reads per instance
+struct ParticleInstance
+{
+	glm::vec4 positionSize;
+	glm::vec4 color;   // alpha fades out over the lifetime
+};
+
+class ParticleSystem
+{
+public:
+	// updates split over the jobs in chunks of this many particles, a multiple of every SIMD width
+	static const int CHUNK_SIZE = 16384;
+
+	explicit ParticleSystem(const ParticleSettings& particleSettings = ParticleSettings())
+		: settings(particleSettings), count(0), random(particleSettings.seed), spawned(0), killed(0), dropped(0)
+	{
+		AlignedArray<float>* arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &age, &lifetime, &size };
+		for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
+			arrays[i]->resize(settings.capacity);
+	}
+
+	// appends up to n particles, returns how many fit
+	int emit(int n, const ParticleSpawn& spawn)
+	{
+		int fitting = std::min(n, settings.capacity - count);
+		dropped += n - fitting;
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		for (int k = 0; k < fitting; k++)
+		{
+			int i = count++;
+			px[i] = spawn.position.x + unit(random) * spawn.positionSpread.x;
+			py[i] = spawn.position.y + unit(random) * spawn.positionSpread.y;
+			pz[i] = spawn.position.z + unit(random) * spawn.positionSpread.z;
+			vx[i] = spawn.velocity.x + unit(random) * spawn.velocitySpread.x;
+			vy[i] = spawn.velocity.y + unit(random) * spawn.velocitySpread.y;
+			vz[i] = spawn.velocity.z + unit(random) * spawn.velocitySpread.z;
+			age[i] = 0.0f;
+			lifetime[i] = std::max(0.001f, spawn.lifetime + unit(random) * spawn.lifetimeSpread);
+			size[i] = std::max(0.0f, spawn.size + unit(random) * spawn.sizeSpread);
+		}
+		spawned += fitting;
+		return fitting;
+	}
+
+	// one step of every particle, then the dead ones are removed
+	void update(float dt, ParticlePath path = getBestPath(), JobSystem* jobs = &JobSystem::shared())
+	{
+		PROFILE_SCOPE(updateScope, "Particles update");
+		int chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		if ((int)deaths.size() < chunkCount)
+			deaths.resize(chunkCount);
+
+		std::function<void(int, int)> body = [this, dt, path](int begin, int end) {
+			std::vector<int>& dead = deaths[begin / CHUNK_SIZE];
+			dead.clear();
+			updateRange(dt, path, begin, end, dead);
+		};
+		if (jobs != NULL)
+			jobs->parallelFor(count, body, CHUNK_SIZE);
+		else
+			body(0, count);
+
+		// the chunks hold their deaths in increasing order, so going through the chunks backwards removes the highest
+		// index first, and the last live particle moved into a slot is never one still to be removed
+		for (int chunk = chunkCount - 1; chunk >= 0; chunk--)
+		{
+			std::vector<int>& dead = deaths[chunk];
+			for (int k = (int)dead.size() - 1; k >= 0; k--)
+				remove(dead[k]);
+			dead.clear();
+		}
+	}
+
+	// the live particles as instances, alpha fading out over the last third of the lifetime
+	void fillInstances(ParticleInstance* instances, JobSystem* jobs = &JobSystem::shared()) const
+	{
+		std::function<void(int, int)> body = [this, instances](int begin, int end) {
+			for (int i = begin; i < end; i++)
+			{
+				float fade = std::min(1.0f, 3.0f * (1.0f - age[i] / lifetime[i]));
+				instances[i].positionSize = glm::vec4(px[i], py[i], pz[i], size[i]);
+				instances[i].color = glm::vec4(settings.color, fade);
+			}
+		};
+		if (jobs != NULL)
+			jobs->parallelFor(count, body, CHUNK_SIZE);
+		else
+			body(0, count);
+	}
+
+	void clear() { count = 0; }
+	int getCount() const { return count; }
+	int getCapacity() const { return settings.capacity; }
+
+	static bool isPathSupported(ParticlePath path)
+	{
+		return ImageResize::isPathSupported(path == PARTICLES_AVX2 ? RESIZE_AVX2 : (path == PARTICLES_SSE2 ? RESIZE_SSE2 : RESIZE_SCALAR));
+	}
+
+	static ParticlePath getBestPath()
+	{
+		static const ParticlePath best = isPathSupported(PARTICLES_AVX2) ? PARTICLES_AVX2 : (isPathSupported(PARTICLES_SSE2) ? PARTICLES_SSE2 : PARTICLES_SCALAR);
+		return best;
+	}
+
+	static const char* getPathName(ParticlePath path)
+	{
+		return path == PARTICLES_AVX2 ? "AVX2" : (path == PARTICLES_SSE2 ? "SSE2" : "scalar");
+	}
+
+	void printStats(const char* name) const
+	{
+		std::cout << "Particles " << name << " : " << count << " / " << settings.capacity << " live, " << spawned << " spawned, "
+			<< killed << " died, " << dropped << " dropped for lack of space" << std::endl;
+	}
+
+	AlignedArray<float> px, py, pz;
+	AlignedArray<float> vx, vy, vz;
+	AlignedArray<float> age, lifetime;
+	AlignedArray<float> size;
+
+private:
+	void remove(int i)
+	{
+		int last = --count;
+		killed++;
+		if (i == last)
+			return;
+		px[i] = px[last];
+		py[i] = py[last];
+		pz[i] = pz[last];
+		vx[i] = vx[last];
+		vy[i] = vy[last];
+		vz[i] = vz[last];
+		age[i] = age[last];
+		lifetime[i] = lifetime[last];
+		size[i] = size[last];
+	}
+
+	void updateRange(float dt, ParticlePath path, int begin, int end, std::vector<int>& dead)
+	{
+#if defined(IMAGERESIZE_X86)
+		if (path == PARTICLES_AVX2)
+			begin = updateAVX2(dt, begin, end, dead);
+		else if (path == PARTICLES_SSE2)
+			begin = updateSSE2(dt, begin, end, dead);
+#endif
+		updateScalar(dt, begin, end, dead);
+	}
+
+	void updateScalar(float dt, int begin, int end, std::vector<int>& dead)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			vx[i] += (settings.gravity.x - vx[i] * settings.drag) * dt;
+			vy[i] += (settings.gravity.y - vy[i] * settings.drag) * dt;
+			vz[i] += (settings.gravity.z - vz[i] * settings.drag) * dt;
+			px[i] += vx[i] * dt;
+			py[i] += vy[i] * dt;
+			pz[i] += vz[i] * dt;
+			if (py[i] < settings.groundHeight)
+			{
+				py[i] = settings.groundHeight;
+				vx[i] = vy[i] = vz[i] = 0.0f;
+			}
+			age[i] += dt;
+			if (age[i] >= lifetime[i])
+				dead.push_back(i);
+		}
+	}
+
+#if defined(IMAGERESIZE_X86)
+	// four particles per register, returns where the scalar loop takes over
+	IMAGERESIZE_SSE2_TARGET int updateSSE2(float dt, int begin, int end, std::vector<int>& dead)
+	{
+		const __m128 step = _mm_set1_ps(dt);
+		const __m128 gravityX = _mm_set1_ps(settings.gravity.x), gravityY = _mm_set1_ps(settings.gravity.y), gravityZ = _mm_set1_ps(settings.gravity.z);
+		const __m128 drag = _mm_set1_ps(settings.drag);
+		const __m128 ground = _mm_set1_ps(settings.groundHeight);
+
+		int i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 x = _mm_load_ps(&vx[i]), y = _mm_load_ps(&vy[i]), z = _mm_load_ps(&vz[i]);
+			x = _mm_add_ps(x, _mm_mul_ps(_mm_sub_ps(gravityX, _mm_mul_ps(x, drag)), step));
+			y = _mm_add_ps(y, _mm_mul_ps(_mm_sub_ps(gravityY, _mm_mul_ps(y, drag)), step));
+			z = _mm_add_ps(z, _mm_mul_ps(_mm_sub_ps(gravityZ, _mm_mul_ps(z, drag)), step));
+			__m128 positionY = _mm_add_ps(_mm_load_ps(&py[i]), _mm_mul_ps(y, step));
+
+			// on the ground: held at its height, no velocity
+			__m128 grounded = _mm_cmplt_ps(positionY, ground);
+			positionY = _mm_or_ps(_mm_and_ps(grounded, ground), _mm_andnot_ps(grounded, positionY));
+			_mm_store_ps(&px[i], _mm_add_ps(_mm_load_ps(&px[i]), _mm_mul_ps(x, step)));
+			_mm_store_ps(&py[i], positionY);
+			_mm_store_ps(&pz[i], _mm_add_ps(_mm_load_ps(&pz[i]), _mm_mul_ps(z, step)));
+			_mm_store_ps(&vx[i], _mm_andnot_ps(grounded, x));
+			_mm_store_ps(&vy[i], _mm_andnot_ps(grounded, y));
+			_mm_store_ps(&vz[i], _mm_andnot_ps(grounded, z));
+
+			__m128 ages = _mm_add_ps(_mm_load_ps(&age[i]), step);
+			_mm_store_ps(&age[i], ages);
+			for (int expired = _mm_movemask_ps(_mm_cmpge_ps(ages, _mm_load_ps(&lifetime[i]))); expired != 0; expired &= expired - 1)
+				dead.push_back(i + lowestBit(expired));
+		}
+		return i;
+	}
+
+	// eight particles per register, returns where the scalar loop takes over
+	IMAGERESIZE_AVX2_TARGET int updateAVX2(float dt, int begin, int end, std::vector<int>& dead)
+	{
+		const __m256 step = _mm256_set1_ps(dt);
+		const __m256 gravityX = _mm256_set1_ps(settings.gravity.x), gravityY = _mm256_set1_ps(settings.gravity.y), gravityZ = _mm256_set1_ps(settings.gravity.z);
+		const __m256 drag = _mm256_set1_ps(settings.drag);
+		const __m256 ground = _mm256_set1_ps(settings.groundHeight);
+
+		int i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 x = _mm256_load_ps(&vx[i]), y = _mm256_load_ps(&vy[i]), z = _mm256_load_ps(&vz[i]);
+			x = _mm256_add_ps(x, _mm256_mul_ps(_mm256_sub_ps(gravityX, _mm256_mul_ps(x, drag)), step));
+			y = _mm256_add_ps(y, _mm256_mul_ps(_mm256_sub_ps(gravityY, _mm256_mul_ps(y, drag)), step));
+			z = _mm256_add_ps(z, _mm256_mul_ps(_mm256_sub_ps(gravityZ, _mm256_mul_ps(z, drag)), step));
+			__m256 positionY = _mm256_add_ps(_mm256_load_ps(&py[i]), _mm256_mul_ps(y, step));
+
+			__m256 grounded = _mm256_cmp_ps(positionY, ground, _CMP_LT_OQ);
+			_mm256_store_ps(&px[i], _mm256_add_ps(_mm256_load_ps(&px[i]), _mm256_mul_ps(x, step)));
+			_mm256_store_ps(&py[i], _mm256_blendv_ps(positionY, ground, grounded));
+			_mm256_store_ps(&pz[i], _mm256_add_ps(_mm256_load_ps(&pz[i]), _mm256_mul_ps(z, step)));
+			_mm256_store_ps(&vx[i], _mm256_andnot_ps(grounded, x));
+			_mm256_store_ps(&vy[i], _mm256_andnot_ps(grounded, y));
+			_mm256_store_ps(&vz[i], _mm256_andnot_ps(grounded, z));
+
+			__m256 ages = _mm256_add_ps(_mm256_load_ps(&age[i]), step);
+			_mm256_store_ps(&age[i], ages);
+			for (int expired = _mm256_movemask_ps(_mm256_cmp_ps(ages, _mm256_load_ps(&lifetime[i]), _CMP_GE_OQ)); expired != 0; expired &= expired - 1)
+				dead.push_back(i + lowestBit(expired));
+		}
+		return i;
+	}
+
+	static int lowestBit(int mask)
+	{
+		int bit = 0;
+		while ((mask & (1 << bit)) == 0)
+			bit++;
+		return bit;
+	}
+#endif
+
+	ParticleSettings settings;
+	int count;
+	std::mt19937 random;
+	std::vector<std::vector<int> > deaths;   // per chunk of the last update
+	long long spawned;
+	long long killed;
+	long long dropped;
+};
+
+// draws particle systems as camera facing quads, the instance buffer is orphaned and refilled every draw
+class ParticleRenderer
+{
+public:
+	ParticleRenderer() : shaders(NULL), program(0), vertexArray(0), instanceBuffer(0), instanceCapacity(0)
+	{
+	}
+
+	~ParticleRenderer()
+	{
+		release();
+	}
+
+	// needs the context to be current, the program finishes building on the first draw
+	bool create(ShaderBatch& shaderBatch, const std::string& shaderPathPrefix)
+	{
+		program = shaderBatch.submit(shaderPathPrefix + "particle_vertex.glsl", shaderPathPrefix + "particle_fragment.glsl");
+		if (program == 0)
+		{
+			std::cerr << "Error::ParticleRenderer could not load the particle shaders" << std::endl;
+			return false;
+		}
+		shaders = &shaderBatch;
+
+		glGenVertexArrays(1, &vertexArray);
+		glGenBuffers(1, &instanceBuffer);
+		bindVertexArray(vertexArray);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (GLvoid*)offsetof(ParticleInstance, positionSize));
+		glEnableVertexAttribArray(0);
+		glVertexAttribDivisor(0, 1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (GLvoid*)offsetof(ParticleInstance, color));
+		glEnableVertexAttribArray(1);
+		glVertexAttribDivisor(1, 1);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		bindVertexArray(0);
+		return true;
+	}
+
+	// deletes the buffer and the program, call before the GL context goes away
+	void release()
+	{
+		if (vertexArray != 0)
+		{
+			glDeleteVertexArrays(1, &vertexArray);
+			GLStateCache::get().invalidateVertexArray();
+		}
+		if (instanceBuffer != 0)
+			glDeleteBuffers(1, &instanceBuffer);
+		if (program != 0)
+		{
+			glDeleteProgram(program);
+			GLStateCache::get().invalidateProgram();
+		}
+		vertexArray = 0;
+		instanceBuffer = 0;
+		program = 0;
+		shaders = NULL;
+	}
+
+	bool isCreated() const { return program != 0; }
+
+	// blended over the scene without writing depth, reads the SceneBlock bound by the render queue
+	void draw(const ParticleSystem& system)
+	{
+		int count = system.getCount();
+		if (program == 0 || count == 0)
+			return;
+
+		if (shaders != NULL)
+		{
+			shaders->resolve(program);
+			GLuint block = glGetUniformBlockIndex(program, "SceneBlock");
+			if (block != GL_INVALID_INDEX)
+				glUniformBlockBinding(program, block, SCENE_BLOCK_BINDING);
+			shaders = NULL;
+		}
+
+		instances.resize(std::max((size_t)count, instances.size()));
+		system.fillInstances(&instances[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		if ((size_t)count > instanceCapacity)
+			instanceCapacity = std::max((size_t)count, instanceCapacity * 2);
+		glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(ParticleInstance), &instances[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		useProgram(program);
+		bindVertexArray(vertexArray);
+		GLStateCache::get().enable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDepthMask(GL_FALSE);
+		drawArraysInstanced(GL_TRIANGLE_STRIP, 4, count);
+		glDepthMask(GL_TRUE);
+		GLStateCache::get().disable(GL_BLEND);
+	}
+
+private:
+	ShaderBatch* shaders;   // until the program is resolved
+	GLuint program;
+	GLuint vertexArray;
+	GLuint instanceBuffer;
+	size_t instanceCapacity;
+	std::vector<ParticleInstance> instances;
+};
+
+// particles per millisecond of every path over 1, 2, 4... threads, --bench-particles [particles] [steps]
+inline int benchmarkParticles(int particleCount, int steps)
+{
+	ParticleSettings settings;
+	settings.capacity = particleCount;
+	settings.drag = 0.5f;
+	settings.groundHeight = -1e30f;   // nothing lands, every particle is stepped in full
+	ParticleSpawn spawn;
+	spawn.positionSpread = glm::vec3(10.0f);
+	spawn.velocitySpread = glm::vec3(2.0f);
+	spawn.lifetime = 1e30f;
+
+	int hardwareThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	std::cout << "Particle benchmark, " << particleCount << " particles, " << steps << " steps, " << hardwareThreads << " hardware threads" << std::endl;
+
+	ParticlePath paths[] = { PARTICLES_SCALAR, PARTICLES_SSE2, PARTICLES_AVX2 };
+	for (int p = 0; p < 3; p++)
+	{
+		if (!ParticleSystem::isPathSupported(paths[p]))
+		{
+			std::cout << ParticleSystem::getPathName(paths[p]) << " : not supported" << std::endl;
+			continue;
+		}
+
+		for (int threads = 1; threads <= hardwareThreads; threads = threads < hardwareThreads ? std::min(threads * 2, hardwareThreads) : threads + 1)
+		{
+			// the calling thread works too, so a pool of threads - 1 workers
+			std::unique_ptr<JobSystem> jobs(threads > 1 ? new JobSystem(threads - 1) : NULL);
+			ParticleSystem system(settings);
+			system.emit(particleCount, spawn);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int i = 0; i < steps; i++)
+				system.update(1.0f / 60.0f, paths[p], jobs.get());
+			double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			std::cout << std::fixed << std::setprecision(3) << ParticleSystem::getPathName(paths[p]) << ", " << threads << " threads : "
+				<< elapsed / steps << " ms per step, " << std::setprecision(0) << particleCount * (double)steps / elapsed << " particles per ms" << std::endl;
+		}
+	}
+
+	// the compaction, half the particles die in one step
+	ParticleSystem system(settings);
+	ParticleSpawn shortLived = spawn;
+	shortLived.lifetime = 0.01f;
+	system.emit(particleCount / 2, spawn);
+	system.emit(particleCount - particleCount / 2, shortLived);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	system.update(1.0f / 60.0f);
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << std::setprecision(3) << "Step removing half the particles : " << elapsed << " ms, " << system.getCount() << " left" << std::endl;
+	if (system.getCount() != particleCount / 2)
+	{
+		std::cerr << "Error::ParticleSystem " << system.getCount() << " particles left instead of " << particleCount / 2 << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+#endif
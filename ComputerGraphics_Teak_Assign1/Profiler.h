@@ -0,0 +1,304 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Hierarchical CPU (and GPU, see GpuProfiler.h) profiler exporting a Chrome trace (chrome://tracing or ui.perfetto.dev).
+// PROFILE_SCOPE(var, "name") times the code up to the end of the enclosing block, or up to PROFILE_NEXT(var, "other name")
+// which closes it and opens the next section. Scopes nest, the trace viewer rebuilds the hierarchy from the times.
+// Every thread records into its own ring, a single producer / single consumer queue, so recording takes no lock.
+// The main thread drains the rings once per frame. While disabled at run time a scope costs one branch, defining
+// PROFILER_DISABLED compiles the markers out.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <stdint.h>
+
+struct ProfileEvent
+{
+	const char* name;   // string literal, only the pointer is stored
+	int64_t start;      // nanoseconds since the profiler started
+	int64_t end;
+	int track;          // thread (or GPU) the event ran on
+};
+
+// events of one thread, written by that thread and read by the main thread
+class ProfilerRing
+{
+public:
+	explicit ProfilerRing(int track) : track(track), head(0), tail(0), dropped(0)
+	{
+	}
+
+	// drops the event if the main thread did not drain the ring in time
+	void push(const char* name, int64_t start, int64_t end)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == CAPACITY)
+		{
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		ProfileEvent& event = events[h & (CAPACITY - 1)];
+		event.name = name;
+		event.start = start;
+		event.end = end;
+		event.track = track;
+		head.store(h + 1, std::memory_order_release);
+	}
+
+	void drain(std::vector<ProfileEvent>& out, size_t maxEvents)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t h = head.load(std::memory_order_acquire);
+		for (; t != h; t++)
+		{
+			if (out.size() < maxEvents)
+				out.push_back(events[t & (CAPACITY - 1)]);
+			else
+				dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+		tail.store(t, std::memory_order_release);
+	}
+
+	int getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+	static const size_t CAPACITY = 4096;   // power of two
+
+	int track;
+	ProfileEvent events[CAPACITY];
+	std::atomic<size_t> head;   // next event written
+	std::atomic<size_t> tail;   // next event read
+	std::atomic<int> dropped;
+};
+
+// hook timing the outermost GPU scopes, set by GpuProfiler
+class ProfilerGpuTimer
+{
+public:
+	virtual ~ProfilerGpuTimer() {}
+	// returns false if the scope is not timed (nested in another one, or out of queries)
+	virtual bool begin(const char* name, int64_t cpuStart) = 0;
+	virtual void end() = 0;
+};
+
+class Profiler
+{
+public:
+	static Profiler& get()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	static bool isEnabled()
+	{
+		return get().enabled.load(std::memory_order_relaxed);
+	}
+
+	void setEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+
+	// nanoseconds since the profiler started
+	int64_t now() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	void record(const char* name, int64_t start, int64_t end)
+	{
+		getThreadRing().push(name, start, end);
+	}
+
+	// name of the calling thread in the trace, the thread gets its ring when it first records an event
+	void setThreadName(const std::string& name)
+	{
+		getThreadName() = name;
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		for (size_t i = 0; i < rings.size(); i++)
+			if (rings[i].get() == getThreadRingPointer())
+				trackNames[i] = name;
+	}
+
+	// main thread only, adds an event measured elsewhere (the GPU track)
+	void addEvent(const char* name, int64_t start, int64_t end, int track)
+	{
+		ProfileEvent event = { name, start, end, track };
+		if (events.size() < maxEvents)
+			events.push_back(event);
+	}
+
+	// main thread, once per frame: moves what the threads recorded out of their rings
+	void collect()
+	{
+		if (!isEnabled())
+			return;
+
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		for (size_t i = 0; i < rings.size(); i++)
+			rings[i]->drain(events, maxEvents);
+	}
+
+	void setGpuTimer(ProfilerGpuTimer* timer) { gpuTimer = timer; }
+	ProfilerGpuTimer* getGpuTimer() const { return gpuTimer; }
+
+	// events kept for the trace, later ones are dropped
+	void setMaxEvents(size_t count) { maxEvents = count; }
+
+	bool writeTrace(const std::string& filename)
+	{
+		collect();
+		std::ofstream file(filename.c_str());
+		if (!file)
+		{
+			std::cerr << "Error::Profiler could not write trace:" << filename << std::endl;
+			return false;
+		}
+
+		int dropped = 0;
+		file << std::fixed << std::setprecision(3);
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		writeTrackName(file, GPU_TRACK, "GPU");
+		{
+			std::lock_guard<std::mutex> lock(ringsMutex);
+			for (size_t i = 0; i < rings.size(); i++)
+			{
+				dropped += rings[i]->getDropped();
+				file << ",\n";
+				writeTrackName(file, (int)i, trackNames[i]);
+			}
+		}
+
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			const ProfileEvent& event = events[i];
+			file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track
+				<< ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+		}
+		file << "\n]}\n";
+
+		std::cout << "Profiler : " << events.size() << " events written to " << filename;
+		if (dropped > 0)
+			std::cout << ", " << dropped << " dropped";
+		std::cout << std::endl;
+		return true;
+	}
+
+	// track id of the GPU events in the trace
+	static const int GPU_TRACK = 1000;
+
+private:
+	Profiler() : enabled(false), epoch(std::chrono::steady_clock::now()), gpuTimer(NULL), maxEvents(1024 * 1024)
+	{
+	}
+
+	// the ring of the calling thread, registered the first time the thread records an event
+	ProfilerRing& getThreadRing()
+	{
+		ProfilerRing*& ring = getThreadRingPointer();
+		if (ring == NULL)
+		{
+			std::lock_guard<std::mutex> lock(ringsMutex);
+			rings.push_back(std::unique_ptr<ProfilerRing>(new ProfilerRing((int)rings.size())));
+			trackNames.push_back(getThreadName().empty() ? "Thread " + std::to_string(rings.size() - 1) : getThreadName());
+			ring = rings.back().get();
+		}
+		return *ring;
+	}
+
+	static ProfilerRing*& getThreadRingPointer()
+	{
+		static thread_local ProfilerRing* ring = NULL;
+		return ring;
+	}
+
+	static std::string& getThreadName()
+	{
+		static thread_local std::string name;
+		return name;
+	}
+
+	static void writeTrackName(std::ofstream& file, int track, const std::string& name)
+	{
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"args\":{\"name\":\"" << name << "\"}}";
+	}
+
+	std::atomic<bool> enabled;
+	std::chrono::steady_clock::time_point epoch;
+	ProfilerGpuTimer* gpuTimer;
+	size_t maxEvents;
+	std::mutex ringsMutex;   // taken when a thread registers and when the rings are drained, never while recording
+	std::vector<std::unique_ptr<ProfilerRing> > rings;
+	std::vector<std::string> trackNames;
+	std::vector<ProfileEvent> events;
+};
+
+// times a section of code, on the GPU as well when gpu is true and a GPU timer is set
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name, bool gpu = false) : name(NULL), gpuTimed(false)
+	{
+		begin(name, gpu);
+	}
+
+	~ProfileScope()
+	{
+		end();
+	}
+
+	// closes this section and opens the next one
+	void next(const char* nextName, bool gpu = false)
+	{
+		end();
+		begin(nextName, gpu);
+	}
+
+	void end()
+	{
+		if (name == NULL)
+			return;
+
+		if (gpuTimed)
+			Profiler::get().getGpuTimer()->end();
+		Profiler::get().record(name, start, Profiler::get().now());
+		name = NULL;
+		gpuTimed = false;
+	}
+
+private:
+	void begin(const char* sectionName, bool gpu)
+	{
+		if (!Profiler::isEnabled())
+			return;
+
+		Profiler& profiler = Profiler::get();
+		name = sectionName;
+		start = profiler.now();
+		gpuTimed = gpu && profiler.getGpuTimer() != NULL && profiler.getGpuTimer()->begin(name, start);
+	}
+
+	const char* name;   // NULL while not recording
+	bool gpuTimed;
+	int64_t start;
+};
+
+#if defined(PROFILER_DISABLED)
+#define PROFILE_SCOPE(var, name)
+#define PROFILE_GPU_SCOPE(var, name)
+#define PROFILE_NEXT(var, name)
+#define PROFILE_GPU_NEXT(var, name)
+#else
+#define PROFILE_SCOPE(var, name) ProfileScope var(name)
+#define PROFILE_GPU_SCOPE(var, name) ProfileScope var(name, true)
+#define PROFILE_NEXT(var, name) var.next(name)
+#define PROFILE_GPU_NEXT(var, name) var.next(name, true)
+#endif
+
+#endif
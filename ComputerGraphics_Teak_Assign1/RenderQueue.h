@@ -0,0 +1,148 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+// Draws of a frame, submitted in any order and executed sorted by a 64 bit key.
+// The key packs, from the most significant bits: pass, program, material, vertex array, then the depth.
+// Sorting groups the draws sharing a program, then a material, then a vertex array, so state changes once per group,
+// and inside a group opaque draws go front to back. Transparent draws are sorted back to front before anything else.
+// The keys are sorted with an LSD radix sort, one pass per byte, skipping the bytes every key has in common.
+// Include after GL/glew.h.
+
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include <glm/glm.hpp>
+
+enum RenderPass
+{
+	RENDER_PASS_OPAQUE = 0,
+	RENDER_PASS_TRANSPARENT = 1,
+	RENDER_PASS_OVERLAY = 2
+};
+
+// what executing a draw needs
+struct DrawCommand
+{
+	GLuint vertexArray;
+	GLenum mode;
+	GLsizei indexCount;
+	GLuint firstIndex;        // index range and base vertex of the mesh in the GeometryPool
+	GLint baseVertex;
+	unsigned int features;    // shader variant
+	float textureLayer;
+	glm::vec3 color;
+	glm::mat4 worldMatrix;
+};
+
+struct RenderQueueItem
+{
+	uint64_t key;
+	uint32_t command;   // index in the command list
+};
+
+class RenderQueue
+{
+public:
+	// bits of each key field
+	static const int PASS_BITS = 4;
+	static const int PROGRAM_BITS = 10;
+	static const int MATERIAL_BITS = 12;
+	static const int VERTEX_ARRAY_BITS = 10;
+	static const int DEPTH_BITS = 24;
+
+	// depth is normalized, 0 at the near plane and 1 at the far plane. the state ids are truncated to their field size
+	static uint64_t makeKey(RenderPass pass, unsigned int program, unsigned int material, unsigned int vertexArray, float depth)
+	{
+		const uint64_t depthMax = (1u << DEPTH_BITS) - 1;
+		uint64_t quantizedDepth = (uint64_t)(glm::clamp(depth, 0.0f, 1.0f) * depthMax);
+		uint64_t state = ((uint64_t)(program & ((1u << PROGRAM_BITS) - 1)) << (MATERIAL_BITS + VERTEX_ARRAY_BITS))
+			| ((uint64_t)(material & ((1u << MATERIAL_BITS) - 1)) << VERTEX_ARRAY_BITS)
+			| (uint64_t)(vertexArray & ((1u << VERTEX_ARRAY_BITS) - 1));
+		uint64_t key = (uint64_t)pass << 60;
+
+		// blending needs back to front order more than it needs fewer state changes
+		if (pass == RENDER_PASS_TRANSPARENT)
+			return key | ((depthMax - quantizedDepth) << 32) | (state & 0xffffffffu);
+		return key | (state << 28) | quantizedDepth;
+	}
+
+	void clear()
+	{
+		items.clear();
+		commands.clear();
+	}
+
+	void submit(uint64_t key, const DrawCommand& command)
+	{
+		RenderQueueItem item;
+		item.key = key;
+		item.command = (uint32_t)commands.size();
+		items.push_back(item);
+		commands.push_back(command);
+	}
+
+	void sort()
+	{
+		size_t count = items.size();
+		if (count < 2)
+			return;
+
+		// the histograms of the 8 bytes are counted in one pass over the keys
+		memset(histograms, 0, sizeof(histograms));
+		for (size_t i = 0; i < count; i++)
+		{
+			uint64_t key = items[i].key;
+			for (int byte = 0; byte < 8; byte++)
+				histograms[byte][(key >> (byte * 8)) & 0xff]++;
+		}
+
+		scratch.resize(count);
+		RenderQueueItem* source = &items[0];
+		RenderQueueItem* destination = &scratch[0];
+		for (int byte = 0; byte < 8; byte++)
+		{
+			int shift = byte * 8;
+			uint32_t* histogram = histograms[byte];
+			if (histogram[(source[0].key >> shift) & 0xff] == count)
+				continue;
+
+			uint32_t offset = 0;
+			for (int digit = 0; digit < 256; digit++)
+			{
+				uint32_t digitCount = histogram[digit];
+				histogram[digit] = offset;
+				offset += digitCount;
+			}
+			for (size_t i = 0; i < count; i++)
+				destination[histogram[(source[i].key >> shift) & 0xff]++] = source[i];
+
+			RenderQueueItem* swap = source;
+			source = destination;
+			destination = swap;
+		}
+
+		if (source != &items[0])
+			items.swap(scratch);
+	}
+
+	// calls executor(command) for every draw in key order, sort first
+	template <class Executor>
+	void execute(Executor& executor) const
+	{
+		for (size_t i = 0; i < items.size(); i++)
+			executor(commands[items[i].command]);
+	}
+
+	size_t getSize() const { return items.size(); }
+	const std::vector<RenderQueueItem>& getItems() const { return items; }
+	const DrawCommand& getCommand(const RenderQueueItem& item) const { return commands[item.command]; }
+
+private:
+	std::vector<RenderQueueItem> items;
+	std::vector<RenderQueueItem> scratch;
+	std::vector<DrawCommand> commands;
+	uint32_t histograms[8][256];
+};
+
+#endif
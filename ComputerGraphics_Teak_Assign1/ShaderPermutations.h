@@ -0,0 +1,184 @@
+#ifndef SHADERPERMUTATIONS_H
+#define SHADERPERMUTATIONS_H
+
+#include <string>
+#include <map>
+
+#include <glm/glm.hpp>
+
+#include <shaderloader.h>
+#include <GLStateCache.h>
+
+// Features that can be compiled in or out of the scene shaders.
+// Each one maps to a #define injected right after the #version line.
+enum ShaderFeature
+{
+	SHADER_SHADOWS   = 1 << 0,  // sample the shadow map (bound on unit 1)
+	SHADER_SPOTLIGHT = 1 << 1,  // fade the light with light_cutoff_inner/outer
+	SHADER_TEXTURED  = 1 << 2,  // modulate objectColor by the textureLayer of the textureSampler array (unit 0)
+	SHADER_INSTANCED = 1 << 3,  // read the world matrix from attributes 3-6 instead of the worldMatrix uniform
+	SHADER_INDIRECT  = 1 << 4,  // read the world matrix, color and texture layer of the draw from the DrawDataBuffer, see MultiDrawIndirect.h
+	SHADER_SKINNED   = 1 << 5   // blend the joint matrices of the JointBlock by the vertex weights, the color is per vertex, see SkinnedMesh.h
+};
+
+// shader storage binding of the per draw data of SHADER_INDIRECT variants
+const GLuint DRAW_DATA_BINDING = 0;
+// uniform block bindings of every variant, the ranges come from the FrameRingBuffer
+const GLuint SCENE_BLOCK_BINDING = 0;
+const GLuint DRAW_BLOCK_BINDING = 1;
+const GLuint JOINT_BLOCK_BINDING = 2;
+
+// std140 layout of SceneBlock in the scene shaders, the vec3 members take a vec4 slot
+struct SceneBlock
+{
+	glm::mat4 viewMatrix;
+	glm::mat4 projectionMatrix;
+	glm::mat4 lightViewProjMatrix;
+	glm::vec4 lightColor;
+	glm::vec4 lightPosition;
+	glm::vec4 lightDirection;
+	glm::vec4 viewPosition;
+};
+
+// std140 layout of DrawBlock, and std430 layout of the DrawDataBuffer entries of SHADER_INDIRECT variants
+struct DrawBlock
+{
+	glm::mat4 worldMatrix;
+	glm::vec4 colorLayer;   // object color, texture layer in w
+};
+
+// A compiled variant with the locations used by every draw
+struct ShaderVariant
+{
+	GLuint program;
+	unsigned int features;
+	GLint worldMatrixLocation;
+	GLint objectColorLocation;
+	GLint textureLayerLocation;
+	GLint drawBaseLocation;
+};
+
+// One vertex/fragment source pair compiled on demand into as many variants as needed.
+// Variants are submitted to the ShaderBatch the first time they are asked for and cached,
+// so a feature nobody uses never gets compiled and costs nothing in the fragment shader.
+class ShaderPermutations
+{
+public:
+	ShaderPermutations(ShaderBatch& batch, const std::string& vertex_file_path, const std::string& fragment_file_path, const std::string& commonDefines = "")
+		: batch(batch), commonDefines(commonDefines)
+	{
+		if (!readShaderFile(vertex_file_path, vertexCode) || !readShaderFile(fragment_file_path, fragmentCode))
+			std::cerr << "Error::ShaderPermutations could not read " << vertex_file_path << " or " << fragment_file_path << std::endl;
+		name = vertex_file_path + " / " + fragment_file_path;
+	}
+
+	// start compiling a variant we know we will need, without waiting for it
+	void prefetch(unsigned int features)
+	{
+		if (variants.find(features) != variants.end())
+			return;
+
+		std::string defines = commonDefines + getFeatureDefines(features);
+		ShaderVariant variant;
+		variant.program = batch.submitSource(injectDefines(vertexCode, defines), injectDefines(fragmentCode, defines), name + " [" + getFeatureNames(features) + "]");
+		variant.features = features;
+		variant.worldMatrixLocation = -1;
+		variant.objectColorLocation = -1;
+		variant.textureLayerLocation = -1;
+		variant.drawBaseLocation = -1;
+		variants[features] = variant;
+	}
+
+	// returns the variant ready to use, compiling it first if this is the first request
+	const ShaderVariant& get(unsigned int features)
+	{
+		prefetch(features);
+
+		ShaderVariant& variant = variants[features];
+		if (!resolved[features])
+		{
+			batch.use(variant.program);
+			GLStateCache::get().invalidateProgram();
+			variant.worldMatrixLocation = glGetUniformLocation(variant.program, "worldMatrix");
+			variant.objectColorLocation = glGetUniformLocation(variant.program, "objectColor");
+			variant.textureLayerLocation = glGetUniformLocation(variant.program, "textureLayer");
+			variant.drawBaseLocation = glGetUniformLocation(variant.program, "drawBase");
+
+			// samplers: material texture on unit 0, shadow map on unit 1
+			if (features & SHADER_TEXTURED)
+				glUniform1i(glGetUniformLocation(variant.program, "textureSampler"), 0);
+			if (features & SHADER_SHADOWS)
+				glUniform1i(glGetUniformLocation(variant.program, "shadow_map"), 1);
+			bindUniformBlock(variant.program, "SceneBlock", SCENE_BLOCK_BINDING);
+			bindUniformBlock(variant.program, "DrawBlock", DRAW_BLOCK_BINDING);
+			bindUniformBlock(variant.program, "JointBlock", JOINT_BLOCK_BINDING);
+			if (features & SHADER_INDIRECT)
+			{
+				GLuint block = glGetProgramResourceIndex(variant.program, GL_SHADER_STORAGE_BLOCK, "DrawDataBuffer");
+				if (block != GL_INVALID_INDEX)
+					glShaderStorageBlockBinding(variant.program, block, DRAW_DATA_BINDING);
+			}
+
+			resolved[features] = true;
+		}
+		return variant;
+	}
+
+	int getVariantCount() const { return (int)variants.size(); }
+
+	static std::string getFeatureDefines(unsigned int features)
+	{
+		std::string defines;
+		if (features & SHADER_SHADOWS)   defines += "#define SHADOWS\n";
+		if (features & SHADER_SPOTLIGHT) defines += "#define SPOTLIGHT\n";
+		if (features & SHADER_TEXTURED)  defines += "#define TEXTURED\n";
+		if (features & SHADER_INSTANCED) defines += "#define INSTANCED\n";
+		if (features & SHADER_INDIRECT)  defines += "#define INDIRECT\n";
+		if (features & SHADER_SKINNED)   defines += "#define SKINNED\n";
+		return defines;
+	}
+
+	static std::string getFeatureNames(unsigned int features)
+	{
+		std::string names;
+		if (features & SHADER_SHADOWS)   names += " SHADOWS";
+		if (features & SHADER_SPOTLIGHT) names += " SPOTLIGHT";
+		if (features & SHADER_TEXTURED)  names += " TEXTURED";
+		if (features & SHADER_INSTANCED) names += " INSTANCED";
+		if (features & SHADER_INDIRECT)  names += " INDIRECT";
+		if (features & SHADER_SKINNED)   names += " SKINNED";
+		return names.empty() ? "default" : names.substr(1);
+	}
+
+	// the defines have to go after #version, which must stay the first statement of the source
+	static std::string injectDefines(const std::string& source, const std::string& defines)
+	{
+		size_t versionPos = source.find("#version");
+		if (versionPos == std::string::npos)
+			return defines + source;
+
+		size_t lineEnd = source.find('\n', versionPos);
+		if (lineEnd == std::string::npos)
+			return source + "\n" + defines;
+
+		return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+	}
+
+private:
+	static void bindUniformBlock(GLuint program, const char* name, GLuint binding)
+	{
+		GLuint block = glGetUniformBlockIndex(program, name);
+		if (block != GL_INVALID_INDEX)
+			glUniformBlockBinding(program, block, binding);
+	}
+
+	ShaderBatch& batch;
+	std::string name;
+	std::string vertexCode;
+	std::string fragmentCode;
+	std::string commonDefines;
+	std::map<unsigned int, ShaderVariant> variants;
+	std::map<unsigned int, bool> resolved;
+};
+
+#endif
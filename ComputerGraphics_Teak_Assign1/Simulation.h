@@ -0,0 +1,362 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+// Fixed step simulation of the Olaf, decoupled from the render loop.
+// The simulation runs on its own thread at a fixed tick rate, so the Olaf moves at the same speed whatever the frame
+// rate and a slow frame does not slow the simulation down. Every tick publishes a snapshot of the state through a
+// TripleBuffer, a lock-free exchange where the writer and the reader each own a slot and swap with the middle one.
+// The render loop draws one tick in the past, interpolated between the two latest snapshots, so the motion stays
+// smooth when the frame rate and the tick rate do not match.
+// The main thread forwards the timed key events of InputScript through a lock-free single producer queue. A tick
+// applies the events up to its own time, and a key pressed and released between two ticks still acts for one tick.
+// Headless and replayed runs step the simulation on the main thread instead, advance() runs the ticks that fit in the
+// fixed frame time, so the run stays repeatable.
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <string.h>
+#include <stdlib.h>
+#include <iostream>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <Profiler.h>
+
+// single writer single reader exchange of the latest value, neither side ever waits
+template <class T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : writeSlot(0), middle(1), readSlot(2)
+	{
+	}
+
+	// the slot the writer fills before publish()
+	T& getWriteBuffer() { return slots[writeSlot]; }
+
+	void publish()
+	{
+		writeSlot = middle.exchange(writeSlot | FRESH, std::memory_order_acq_rel) & SLOT_MASK;
+	}
+
+	// true if a value was published since the last call, getReadBuffer() then holds it
+	bool update()
+	{
+		if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+			return false;
+		readSlot = middle.exchange(readSlot, std::memory_order_acq_rel) & SLOT_MASK;
+		return true;
+	}
+
+	const T& getReadBuffer() const { return slots[readSlot]; }
+
+private:
+	static const unsigned int SLOT_MASK = 3;
+	static const unsigned int FRESH = 4;   // the middle slot holds a value the reader has not taken yet
+
+	T slots[3];
+	unsigned int writeSlot;            // writer only
+	std::atomic<unsigned int> middle;  // slot index, and FRESH
+	unsigned int readSlot;             // reader only
+};
+
+// what the simulation moves, the Olaf stays on the ground so its body matrix is a translation, a rotation about Y and a height scale
+struct OlafState
+{
+	glm::vec3 position;
+	float yaw;           // degrees
+	float heightScale;
+
+	OlafState() : position(0.0f), yaw(0.0f), heightScale(1.0f) {}
+
+	glm::mat4 getBodyMatrix() const
+	{
+		glm::mat4 body = glm::translate(glm::mat4(1.0f), position);
+		body = glm::rotate(body, glm::radians(yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+		return glm::scale(body, glm::vec3(1.0f, heightScale, 1.0f));
+	}
+
+	static OlafState interpolate(const OlafState& from, const OlafState& to, float t)
+	{
+		OlafState state;
+		state.position = glm::mix(from.position, to.position, t);
+		state.yaw = glm::mix(from.yaw, to.yaw, t);
+		state.heightScale = glm::mix(from.heightScale, to.heightScale, t);
+		return state;
+	}
+};
+
+struct SimulationSnapshot
+{
+	long long tick;
+	double time;   // seconds, on the simulation's clock
+	OlafState olaf;
+
+	SimulationSnapshot() : tick(0), time(0.0) {}
+};
+
+// the keys the simulation reads, set by the main thread
+enum SimulationKey
+{
+	SIM_KEY_LEFT = 1 << 0,
+	SIM_KEY_RIGHT = 1 << 1,
+	SIM_KEY_BACKWARD = 1 << 2,
+	SIM_KEY_FORWARD = 1 << 3,
+	SIM_KEY_TURN_LEFT = 1 << 4,
+	SIM_KEY_TURN_RIGHT = 1 << 5,
+	SIM_KEY_RESPAWN = 1 << 6,
+	SIM_KEY_GROW = 1 << 7,
+	SIM_KEY_SHRINK = 1 << 8
+};
+
+// a press or release of SimulationKey keys
+struct SimulationEvent
+{
+	std::chrono::steady_clock::time_point time;
+	unsigned int keys;
+	bool down;
+};
+
+struct SimulationOptions
+{
+	double tickRate;   // ticks per second
+
+	SimulationOptions() : tickRate(60.0) {}
+};
+
+// --tick-rate <ticks per second>
+inline SimulationOptions parseSimulationOptions(int argc, char* argv[])
+{
+	SimulationOptions options;
+	for (int i = 1; i + 1 < argc; i++)
+		if (strcmp(argv[i], "--tick-rate") == 0)
+			options.tickRate = std::max(1.0, atof(argv[++i]));
+	return options;
+}
+
+class Simulation
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// the speeds are those the key handling had per frame at 60 fps
+	static constexpr float MOVE_SPEED = 3.0f;     // units per second
+	static constexpr float TURN_SPEED = 300.0f;   // degrees per second
+	static constexpr float GROW_RATE = 1.01f;     // height factors per 60th of a second
+	static constexpr float SHRINK_RATE = 0.99f;
+
+	Simulation(const SimulationOptions& options, unsigned int seed)
+		: tickPeriod(1.0 / options.tickRate), random(seed), gridPosition(-5.0f, 5.0f), heldKeys(0), latchedKeys(0),
+		eventHead(0), eventTail(0), droppedEvents(0), running(false), threaded(false), simulatedTime(0.0), accumulator(0.0),
+		tickCount(0), lateTicks(0)
+	{
+	}
+
+	~Simulation()
+	{
+		stop();
+	}
+
+	// ticks on a thread of its own, until stop()
+	void start()
+	{
+		threaded = true;
+		running = true;
+		startTime = Clock::now();
+		thread = std::thread(&Simulation::threadLoop, this);
+	}
+
+	void stop()
+	{
+		running = false;
+		if (thread.joinable())
+			thread.join();
+	}
+
+	// call from one thread only, keys is a bitmask of SimulationKey, a full queue drops the event
+	bool pushEvent(std::chrono::steady_clock::time_point time, unsigned int keys, bool down)
+	{
+		size_t head = eventHead.load(std::memory_order_relaxed);
+		if (head - eventTail.load(std::memory_order_acquire) == EVENT_CAPACITY)
+		{
+			droppedEvents++;
+			return false;
+		}
+		SimulationEvent event = { time, keys, down };
+		events[head % EVENT_CAPACITY] = event;
+		eventHead.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// runs the ticks that fit in dt on the calling thread, for runs that have to be repeatable
+	void advance(double dt)
+	{
+		accumulator += dt;
+		// the small tolerance keeps a frame time equal to the tick period from losing a tick to rounding
+		while (accumulator >= tickPeriod - 1e-9)
+		{
+			accumulator -= tickPeriod;
+			simulatedTime += tickPeriod;
+			tick(simulatedTime);
+		}
+	}
+
+	// the state to draw this frame, one tick behind the latest one so there are two snapshots around it
+	OlafState sample()
+	{
+		if (snapshots.update())
+		{
+			previous = current;
+			current = snapshots.getReadBuffer();
+		}
+
+		double now = threaded ? std::chrono::duration<double>(Clock::now() - startTime).count() : simulatedTime + accumulator;
+		double renderTime = now - tickPeriod;
+		double span = current.time - previous.time;
+		float t = span > 0.0 ? (float)std::min(1.0, std::max(0.0, (renderTime - previous.time) / span)) : 1.0f;
+		return OlafState::interpolate(previous.olaf, current.olaf, t);
+	}
+
+	long long getTickCount() const { return tickCount.load(std::memory_order_relaxed); }
+
+	void printStats() const
+	{
+		std::cout << "Simulation : " << getTickCount() << " ticks at " << 1.0 / tickPeriod << " Hz, " << (threaded ? "threaded" : "stepped by the frames");
+		if (threaded)
+			std::cout << ", " << lateTicks << " ticks late by over a tick";
+		if (droppedEvents > 0)
+			std::cout << ", " << droppedEvents << " input events dropped";
+		std::cout << std::endl;
+	}
+
+private:
+	void threadLoop()
+	{
+		Profiler::get().setThreadName("Simulation");
+		Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(tickPeriod));
+		Clock::time_point next = startTime;
+		long long ticks = 0;
+		while (running)
+		{
+			next += period;
+			std::this_thread::sleep_until(next);
+			ticks++;
+			tick(ticks * tickPeriod);
+
+			// after a stall the ticks restart from now instead of rushing to catch up
+			if (Clock::now() - next > period)
+			{
+				lateTicks++;
+				ticks = (long long)(std::chrono::duration<double>(Clock::now() - startTime).count() / tickPeriod);
+				next = startTime + period * ticks;
+			}
+		}
+	}
+
+	// the events up to the tick's time, stepped runs take all of them so a replay does not depend on timing
+	void applyEvents(Clock::time_point tickTime)
+	{
+		size_t tail = eventTail.load(std::memory_order_relaxed);
+		size_t head = eventHead.load(std::memory_order_acquire);
+		for (; tail != head; tail++)
+		{
+			const SimulationEvent& event = events[tail % EVENT_CAPACITY];
+			if (threaded && event.time > tickTime)
+				break;
+			if (event.down)
+			{
+				heldKeys |= event.keys;
+				latchedKeys |= event.keys;
+			}
+			else
+				heldKeys &= ~event.keys;
+		}
+		eventTail.store(tail, std::memory_order_release);
+	}
+
+	void tick(double time)
+	{
+		PROFILE_SCOPE(tickScope, "Simulation tick");
+		applyEvents(startTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(time)));
+		unsigned int pressed = heldKeys | latchedKeys;
+		latchedKeys = 0;
+		float step = (float)tickPeriod;
+
+		// the moves are along the Olaf's own axes
+		glm::vec3 move(0.0f);
+		if (pressed & SIM_KEY_LEFT)
+			move.x -= 1.0f;
+		if (pressed & SIM_KEY_RIGHT)
+			move.x += 1.0f;
+		if (pressed & SIM_KEY_BACKWARD)
+			move.z += 1.0f;
+		if (pressed & SIM_KEY_FORWARD)
+			move.z -= 1.0f;
+		float yaw = glm::radians(state.yaw);
+		glm::vec3 right(cos(yaw), 0.0f, -sin(yaw));
+		glm::vec3 back(sin(yaw), 0.0f, cos(yaw));
+		state.position += (right * move.x + back * move.z) * MOVE_SPEED * step;
+
+		if (pressed & SIM_KEY_TURN_LEFT)
+			state.yaw += TURN_SPEED * step;
+		if (pressed & SIM_KEY_TURN_RIGHT)
+			state.yaw -= TURN_SPEED * step;
+		if (pressed & SIM_KEY_GROW)
+			state.heightScale *= pow(GROW_RATE, 60.0f * step);
+		if (pressed & SIM_KEY_SHRINK)
+			state.heightScale *= pow(SHRINK_RATE, 60.0f * step);
+
+		// pressing the spacebar re-positions the Olaf at a random location on the grid
+		if (pressed & SIM_KEY_RESPAWN)
+		{
+			float x = gridPosition(random);
+			float z = gridPosition(random);
+			state = OlafState();
+			state.position = glm::vec3(x, 0.0f, z);
+		}
+
+		long long ticks = tickCount.load(std::memory_order_relaxed) + 1;
+		tickCount.store(ticks, std::memory_order_relaxed);
+		SimulationSnapshot& snapshot = snapshots.getWriteBuffer();
+		snapshot.tick = ticks;
+		snapshot.time = time;
+		snapshot.olaf = state;
+		snapshots.publish();
+	}
+
+	double tickPeriod;
+
+	// simulation side
+	OlafState state;
+	std::mt19937 random;   // seeded, so a replayed script puts the Olaf at the same places
+	std::uniform_real_distribution<float> gridPosition;
+
+	unsigned int heldKeys;
+	unsigned int latchedKeys;   // pressed since the last tick
+
+	// main thread to simulation events
+	static const size_t EVENT_CAPACITY = 256;
+	SimulationEvent events[EVENT_CAPACITY];
+	std::atomic<size_t> eventHead;   // written by pushEvent
+	std::atomic<size_t> eventTail;   // written by the ticks
+	std::atomic<int> droppedEvents;
+	TripleBuffer<SimulationSnapshot> snapshots;
+	std::atomic<bool> running;
+	std::thread thread;
+	bool threaded;
+	Clock::time_point startTime;
+	double simulatedTime;   // stepped runs only
+	double accumulator;
+	std::atomic<long long> tickCount;
+	int lateTicks;
+
+	// render side
+	SimulationSnapshot previous;
+	SimulationSnapshot current;
+};
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef SKINNEDMESH_H
+#define SKINNEDMESH_H
+
+// A mesh deformed by a skeleton, drawn with the SHADER_SKINNED variant of the scene shaders.
+// Parts (the models the rigid scene draws with a part matrix) are baked in their rest pose into one vertex buffer,
+// each vertex following one joint, or blending from one joint to another along a segment of the part.
+// Every character drawn gets a JointBlock in the frame's ring buffer: its world matrix and skinning matrices,
+// see Animation.h for where those come from.
+// Include after GL/glew.h.
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <stddef.h>
+#include <string.h>
+
+#include <glm/glm.hpp>
+
+#include <Animation.h>
+#include <FrameBenchmark.h>
+#include <FrameRingBuffer.h>
+#include <GLStateCache.h>
+#include <ShaderPermutations.h>
+
+struct SkinnedVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 uv;
+	glm::vec3 color;
+	unsigned char joints[4];
+	glm::vec4 weights;
+};
+
+// std140 layout of JointBlock in scene_vertex.glsl
+struct JointBlock
+{
+	glm::mat4 characterMatrix;
+	glm::mat4 joints[MAX_JOINTS];
+};
+
+class SkinnedMesh
+{
+public:
+	SkinnedMesh() : vertexArray(0), vertexBuffer(0), indexBuffer(0), indexCount(0)
+	{
+	}
+
+	~SkinnedMesh()
+	{
+		release();
+	}
+
+	// adds a model placed by partMatrix, following joint, or blending into blendJoint from blendFrom to blendTo
+	void addPart(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& uvs,
+		const std::vector<GLuint>& indices, const glm::mat4& partMatrix, const glm::vec3& color, int joint,
+		int blendJoint = -1, const glm::vec3& blendFrom = glm::vec3(0.0f), const glm::vec3& blendTo = glm::vec3(0.0f))
+	{
+		GLuint firstVertex = (GLuint)vertices.size();
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(partMatrix)));
+		glm::vec3 segment = blendTo - blendFrom;
+		float segmentLength2 = std::max(glm::dot(segment, segment), 1e-12f);
+
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			SkinnedVertex vertex;
+			vertex.position = glm::vec3(partMatrix * glm::vec4(positions[i], 1.0f));
+			vertex.normal = i < normals.size() ? glm::normalize(normalMatrix * normals[i]) : glm::vec3(0.0f);
+			vertex.uv = i < uvs.size() ? uvs[i] : glm::vec2(0.0f);
+			vertex.color = color;
+
+			// smoothstep along the segment, so the bend has no crease at its ends
+			float blend = 0.0f;
+			if (blendJoint >= 0)
+			{
+				blend = glm::clamp(glm::dot(vertex.position - blendFrom, segment) / segmentLength2, 0.0f, 1.0f);
+				blend = blend * blend * (3.0f - 2.0f * blend);
+			}
+			vertex.joints[0] = (unsigned char)joint;
+			vertex.joints[1] = (unsigned char)std::max(blendJoint, 0);
+			vertex.joints[2] = vertex.joints[3] = 0;
+			vertex.weights = glm::vec4(1.0f - blend, blend, 0.0f, 0.0f);
+			vertices.push_back(vertex);
+		}
+		for (size_t i = 0; i < indices.size(); i++)
+			this->indices.push_back(firstVertex + indices[i]);
+	}
+
+	// uploads the parts added so far, needs the context to be current
+	bool create()
+	{
+		if (vertices.empty() || indices.empty())
+		{
+			std::cerr << "Error::SkinnedMesh has no parts" << std::endl;
+			return false;
+		}
+
+		glGenVertexArrays(1, &vertexArray);
+		glGenBuffers(1, &vertexBuffer);
+		glGenBuffers(1, &indexBuffer);
+		bindVertexArray(vertexArray);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(SkinnedVertex), &vertices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (GLvoid*)offsetof(SkinnedVertex, position));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (GLvoid*)offsetof(SkinnedVertex, normal));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (GLvoid*)offsetof(SkinnedVertex, uv));
+		glEnableVertexAttribArray(2);
+		glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, sizeof(SkinnedVertex), (GLvoid*)offsetof(SkinnedVertex, joints));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (GLvoid*)offsetof(SkinnedVertex, weights));
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (GLvoid*)offsetof(SkinnedVertex, color));
+		glEnableVertexAttribArray(5);
+		bindVertexArray(0);
+
+		indexCount = (GLsizei)indices.size();
+		vertices.clear();
+		indices.clear();
+		return true;
+	}
+
+	// deletes the buffers, call before the GL context goes away
+	void release()
+	{
+		if (vertexArray != 0)
+		{
+			glDeleteVertexArrays(1, &vertexArray);
+			GLStateCache::get().invalidateVertexArray();
+		}
+		if (vertexBuffer != 0)
+			glDeleteBuffers(1, &vertexBuffer);
+		if (indexBuffer != 0)
+			glDeleteBuffers(1, &indexBuffer);
+		vertexArray = 0;
+		vertexBuffer = 0;
+		indexBuffer = 0;
+		indexCount = 0;
+	}
+
+	bool isCreated() const { return vertexArray != 0; }
+
+	// draws count characters of jointCount skinning matrices each, the blocks are written and flushed before the first draw.
+	// Reads the SceneBlock bound by the render queue
+	void draw(ShaderPermutations& permutations, FrameRingBuffer& frameData, GLenum mode, const glm::mat4* characterMatrices,
+		const glm::mat4* skinMatrices, int jointCount, int count)
+	{
+		if (vertexArray == 0 || count <= 0)
+			return;
+
+		size_t stride = (sizeof(JointBlock) + frameData.getAlignment() - 1) / frameData.getAlignment() * frameData.getAlignment();
+		RingAllocation blocks = frameData.allocate(stride * count);
+		if (blocks.data == NULL)
+			return;
+		for (int c = 0; c < count; c++)
+		{
+			JointBlock* block = (JointBlock*)((char*)blocks.data + c * stride);
+			block->characterMatrix = characterMatrices[c];
+			memcpy(block->joints, &skinMatrices[(size_t)c * jointCount], jointCount * sizeof(glm::mat4));
+		}
+		frameData.flush();
+
+		useProgram(permutations.get(SHADER_SKINNED).program);
+		bindVertexArray(vertexArray);
+		for (int c = 0; c < count; c++)
+		{
+			RingAllocation block = { NULL, (GLintptr)(blocks.offset + c * stride), sizeof(JointBlock) };
+			frameData.bindRange(GL_UNIFORM_BUFFER, JOINT_BLOCK_BINDING, block);
+			drawElements(mode, indexCount);
+		}
+	}
+
+private:
+	GLuint vertexArray;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	GLsizei indexCount;
+	std::vector<SkinnedVertex> vertices;   // until create()
+	std::vector<GLuint> indices;
+};
+
+#endif
@@ -0,0 +1,510 @@
+#ifndef SNOWSYSTEM_H
+#define SNOWSYSTEM_H
+
+// Snowfall over the ground, simulated and drawn on the GPU.
+// The flakes live in two vertex buffers. Every frame a vertex shader reads one buffer and writes the next state into
+// the other through transform feedback, with the rasterizer off, then the buffers swap. The flakes fall under gravity
+// and drag, drift with the wind, wrap around the edges of the area and start again from the top when they reach the
+// ground, all without the CPU touching a flake. They are drawn as point sprites straight from the new buffer.
+// SnowReference is the same simulation on the CPU, a structure of arrays with a scalar and an AVX2 loop. It seeds
+// the GPU buffers, checks the GPU against the CPU (--snow-check) and benchmarks the CPU loops (--bench-snow).
+// Include after GL/glew.h.
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include <AlignedArray.h>
+#include <ImageResize.h>
+#include <FrameBenchmark.h>
+#include <ShaderPermutations.h>
+#include <shaderloader.h>
+
+struct SnowSettings
+{
+	int flakeCount;
+	float extent;         // half size of the snowing area, the ground is 25 units wide
+	float groundHeight;   // the ground plane
+	float spawnHeight;
+	float gravity;
+	float drag;           // per second, gravity / drag is the fall speed
+	glm::vec3 wind;
+	float flakeSize;      // world units
+
+	SnowSettings()
+		: flakeCount(100000), extent(12.5f), groundHeight(-0.02f), spawnHeight(8.0f), gravity(-2.0f), drag(2.0f),
+		wind(0.4f, 0.0f, 0.15f), flakeSize(0.03f)
+	{
+	}
+};
+
+// what changes from one step to the next, the same for the GPU and the CPU
+struct SnowStep
+{
+	float dt;
+	glm::vec3 wind;
+	uint32_t index;   // seeds the respawn positions
+
+	// the wind blows in gusts, time is the simulated time
+	static SnowStep make(const SnowSettings& settings, float dt, double time, uint32_t index)
+	{
+		SnowStep step;
+		step.dt = std::min(dt, 0.1f);
+		step.wind = settings.wind * (float)(1.0 + 0.5 * sin(time * 0.5));
+		step.index = index;
+		return step;
+	}
+};
+
+enum SnowPath
+{
+	SNOW_SCALAR,
+	SNOW_AVX2
+};
+
+class SnowReference
+{
+public:
+	SnowReference() : count(0)
+	{
+	}
+
+	// every flake at a random place in the volume
+	void initialize(const SnowSettings& snowSettings)
+	{
+		settings = snowSettings;
+		count = std::max(0, settings.flakeCount);
+		AlignedArray<float>* arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &phase };
+		for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
+			arrays[i]->resize(count);
+
+		for (int i = 0; i < count; i++)
+		{
+			px[i] = (random01(i, 0, 0) * 2.0f - 1.0f) * settings.extent;
+			py[i] = settings.groundHeight + random01(i, 0, 1) * (settings.spawnHeight - settings.groundHeight);
+			pz[i] = (random01(i, 0, 2) * 2.0f - 1.0f) * settings.extent;
+			phase[i] = random01(i, 0, 3);
+		}
+	}
+
+	void update(const SnowStep& step, SnowPath path)
+	{
+#if defined(IMAGERESIZE_X86)
+		if (path == SNOW_AVX2)
+			return updateAVX2(step);
+#endif
+		updateScalar(step, 0, count);
+	}
+
+	static bool isPathSupported(SnowPath path)
+	{
+		return path == SNOW_SCALAR || ImageResize::isAVX2Supported();
+	}
+
+	static const char* getPathName(SnowPath path)
+	{
+		return path == SNOW_AVX2 ? "AVX2" : "scalar";
+	}
+
+	// the layout of the GPU buffers, position and phase then velocity
+	void pack(std::vector<glm::vec4>& flakes) const
+	{
+		flakes.resize((size_t)count * 2);
+		for (int i = 0; i < count; i++)
+		{
+			flakes[i * 2] = glm::vec4(px[i], py[i], pz[i], phase[i]);
+			flakes[i * 2 + 1] = glm::vec4(vx[i], vy[i], vz[i], 0.0f);
+		}
+	}
+
+	int getCount() const { return count; }
+
+	// the hash of snow_update_vertex.glsl
+	static uint32_t hash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	static float random01(uint32_t id, uint32_t seed, uint32_t k)
+	{
+		return (float)(hash(id * 4u + k + hash(seed)) >> 8) / 16777216.0f;
+	}
+
+	AlignedArray<float> px, py, pz;
+	AlignedArray<float> vx, vy, vz;
+	AlignedArray<float> phase;
+
+private:
+	void respawn(int i, uint32_t index)
+	{
+		px[i] = (random01(i, index, 0) * 2.0f - 1.0f) * settings.extent;
+		py[i] = settings.spawnHeight;
+		pz[i] = (random01(i, index, 1) * 2.0f - 1.0f) * settings.extent;
+		vx[i] = vy[i] = vz[i] = 0.0f;
+	}
+
+	// the step of snow_update_vertex.glsl, in the same order of operations
+	void updateScalar(const SnowStep& step, int begin, int end)
+	{
+		const float dt = step.dt;
+		const float extent = settings.extent;
+		for (int i = begin; i < end; i++)
+		{
+			float flakeDrag = settings.drag * (0.75f + 0.5f * phase[i]);
+			vx[i] += ((step.wind.x - vx[i]) * flakeDrag + 0.0f) * dt;
+			vy[i] += ((step.wind.y - vy[i]) * flakeDrag + settings.gravity) * dt;
+			vz[i] += ((step.wind.z - vz[i]) * flakeDrag + 0.0f) * dt;
+			px[i] += vx[i] * dt;
+			py[i] += vy[i] * dt;
+			pz[i] += vz[i] * dt;
+
+			if (px[i] > extent)
+				px[i] -= 2.0f * extent;
+			else if (px[i] < -extent)
+				px[i] += 2.0f * extent;
+			if (pz[i] > extent)
+				pz[i] -= 2.0f * extent;
+			else if (pz[i] < -extent)
+				pz[i] += 2.0f * extent;
+
+			if (py[i] < settings.groundHeight)
+				respawn(i, step.index);
+		}
+	}
+
+#if defined(IMAGERESIZE_X86)
+	// wraps one axis of eight flakes into [-extent, extent]
+	IMAGERESIZE_AVX2_TARGET static __m256 wrap(__m256 p, __m256 extent, __m256 negativeExtent, __m256 size)
+	{
+		p = _mm256_sub_ps(p, _mm256_and_ps(_mm256_cmp_ps(p, extent, _CMP_GT_OQ), size));
+		return _mm256_add_ps(p, _mm256_and_ps(_mm256_cmp_ps(p, negativeExtent, _CMP_LT_OQ), size));
+	}
+
+	// eight flakes per register, the few that reach the ground respawn one by one
+	IMAGERESIZE_AVX2_TARGET void updateAVX2(const SnowStep& step)
+	{
+		const __m256 dt = _mm256_set1_ps(step.dt);
+		const __m256 windX = _mm256_set1_ps(step.wind.x), windY = _mm256_set1_ps(step.wind.y), windZ = _mm256_set1_ps(step.wind.z);
+		const __m256 gravity = _mm256_set1_ps(settings.gravity);
+		const __m256 drag = _mm256_set1_ps(settings.drag);
+		const __m256 dragBase = _mm256_set1_ps(0.75f), dragRange = _mm256_set1_ps(0.5f);
+		const __m256 extent = _mm256_set1_ps(settings.extent), negativeExtent = _mm256_set1_ps(-settings.extent);
+		const __m256 size = _mm256_set1_ps(2.0f * settings.extent);
+		const __m256 ground = _mm256_set1_ps(settings.groundHeight);
+
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 flakeDrag = _mm256_mul_ps(drag, _mm256_add_ps(dragBase, _mm256_mul_ps(dragRange, _mm256_load_ps(&phase[i]))));
+			__m256 x = _mm256_load_ps(&vx[i]), y = _mm256_load_ps(&vy[i]), z = _mm256_load_ps(&vz[i]);
+			x = _mm256_add_ps(x, _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(windX, x), flakeDrag), dt));
+			y = _mm256_add_ps(y, _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(windY, y), flakeDrag), gravity), dt));
+			z = _mm256_add_ps(z, _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(windZ, z), flakeDrag), dt));
+			_mm256_store_ps(&vx[i], x);
+			_mm256_store_ps(&vy[i], y);
+			_mm256_store_ps(&vz[i], z);
+
+			__m256 positionX = wrap(_mm256_add_ps(_mm256_load_ps(&px[i]), _mm256_mul_ps(x, dt)), extent, negativeExtent, size);
+			__m256 positionY = _mm256_add_ps(_mm256_load_ps(&py[i]), _mm256_mul_ps(y, dt));
+			__m256 positionZ = wrap(_mm256_add_ps(_mm256_load_ps(&pz[i]), _mm256_mul_ps(z, dt)), extent, negativeExtent, size);
+			_mm256_store_ps(&px[i], positionX);
+			_mm256_store_ps(&py[i], positionY);
+			_mm256_store_ps(&pz[i], positionZ);
+
+			int landed = _mm256_movemask_ps(_mm256_cmp_ps(positionY, ground, _CMP_LT_OQ));
+			for (; landed != 0; landed &= landed - 1)
+				respawn(i + ctz(landed), step.index);
+		}
+		updateScalar(step, i, count);
+	}
+
+	static int ctz(int mask)
+	{
+		int bit = 0;
+		while ((mask & (1 << bit)) == 0)
+			bit++;
+		return bit;
+	}
+#endif
+
+	SnowSettings settings;
+	int count;
+};
+
+class SnowSystem
+{
+public:
+	SnowSystem() : shaders(NULL), updateProgram(0), drawProgram(0), pointScaleLocation(-1), flakeCount(0), current(0), stepIndex(0), time(0.0)
+	{
+		buffers[0] = buffers[1] = 0;
+		vertexArrays[0] = vertexArrays[1] = 0;
+	}
+
+	~SnowSystem()
+	{
+		release();
+	}
+
+	// needs the context to be current, the programs finish building on the first update
+	bool create(ShaderBatch& shaders, const std::string& shaderPathPrefix, const SnowSettings& snowSettings)
+	{
+		settings = snowSettings;
+		flakeCount = std::max(0, settings.flakeCount);
+		if (flakeCount == 0)
+			return false;
+
+		std::vector<const char*> varyings;
+		varyings.push_back("outPosition");
+		varyings.push_back("outVelocity");
+		updateProgram = shaders.submitFeedback(shaderPathPrefix + "snow_update_vertex.glsl", varyings);
+		drawProgram = shaders.submit(shaderPathPrefix + "snow_vertex.glsl", shaderPathPrefix + "snow_fragment.glsl");
+		if (updateProgram == 0 || drawProgram == 0)
+		{
+			std::cerr << "Error::SnowSystem could not load the snow shaders" << std::endl;
+			release();
+			return false;
+		}
+		this->shaders = &shaders;
+
+		SnowReference reference;
+		reference.initialize(settings);
+		std::vector<glm::vec4> flakes;
+		reference.pack(flakes);
+
+		glGenBuffers(2, buffers);
+		glGenVertexArrays(2, vertexArrays);
+		for (int i = 0; i < 2; i++)
+		{
+			bindVertexArray(vertexArrays[i]);
+			glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+			glBufferData(GL_ARRAY_BUFFER, flakes.size() * sizeof(glm::vec4), &flakes[0], GL_DYNAMIC_COPY);
+			glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (GLvoid*)0);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (GLvoid*)sizeof(glm::vec4));
+			glEnableVertexAttribArray(1);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		bindVertexArray(0);
+		return true;
+	}
+
+	// deletes the buffers and programs, call before the GL context goes away
+	void release()
+	{
+		if (vertexArrays[0] != 0)
+		{
+			glDeleteVertexArrays(2, vertexArrays);
+			GLStateCache::get().invalidateVertexArray();
+		}
+		if (buffers[0] != 0)
+			glDeleteBuffers(2, buffers);
+		if (updateProgram != 0)
+			glDeleteProgram(updateProgram);
+		if (drawProgram != 0)
+			glDeleteProgram(drawProgram);
+		if (updateProgram != 0 || drawProgram != 0)
+			GLStateCache::get().invalidateProgram();
+		buffers[0] = buffers[1] = 0;
+		vertexArrays[0] = vertexArrays[1] = 0;
+		updateProgram = drawProgram = 0;
+		flakeCount = 0;
+	}
+
+	bool isEnabled() const { return flakeCount > 0; }
+	int getFlakeCount() const { return flakeCount; }
+
+	// one step of every flake, from the current buffer into the other one
+	void update(float dt)
+	{
+		if (!isEnabled())
+			return;
+
+		if (updateLocations.empty())
+		{
+			shaders->resolve(updateProgram);
+			const char* names[] = { "dt", "wind", "gravity", "drag", "groundHeight", "spawnHeight", "extent", "step" };
+			for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+				updateLocations.push_back(glGetUniformLocation(updateProgram, names[i]));
+		}
+
+		stepIndex++;
+		SnowStep step = SnowStep::make(settings, dt, time, stepIndex);
+		time += step.dt;
+
+		useProgram(updateProgram);
+		glUniform1f(updateLocations[0], step.dt);
+		glUniform3f(updateLocations[1], step.wind.x, step.wind.y, step.wind.z);
+		glUniform1f(updateLocations[2], settings.gravity);
+		glUniform1f(updateLocations[3], settings.drag);
+		glUniform1f(updateLocations[4], settings.groundHeight);
+		glUniform1f(updateLocations[5], settings.spawnHeight);
+		glUniform1f(updateLocations[6], settings.extent);
+		glUniform1ui(updateLocations[7], step.index);
+
+		bindVertexArray(vertexArrays[current]);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[1 - current]);
+		GLStateCache::get().enable(GL_RASTERIZER_DISCARD);
+		glBeginTransformFeedback(GL_POINTS);
+		drawArrays(GL_POINTS, 0, flakeCount);
+		glEndTransformFeedback();
+		GLStateCache::get().disable(GL_RASTERIZER_DISCARD);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		current = 1 - current;
+	}
+
+	// the flakes as point sprites, reads the SceneBlock bound by the render queue
+	void draw(int viewportHeight)
+	{
+		if (!isEnabled())
+			return;
+
+		if (pointScaleLocation < 0)
+		{
+			shaders->resolve(drawProgram);
+			GLuint block = glGetUniformBlockIndex(drawProgram, "SceneBlock");
+			if (block != GL_INVALID_INDEX)
+				glUniformBlockBinding(drawProgram, block, SCENE_BLOCK_BINDING);
+			pointScaleLocation = glGetUniformLocation(drawProgram, "pointScale");
+		}
+
+		useProgram(drawProgram);
+		// the perspective projection of the scene spans about 1.4 units at a distance of 1
+		glUniform1f(pointScaleLocation, settings.flakeSize * viewportHeight / 1.4f);
+		GLStateCache::get().enable(GL_PROGRAM_POINT_SIZE);
+		bindVertexArray(vertexArrays[current]);
+		drawArrays(GL_POINTS, 0, flakeCount);
+	}
+
+	// runs steps on the GPU and the CPU reference from the initial state and compares the flakes
+	bool verify(int steps, float dt)
+	{
+		if (!isEnabled())
+			return false;
+
+		SnowReference reference;
+		reference.initialize(settings);
+		std::vector<glm::vec4> flakes;
+		reference.pack(flakes);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[current]);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, flakes.size() * sizeof(glm::vec4), &flakes[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		stepIndex = 0;
+		time = 0.0;
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		double cpuTime = 0.0;
+		for (int i = 0; i < steps; i++)
+			update(dt);
+		glFinish();
+		double gpuTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		double referenceTime = 0.0;
+		for (int i = 0; i < steps; i++)
+		{
+			SnowStep step = SnowStep::make(settings, dt, referenceTime, (uint32_t)(i + 1));
+			referenceTime += step.dt;
+			std::chrono::steady_clock::time_point stepStart = std::chrono::steady_clock::now();
+			reference.update(step, SnowReference::isPathSupported(SNOW_AVX2) ? SNOW_AVX2 : SNOW_SCALAR);
+			cpuTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stepStart).count();
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[current]);
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, flakes.size() * sizeof(glm::vec4), &flakes[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// a flake landing one step apart on the GPU and the CPU respawns somewhere else, those are counted, not measured
+		int respawnedApart = 0;
+		float maxError = 0.0f;
+		for (int i = 0; i < flakeCount; i++)
+		{
+			glm::vec3 difference = glm::vec3(flakes[i * 2]) - glm::vec3(reference.px[i], reference.py[i], reference.pz[i]);
+			float error = std::max(fabs(difference.x), std::max(fabs(difference.y), fabs(difference.z)));
+			if (error > 0.01f)
+				respawnedApart++;
+			else
+				maxError = std::max(maxError, error);
+		}
+
+		bool passed = respawnedApart <= flakeCount / 1000;
+		std::cout << "Snow check : " << flakeCount << " flakes, " << steps << " steps, max error " << std::scientific << std::setprecision(2) << maxError
+			<< std::fixed << ", " << respawnedApart << " flakes apart, " << (passed ? "passed" : "FAILED") << ", GPU " << std::setprecision(3)
+			<< gpuTime / steps << " ms per step, CPU " << cpuTime / steps << " ms per step" << std::endl;
+		return passed;
+	}
+
+private:
+	SnowSettings settings;
+	ShaderBatch* shaders;
+	GLuint updateProgram;
+	GLuint drawProgram;
+	std::vector<GLint> updateLocations;
+	GLint pointScaleLocation;
+	GLuint buffers[2];
+	GLuint vertexArrays[2];   // vertexArrays[i] reads buffers[i]
+	int flakeCount;
+	int current;              // the buffer holding the latest state
+	uint32_t stepIndex;
+	double time;              // simulated seconds, the wind gusts follow it
+};
+
+// CPU reference cost per path, and how far the SIMD loop drifts from the scalar one, --bench-snow [flakes] [steps]
+inline int benchmarkSnow(int flakeCount, int steps)
+{
+	SnowSettings settings;
+	settings.flakeCount = flakeCount;
+	SnowReference scalar, simd;
+	scalar.initialize(settings);
+	simd.initialize(settings);
+
+	std::cout << "Snow benchmark, " << flakeCount << " flakes, " << steps << " steps" << std::endl;
+	SnowPath paths[] = { SNOW_SCALAR, SNOW_AVX2 };
+	SnowReference* references[] = { &scalar, &simd };
+	for (int p = 0; p < 2; p++)
+	{
+		if (!SnowReference::isPathSupported(paths[p]))
+		{
+			std::cout << SnowReference::getPathName(paths[p]) << " : not supported" << std::endl;
+			continue;
+		}
+
+		double time = 0.0, elapsed = 0.0;
+		for (int i = 0; i < steps; i++)
+		{
+			SnowStep step = SnowStep::make(settings, 1.0f / 60.0f, time, (uint32_t)(i + 1));
+			time += step.dt;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			references[p]->update(step, paths[p]);
+			elapsed += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		std::cout << std::fixed << std::setprecision(3) << SnowReference::getPathName(paths[p]) << " : " << elapsed / steps << " ms per step, "
+			<< std::setprecision(0) << flakeCount * (double)steps / elapsed << " flakes per ms" << std::endl;
+	}
+
+	if (SnowReference::isPathSupported(SNOW_AVX2))
+	{
+		float maxError = 0.0f;
+		for (int i = 0; i < flakeCount; i++)
+			maxError = std::max(maxError, std::max(fabs(scalar.px[i] - simd.px[i]), std::max(fabs(scalar.py[i] - simd.py[i]), fabs(scalar.pz[i] - simd.pz[i]))));
+		std::cout << "AVX2 against scalar : max position error " << std::scientific << std::setprecision(2) << maxError << std::fixed << std::endl;
+		if (maxError > 0.01f)
+		{
+			std::cerr << "Error::SnowReference the AVX2 loop differs from the scalar one" << std::endl;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef TEXTUREARRAY_H
+#define TEXTUREARRAY_H
+
+// Packs the scene textures into one GL_TEXTURE_2D_ARRAY.
+// Materials select a layer with the textureLayer uniform instead of binding their own texture,
+// so the whole scene needs a single texture bind per frame.
+// Include after GL/glew.h and stb_image.h.
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <utility>
+
+#include <TextureData.h>
+#include <TextureCompression.h>
+#include <ImageResize.h>
+
+class TextureArray
+{
+public:
+	// every layer of an array has the same size, images are resized to it (Lanczos3) when packed
+	TextureArray(int layerWidth = 512, int layerHeight = 512)
+		: layerWidth(layerWidth), layerHeight(layerHeight), textureId(0), videoMemorySize(0)
+	{
+	}
+
+	// queues an image and returns its layer index
+	int add(const std::string& filename)
+	{
+		sources.push_back(filename);
+		return (int)sources.size() - 1;
+	}
+
+	// runtime packer: decodes and resizes every queued image, then builds the mips and compresses them.
+	// returns false if one of the images failed
+	bool pack(const TextureBuildOptions& options = TextureBuildOptions())
+	{
+		std::vector<unsigned char> pixels((size_t)layerWidth * layerHeight * 4 * sources.size(), 0);
+
+		bool success = true;
+		for (size_t layer = 0; layer < sources.size(); layer++)
+		{
+			int width, height, nrChannels;
+			unsigned char *data = stbi_load(sources[layer].c_str(), &width, &height, &nrChannels, 4);
+			if (!data)
+			{
+				std::cerr << "Error::TextureArray could not load texture file:" << sources[layer] << std::endl;
+				success = false;
+				continue;
+			}
+
+			ImageResize::resize(data, width, height, &pixels[(size_t)layer * layerWidth * layerHeight * 4], layerWidth, layerHeight);
+			stbi_image_free(data);
+		}
+
+		texture = buildTextureData(&pixels[0], layerWidth, layerHeight, (int)sources.size(), options);
+		return success;
+	}
+
+	// offline packer: the packed layers are saved to a KTX file so the runtime can skip decoding and compressing
+	bool save(const std::string& filename) const
+	{
+		return saveKTX(filename, texture, getSourceList());
+	}
+
+	// loads layers packed offline, fails if the file was packed from other sources (or another version of them)
+	// or with another compression, so the caller can repack
+	bool load(const std::string& filename, bool compressed)
+	{
+		std::string source;
+		TextureData loaded;
+		if (!loadKTX(filename, loaded, source))
+			return false;
+
+		if (source != getSourceList() || loaded.isCompressed() != compressed
+			|| loaded.width != layerWidth || loaded.height != layerHeight || loaded.layers != (int)sources.size())
+			return false;
+
+		texture = loaded;
+		return true;
+	}
+
+	// uploads the packed layers, returns the GL texture id
+	GLuint upload()
+	{
+		if (textureId == 0)
+			glGenTextures(1, &textureId);
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		uploadTextureData(GL_TEXTURE_2D_ARRAY, texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		// the GPU has its copy now
+		videoMemorySize = texture.getTotalSize();
+		texture = TextureData();
+		return textureId;
+	}
+
+	// loads the offline pack when it is up to date, packs at runtime (and refreshes the file) otherwise.
+	// makes no GL call, so it can run on a worker thread
+	bool prepare(const std::string& packedFilename, bool compressed)
+	{
+		if (load(packedFilename, compressed))
+			return true;
+
+		std::cout << "Packing textures : " << packedFilename << std::endl;
+		TextureBuildOptions options;
+		if (!compressed)
+			options.compression = TEXTURE_COMPRESSION_NONE;
+		bool success = pack(options);
+		save(packedFilename);
+		return success;
+	}
+
+	// hands the prepared layers over to someone else uploading them (the TextureStreamer)
+	TextureData takeTextureData()
+	{
+		TextureData data;
+		std::swap(data, texture);
+		return data;
+	}
+
+	// prepares and uploads right away, the layers are BC compressed when the driver supports S3TC
+	GLuint loadOrPack(const std::string& packedFilename)
+	{
+		prepare(packedFilename, GLEW_EXT_texture_compression_s3tc != 0);
+		return upload();
+	}
+
+	GLuint getId() const { return textureId; }
+	int getLayerCount() const { return (int)sources.size(); }
+	int getLayerWidth() const { return layerWidth; }
+	int getLayerHeight() const { return layerHeight; }
+	size_t getVideoMemorySize() const { return videoMemorySize; }
+
+private:
+	// the source list is stored in the KTX file to detect stale packs
+	std::string getSourceList() const
+	{
+		std::string list;
+		for (size_t i = 0; i < sources.size(); i++)
+			list += getTextureSourceKey(sources[i]) + "|";
+		return list;
+	}
+
+	int layerWidth;
+	int layerHeight;
+	GLuint textureId;
+	size_t videoMemorySize;
+	std::vector<std::string> sources;
+	TextureData texture;
+};
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+// Textures shared by path with reference counted handles.
+// A texture nobody holds a handle to stays resident until the estimated video memory goes over the budget,
+// then the least recently used ones are deleted first.
+// Include after GL/glew.h and stb_image.h.
+
+#include <string>
+#include <map>
+#include <list>
+#include <iostream>
+
+#include <TextureStreamer.h>
+
+struct TextureCacheEntry
+{
+	GLuint textureId;
+	int refCount;
+	std::list<std::string>::iterator lruPosition;
+};
+
+// keeps a cached texture alive, must not outlive its cache
+class TextureHandle
+{
+public:
+	TextureHandle() : entry(NULL) {}
+	explicit TextureHandle(TextureCacheEntry* entry) : entry(entry) { acquire(); }
+	TextureHandle(const TextureHandle& other) : entry(other.entry) { acquire(); }
+	~TextureHandle() { release(); }
+
+	TextureHandle& operator=(const TextureHandle& other)
+	{
+		if (this != &other)
+		{
+			release();
+			entry = other.entry;
+			acquire();
+		}
+		return *this;
+	}
+
+	GLuint getId() const { return entry != NULL ? entry->textureId : 0; }
+	bool isValid() const { return entry != NULL; }
+
+private:
+	void acquire()
+	{
+		if (entry != NULL)
+			entry->refCount++;
+	}
+
+	void release()
+	{
+		if (entry != NULL)
+			entry->refCount--;
+		entry = NULL;
+	}
+
+	TextureCacheEntry* entry;  // map nodes do not move, the pointer stays valid until the entry is evicted
+};
+
+struct TextureCacheStats
+{
+	int hits;
+	int misses;
+	int evictions;
+	int residentCount;
+	size_t residentBytes;
+};
+
+class TextureCache
+{
+public:
+	TextureCache(TextureStreamer& streamer, size_t budget = 256 * 1024 * 1024)
+		: streamer(streamer), budget(budget)
+	{
+		stats.hits = 0;
+		stats.misses = 0;
+		stats.evictions = 0;
+	}
+
+	~TextureCache()
+	{
+		clear();
+	}
+
+	// deletes every texture, call before the GL context goes away once the handles are dropped
+	void clear()
+	{
+		for (std::map<std::string, TextureCacheEntry>::iterator it = entries.begin(); it != entries.end(); ++it)
+			streamer.release(it->second.textureId);
+		entries.clear();
+		lru.clear();
+	}
+
+	// GL_TEXTURE_2D streamed from an image file
+	TextureHandle acquire(const std::string& filename)
+	{
+		bool compressed = GLEW_EXT_texture_compression_s3tc != 0;
+		int maxSize = streamer.getMaxTextureSize();
+		return acquire(filename, GL_TEXTURE_2D, 0, [filename, compressed, maxSize](TextureData& texture) { return loadTextureFile(filename, compressed, texture, maxSize); });
+	}
+
+	// any streamed texture, the loader only runs on a miss
+	TextureHandle acquire(const std::string& key, GLenum target, int layers, const TextureStreamer::Loader& loader)
+	{
+		std::map<std::string, TextureCacheEntry>::iterator found = entries.find(key);
+		if (found != entries.end())
+		{
+			stats.hits++;
+			lru.splice(lru.begin(), lru, found->second.lruPosition);
+			return TextureHandle(&found->second);
+		}
+
+		stats.misses++;
+		lru.push_front(key);
+		TextureCacheEntry entry;
+		entry.textureId = streamer.request(target, layers, loader);
+		entry.refCount = 0;
+		entry.lruPosition = lru.begin();
+		found = entries.insert(std::make_pair(key, entry)).first;
+		return TextureHandle(&found->second);
+	}
+
+	// call once per frame after TextureStreamer::update, evicts unused textures while over budget
+	void update()
+	{
+		if (getResidentBytes() <= budget)
+			return;
+
+		std::list<std::string>::iterator it = lru.end();
+		while (it != lru.begin() && getResidentBytes() > budget)
+		{
+			--it;
+			std::map<std::string, TextureCacheEntry>::iterator found = entries.find(*it);
+			if (found->second.refCount > 0)
+				continue;
+
+			streamer.release(found->second.textureId);
+			entries.erase(found);
+			it = lru.erase(it);
+			stats.evictions++;
+		}
+	}
+
+	void setBudget(size_t bytes) { budget = bytes; }
+	size_t getBudget() const { return budget; }
+
+	// video memory of every cached texture with its mips, estimated from the formats
+	size_t getResidentBytes() const
+	{
+		size_t total = 0;
+		for (std::map<std::string, TextureCacheEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+			total += streamer.getVideoMemorySize(it->second.textureId);
+		return total;
+	}
+
+	TextureCacheStats getStats() const
+	{
+		TextureCacheStats current = stats;
+		current.residentCount = (int)entries.size();
+		current.residentBytes = getResidentBytes();
+		return current;
+	}
+
+	void printStats() const
+	{
+		TextureCacheStats current = getStats();
+		std::cout << "Texture cache : " << current.hits << " hits, " << current.misses << " misses, " << current.evictions << " evictions, "
+			<< current.residentCount << " textures, " << current.residentBytes / 1024 << " KB resident / " << budget / 1024 << " KB budget" << std::endl;
+	}
+
+private:
+	TextureStreamer& streamer;
+	size_t budget;
+	std::map<std::string, TextureCacheEntry> entries;
+	std::list<std::string> lru;  // most recently acquired first
+	TextureCacheStats stats;
+};
+
+#endif
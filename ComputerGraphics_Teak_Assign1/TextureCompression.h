@@ -0,0 +1,461 @@
+#ifndef TEXTURECOMPRESSION_H
+#define TEXTURECOMPRESSION_H
+
+// CPU texture processing: mip chain generation (box or Kaiser filter, optionally in linear space
+// for sRGB images) and BC1/BC3 block compression. The work is split in row bands over the job system.
+// Include after GL/glew.h.
+
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <string.h>
+
+#include <JobSystem.h>
+#include <TextureData.h>
+
+enum MipFilter
+{
+	MIP_FILTER_BOX,     // 2x2 average, fast
+	MIP_FILTER_KAISER   // Kaiser windowed sinc, sharper minification
+};
+
+enum TextureCompression
+{
+	TEXTURE_COMPRESSION_NONE,  // RGBA8
+	TEXTURE_COMPRESSION_BC1,   // 4 bits per texel, opaque
+	TEXTURE_COMPRESSION_BC3,   // 8 bits per texel, with alpha
+	TEXTURE_COMPRESSION_AUTO   // BC1 when every texel is opaque, BC3 otherwise
+};
+
+struct TextureBuildOptions
+{
+	MipFilter filter;
+	bool srgb;          // filter color channels in linear space
+	bool mipmaps;
+	TextureCompression compression;
+
+	TextureBuildOptions() : filter(MIP_FILTER_BOX), srgb(true), mipmaps(true), compression(TEXTURE_COMPRESSION_AUTO) {}
+};
+
+namespace TextureProcessing
+{
+	// conversion tables, built once (function statics are thread safe)
+	struct SrgbTables
+	{
+		float toLinear[256];
+		unsigned char toSrgb[4096];
+
+		SrgbTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < 4096; i++)
+			{
+				float c = i / 4095.0f;
+				float s = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+				toSrgb[i] = (unsigned char)(s * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	inline const SrgbTables& getSrgbTables()
+	{
+		static SrgbTables tables;
+		return tables;
+	}
+
+	inline unsigned char toByte(float value, bool srgb)
+	{
+		if (value < 0.0f) value = 0.0f;
+		if (value > 1.0f) value = 1.0f;
+		if (srgb)
+			return getSrgbTables().toSrgb[(int)(value * 4095.0f + 0.5f)];
+		return (unsigned char)(value * 255.0f + 0.5f);
+	}
+
+	// RGBA8 to float, color channels decoded to linear when srgb is set
+	inline void toFloat(const unsigned char* src, size_t texels, float* dst, bool srgb)
+	{
+		const float* table = getSrgbTables().toLinear;
+		for (size_t i = 0; i < texels * 4; i += 4)
+		{
+			for (int c = 0; c < 3; c++)
+				dst[i + c] = srgb ? table[src[i + c]] : src[i + c] / 255.0f;
+			dst[i + 3] = src[i + 3] / 255.0f;
+		}
+	}
+
+	inline float sinc(float x)
+	{
+		if (fabsf(x) < 1e-5f)
+			return 1.0f;
+		x *= 3.14159265f;
+		return sinf(x) / x;
+	}
+
+	// zeroth order modified Bessel function of the first kind
+	inline float besselI0(float x)
+	{
+		float sum = 1.0f, term = 1.0f;
+		for (int k = 1; k < 20; k++)
+		{
+			term *= (x / (2.0f * k)) * (x / (2.0f * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	// weights for halving a row: destination texel d reads source texels [2d + firstTap, 2d + firstTap + taps)
+	inline void getDownsampleWeights(MipFilter filter, std::vector<float>& weights, int& firstTap)
+	{
+		if (filter == MIP_FILTER_BOX)
+		{
+			weights.assign(2, 0.5f);
+			firstTap = 0;
+			return;
+		}
+
+		// Kaiser window of width 3 destination texels, alpha 4
+		const float width = 3.0f, alpha = 4.0f;
+		int radius = (int)(width * 2.0f);
+		firstTap = 1 - radius;
+		weights.resize(radius * 2);
+		float total = 0.0f;
+		for (int i = 0; i < radius * 2; i++)
+		{
+			// distance from the destination texel center in destination texels
+			float t = ((firstTap + i) + 0.5f - 1.0f) * 0.5f;
+			float w = t / width;
+			float window = fabsf(w) < 1.0f ? besselI0(alpha * sqrtf(1.0f - w * w)) / besselI0(alpha) : 0.0f;
+			weights[i] = sinc(t) * window;
+			total += weights[i];
+		}
+		for (size_t i = 0; i < weights.size(); i++)
+			weights[i] /= total;
+	}
+
+	// halves a float RGBA image (each dimension stops at 1), separable so the filter is applied per axis
+	inline void downsample(const float* src, int srcWidth, int srcHeight, float* dst, MipFilter filter, JobSystem& jobs)
+	{
+		int dstWidth = srcWidth > 1 ? srcWidth / 2 : 1;
+		int dstHeight = srcHeight > 1 ? srcHeight / 2 : 1;
+
+		std::vector<float> weights;
+		int firstTap;
+		getDownsampleWeights(filter, weights, firstTap);
+		int taps = (int)weights.size();
+
+		// horizontal pass into a srcHeight x dstWidth buffer
+		std::vector<float> rows((size_t)srcHeight * dstWidth * 4);
+		float* rowsData = &rows[0];
+		jobs.parallelFor(srcHeight, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; y++)
+			{
+				const float* srcRow = src + (size_t)y * srcWidth * 4;
+				for (int x = 0; x < dstWidth; x++)
+				{
+					float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+					for (int t = 0; t < taps; t++)
+					{
+						int sx = srcWidth > 1 ? 2 * x + firstTap + t : 0;
+						sx = sx < 0 ? 0 : (sx >= srcWidth ? srcWidth - 1 : sx);
+						for (int c = 0; c < 4; c++)
+							sum[c] += weights[t] * srcRow[sx * 4 + c];
+					}
+					memcpy(rowsData + ((size_t)y * dstWidth + x) * 4, sum, sizeof(sum));
+				}
+			}
+		}, 16);
+
+		// vertical pass
+		jobs.parallelFor(dstHeight, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; y++)
+			{
+				for (int x = 0; x < dstWidth; x++)
+				{
+					float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+					for (int t = 0; t < taps; t++)
+					{
+						int sy = srcHeight > 1 ? 2 * y + firstTap + t : 0;
+						sy = sy < 0 ? 0 : (sy >= srcHeight ? srcHeight - 1 : sy);
+						for (int c = 0; c < 4; c++)
+							sum[c] += weights[t] * rowsData[((size_t)sy * dstWidth + x) * 4 + c];
+					}
+					memcpy(dst + ((size_t)y * dstWidth + x) * 4, sum, sizeof(sum));
+				}
+			}
+		}, 16);
+	}
+
+	inline unsigned short to565(const float color[3])
+	{
+		int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+		int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+		int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+		r = r < 0 ? 0 : (r > 31 ? 31 : r);
+		g = g < 0 ? 0 : (g > 63 ? 63 : g);
+		b = b < 0 ? 0 : (b > 31 ? 31 : b);
+		return (unsigned short)((r << 11) | (g << 5) | b);
+	}
+
+	inline void from565(unsigned short color, int out[3])
+	{
+		int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+		out[0] = (r << 3) | (r >> 2);
+		out[1] = (g << 2) | (g >> 4);
+		out[2] = (b << 3) | (b >> 2);
+	}
+
+	// BC1 color block: endpoints along the principal axis of the block colors, inset by 1/16 of the range
+	inline void encodeBC1Block(const unsigned char block[64], unsigned char out[8])
+	{
+		float mean[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 3; c++)
+				mean[c] += block[i * 4 + c] / 16.0f;
+
+		float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+		{
+			float r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+			cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+			cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+		}
+
+		// power iteration for the principal axis
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+			float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+			float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+			float length = sqrtf(x * x + y * y + z * z);
+			if (length < 1e-6f)
+				break;
+			axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+		}
+
+		float minProjection = 1e30f, maxProjection = -1e30f;
+		for (int i = 0; i < 16; i++)
+		{
+			float p = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+			if (p < minProjection) minProjection = p;
+			if (p > maxProjection) maxProjection = p;
+		}
+		float inset = (maxProjection - minProjection) / 16.0f;
+		minProjection += inset;
+		maxProjection -= inset;
+
+		float endpoint0[3], endpoint1[3];
+		for (int c = 0; c < 3; c++)
+		{
+			endpoint0[c] = mean[c] + axis[c] * maxProjection;
+			endpoint1[c] = mean[c] + axis[c] * minProjection;
+		}
+
+		unsigned short color0 = to565(endpoint0), color1 = to565(endpoint1);
+		// color0 > color1 selects the 4 color mode
+		if (color0 < color1)
+		{
+			unsigned short swap = color0; color0 = color1; color1 = swap;
+		}
+
+		int palette[4][3];
+		from565(color0, palette[0]);
+		from565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		unsigned int indices = 0;
+		if (color0 != color1)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0, bestDistance = 1 << 30;
+				for (int p = 0; p < 4; p++)
+				{
+					int dr = block[i * 4] - palette[p][0], dg = block[i * 4 + 1] - palette[p][1], db = block[i * 4 + 2] - palette[p][2];
+					int distance = dr * dr + dg * dg + db * db;
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= (unsigned int)best << (i * 2);
+			}
+		}
+
+		out[0] = color0 & 0xFF; out[1] = color0 >> 8;
+		out[2] = color1 & 0xFF; out[3] = color1 >> 8;
+		out[4] = indices & 0xFF; out[5] = (indices >> 8) & 0xFF;
+		out[6] = (indices >> 16) & 0xFF; out[7] = indices >> 24;
+	}
+
+	// BC4 style alpha block used by BC3, 8 interpolated values between the block min and max
+	inline void encodeAlphaBlock(const unsigned char block[64], unsigned char out[8])
+	{
+		int alphaMin = 255, alphaMax = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int a = block[i * 4 + 3];
+			if (a < alphaMin) alphaMin = a;
+			if (a > alphaMax) alphaMax = a;
+		}
+
+		int palette[8];
+		palette[0] = alphaMax;
+		palette[1] = alphaMin;
+		for (int i = 2; i < 8; i++)
+			palette[i] = ((8 - i) * alphaMax + (i - 1) * alphaMin) / 7;
+
+		unsigned long long indices = 0;
+		if (alphaMax != alphaMin)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0, bestDistance = 1 << 30;
+				for (int p = 0; p < 8; p++)
+				{
+					int distance = abs(block[i * 4 + 3] - palette[p]);
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= (unsigned long long)best << (i * 3);
+			}
+		}
+
+		out[0] = (unsigned char)alphaMax;
+		out[1] = (unsigned char)alphaMin;
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = (unsigned char)(indices >> (i * 8));
+	}
+
+	// compresses one RGBA8 layer, blocks crossing the image border replicate the edge texels
+	inline void compressLayer(const unsigned char* rgba, int width, int height, GLenum format, unsigned char* out, JobSystem& jobs)
+	{
+		int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		int blockBytes = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+
+		jobs.parallelFor(blocksY, [&](int begin, int end)
+		{
+			unsigned char block[64];
+			for (int by = begin; by < end; by++)
+			{
+				for (int bx = 0; bx < blocksX; bx++)
+				{
+					for (int y = 0; y < 4; y++)
+					{
+						int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+						for (int x = 0; x < 4; x++)
+						{
+							int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+							memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+						}
+					}
+
+					unsigned char* blockOut = out + ((size_t)by * blocksX + bx) * blockBytes;
+					if (blockBytes == 16)
+					{
+						encodeAlphaBlock(block, blockOut);
+						encodeBC1Block(block, blockOut + 8);
+					}
+					else
+						encodeBC1Block(block, blockOut);
+				}
+			}
+		}, 4);
+	}
+}
+
+// Builds the GPU ready texture (mips, compression) from RGBA8 layers stored back to back.
+// layers = 0 builds a plain 2D texture.
+inline TextureData buildTextureData(const unsigned char* rgba, int width, int height, int layers, const TextureBuildOptions& options, JobSystem& jobs = JobSystem::shared())
+{
+	using namespace TextureProcessing;
+
+	TextureData texture;
+	texture.width = width;
+	texture.height = height;
+	texture.layers = layers;
+	int layerCount = texture.getLayerCount();
+	size_t layerTexels = (size_t)width * height;
+
+	TextureCompression compression = options.compression;
+	if (compression == TEXTURE_COMPRESSION_AUTO)
+	{
+		compression = TEXTURE_COMPRESSION_BC1;
+		for (size_t i = 0; i < layerTexels * layerCount; i++)
+			if (rgba[i * 4 + 3] != 255)
+			{
+				compression = TEXTURE_COMPRESSION_BC3;
+				break;
+			}
+	}
+	texture.internalFormat = compression == TEXTURE_COMPRESSION_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+		: compression == TEXTURE_COMPRESSION_BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA8;
+
+	int levelCount = 1;
+	if (options.mipmaps)
+		while ((width >> levelCount) > 0 || (height >> levelCount) > 0)
+			levelCount++;
+	texture.levels.resize(levelCount);
+
+	for (int level = 0; level < levelCount; level++)
+		texture.levels[level].resize(texture.getLayerSize(level) * layerCount);
+
+	std::vector<unsigned char> levelPixels;
+	std::vector<float> current, next;
+	for (int layer = 0; layer < layerCount; layer++)
+	{
+		const unsigned char* layerPixels = rgba + layerTexels * 4 * layer;
+		current.resize(layerTexels * 4);
+		toFloat(layerPixels, layerTexels, &current[0], options.srgb);
+
+		for (int level = 0; level < levelCount; level++)
+		{
+			int w = texture.getLevelWidth(level), h = texture.getLevelHeight(level);
+
+			// level 0 is the source as is, the others are converted back from the filtered floats
+			const unsigned char* pixels = layerPixels;
+			if (level > 0)
+			{
+				levelPixels.resize((size_t)w * h * 4);
+				for (size_t i = 0; i < (size_t)w * h * 4; i += 4)
+				{
+					for (int c = 0; c < 3; c++)
+						levelPixels[i + c] = toByte(current[i + c], options.srgb);
+					levelPixels[i + 3] = toByte(current[i + 3], false);
+				}
+				pixels = &levelPixels[0];
+			}
+
+			unsigned char* out = &texture.levels[level][0] + texture.getLayerSize(level) * layer;
+			if (texture.isCompressed())
+				compressLayer(pixels, w, h, texture.internalFormat, out, jobs);
+			else
+				memcpy(out, pixels, (size_t)w * h * 4);
+
+			if (level + 1 < levelCount)
+			{
+				next.resize((size_t)texture.getLevelWidth(level + 1) * texture.getLevelHeight(level + 1) * 4);
+				downsample(&current[0], w, h, &next[0], options.filter, jobs);
+				current.swap(next);
+			}
+		}
+	}
+	return texture;
+}
+
+#endif
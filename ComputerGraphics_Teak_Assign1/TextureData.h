@@ -0,0 +1,228 @@
+#ifndef TEXTUREDATA_H
+#define TEXTUREDATA_H
+
+// CPU side copy of a texture with its mip chain, possibly block compressed,
+// and the KTX 1.1 container used to cache it on disk.
+// Include after GL/glew.h.
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <sys/stat.h>
+
+struct TextureData
+{
+	int width;
+	int height;
+	int layers;             // 0 for a GL_TEXTURE_2D, number of layers for a GL_TEXTURE_2D_ARRAY
+	GLenum internalFormat;  // GL_RGBA8, GL_COMPRESSED_RGB_S3TC_DXT1_EXT or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+	std::vector<std::vector<unsigned char> > levels;  // each mip level holds all the layers back to back
+
+	TextureData() : width(0), height(0), layers(0), internalFormat(GL_RGBA8) {}
+
+	bool isCompressed() const { return internalFormat != GL_RGBA8; }
+	int getLayerCount() const { return layers > 0 ? layers : 1; }
+	int getLevelCount() const { return (int)levels.size(); }
+	int getLevelWidth(int level) const { return width >> level > 0 ? width >> level : 1; }
+	int getLevelHeight(int level) const { return height >> level > 0 ? height >> level : 1; }
+
+	// bytes of one layer of a mip level
+	size_t getLayerSize(int level) const
+	{
+		size_t w = getLevelWidth(level), h = getLevelHeight(level);
+		if (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+			return ((w + 3) / 4) * ((h + 3) / 4) * 8;
+		if (internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+			return ((w + 3) / 4) * ((h + 3) / 4) * 16;
+		return w * h * 4;
+	}
+
+	// bytes of the whole mip chain, what the texture costs in video memory
+	size_t getTotalSize() const
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < levels.size(); i++)
+			total += levels[i].size();
+		return total;
+	}
+};
+
+// identifies the exact version of a source image, cached textures built from another version are stale
+inline std::string getTextureSourceKey(const std::string& path)
+{
+	std::ostringstream key;
+	key << path;
+	struct stat info;
+	if (stat(path.c_str(), &info) == 0)
+		key << ";" << (long long)info.st_size << ";" << (long long)info.st_mtime;
+	return key.str();
+}
+
+// KTX 1.1 header following the 12 byte identifier
+struct KTXHeader
+{
+	unsigned int endianness;
+	unsigned int glType;
+	unsigned int glTypeSize;
+	unsigned int glFormat;
+	unsigned int glInternalFormat;
+	unsigned int glBaseInternalFormat;
+	unsigned int pixelWidth;
+	unsigned int pixelHeight;
+	unsigned int pixelDepth;
+	unsigned int numberOfArrayElements;
+	unsigned int numberOfFaces;
+	unsigned int numberOfMipmapLevels;
+	unsigned int bytesOfKeyValueData;
+};
+
+inline const unsigned char* getKTXIdentifier()
+{
+	static const unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+	return identifier;
+}
+
+// the source key is stored in the KTX key/value data under this key
+inline const char* getKTXSourceKey() { return "olafSources"; }
+
+inline bool saveKTX(const std::string& filename, const TextureData& texture, const std::string& source)
+{
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cerr << "Error::KTX could not write " << filename << std::endl;
+		return false;
+	}
+
+	unsigned int pairSize = (unsigned int)(strlen(getKTXSourceKey()) + 1 + source.size() + 1);
+	unsigned int paddedPairSize = (pairSize + 3) & ~3u;
+
+	KTXHeader header;
+	header.endianness = 0x04030201;
+	header.glType = texture.isCompressed() ? 0 : GL_UNSIGNED_BYTE;
+	header.glTypeSize = 1;
+	header.glFormat = texture.isCompressed() ? 0 : GL_RGBA;
+	header.glInternalFormat = texture.internalFormat;
+	header.glBaseInternalFormat = texture.internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? GL_RGB : GL_RGBA;
+	header.pixelWidth = texture.width;
+	header.pixelHeight = texture.height;
+	header.pixelDepth = 0;
+	header.numberOfArrayElements = texture.layers;
+	header.numberOfFaces = 1;
+	header.numberOfMipmapLevels = (unsigned int)texture.levels.size();
+	header.bytesOfKeyValueData = 4 + paddedPairSize;
+
+	file.write((const char*)getKTXIdentifier(), 12);
+	file.write((const char*)&header, sizeof(header));
+
+	const char padding[3] = { 0, 0, 0 };
+	file.write((const char*)&pairSize, sizeof(pairSize));
+	file.write(getKTXSourceKey(), strlen(getKTXSourceKey()) + 1);
+	file.write(source.c_str(), source.size() + 1);
+	file.write(padding, paddedPairSize - pairSize);
+
+	// level sizes are always a multiple of 4 here (RGBA8 texels or 8/16 byte blocks), no mip padding needed
+	for (size_t level = 0; level < texture.levels.size(); level++)
+	{
+		unsigned int imageSize = (unsigned int)texture.levels[level].size();
+		file.write((const char*)&imageSize, sizeof(imageSize));
+		file.write((const char*)&texture.levels[level][0], imageSize);
+	}
+	return file.good();
+}
+
+inline bool loadKTX(const std::string& filename, TextureData& texture, std::string& source)
+{
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	unsigned char identifier[12];
+	KTXHeader header;
+	file.read((char*)identifier, sizeof(identifier));
+	file.read((char*)&header, sizeof(header));
+	if (!file.good() || memcmp(identifier, getKTXIdentifier(), sizeof(identifier)) != 0 || header.endianness != 0x04030201)
+		return false;
+	if (header.glInternalFormat != GL_RGBA8 && header.glInternalFormat != GL_COMPRESSED_RGB_S3TC_DXT1_EXT && header.glInternalFormat != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+		return false;
+	if (header.numberOfFaces != 1 || header.pixelDepth > 1)
+		return false;
+
+	// only our source key is expected in the key/value data
+	source.clear();
+	std::vector<char> keyValue(header.bytesOfKeyValueData + 1, 0);
+	if (header.bytesOfKeyValueData > 0)
+		file.read(&keyValue[0], header.bytesOfKeyValueData);
+	size_t keyLength = strlen(getKTXSourceKey()) + 1;
+	if (header.bytesOfKeyValueData > 4 + keyLength && memcmp(&keyValue[4], getKTXSourceKey(), keyLength) == 0)
+		source = &keyValue[4 + keyLength];
+
+	texture.width = header.pixelWidth;
+	texture.height = header.pixelHeight;
+	texture.layers = header.numberOfArrayElements;
+	texture.internalFormat = header.glInternalFormat;
+	texture.levels.resize(header.numberOfMipmapLevels > 0 ? header.numberOfMipmapLevels : 1);
+	for (size_t level = 0; level < texture.levels.size(); level++)
+	{
+		unsigned int imageSize = 0;
+		file.read((char*)&imageSize, sizeof(imageSize));
+		if (!file.good() || imageSize != texture.getLayerSize((int)level) * texture.getLayerCount())
+			return false;
+		texture.levels[level].resize(imageSize);
+		file.read((char*)&texture.levels[level][0], imageSize);
+	}
+	return file.good();
+}
+
+// defines one level of the texture bound to target (GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY) with every layer.
+// data is a client pointer, or an offset when a pixel unpack buffer is bound
+inline void uploadTextureLevel(GLenum target, const TextureData& texture, int level, const void* data)
+{
+	int w = texture.getLevelWidth(level), h = texture.getLevelHeight(level);
+	GLsizei size = (GLsizei)(texture.getLayerSize(level) * texture.getLayerCount());
+
+	if (target == GL_TEXTURE_2D_ARRAY)
+	{
+		if (texture.isCompressed())
+			glCompressedTexImage3D(target, level, texture.internalFormat, w, h, texture.getLayerCount(), 0, size, data);
+		else
+			glTexImage3D(target, level, GL_RGBA8, w, h, texture.getLayerCount(), 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	}
+	else
+	{
+		if (texture.isCompressed())
+			glCompressedTexImage2D(target, level, texture.internalFormat, w, h, 0, size, data);
+		else
+			glTexImage2D(target, level, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	}
+}
+
+// mipmapped textures take the trilinear path, and anisotropic filtering when the driver has it
+inline void setTextureFiltering(GLenum target, int levelCount)
+{
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (GLEW_EXT_texture_filter_anisotropic && levelCount > 1)
+	{
+		GLfloat maxAnisotropy = 1.0f;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+		glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy < 8.0f ? maxAnisotropy : 8.0f);
+	}
+}
+
+// uploads every level to the texture bound to target (GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY)
+inline void uploadTextureData(GLenum target, const TextureData& texture)
+{
+	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, texture.getLevelCount() - 1);
+
+	for (int level = 0; level < texture.getLevelCount(); level++)
+		uploadTextureLevel(target, texture, level, &texture.levels[level][0]);
+
+	setTextureFiltering(target, texture.getLevelCount());
+}
+
+#endif
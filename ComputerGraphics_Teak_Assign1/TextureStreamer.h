@@ -0,0 +1,377 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+// Loads textures in the background.
+// request() returns a texture name right away, showing a 1x1 placeholder. A worker thread decodes the image
+// and builds its mips, then update() uploads a few mip levels per frame through a ring of pixel buffer objects.
+// Levels are uploaded smallest first and GL_TEXTURE_BASE_LEVEL follows them, so the texture sharpens
+// progressively and is complete at all times.
+// Include after GL/glew.h and stb_image.h.
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <functional>
+#include <iostream>
+#include <string.h>
+
+#include <JobSystem.h>
+#include <TextureData.h>
+#include <TextureCompression.h>
+#include <ImageResize.h>
+
+// decodes an image, scales it down to maxSize (0 keeps the full size) and builds its mips,
+// reusing the KTX cached next to it when it is up to date. makes no GL call, so it can run on a worker thread
+inline bool loadTextureFile(const std::string& filename, bool compressed, TextureData& texture, int maxSize = 0)
+{
+	std::string cacheFilename = filename + ".ktx";
+	std::string sourceKey = getTextureSourceKey(filename);
+	if (maxSize > 0)
+		sourceKey += ";max " + std::to_string(maxSize);
+	std::string cachedSourceKey;
+	if (loadKTX(cacheFilename, texture, cachedSourceKey) && cachedSourceKey == sourceKey && texture.isCompressed() == compressed && texture.layers == 0)
+		return true;
+
+	int width, height, nrChannels;
+	unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrChannels, 4);
+	if (!data)
+	{
+		std::cerr << "Error::Texture could not load texture file:" << filename << std::endl;
+		return false;
+	}
+
+	int fitWidth, fitHeight;
+	ImageResize::fitToMaxSize(width, height, maxSize, fitWidth, fitHeight);
+	std::vector<unsigned char> resized;
+	if (fitWidth != width || fitHeight != height)
+	{
+		resized.resize((size_t)fitWidth * fitHeight * 4);
+		ImageResize::resize(data, width, height, &resized[0], fitWidth, fitHeight);
+	}
+
+	TextureBuildOptions options;
+	if (!compressed)
+		options.compression = TEXTURE_COMPRESSION_NONE;
+	texture = buildTextureData(resized.empty() ? data : &resized[0], fitWidth, fitHeight, 0, options);
+	stbi_image_free(data);
+
+	saveKTX(cacheFilename, texture, sourceKey);
+	return true;
+}
+
+class TextureStreamer
+{
+public:
+	// fills the texture, runs on a worker thread
+	typedef std::function<bool(TextureData&)> Loader;
+
+	// uploadBudget is the number of bytes uploaded per frame, at least one mip level goes through each frame
+	explicit TextureStreamer(size_t uploadBudget = 4 * 1024 * 1024, JobSystem& jobs = JobSystem::shared())
+		: uploadBudget(uploadBudget), maxTextureSize(0), jobs(jobs), nextBuffer(0), uploadedBytes(0), pendingCount(0)
+	{
+		for (int i = 0; i < BUFFER_COUNT; i++)
+		{
+			buffers[i] = 0;
+			bufferSizes[i] = 0;
+			fences[i] = 0;
+		}
+	}
+
+	~TextureStreamer()
+	{
+		shutdown();
+	}
+
+	// call before the GL context goes away. the texture names belong to the caller, only the upload buffers are released
+	void shutdown()
+	{
+		// the loaders still running reference this streamer (and whatever they captured)
+		jobs.wait();
+
+		for (int i = 0; i < BUFFER_COUNT; i++)
+		{
+			if (fences[i] != 0)
+				glDeleteSync(fences[i]);
+			if (buffers[i] != 0)
+				glDeleteBuffers(1, &buffers[i]);
+			fences[i] = 0;
+			buffers[i] = 0;
+			bufferSizes[i] = 0;
+		}
+	}
+
+	// GL_TEXTURE_2D from an image file, BC compressed when the driver supports S3TC
+	GLuint request(const std::string& filename)
+	{
+		bool compressed = GLEW_EXT_texture_compression_s3tc != 0;
+		int maxSize = maxTextureSize;
+		return request(GL_TEXTURE_2D, 0, [filename, compressed, maxSize](TextureData& texture) { return loadTextureFile(filename, compressed, texture, maxSize); });
+	}
+
+	// target is GL_TEXTURE_2D (layers = 0) or GL_TEXTURE_2D_ARRAY, the loader has to produce the same layer count
+	GLuint request(GLenum target, int layers, const Loader& loader)
+	{
+		GLuint textureId = 0;
+		glGenTextures(1, &textureId);
+		glBindTexture(target, textureId);
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, 0);
+
+		// placeholder: one grey texel per layer
+		std::vector<unsigned char> grey((layers > 0 ? layers : 1) * 4, 128);
+		if (target == GL_TEXTURE_2D_ARRAY)
+			glTexImage3D(target, 0, GL_RGBA8, 1, 1, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, &grey[0]);
+		else
+			glTexImage2D(target, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &grey[0]);
+		glBindTexture(target, 0);
+
+		StreamedTexture streamed;
+		streamed.textureId = textureId;
+		streamed.target = target;
+		streamed.layers = layers;
+		streamed.pending = true;
+		streamed.released = false;
+		streamed.videoMemorySize = grey.size();
+		textures.push_back(streamed);
+		pendingCount++;
+
+		int index = (int)textures.size() - 1;
+		indices[textureId] = index;
+		jobs.submit([this, index, loader]() {
+			PROFILE_SCOPE(scope, "Texture load");
+			LoadResult result;
+			result.index = index;
+			result.success = loader(result.texture);
+
+			std::lock_guard<std::mutex> lock(resultsMutex);
+			results.push_back(std::move(result));
+		});
+
+		return textureId;
+	}
+
+	// call once per frame: picks up the decoded textures and uploads mip levels until the budget is spent
+	void update()
+	{
+		PROFILE_SCOPE(scope, "Texture streaming");
+		collectResults();
+		if (uploads.empty())
+			return;
+
+		// the buffer we are about to refill may still be read by the GPU, come back next frame in that case
+		int buffer = nextBuffer;
+		if (fences[buffer] != 0)
+		{
+			if (glClientWaitSync(fences[buffer], 0, 0) == GL_TIMEOUT_EXPIRED)
+				return;
+			glDeleteSync(fences[buffer]);
+			fences[buffer] = 0;
+		}
+
+		// pick the levels of this frame, in the order they were queued
+		size_t frameSize = 0;
+		size_t count = 0;
+		for (; count < uploads.size(); count++)
+		{
+			size_t size = getLevelSize(uploads[count]);
+			if (count > 0 && frameSize + size > uploadBudget)
+				break;
+			frameSize += (size + 15) & ~(size_t)15;
+		}
+
+		if (buffers[buffer] == 0)
+			glGenBuffers(1, &buffers[buffer]);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[buffer]);
+		// orphan the previous storage, the driver keeps it alive for the copies still in flight
+		if (bufferSizes[buffer] < frameSize)
+			bufferSizes[buffer] = frameSize;
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, bufferSizes[buffer], NULL, GL_STREAM_DRAW);
+		unsigned char* mapped = (unsigned char*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if (mapped == NULL)
+		{
+			std::cerr << "Error::TextureStreamer could not map the upload buffer" << std::endl;
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			return;
+		}
+
+		size_t offset = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			const LevelUpload& upload = uploads[i];
+			const std::vector<unsigned char>& level = textures[upload.index].texture.levels[upload.level];
+			memcpy(mapped + offset, &level[0], level.size());
+			offset += (level.size() + 15) & ~(size_t)15;
+		}
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		// the copies from the buffer into the textures happen asynchronously
+		offset = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			const LevelUpload& upload = uploads[i];
+			StreamedTexture& streamed = textures[upload.index];
+			glBindTexture(streamed.target, streamed.textureId);
+			uploadTextureLevel(streamed.target, streamed.texture, upload.level, (const void*)offset);
+			offset += (getLevelSize(upload) + 15) & ~(size_t)15;
+			uploadedBytes += getLevelSize(upload);
+
+			// the smaller levels are already there, this one can be sampled now.
+			// the placeholder stays in use until the smallest level replaces it
+			glTexParameteri(streamed.target, GL_TEXTURE_BASE_LEVEL, upload.level);
+			if (upload.level == streamed.texture.getLevelCount() - 1)
+			{
+				glTexParameteri(streamed.target, GL_TEXTURE_MAX_LEVEL, upload.level);
+				setTextureFiltering(streamed.target, streamed.texture.getLevelCount());
+			}
+			if (upload.level == 0)
+			{
+				streamed.texture = TextureData();
+				streamed.pending = false;
+				pendingCount--;
+			}
+			glBindTexture(streamed.target, 0);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		uploads.erase(uploads.begin(), uploads.begin() + count);
+
+		if (GLEW_ARB_sync)
+			fences[buffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		nextBuffer = (nextBuffer + 1) % BUFFER_COUNT;
+	}
+
+	// deletes a texture, stops loading or uploading it if it is not done yet
+	void release(GLuint textureId)
+	{
+		std::map<GLuint, int>::iterator found = indices.find(textureId);
+		if (found == indices.end())
+			return;
+
+		int index = found->second;
+		StreamedTexture& streamed = textures[index];
+		for (size_t i = 0; i < uploads.size();)
+		{
+			if (uploads[i].index == index)
+				uploads.erase(uploads.begin() + i);
+			else
+				i++;
+		}
+		if (streamed.pending)
+			pendingCount--;
+		streamed.pending = false;
+		streamed.released = true;
+		streamed.videoMemorySize = 0;
+		streamed.texture = TextureData();
+
+		glDeleteTextures(1, &streamed.textureId);
+		indices.erase(found);
+	}
+
+	// video memory of a texture with all its mips, once it is loaded (the placeholder before that)
+	size_t getVideoMemorySize(GLuint textureId) const
+	{
+		std::map<GLuint, int>::const_iterator found = indices.find(textureId);
+		return found != indices.end() ? textures[found->second].videoMemorySize : 0;
+	}
+
+	// images larger than this are scaled down before their mips are built, 0 keeps them at full size
+	void setMaxTextureSize(int size) { maxTextureSize = size; }
+	int getMaxTextureSize() const { return maxTextureSize; }
+
+	// textures still loading or uploading
+	int getPendingCount() const { return pendingCount; }
+	bool isIdle() const { return pendingCount == 0; }
+	size_t getUploadedBytes() const { return uploadedBytes; }
+
+private:
+	enum { BUFFER_COUNT = 3 };
+
+	struct StreamedTexture
+	{
+		GLuint textureId;
+		GLenum target;
+		int layers;
+		bool pending;           // loading or uploading
+		bool released;          // deleted while its loader was running, the result is dropped
+		size_t videoMemorySize;
+		TextureData texture;
+	};
+
+	struct LoadResult
+	{
+		int index;
+		bool success;
+		TextureData texture;
+	};
+
+	struct LevelUpload
+	{
+		int index;
+		int level;
+	};
+
+	size_t getLevelSize(const LevelUpload& upload) const
+	{
+		return textures[upload.index].texture.levels[upload.level].size();
+	}
+
+	// queues the levels of the textures the workers finished, smallest level first
+	void collectResults()
+	{
+		std::vector<LoadResult> done;
+		{
+			std::lock_guard<std::mutex> lock(resultsMutex);
+			done.swap(results);
+		}
+
+		for (size_t i = 0; i < done.size(); i++)
+		{
+			StreamedTexture& streamed = textures[done[i].index];
+			TextureData& texture = done[i].texture;
+			if (streamed.released)
+				continue;
+			if (!done[i].success || texture.getLevelCount() == 0 || texture.layers != streamed.layers)
+			{
+				// keeps the placeholder
+				std::cerr << "Error::TextureStreamer could not load texture " << streamed.textureId << std::endl;
+				streamed.pending = false;
+				pendingCount--;
+				continue;
+			}
+
+			streamed.texture = std::move(texture);
+			streamed.videoMemorySize = streamed.texture.getTotalSize();
+			for (int level = streamed.texture.getLevelCount() - 1; level >= 0; level--)
+			{
+				LevelUpload upload;
+				upload.index = done[i].index;
+				upload.level = level;
+				uploads.push_back(upload);
+			}
+		}
+	}
+
+	size_t uploadBudget;
+	int maxTextureSize;
+	JobSystem& jobs;
+	std::mutex resultsMutex;
+	std::vector<LoadResult> results;
+	std::vector<StreamedTexture> textures;
+	std::map<GLuint, int> indices;
+	std::deque<LevelUpload> uploads;
+
+	GLuint buffers[BUFFER_COUNT];
+	size_t bufferSizes[BUFFER_COUNT];
+	GLsync fences[BUFFER_COUNT];
+	int nextBuffer;
+
+	size_t uploadedBytes;
+	int pendingCount;
+};
+
+#endif
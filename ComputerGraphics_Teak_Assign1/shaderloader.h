@@ -1,12 +1,52 @@
+#ifndef SHADERLOADER_H
+#define SHADERLOADER_H
+
 #include <stdio.h>
 #include <string>
 #include <vector>
+#include <map>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 using namespace std;
 
-int loadSHADER(string vertex_file_path, string fragment_file_path) {
+inline bool readShaderFile(const string& file_path, string& code) {
+
+	std::ifstream ShaderStream(file_path, std::ios::in);
+	if (!ShaderStream.is_open()) {
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", file_path.c_str());
+		return false;
+	}
+	std::stringstream sstr;
+	sstr << ShaderStream.rdbuf();
+	code = sstr.str();
+	ShaderStream.close();
+	return true;
+}
+
+inline void printShaderLog(GLuint ShaderID) {
+
+	int InfoLogLength;
+	glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if (InfoLogLength > 0) {
+		std::vector<char> ShaderErrorMessage(InfoLogLength + 1);
+		glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		printf("%s\n", &ShaderErrorMessage[0]);
+	}
+}
+
+inline void printProgramLog(GLuint ProgramID) {
+
+	int InfoLogLength;
+	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if (InfoLogLength > 0) {
+		std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
+		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		printf("%s\n", &ProgramErrorMessage[0]);
+	}
+}
+
+inline int loadSHADER(string vertex_file_path, string fragment_file_path) {
 
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
@@ -14,31 +54,16 @@ int loadSHADER(string vertex_file_path, string fragment_file_path) {
 
 	// Read the Vertex Shader code from the file
 	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if (VertexShaderStream.is_open()) {
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}
-	else {
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
+	if (!readShaderFile(vertex_file_path, VertexShaderCode)) {
 		getchar();
 		return 0;
 	}
 
 	// Read the Fragment Shader code from the file
 	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if (FragmentShaderStream.is_open()) {
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
-	}
+	readShaderFile(fragment_file_path, FragmentShaderCode);
 
 	GLint Result = GL_FALSE;
-	int InfoLogLength;
 
 	// Compile Vertex Shader
 	cout << "Compiling shader : " << vertex_file_path << endl;
@@ -48,12 +73,7 @@ int loadSHADER(string vertex_file_path, string fragment_file_path) {
 
 	// Check Vertex Shader
 	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
-	}
+	printShaderLog(VertexShaderID);
 
 	// Compile Fragment Shader
 	cout << "Compiling shader : " << fragment_file_path << endl;
@@ -63,12 +83,7 @@ int loadSHADER(string vertex_file_path, string fragment_file_path) {
 
 	// Check Fragment Shader
 	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
-	}
+	printShaderLog(FragmentShaderID);
 
 	// Link the program
 	printf("Linking program\n");
@@ -79,12 +94,7 @@ int loadSHADER(string vertex_file_path, string fragment_file_path) {
 
 	// Check the program
 	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-		printf("%s\n", &ProgramErrorMessage[0]);
-	}
+	printProgramLog(ProgramID);
 
 	glDetachShader(ProgramID, VertexShaderID);
 	glDetachShader(ProgramID, FragmentShaderID);
@@ -93,4 +103,174 @@ int loadSHADER(string vertex_file_path, string fragment_file_path) {
 	glDeleteShader(FragmentShaderID);
 
 	return ProgramID;
-}
\ No newline at end of file
+}
+
+
+// Batched shader builds.
+// submit() hands the sources to the driver and issues the link right away without
+// querying any status, so the compiler can run while we load textures and meshes.
+// When GL_KHR_parallel_shader_compile (or the ARB version) is available the driver
+// also spreads the programs over its own compiler threads.
+// The status and info logs are only read the first time a program is used.
+class ShaderBatch
+{
+public:
+	ShaderBatch() : parallel(false), readyOnFirstUse(0), stalledOnFirstUse(0)
+	{
+		// allow the driver to use as many compiler threads as it wants
+		if (GLEW_KHR_parallel_shader_compile)
+		{
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+			parallel = true;
+		}
+		else if (GLEW_ARB_parallel_shader_compile)
+		{
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+			parallel = true;
+		}
+	}
+
+	// returns the program id immediately, the program is not ready yet
+	GLuint submit(const string& vertex_file_path, const string& fragment_file_path)
+	{
+		string VertexShaderCode, FragmentShaderCode;
+		if (!readShaderFile(vertex_file_path, VertexShaderCode) || !readShaderFile(fragment_file_path, FragmentShaderCode))
+			return 0;
+
+		return submitSource(VertexShaderCode, FragmentShaderCode, vertex_file_path + " / " + fragment_file_path);
+	}
+
+	GLuint submitSource(const string& vertex_code, const string& fragment_code, const string& name)
+	{
+		cout << "Submitting shader : " << name << endl;
+
+		PendingProgram pending;
+		pending.name = name;
+		pending.vertexShader = compile(GL_VERTEX_SHADER, vertex_code);
+		pending.fragmentShader = compile(GL_FRAGMENT_SHADER, fragment_code);
+
+		GLuint ProgramID = glCreateProgram();
+		glAttachShader(ProgramID, pending.vertexShader);
+		glAttachShader(ProgramID, pending.fragmentShader);
+		glLinkProgram(ProgramID);
+
+		pendingPrograms[ProgramID] = pending;
+		return ProgramID;
+	}
+
+	// vertex only program whose outputs are captured by transform feedback, interleaved in the order of varyings
+	GLuint submitFeedback(const string& vertex_file_path, const vector<const char*>& varyings)
+	{
+		string VertexShaderCode;
+		if (!readShaderFile(vertex_file_path, VertexShaderCode) || varyings.empty())
+			return 0;
+
+		cout << "Submitting shader : " << vertex_file_path << endl;
+
+		PendingProgram pending;
+		pending.name = vertex_file_path;
+		pending.vertexShader = compile(GL_VERTEX_SHADER, VertexShaderCode);
+		pending.fragmentShader = 0;
+
+		// the captured outputs are part of the link
+		GLuint ProgramID = glCreateProgram();
+		glAttachShader(ProgramID, pending.vertexShader);
+		glTransformFeedbackVaryings(ProgramID, (GLsizei)varyings.size(), &varyings[0], GL_INTERLEAVED_ATTRIBS);
+		glLinkProgram(ProgramID);
+
+		pendingPrograms[ProgramID] = pending;
+		return ProgramID;
+	}
+
+	// non blocking check, only meaningful when the driver compiles in parallel
+	bool isReady(GLuint program) const
+	{
+		if (pendingPrograms.find(program) == pendingPrograms.end())
+			return true;
+		if (!parallel)
+			return false;
+
+		GLint completed = GL_FALSE;
+		glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+		return completed == GL_TRUE;
+	}
+
+	// finishes the build on first use (may block) and reports errors, returns false if the link failed
+	bool resolve(GLuint program)
+	{
+		map<GLuint, PendingProgram>::iterator it = pendingPrograms.find(program);
+		if (it == pendingPrograms.end())
+			return true;
+
+		if (isReady(program))
+			readyOnFirstUse++;
+		else
+			stalledOnFirstUse++;
+
+		PendingProgram& pending = it->second;
+		GLint Result = GL_FALSE;
+
+		// the link status query waits for the compiler if it is still busy
+		glGetProgramiv(program, GL_LINK_STATUS, &Result);
+		if (Result != GL_TRUE)
+		{
+			cout << "Failed to build shader : " << pending.name << endl;
+			printShaderLog(pending.vertexShader);
+			if (pending.fragmentShader != 0)
+				printShaderLog(pending.fragmentShader);
+			printProgramLog(program);
+		}
+
+		glDetachShader(program, pending.vertexShader);
+		glDeleteShader(pending.vertexShader);
+		if (pending.fragmentShader != 0)
+		{
+			glDetachShader(program, pending.fragmentShader);
+			glDeleteShader(pending.fragmentShader);
+		}
+
+		pendingPrograms.erase(it);
+		return Result == GL_TRUE;
+	}
+
+	GLuint use(GLuint program)
+	{
+		resolve(program);
+		glUseProgram(program);
+		return program;
+	}
+
+	void resolveAll()
+	{
+		while (!pendingPrograms.empty())
+			resolve(pendingPrograms.begin()->first);
+	}
+
+	bool isParallel() const { return parallel; }
+	int getReadyOnFirstUse() const { return readyOnFirstUse; }
+	int getStalledOnFirstUse() const { return stalledOnFirstUse; }
+
+private:
+	struct PendingProgram
+	{
+		string name;
+		GLuint vertexShader;
+		GLuint fragmentShader;
+	};
+
+	static GLuint compile(GLenum type, const string& code)
+	{
+		GLuint ShaderID = glCreateShader(type);
+		char const * SourcePointer = code.c_str();
+		glShaderSource(ShaderID, 1, &SourcePointer, NULL);
+		glCompileShader(ShaderID);
+		return ShaderID;
+	}
+
+	bool parallel;
+	int readyOnFirstUse;
+	int stalledOnFirstUse;
+	map<GLuint, PendingProgram> pendingPrograms;
+};
+
+#endif
@@ -32,6 +32,12 @@
 static const int CACHE_SIZE = 32;
 static const int BLOCK_SIZE = (64 * 1024) - 8;
 
+#ifdef _WIN32
+typedef void *CacheFileHandle;	// HANDLE, without pulling windows.h in
+#else
+typedef int CacheFileHandle;
+#endif // _WIN32
+
 // ----------------------------------------------------------
 
 #ifdef _WIN32
@@ -61,12 +67,22 @@ class CacheFile {
 	typedef std::map<int, PageCacheIt>::iterator PageMapIt;
 
 public :
-	CacheFile(const std::string filename, BOOL keep_in_memory);
+	/**
+	@param filename Cache file name, not used when keep_in_memory is TRUE
+	@param keep_in_memory Keep every block in memory
+	@param mode Block I/O through stdio or a memory mapping of the file (ignored when keep_in_memory is TRUE)
+	@param block_size Block size in bytes, larger blocks mean less chaining for large pages
+	*/
+	CacheFile(const std::string filename, BOOL keep_in_memory, FREE_IMAGE_CACHE_MODE mode = FICM_FILE_IO, int block_size = BLOCK_SIZE);
 	~CacheFile();
 
 	BOOL open();
 	void close();
 	BOOL readFile(BYTE *data, int nr, int size);
+	/**
+	Writes a file into a chain of blocks
+	@return Returns the first block of the file, or -1 when there is no data or no block could be allocated
+	*/
 	int writeFile(BYTE *data, int size);
 	void deleteFile(int nr);
 
@@ -77,6 +93,15 @@ private :
 	BOOL unlockBlock(int nr);
 	BOOL deleteBlock(int nr);
 
+	// memory mapped mode
+	BOOL openMapping();
+	void closeMapping();
+	BOOL reserveBlocks(int count);
+	int allocateMappedBlock();
+	BOOL readMappedFile(BYTE *data, int nr, int size);
+	int writeMappedFile(BYTE *data, int size);
+	void deleteMappedFile(int nr);
+
 private :
 	FILE *m_file;
 	std::string m_filename;
@@ -87,6 +112,15 @@ private :
 	int m_page_count;
 	Block *m_current_block;
 	BOOL m_keep_in_memory;
+	BOOL m_memory_mapped;
+	int m_block_size;
+
+	// memory mapped mode: the file is grown and mapped again when it runs out of blocks
+	CacheFileHandle m_map_file;
+	void *m_map_handle;
+	BYTE *m_map;
+	int m_map_block_count;
+	std::vector<int> m_block_next;
 };
 
 #endif // CACHEFILE_H
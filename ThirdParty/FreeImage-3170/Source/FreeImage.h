@@ -524,6 +524,14 @@ FI_ENUM(FREE_IMAGE_COLOR_CHANNEL) {
 	FICC_PHASE	= 9		//! Complex images: use phase
 };
 
+/** Multipage cache modes.
+Constants used in FreeImage_SetMultiBitmapCache.
+*/
+FI_ENUM(FREE_IMAGE_CACHE_MODE) {
+	FICM_FILE_IO		= 0,	//! Blocks read and written with stdio, the last used ones kept in memory
+	FICM_MEMORY_MAPPED	= 1		//! Cache file mapped in memory, blocks paged in and out by the OS
+};
+
 // Metadata support ---------------------------------------------------------
 
 /**
@@ -787,6 +795,13 @@ extern "C" {
 DLL_API void DLL_CALLCONV FreeImage_Initialise(BOOL load_local_plugins_only FI_DEFAULT(FALSE));
 DLL_API void DLL_CALLCONV FreeImage_DeInitialise(void);
 
+// Multithreading and SIMD routines -----------------------------------------
+
+DLL_API void DLL_CALLCONV FreeImage_SetThreadCount(unsigned count);
+DLL_API unsigned DLL_CALLCONV FreeImage_GetThreadCount(void);
+DLL_API void DLL_CALLCONV FreeImage_EnableSIMD(BOOL enable);
+DLL_API BOOL DLL_CALLCONV FreeImage_IsSIMDEnabled(void);
+
 // Version routines ---------------------------------------------------------
 
 DLL_API const char *DLL_CALLCONV FreeImage_GetVersion(void);
@@ -872,6 +887,7 @@ DLL_API FIBITMAP * DLL_CALLCONV FreeImage_LockPage(FIMULTIBITMAP *bitmap, int pa
 DLL_API void DLL_CALLCONV FreeImage_UnlockPage(FIMULTIBITMAP *bitmap, FIBITMAP *data, BOOL changed);
 DLL_API BOOL DLL_CALLCONV FreeImage_MovePage(FIMULTIBITMAP *bitmap, int target, int source);
 DLL_API BOOL DLL_CALLCONV FreeImage_GetLockedPageNumbers(FIMULTIBITMAP *bitmap, int *pages, int *count);
+DLL_API void DLL_CALLCONV FreeImage_SetMultiBitmapCache(FREE_IMAGE_CACHE_MODE mode, unsigned block_size FI_DEFAULT(0));
 
 // Filetype request routines ------------------------------------------------
 
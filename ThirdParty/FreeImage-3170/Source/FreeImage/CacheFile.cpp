@@ -24,11 +24,19 @@
 #pragma warning (disable : 4786) // identifier was truncated to 'number' characters
 #endif 
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif // _WIN32
+
 #include "CacheFile.h"
 
 // ----------------------------------------------------------
 
-CacheFile::CacheFile(const std::string filename, BOOL keep_in_memory) :
+CacheFile::CacheFile(const std::string filename, BOOL keep_in_memory, FREE_IMAGE_CACHE_MODE mode, int block_size) :
 m_file(NULL),
 m_filename(filename),
 m_free_pages(),
@@ -37,7 +45,18 @@ m_page_cache_disk(),
 m_page_map(),
 m_page_count(0),
 m_current_block(NULL),
-m_keep_in_memory(keep_in_memory) {
+m_keep_in_memory(keep_in_memory),
+m_memory_mapped((mode == FICM_MEMORY_MAPPED) && !keep_in_memory && !filename.empty()),
+m_block_size((block_size > 0) ? block_size : BLOCK_SIZE),
+m_map_handle(NULL),
+m_map(NULL),
+m_map_block_count(0),
+m_block_next() {
+#ifdef _WIN32
+	m_map_file = INVALID_HANDLE_VALUE;
+#else
+	m_map_file = -1;
+#endif // _WIN32
 }
 
 CacheFile::~CacheFile() {
@@ -45,6 +64,9 @@ CacheFile::~CacheFile() {
 
 BOOL
 CacheFile::open() {
+	if (m_memory_mapped) {
+		return openMapping();
+	}
 	if ((!m_filename.empty()) && (!m_keep_in_memory)) {
 		m_file = fopen(m_filename.c_str(), "w+b");
 		return (m_file != NULL);
@@ -55,6 +77,11 @@ CacheFile::open() {
 
 void
 CacheFile::close() {
+	if (m_memory_mapped) {
+		closeMapping();
+		return;
+	}
+
 	// dispose the cache entries
 
 	while (!m_page_cache_disk.empty()) {
@@ -88,8 +115,8 @@ CacheFile::cleanupMemCache() {
 			// flush the least used block to file
 
 			Block *old_block = m_page_cache_mem.back();
-			fseek(m_file, old_block->nr * BLOCK_SIZE, SEEK_SET);
-			fwrite(old_block->data, BLOCK_SIZE, 1, m_file);
+			fseek(m_file, (long)old_block->nr * m_block_size, SEEK_SET);
+			fwrite(old_block->data, m_block_size, 1, m_file);
 
 			// remove the data
 
@@ -107,7 +134,7 @@ CacheFile::cleanupMemCache() {
 int
 CacheFile::allocateBlock() {
 	Block *block = new Block;
-	block->data = new BYTE[BLOCK_SIZE];
+	block->data = new BYTE[m_block_size];
 	block->next = 0;
 
 	if (!m_free_pages.empty()) {
@@ -138,10 +165,10 @@ CacheFile::lockBlock(int nr) {
 			// again as soon as the memory buffer fills up
 
 			if (m_current_block->data == NULL) {
-				m_current_block->data = new BYTE[BLOCK_SIZE];
+				m_current_block->data = new BYTE[m_block_size];
 
-				fseek(m_file, m_current_block->nr * BLOCK_SIZE, SEEK_SET);
-				fread(m_current_block->data, BLOCK_SIZE, 1, m_file);
+				fseek(m_file, (long)m_current_block->nr * m_block_size, SEEK_SET);
+				fread(m_current_block->data, m_block_size, 1, m_file);
 
 				m_page_cache_mem.splice(m_page_cache_mem.begin(), m_page_cache_disk, it->second);
 				m_page_map[nr] = m_page_cache_mem.begin();
@@ -193,6 +220,10 @@ CacheFile::deleteBlock(int nr) {
 
 BOOL
 CacheFile::readFile(BYTE *data, int nr, int size) {
+	if (m_memory_mapped) {
+		return readMappedFile(data, nr, size);
+	}
+
 	if ((data) && (size > 0)) {
 		int s = 0;
 		int block_nr = nr;
@@ -204,11 +235,11 @@ CacheFile::readFile(BYTE *data, int nr, int size) {
 
 			block_nr = block->next;
 
-			memcpy(data + s, block->data, (s + BLOCK_SIZE > size) ? size - s : BLOCK_SIZE);
+			memcpy(data + s, block->data, (s + m_block_size > size) ? size - s : m_block_size);
 
 			unlockBlock(copy_nr);
 
-			s += BLOCK_SIZE;
+			s += m_block_size;
 		} while (block_nr != 0);
 
 		return TRUE;
@@ -219,8 +250,12 @@ CacheFile::readFile(BYTE *data, int nr, int size) {
 
 int
 CacheFile::writeFile(BYTE *data, int size) {
+	if (m_memory_mapped) {
+		return writeMappedFile(data, size);
+	}
+
 	if ((data) && (size > 0)) {
-		int nr_blocks_required = 1 + (size / BLOCK_SIZE);
+		int nr_blocks_required = 1 + (size / m_block_size);
 		int count = 0;
 		int s = 0;
 		int stored_alloc;
@@ -235,24 +270,29 @@ CacheFile::writeFile(BYTE *data, int size) {
 
 			block->next = 0;
 
-			memcpy(block->data, data + s, (s + BLOCK_SIZE > size) ? size - s : BLOCK_SIZE);
+			memcpy(block->data, data + s, (s + m_block_size > size) ? size - s : m_block_size);
 
 			if (count + 1 < nr_blocks_required)
 				alloc = block->next = allocateBlock();
 
 			unlockBlock(copy_alloc);
 
-			s += BLOCK_SIZE;			
+			s += m_block_size;			
 		} while (++count < nr_blocks_required);
 
 		return stored_alloc;
 	}
 
-	return 0;
+	return -1;
 }
 
 void
 CacheFile::deleteFile(int nr) {
+	if (m_memory_mapped) {
+		deleteMappedFile(nr);
+		return;
+	}
+
 	do {
 		Block *block = lockBlock(nr);
 
@@ -269,3 +309,205 @@ CacheFile::deleteFile(int nr) {
 	} while (nr != 0);
 }
 
+// ----------------------------------------------------------
+// Memory mapped mode
+//
+// The blocks live in the mapped file only, the OS pages them in and out 
+// instead of the 32 blocks memory cache above. Block links are kept in 
+// m_block_next. When the file runs out of blocks, it is grown (at least 
+// doubled) and mapped again, so pointers into the mapping are never kept 
+// across calls.
+// ----------------------------------------------------------
+
+BOOL
+CacheFile::openMapping() {
+#ifdef _WIN32
+	m_map_file = CreateFileA(m_filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+	return (m_map_file != INVALID_HANDLE_VALUE);
+#else
+	m_map_file = ::open(m_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	return (m_map_file != -1);
+#endif // _WIN32
+}
+
+void
+CacheFile::closeMapping() {
+#ifdef _WIN32
+	if (m_map) {
+		UnmapViewOfFile(m_map);
+	}
+	if (m_map_handle) {
+		CloseHandle((HANDLE)m_map_handle);
+	}
+	if (m_map_file != INVALID_HANDLE_VALUE) {
+		CloseHandle((HANDLE)m_map_file);
+		m_map_file = INVALID_HANDLE_VALUE;
+
+		remove(m_filename.c_str());
+	}
+#else
+	if (m_map) {
+		munmap(m_map, (size_t)m_map_block_count * m_block_size);
+	}
+	if (m_map_file != -1) {
+		::close(m_map_file);
+		m_map_file = -1;
+
+		remove(m_filename.c_str());
+	}
+#endif // _WIN32
+
+	m_map = NULL;
+	m_map_handle = NULL;
+	m_map_block_count = 0;
+	m_block_next.clear();
+}
+
+BOOL
+CacheFile::reserveBlocks(int count) {
+	if (count <= m_map_block_count) {
+		return TRUE;
+	}
+
+	const int new_count = MAX(count, MAX(16, 2 * m_map_block_count));
+	const size_t new_size = (size_t)new_count * m_block_size;
+
+#ifdef _WIN32
+	if (m_map) {
+		UnmapViewOfFile(m_map);
+		m_map = NULL;
+	}
+	if (m_map_handle) {
+		CloseHandle((HANDLE)m_map_handle);
+		m_map_handle = NULL;
+	}
+
+	// the mapping grows the file to its size
+	const unsigned long long file_size = new_size;
+	m_map_handle = CreateFileMappingA((HANDLE)m_map_file, NULL, PAGE_READWRITE, (DWORD)(file_size >> 32), (DWORD)(file_size & 0xFFFFFFFF), NULL);
+	if (m_map_handle) {
+		m_map = (BYTE *)MapViewOfFile((HANDLE)m_map_handle, FILE_MAP_ALL_ACCESS, 0, 0, new_size);
+	}
+#else
+	if (m_map) {
+		munmap(m_map, (size_t)m_map_block_count * m_block_size);
+		m_map = NULL;
+	}
+
+	if (ftruncate(m_map_file, (off_t)new_size) == 0) {
+		void *map = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_map_file, 0);
+		if (map != MAP_FAILED) {
+			m_map = (BYTE *)map;
+
+			// large blocks are copied in and out whole, let the OS read ahead
+			if (m_block_size > BLOCK_SIZE) {
+				madvise(m_map, new_size, MADV_SEQUENTIAL);
+			}
+		}
+	}
+#endif // _WIN32
+
+	if (m_map == NULL) {
+		// the blocks written so far are still in the file, but not reachable: 
+		// this cache cannot be used anymore
+		m_map_block_count = 0;
+		return FALSE;
+	}
+
+	m_map_block_count = new_count;
+	m_block_next.resize(new_count, 0);
+	return TRUE;
+}
+
+int
+CacheFile::allocateMappedBlock() {
+	int nr;
+
+	if (!m_free_pages.empty()) {
+		nr = *m_free_pages.begin();
+		m_free_pages.pop_front();
+	} else {
+		nr = m_page_count++;
+	}
+
+	if (!reserveBlocks(nr + 1)) {
+		m_free_pages.push_front(nr);
+		return -1;
+	}
+
+	m_block_next[nr] = 0;
+
+	return nr;
+}
+
+BOOL
+CacheFile::readMappedFile(BYTE *data, int nr, int size) {
+	if ((data) && (size > 0) && (m_map)) {
+		int s = 0;
+		int block_nr = nr;
+
+		do {
+			memcpy(data + s, m_map + (size_t)block_nr * m_block_size, (s + m_block_size > size) ? size - s : m_block_size);
+
+			block_nr = m_block_next[block_nr];
+
+			s += m_block_size;
+		} while (block_nr != 0);
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+int
+CacheFile::writeMappedFile(BYTE *data, int size) {
+	if ((data) && (size > 0)) {
+		int nr_blocks_required = 1 + (size / m_block_size);
+		int s = 0;
+
+		const int first = allocateMappedBlock();
+		if (first < 0) {
+			return -1;
+		}
+
+		int nr = first;
+
+		for (int count = 0; count < nr_blocks_required; count++) {
+			// the mapping may move when a block is allocated, always address it from m_map
+			memcpy(m_map + (size_t)nr * m_block_size, data + s, (s + m_block_size > size) ? size - s : m_block_size);
+
+			s += m_block_size;
+
+			if (count + 1 < nr_blocks_required) {
+				const int next = allocateMappedBlock();
+				if (next < 0) {
+					deleteMappedFile(first);
+					return -1;
+				}
+				m_block_next[nr] = next;
+				nr = next;
+			}
+		}
+
+		return first;
+	}
+
+	return -1;
+}
+
+void
+CacheFile::deleteMappedFile(int nr) {
+	do {
+		if ((nr < 0) || (nr >= m_map_block_count)) {
+			break;
+		}
+
+		int next = m_block_next[nr];
+
+		m_block_next[nr] = 0;
+		m_free_pages.push_back(nr);
+
+		nr = next;
+	} while (nr != 0);
+}
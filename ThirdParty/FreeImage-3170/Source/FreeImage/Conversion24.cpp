@@ -25,6 +25,10 @@
 #include "FreeImage.h"
 #include "Utilities.h"
 
+#ifdef FI_SIMD_X86
+#include <immintrin.h>
+#endif
+
 // ----------------------------------------------------------
 //  internal conversions X to 24 bits
 // ----------------------------------------------------------
@@ -103,8 +107,78 @@ FreeImage_ConvertLine16To24_565(BYTE *target, BYTE *source, int width_in_pixels)
 	}
 }
 
+#ifdef FI_SIMD_X86
+
+/**
+SSSE3 32- to 24-bit kernel, 16 pixels (64 bytes in, 48 bytes out) per iteration. 
+Each group of 4 pixels is packed to 12 bytes, then the groups are stitched into 3 stores.
+@return Returns the number of converted pixels, the caller converts the remaining ones
+*/
+static FI_TARGET_SSSE3 int 
+ConvertLine32To24_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	int cols = 0;
+	for (; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source)), shuffle);
+		const __m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + 16)), shuffle);
+		const __m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + 32)), shuffle);
+		const __m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + 48)), shuffle);
+
+		_mm_storeu_si128((__m128i*)(target),      _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+		_mm_storeu_si128((__m128i*)(target + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+		_mm_storeu_si128((__m128i*)(target + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+
+		source += 64;
+		target += 48;
+	}
+	return cols;
+}
+
+/**
+AVX2 32- to 24-bit kernel, 8 pixels (32 bytes in, 24 bytes out) per iteration. 
+Both lanes are packed to 12 bytes, then joined by a cross-lane permute.
+@return Returns the number of converted pixels, the caller converts the remaining ones
+*/
+static FI_TARGET_AVX2 int 
+ConvertLine32To24_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m256i shuffle = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+	int cols = 0;
+	for (; cols + 8 <= width_in_pixels; cols += 8) {
+		const __m256i pixels = _mm256_loadu_si256((const __m256i*)source);
+		const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(pixels, shuffle), pack);
+
+		// 24 bytes, without touching the bytes after them
+		_mm_storeu_si128((__m128i*)target, _mm256_castsi256_si128(packed));
+		_mm_storel_epi64((__m128i*)(target + 16), _mm256_extracti128_si256(packed, 1));
+
+		source += 32;
+		target += 24;
+	}
+	return cols;
+}
+
+#endif // FI_SIMD_X86
+
 void DLL_CALLCONV
 FreeImage_ConvertLine32To24(BYTE *target, BYTE *source, int width_in_pixels) {
+#ifdef FI_SIMD_X86
+	const unsigned features = FreeImage_GetCPUFeatures();
+	int done = 0;
+	if (features & FI_CPU_AVX2) {
+		done = ConvertLine32To24_AVX2(target, source, width_in_pixels);
+	} else if (features & FI_CPU_SSSE3) {
+		done = ConvertLine32To24_SSSE3(target, source, width_in_pixels);
+	}
+	target += done * 3;
+	source += done * 4;
+	width_in_pixels -= done;
+#endif // FI_SIMD_X86
+
 	for (int cols = 0; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_BLUE] = source[FI_RGBA_BLUE];
 		target[FI_RGBA_GREEN] = source[FI_RGBA_GREEN];
@@ -146,49 +220,53 @@ FreeImage_ConvertTo24Bits(FIBITMAP *dib) {
 		// copy metadata from src to dst
 		FreeImage_CloneMetadata(new_dib, dib);
 
+		RGBQUAD *palette = FreeImage_GetPalette(dib);
+
 		switch(bpp) {
 			case 1 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine1To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));					
-				}
+				FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+					FreeImage_ConvertLine1To24(target, source, width, palette);
+				});
 				return new_dib;
 			}
 
 			case 4 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine4To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-				}
+				FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+					FreeImage_ConvertLine4To24(target, source, width, palette);
+				});
 				return new_dib;
 			}
 				
 			case 8 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine8To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-				}
+				FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+					FreeImage_ConvertLine8To24(target, source, width, palette);
+				});
 				return new_dib;
 			}
 
 			case 16 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					if ((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
-						FreeImage_ConvertLine16To24_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-					} else {
-						// includes case where all the masks are 0
-						FreeImage_ConvertLine16To24_555(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-					}
+				if ((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
+					FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+						FreeImage_ConvertLine16To24_565(target, source, width);
+					});
+				} else {
+					// includes case where all the masks are 0
+					FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+						FreeImage_ConvertLine16To24_555(target, source, width);
+					});
 				}
 				return new_dib;
 			}
 
 			case 32 :
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine32To24(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-				}
+				FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+					FreeImage_ConvertLine32To24(target, source, width);
+				});
 				return new_dib;
 			}
 		}
@@ -202,11 +280,7 @@ FreeImage_ConvertTo24Bits(FIBITMAP *dib) {
 		// copy metadata from src to dst
 		FreeImage_CloneMetadata(new_dib, dib);
 
-		const unsigned src_pitch = FreeImage_GetPitch(dib);
-		const unsigned dst_pitch = FreeImage_GetPitch(new_dib);
-		const BYTE *src_bits = FreeImage_GetBits(dib);
-		BYTE *dst_bits = FreeImage_GetBits(new_dib);
-		for (int rows = 0; rows < height; rows++) {
+		FreeImage_ConvertLines(new_dib, dib, [=](BYTE *dst_bits, BYTE *src_bits) {
 			const FIRGB16 *src_pixel = (FIRGB16*)src_bits;
 			RGBTRIPLE *dst_pixel = (RGBTRIPLE*)dst_bits;
 			for(int cols = 0; cols < width; cols++) {
@@ -214,9 +288,7 @@ FreeImage_ConvertTo24Bits(FIBITMAP *dib) {
 				dst_pixel[cols].rgbtGreen = (BYTE)(src_pixel[cols].green >> 8);
 				dst_pixel[cols].rgbtBlue  = (BYTE)(src_pixel[cols].blue  >> 8);
 			}
-			src_bits += src_pitch;
-			dst_bits += dst_pitch;
-		}
+		});
 
 		return new_dib;
 
@@ -229,11 +301,7 @@ FreeImage_ConvertTo24Bits(FIBITMAP *dib) {
 		// copy metadata from src to dst
 		FreeImage_CloneMetadata(new_dib, dib);
 
-		const unsigned src_pitch = FreeImage_GetPitch(dib);
-		const unsigned dst_pitch = FreeImage_GetPitch(new_dib);
-		const BYTE *src_bits = FreeImage_GetBits(dib);
-		BYTE *dst_bits = FreeImage_GetBits(new_dib);
-		for (int rows = 0; rows < height; rows++) {
+		FreeImage_ConvertLines(new_dib, dib, [=](BYTE *dst_bits, BYTE *src_bits) {
 			const FIRGBA16 *src_pixel = (FIRGBA16*)src_bits;
 			RGBTRIPLE *dst_pixel = (RGBTRIPLE*)dst_bits;
 			for(int cols = 0; cols < width; cols++) {
@@ -241,9 +309,7 @@ FreeImage_ConvertTo24Bits(FIBITMAP *dib) {
 				dst_pixel[cols].rgbtGreen = (BYTE)(src_pixel[cols].green >> 8);
 				dst_pixel[cols].rgbtBlue  = (BYTE)(src_pixel[cols].blue  >> 8);
 			}
-			src_bits += src_pitch;
-			dst_bits += dst_pitch;
-		}		
+		});
 
 		return new_dib;
 	}
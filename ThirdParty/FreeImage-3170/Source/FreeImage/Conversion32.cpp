@@ -25,6 +25,10 @@
 #include "FreeImage.h"
 #include "Utilities.h"
 
+#ifdef FI_SIMD_X86
+#include <immintrin.h>
+#endif
+
 // ----------------------------------------------------------
 //  internal conversions X to 32 bits
 // ----------------------------------------------------------
@@ -113,13 +117,84 @@ FreeImage_ConvertLine24To32(BYTE *target, BYTE *source, int width_in_pixels) {
 	}
 }
 */
+#ifdef FI_SIMD_X86
+
+/**
+SSSE3 24- to 32-bit kernel, 16 pixels (48 bytes in, 64 bytes out) per iteration. 
+The color order is the same on both sides, so the shuffle only inserts the alpha byte.
+@return Returns the number of converted pixels, the caller converts the remaining ones
+*/
+static FI_TARGET_SSSE3 int 
+ConvertLine24To32_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32((int)FI_RGBA_ALPHA_MASK);
+
+	int cols = 0;
+	for (; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m128i s0 = _mm_loadu_si128((const __m128i*)(source));
+		const __m128i s1 = _mm_loadu_si128((const __m128i*)(source + 16));
+		const __m128i s2 = _mm_loadu_si128((const __m128i*)(source + 32));
+
+		_mm_storeu_si128((__m128i*)(target),      _mm_or_si128(_mm_shuffle_epi8(s0, shuffle), alpha));
+		_mm_storeu_si128((__m128i*)(target + 16), _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(s1, s0, 12), shuffle), alpha));
+		_mm_storeu_si128((__m128i*)(target + 32), _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(s2, s1, 8), shuffle), alpha));
+		_mm_storeu_si128((__m128i*)(target + 48), _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(s2, 4), shuffle), alpha));
+
+		source += 48;
+		target += 64;
+	}
+	return cols;
+}
+
+/**
+AVX2 24- to 32-bit kernel, 8 pixels (24 bytes in, 32 bytes out) per iteration. 
+The high lane is loaded 8 bytes in, so no byte past the 24 source bytes is read.
+@return Returns the number of converted pixels, the caller converts the remaining ones
+*/
+static FI_TARGET_AVX2 int 
+ConvertLine24To32_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m256i shuffle = _mm256_setr_epi8(
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+	const __m256i alpha = _mm256_set1_epi32((int)FI_RGBA_ALPHA_MASK);
+
+	int cols = 0;
+	for (; cols + 8 <= width_in_pixels; cols += 8) {
+		const __m128i lo = _mm_loadu_si128((const __m128i*)(source));
+		const __m128i hi = _mm_loadu_si128((const __m128i*)(source + 8));
+		const __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+		_mm256_storeu_si256((__m256i*)target, _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+
+		source += 24;
+		target += 32;
+	}
+	return cols;
+}
+
+#endif // FI_SIMD_X86
+
 /**
 This unoptimized version of the conversion function avoid an undetermined bug with VC++ SP6. 
 The bug occurs in release mode only, when the image height is equal to 537 
-(try e.g. a size of 432x537 to reproduce the bug with the optimized function).
+(try e.g. a size of 432x537 to reproduce the bug with the optimized function).<br>
+Most of the line goes through a SIMD kernel when the CPU has one, the scalar loop finishes it.
 */
 void DLL_CALLCONV
 FreeImage_ConvertLine24To32(BYTE *target, BYTE *source, int width_in_pixels) {
+#ifdef FI_SIMD_X86
+	const unsigned features = FreeImage_GetCPUFeatures();
+	int done = 0;
+	if (features & FI_CPU_AVX2) {
+		done = ConvertLine24To32_AVX2(target, source, width_in_pixels);
+	} else if (features & FI_CPU_SSSE3) {
+		done = ConvertLine24To32_SSSE3(target, source, width_in_pixels);
+	}
+	target += done * 4;
+	source += done * 3;
+	width_in_pixels -= done;
+#endif // FI_SIMD_X86
+
 	for (int cols = 0; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_RED]   = source[FI_RGBA_RED];
 		target[FI_RGBA_GREEN] = source[FI_RGBA_GREEN];
@@ -213,18 +288,21 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 		FreeImage_CloneMetadata(new_dib, dib);
 
 		BOOL bIsTransparent = FreeImage_IsTransparent(dib);
+		RGBQUAD *palette = FreeImage_GetPalette(dib);
+		BYTE *table = FreeImage_GetTransparencyTable(dib);
+		const int transparent_pixels = FreeImage_GetTransparencyCount(dib);
 
 		switch(bpp) {
 			case 1:
 			{
 				if(bIsTransparent) {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine1To32MapTransparency(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
-					}
+					FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+						FreeImage_ConvertLine1To32MapTransparency(target, source, width, palette, table, transparent_pixels);
+					});
 				} else {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine1To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-					}					
+					FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+						FreeImage_ConvertLine1To32(target, source, width, palette);
+					});
 				}
 
 				return new_dib;
@@ -233,13 +311,13 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 			case 4:
 			{
 				if(bIsTransparent) {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine4To32MapTransparency(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
-					}
+					FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+						FreeImage_ConvertLine4To32MapTransparency(target, source, width, palette, table, transparent_pixels);
+					});
 				} else {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine4To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-					}					
+					FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+						FreeImage_ConvertLine4To32(target, source, width, palette);
+					});
 				}
 
 				return new_dib;
@@ -248,13 +326,13 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 			case 8:
 			{
 				if(bIsTransparent) {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine8To32MapTransparency(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib), FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
-					}
+					FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+						FreeImage_ConvertLine8To32MapTransparency(target, source, width, palette, table, transparent_pixels);
+					});
 				} else {
-					for (int rows = 0; rows < height; rows++) {
-						FreeImage_ConvertLine8To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width, FreeImage_GetPalette(dib));
-					}					
+					FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+						FreeImage_ConvertLine8To32(target, source, width, palette);
+					});
 				}
 
 				return new_dib;
@@ -262,13 +340,15 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 
 			case 16:
 			{
-				for (int rows = 0; rows < height; rows++) {
-					if ((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
-						FreeImage_ConvertLine16To32_565(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-					} else {
-						// includes case where all the masks are 0
-						FreeImage_ConvertLine16To32_555(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-					}
+				if ((FreeImage_GetRedMask(dib) == FI16_565_RED_MASK) && (FreeImage_GetGreenMask(dib) == FI16_565_GREEN_MASK) && (FreeImage_GetBlueMask(dib) == FI16_565_BLUE_MASK)) {
+					FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+						FreeImage_ConvertLine16To32_565(target, source, width);
+					});
+				} else {
+					// includes case where all the masks are 0
+					FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+						FreeImage_ConvertLine16To32_555(target, source, width);
+					});
 				}
 
 				return new_dib;
@@ -276,9 +356,9 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 
 			case 24:
 			{
-				for (int rows = 0; rows < height; rows++) {
-					FreeImage_ConvertLine24To32(FreeImage_GetScanLine(new_dib, rows), FreeImage_GetScanLine(dib, rows), width);
-				}
+				FreeImage_ConvertLines(new_dib, dib, [=](BYTE *target, BYTE *source) {
+					FreeImage_ConvertLine24To32(target, source, width);
+				});
 
 				return new_dib;
 			}
@@ -293,11 +373,7 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 		// copy metadata from src to dst
 		FreeImage_CloneMetadata(new_dib, dib);
 
-		const unsigned src_pitch = FreeImage_GetPitch(dib);
-		const unsigned dst_pitch = FreeImage_GetPitch(new_dib);
-		const BYTE *src_bits = FreeImage_GetBits(dib);
-		BYTE *dst_bits = FreeImage_GetBits(new_dib);
-		for (int rows = 0; rows < height; rows++) {
+		FreeImage_ConvertLines(new_dib, dib, [=](BYTE *dst_bits, BYTE *src_bits) {
 			const FIRGB16 *src_pixel = (FIRGB16*)src_bits;
 			RGBQUAD *dst_pixel = (RGBQUAD*)dst_bits;
 			for(int cols = 0; cols < width; cols++) {
@@ -306,9 +382,7 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 				dst_pixel[cols].rgbBlue		= (BYTE)(src_pixel[cols].blue  >> 8);
 				dst_pixel[cols].rgbReserved = (BYTE)0xFF;
 			}
-			src_bits += src_pitch;
-			dst_bits += dst_pitch;
-		}
+		});
 
 		return new_dib;
 
@@ -321,11 +395,7 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 		// copy metadata from src to dst
 		FreeImage_CloneMetadata(new_dib, dib);
 
-		const unsigned src_pitch = FreeImage_GetPitch(dib);
-		const unsigned dst_pitch = FreeImage_GetPitch(new_dib);
-		const BYTE *src_bits = FreeImage_GetBits(dib);
-		BYTE *dst_bits = FreeImage_GetBits(new_dib);
-		for (int rows = 0; rows < height; rows++) {
+		FreeImage_ConvertLines(new_dib, dib, [=](BYTE *dst_bits, BYTE *src_bits) {
 			const FIRGBA16 *src_pixel = (FIRGBA16*)src_bits;
 			RGBQUAD *dst_pixel = (RGBQUAD*)dst_bits;
 			for(int cols = 0; cols < width; cols++) {
@@ -334,9 +404,7 @@ FreeImage_ConvertTo32Bits(FIBITMAP *dib) {
 				dst_pixel[cols].rgbBlue		= (BYTE)(src_pixel[cols].blue  >> 8);
 				dst_pixel[cols].rgbReserved = (BYTE)(src_pixel[cols].alpha >> 8);
 			}
-			src_bits += src_pitch;
-			dst_bits += dst_pitch;
-		}		
+		});
 
 		return new_dib;
 	}
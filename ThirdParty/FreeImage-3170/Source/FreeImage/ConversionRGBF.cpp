@@ -22,6 +22,140 @@
 #include "FreeImage.h"
 #include "Utilities.h"
 
+#ifdef FI_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// ----------------------------------------------------------
+//   internal conversions 24- or 32-bit to RGBF
+// ----------------------------------------------------------
+
+#ifdef FI_SIMD_X86
+
+/**
+Shuffle mask gathering the R, G, B bytes of 4 pixels in that order (12 bytes, then 4 zeros)
+@param mask Receives the 16 mask bytes
+@param bytespp 3 for 24-bit or 4 for 32-bit pixels
+@param offset Offset of the first pixel in the source register
+*/
+static void 
+GetRGBShuffleMask(char *mask, unsigned bytespp, unsigned offset) {
+	for (unsigned k = 0; k < 4; k++) {
+		mask[3 * k + 0] = (char)(offset + k * bytespp + FI_RGBA_RED);
+		mask[3 * k + 1] = (char)(offset + k * bytespp + FI_RGBA_GREEN);
+		mask[3 * k + 2] = (char)(offset + k * bytespp + FI_RGBA_BLUE);
+	}
+	mask[12] = mask[13] = mask[14] = mask[15] = (char)0x80;
+}
+
+/**
+Loads 8 pixels and reorders them as R, G, B bytes: 16 bytes in rgb_lo, the last 8 ones in rgb_hi. 
+The second half is loaded 8 bytes in for 24-bit pixels, so no byte past the 8 pixels is read.
+*/
+static FI_TARGET_SSSE3 inline void 
+LoadRGB8(const BYTE *source, unsigned bytespp, __m128i mask_lo, __m128i mask_hi, __m128i &rgb_lo, __m128i &rgb_hi) {
+	const __m128i q0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)source), mask_lo);
+	const __m128i q1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + ((bytespp == 4) ? 16 : 8))), mask_hi);
+	rgb_lo = _mm_or_si128(q0, _mm_slli_si128(q1, 12));
+	rgb_hi = _mm_srli_si128(q1, 4);
+}
+
+/**
+SSSE3 24- or 32-bit to RGBF kernel, 8 pixels (24 floats) per iteration. 
+The values are divided by 255 like the scalar code, so the results are identical.
+@return Returns the number of converted pixels, the caller converts the remaining ones
+*/
+static FI_TARGET_SSSE3 unsigned 
+ConvertLineToRGBF_SSSE3(float *target, const BYTE *source, unsigned width, unsigned bytespp) {
+	char mask[16];
+	GetRGBShuffleMask(mask, bytespp, 0);
+	const __m128i mask_lo = _mm_loadu_si128((const __m128i*)mask);
+	GetRGBShuffleMask(mask, bytespp, (bytespp == 4) ? 0 : 4);
+	const __m128i mask_hi = _mm_loadu_si128((const __m128i*)mask);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(255.0F);
+
+	unsigned x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m128i rgb_lo, rgb_hi;
+		LoadRGB8(source, bytespp, mask_lo, mask_hi, rgb_lo, rgb_hi);
+
+		const __m128i w0 = _mm_unpacklo_epi8(rgb_lo, zero);
+		const __m128i w1 = _mm_unpackhi_epi8(rgb_lo, zero);
+		const __m128i w2 = _mm_unpacklo_epi8(rgb_hi, zero);
+
+		_mm_storeu_ps(target,      _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(w0, zero)), scale));
+		_mm_storeu_ps(target + 4,  _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(w0, zero)), scale));
+		_mm_storeu_ps(target + 8,  _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(w1, zero)), scale));
+		_mm_storeu_ps(target + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(w1, zero)), scale));
+		_mm_storeu_ps(target + 16, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(w2, zero)), scale));
+		_mm_storeu_ps(target + 20, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(w2, zero)), scale));
+
+		source += 8 * bytespp;
+		target += 24;
+	}
+	return x;
+}
+
+/**
+AVX2 24- or 32-bit to RGBF kernel, 8 pixels (24 floats) per iteration
+@return Returns the number of converted pixels, the caller converts the remaining ones
+*/
+static FI_TARGET_AVX2 unsigned 
+ConvertLineToRGBF_AVX2(float *target, const BYTE *source, unsigned width, unsigned bytespp) {
+	char mask[16];
+	GetRGBShuffleMask(mask, bytespp, 0);
+	const __m128i mask_lo = _mm_loadu_si128((const __m128i*)mask);
+	GetRGBShuffleMask(mask, bytespp, (bytespp == 4) ? 0 : 4);
+	const __m128i mask_hi = _mm_loadu_si128((const __m128i*)mask);
+	const __m256 scale = _mm256_set1_ps(255.0F);
+
+	unsigned x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m128i rgb_lo, rgb_hi;
+		LoadRGB8(source, bytespp, mask_lo, mask_hi, rgb_lo, rgb_hi);
+
+		_mm256_storeu_ps(target,      _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(rgb_lo)), scale));
+		_mm256_storeu_ps(target + 8,  _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(rgb_lo, 8))), scale));
+		_mm256_storeu_ps(target + 16, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(rgb_hi)), scale));
+
+		source += 8 * bytespp;
+		target += 24;
+	}
+	return x;
+}
+
+#endif // FI_SIMD_X86
+
+/**
+Convert a 24- or 32-bit scanline to RGBF, scaled to the range [0..1]
+*/
+static void 
+ConvertLineToRGBF(FIRGBF *dst_pixel, const BYTE *src_pixel, unsigned width, unsigned bytespp) {
+	unsigned x = 0;
+
+#ifdef FI_SIMD_X86
+	const unsigned features = FreeImage_GetCPUFeatures();
+	if (features & FI_CPU_AVX2) {
+		x = ConvertLineToRGBF_AVX2((float*)dst_pixel, src_pixel, width, bytespp);
+	} else if (features & FI_CPU_SSSE3) {
+		x = ConvertLineToRGBF_SSSE3((float*)dst_pixel, src_pixel, width, bytespp);
+	}
+	dst_pixel += x;
+	src_pixel += x * bytespp;
+#endif // FI_SIMD_X86
+
+	for (; x < width; x++) {
+		// convert and scale to the range [0..1]
+		dst_pixel->red   = (float)(src_pixel[FI_RGBA_RED])   / 255.0F;
+		dst_pixel->green = (float)(src_pixel[FI_RGBA_GREEN]) / 255.0F;
+		dst_pixel->blue  = (float)(src_pixel[FI_RGBA_BLUE])  / 255.0F;
+
+		src_pixel += bytespp;
+		dst_pixel ++;
+	}
+}
+
 // ----------------------------------------------------------
 //   smart convert X to RGBF
 // ----------------------------------------------------------
@@ -93,10 +227,7 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 	// copy metadata from src to dst
 	FreeImage_CloneMetadata(dst, src);
 
-	// convert from src type to RGBF
-
-	const unsigned src_pitch = FreeImage_GetPitch(src);
-	const unsigned dst_pitch = FreeImage_GetPitch(dst);
+	// convert from src type to RGBF, by bands of rows on several threads
 
 	switch(src_type) {
 		case FIT_BITMAP:
@@ -104,33 +235,15 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 			// calculate the number of bytes per pixel (3 for 24-bit or 4 for 32-bit)
 			const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
 
-			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
-			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
-
-			for(unsigned y = 0; y < height; y++) {
-				const BYTE   *src_pixel = (BYTE*)src_bits;
-				FIRGBF *dst_pixel = (FIRGBF*)dst_bits;
-				for(unsigned x = 0; x < width; x++) {
-					// convert and scale to the range [0..1]
-					dst_pixel->red   = (float)(src_pixel[FI_RGBA_RED])   / 255.0F;
-					dst_pixel->green = (float)(src_pixel[FI_RGBA_GREEN]) / 255.0F;
-					dst_pixel->blue  = (float)(src_pixel[FI_RGBA_BLUE])  / 255.0F;
-
-					src_pixel += bytespp;
-					dst_pixel ++;
-				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			FreeImage_ConvertLines(dst, src, [=](BYTE *dst_bits, BYTE *src_bits) {
+				ConvertLineToRGBF((FIRGBF*)dst_bits, src_bits, width, bytespp);
+			});
 		}
 		break;
 
 		case FIT_UINT16:
 		{
-			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
-			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
-
-			for(unsigned y = 0; y < height; y++) {
+			FreeImage_ConvertLines(dst, src, [=](BYTE *dst_bits, BYTE *src_bits) {
 				const WORD *src_pixel = (WORD*)src_bits;
 				FIRGBF *dst_pixel = (FIRGBF*)dst_bits;
 
@@ -141,18 +254,13 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 					dst_pixel[x].green = dst_value;
 					dst_pixel[x].blue  = dst_value;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
 		case FIT_RGB16:
 		{
-			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
-			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
-
-			for(unsigned y = 0; y < height; y++) {
+			FreeImage_ConvertLines(dst, src, [=](BYTE *dst_bits, BYTE *src_bits) {
 				const FIRGB16 *src_pixel = (FIRGB16*) src_bits;
 				FIRGBF  *dst_pixel = (FIRGBF*)  dst_bits;
 
@@ -162,18 +270,13 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 					dst_pixel[x].green = (float)(src_pixel[x].green) / 65535.0F;
 					dst_pixel[x].blue  = (float)(src_pixel[x].blue)  / 65535.0F;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
 		case FIT_RGBA16:
 		{
-			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
-			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
-
-			for(unsigned y = 0; y < height; y++) {
+			FreeImage_ConvertLines(dst, src, [=](BYTE *dst_bits, BYTE *src_bits) {
 				const FIRGBA16 *src_pixel = (FIRGBA16*) src_bits;
 				FIRGBF  *dst_pixel = (FIRGBF*)  dst_bits;
 
@@ -183,18 +286,13 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 					dst_pixel[x].green = (float)(src_pixel[x].green) / 65535.0F;
 					dst_pixel[x].blue  = (float)(src_pixel[x].blue)  / 65535.0F;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
 		case FIT_FLOAT:
 		{
-			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
-			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
-
-			for(unsigned y = 0; y < height; y++) {
+			FreeImage_ConvertLines(dst, src, [=](BYTE *dst_bits, BYTE *src_bits) {
 				const float *src_pixel = (float*) src_bits;
 				FIRGBF  *dst_pixel = (FIRGBF*)  dst_bits;
 
@@ -206,18 +304,13 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 					dst_pixel[x].green = value;
 					dst_pixel[x].blue  = value;
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 
 		case FIT_RGBAF:
 		{
-			const BYTE *src_bits = (BYTE*)FreeImage_GetBits(src);
-			BYTE *dst_bits = (BYTE*)FreeImage_GetBits(dst);
-
-			for(unsigned y = 0; y < height; y++) {
+			FreeImage_ConvertLines(dst, src, [=](BYTE *dst_bits, BYTE *src_bits) {
 				const FIRGBAF *src_pixel = (FIRGBAF*) src_bits;
 				FIRGBF  *dst_pixel = (FIRGBF*)  dst_bits;
 
@@ -227,9 +320,7 @@ FreeImage_ConvertToRGBF(FIBITMAP *dib) {
 					dst_pixel[x].green = CLAMP(src_pixel[x].green, 0.0F, 1.0F);
 					dst_pixel[x].blue  = CLAMP(src_pixel[x].blue, 0.0F, 1.0F);
 				}
-				src_bits += src_pitch;
-				dst_bits += dst_pitch;
-			}
+			});
 		}
 		break;
 	}
@@ -26,6 +26,15 @@
 #include <windows.h>
 #endif
 
+#include <thread>
+#include <atomic>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#endif
+
 #include "FreeImage.h"
 #include "Utilities.h"
 
@@ -92,6 +101,133 @@ FreeImage_GetCopyrightMessage() {
 
 //----------------------------------------------------------------------
 
+// 0 means one thread per hardware thread
+static unsigned s_thread_count = 0;
+
+void DLL_CALLCONV
+FreeImage_SetThreadCount(unsigned count) {
+	s_thread_count = count;
+}
+
+unsigned DLL_CALLCONV
+FreeImage_GetThreadCount() {
+	if (s_thread_count != 0) {
+		return s_thread_count;
+	}
+	const unsigned hardware_threads = std::thread::hardware_concurrency();
+	return (hardware_threads != 0) ? hardware_threads : 1;
+}
+
+void 
+FreeImage_ParallelFor(unsigned count, unsigned grain, FI_ParallelForProc proc, void *param) {
+	if (count == 0) {
+		return;
+	}
+	grain = MAX(1U, grain);
+
+	const unsigned chunks = (count + grain - 1) / grain;
+	const unsigned thread_count = MIN(FreeImage_GetThreadCount(), chunks);
+	if (thread_count <= 1) {
+		proc(param, 0, count);
+		return;
+	}
+
+	// threads are started per call rather than kept in a pool, 
+	// so that nothing is left running when the library is unloaded
+	std::atomic<unsigned> next_chunk(0);
+	auto worker = [&]() {
+		for (unsigned chunk = next_chunk++; chunk < chunks; chunk = next_chunk++) {
+			const unsigned begin = chunk * grain;
+			proc(param, begin, MIN(begin + grain, count));
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(thread_count - 1);
+	try {
+		for (unsigned i = 0; i < thread_count - 1; i++) {
+			threads.push_back(std::thread(worker));
+		}
+	} catch (...) {
+		// could not start a thread, the ones we have (and the calling thread) take its chunks
+	}
+	worker();
+
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+}
+
+//----------------------------------------------------------------------
+
+static BOOL s_simd_enabled = TRUE;
+
+void DLL_CALLCONV
+FreeImage_EnableSIMD(BOOL enable) {
+	s_simd_enabled = enable;
+}
+
+BOOL DLL_CALLCONV
+FreeImage_IsSIMDEnabled() {
+	return s_simd_enabled;
+}
+
+/**
+Query the instruction sets of the CPU once. 
+AVX2 also needs the OS to save the YMM registers (OSXSAVE and XCR0).
+*/
+static unsigned 
+DetectCPUFeatures() {
+	unsigned ecx1 = 0, edx1 = 0, ebx7 = 0;
+	BOOL ymm_saved = FALSE;
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+	int info[4];
+	__cpuid(info, 0);
+	const int max_leaf = info[0];
+	__cpuid(info, 1);
+	ecx1 = (unsigned)info[2];
+	edx1 = (unsigned)info[3];
+	if (max_leaf >= 7) {
+		__cpuidex(info, 7, 0);
+		ebx7 = (unsigned)info[1];
+	}
+	if (ecx1 & (1 << 27)) {
+		ymm_saved = ((_xgetbv(0) & 6) == 6);
+	}
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	unsigned eax, ebx, ecx, edx;
+	if (__get_cpuid(1, &eax, &ebx, &ecx1, &edx1) && (__get_cpuid_max(0, NULL) >= 7)) {
+		__cpuid_count(7, 0, eax, ebx7, ecx, edx);
+	}
+	if (ecx1 & (1 << 27)) {
+		unsigned xcr0_lo, xcr0_hi;
+		__asm__ __volatile__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+		ymm_saved = ((xcr0_lo & 6) == 6);
+	}
+#endif
+
+	unsigned features = 0;
+	if (edx1 & (1 << 26)) {
+		features |= FI_CPU_SSE2;
+	}
+	if ((features & FI_CPU_SSE2) && (ecx1 & (1 << 9))) {
+		features |= FI_CPU_SSSE3;
+	}
+	if ((features & FI_CPU_SSSE3) && ymm_saved && (ebx7 & (1 << 5))) {
+		features |= FI_CPU_AVX2;
+	}
+	return features;
+}
+
+unsigned 
+FreeImage_GetCPUFeatures() {
+	static const unsigned features = DetectCPUFeatures();
+	return s_simd_enabled ? features : 0;
+}
+
+//----------------------------------------------------------------------
+
 BOOL DLL_CALLCONV
 FreeImage_IsLittleEndian() {
 	union {
@@ -85,6 +85,7 @@ FI_STRUCT (MULTIBITMAPHEADER) {
 	CacheFile *m_cachefile;
 	std::map<FIBITMAP *, int> locked_pages;
 	BOOL changed;
+	BOOL cache_failed;	// a changed page could not be written to the cache, saving would lose it
 	int page_count;
 	BlockList m_blocks;
 	char *m_filename;
@@ -232,6 +233,17 @@ FreeImage_InternalGetPageCount(FIMULTIBITMAP *bitmap) {
 // Multipage functions
 // =====================================================================
 
+// cache used by the multipage bitmaps opened from now on
+static FREE_IMAGE_CACHE_MODE s_cache_mode = FICM_FILE_IO;
+static int s_cache_block_size = BLOCK_SIZE;
+
+void DLL_CALLCONV
+FreeImage_SetMultiBitmapCache(FREE_IMAGE_CACHE_MODE mode, unsigned block_size) {
+	s_cache_mode = mode;
+	// 0 means the default size, and blocks are kept below 1 GB
+	s_cache_block_size = (block_size == 0) ? BLOCK_SIZE : (int)MIN(block_size, 1024U * 1024U * 1024U);
+}
+
 FIMULTIBITMAP * DLL_CALLCONV
 FreeImage_OpenMultiBitmap(FREE_IMAGE_FORMAT fif, const char *filename, BOOL create_new, BOOL read_only, BOOL keep_cache_in_memory, int flags) {
 
@@ -271,6 +283,7 @@ FreeImage_OpenMultiBitmap(FREE_IMAGE_FORMAT fif, const char *filename, BOOL crea
 				header->io = io.get ();
 				header->handle = handle;						
 				header->changed = FALSE;						
+				header->cache_failed = FALSE;
 				header->read_only = read_only;
 				header->m_cachefile = NULL;
 				header->cache_fif = fif;
@@ -296,7 +309,7 @@ FreeImage_OpenMultiBitmap(FREE_IMAGE_FORMAT fif, const char *filename, BOOL crea
 					std::string cache_name;
 					ReplaceExtension(cache_name, filename, "ficache");
 
-					std::auto_ptr<CacheFile> cache_file (new CacheFile(cache_name, keep_cache_in_memory));
+					std::auto_ptr<CacheFile> cache_file (new CacheFile(cache_name, keep_cache_in_memory, s_cache_mode, s_cache_block_size));
 
 					if (cache_file->open()) {
 						// we can use release() as std::bad_alloc won't be thrown from here on
@@ -345,6 +358,7 @@ FreeImage_OpenMultiBitmapFromHandle(FREE_IMAGE_FORMAT fif, FreeImageIO *io, fi_h
 					header->fif = fif;
 					header->handle = handle;						
 					header->changed = FALSE;						
+					header->cache_failed = FALSE;
 					header->read_only = read_only;	
 					header->m_cachefile = NULL;
 					header->cache_fif = fif;
@@ -398,6 +412,11 @@ FreeImage_SaveMultiBitmapToHandle(FREE_IMAGE_FORMAT fif, FIMULTIBITMAP *bitmap,
 
 		if(node) {
 			MULTIBITMAPHEADER *header = FreeImage_GetMultiBitmapHeader(bitmap);
+
+			if (header->cache_failed) {
+				FreeImage_OutputMessageProc(fif, "A changed page could not be written to the multipage cache, the bitmap cannot be saved");
+				return FALSE;
+			}
 			
 			// dst data
 			void *data = FreeImage_Open(node, io, handle, FALSE);
@@ -444,7 +463,11 @@ FreeImage_SaveMultiBitmapToHandle(FREE_IMAGE_FORMAT fif, FIMULTIBITMAP *bitmap,
 							
 							BYTE *compressed_data = (BYTE*)malloc(ref->m_size * sizeof(BYTE));
 							
-							header->m_cachefile->readFile((BYTE *)compressed_data, ref->m_reference, ref->m_size);
+							if (!compressed_data || !header->m_cachefile->readFile((BYTE *)compressed_data, ref->m_reference, ref->m_size)) {
+								free(compressed_data);
+								success = FALSE;
+								break;
+							}
 							
 							// uncompress the data
 							
@@ -646,6 +669,11 @@ FreeImage_SavePageToBlock(MULTIBITMAPHEADER *header, FIBITMAP *data) {
 	// get rid of the compressed data
 	FreeImage_CloseMemory(hmem);
 
+	if (ref < 0) {
+		FreeImage_OutputMessageProc(header->fif, "Failed to write the page to the multipage cache");
+		return NULL;
+	}
+
 	return new(std::nothrow) BlockReference(ref, compressed_size);
 }
 
@@ -797,31 +825,35 @@ FreeImage_UnlockPage(FIMULTIBITMAP *bitmap, FIBITMAP *page, BOOL changed) {
 
 				// write the data to the cache
 
-				switch ((*i)->m_type) {
-					case BLOCK_CONTINUEUS :
-					{
-						int iPage = header->m_cachefile->writeFile(compressed_data, compressed_size);
-
-						delete (*i);
+				int iPage = header->m_cachefile->writeFile(compressed_data, compressed_size);
 
-						*i = (BlockTypeS *)new BlockReference(iPage, compressed_size);
+				if (iPage < 0) {
+					// the page keeps its previous data, and saving fails rather than writing it
+					header->cache_failed = TRUE;
+					FreeImage_OutputMessageProc(header->fif, "Failed to write page %d to the multipage cache", header->locked_pages[page]);
+				} else {
+					switch ((*i)->m_type) {
+						case BLOCK_CONTINUEUS :
+						{
+							delete (*i);
 
-						break;
-					}
+							*i = (BlockTypeS *)new BlockReference(iPage, compressed_size);
 
-					case BLOCK_REFERENCE :
-					{
-						BlockReference *reference = (BlockReference *)(*i);
+							break;
+						}
 
-						header->m_cachefile->deleteFile(reference->m_reference);
+						case BLOCK_REFERENCE :
+						{
+							BlockReference *reference = (BlockReference *)(*i);
 
-						delete (*i);
+							header->m_cachefile->deleteFile(reference->m_reference);
 
-						int iPage = header->m_cachefile->writeFile(compressed_data, compressed_size);
+							delete (*i);
 
-						*i = (BlockTypeS *)new BlockReference(iPage, compressed_size);
+							*i = (BlockTypeS *)new BlockReference(iPage, compressed_size);
 
-						break;
+							break;
+						}
 					}
 				}
 
@@ -921,6 +953,7 @@ FreeImage_LoadMultiBitmapFromMemory(FREE_IMAGE_FORMAT fif, FIMEMORY *stream, int
 						header->io = io;
 						header->handle = (fi_handle)stream;						
 						header->changed = FALSE;						
+						header->cache_failed = FALSE;
 						header->read_only = read_only;
 						header->m_cachefile = NULL;
 						header->cache_fif = fif;
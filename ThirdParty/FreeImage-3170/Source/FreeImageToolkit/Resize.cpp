@@ -21,6 +21,11 @@
 // Use at your own risk!
 // ==========================================================
 
+#include <list>
+#include <memory>
+#include <mutex>
+#include <typeinfo>
+
 #include "Resize.h"
 
 /**
@@ -505,10 +510,115 @@ FIBITMAP* CResizeEngine::scale(FIBITMAP *src, unsigned dst_width, unsigned dst_h
 	return dst;
 } 
 
+// --------------------------------------------------------------------------
+// Weights tables cache
+
+/**
+Weights tables only depend on the filter and on the source and destination sizes. 
+The most recently used ones are kept and shared between calls and threads, 
+so rescaling many images of the same size builds each table once.
+*/
+typedef struct tagWeightsTableEntry {
+	const std::type_info *filter_type;
+	double filter_width;
+	unsigned dst_size;
+	unsigned src_size;
+	std::shared_ptr<const CWeightsTable> table;
+} WeightsTableEntry;
+
+static const size_t WEIGHTS_TABLE_CACHE_SIZE = 8;
+static std::list<WeightsTableEntry> s_weights_tables;	// most recently used first
+static std::mutex s_weights_tables_mutex;
+
+static std::shared_ptr<const CWeightsTable> 
+GetWeightsTable(CGenericFilter *pFilter, unsigned uDstSize, unsigned uSrcSize) {
+	const std::type_info &filter_type = typeid(*pFilter);
+	const double filter_width = pFilter->GetWidth();
+
+	{
+		std::lock_guard<std::mutex> lock(s_weights_tables_mutex);
+		for (std::list<WeightsTableEntry>::iterator it = s_weights_tables.begin(); it != s_weights_tables.end(); ++it) {
+			if ((*it->filter_type == filter_type) && (it->filter_width == filter_width) && (it->dst_size == uDstSize) && (it->src_size == uSrcSize)) {
+				s_weights_tables.splice(s_weights_tables.begin(), s_weights_tables, it);
+				return s_weights_tables.front().table;
+			}
+		}
+	}
+
+	// build the table outside of the lock, filters are only read
+	WeightsTableEntry entry;
+	entry.filter_type = &filter_type;
+	entry.filter_width = filter_width;
+	entry.dst_size = uDstSize;
+	entry.src_size = uSrcSize;
+	entry.table = std::make_shared<CWeightsTable>(pFilter, uDstSize, uSrcSize);
+
+	std::lock_guard<std::mutex> lock(s_weights_tables_mutex);
+	s_weights_tables.push_front(entry);
+	if (s_weights_tables.size() > WEIGHTS_TABLE_CACHE_SIZE) {
+		s_weights_tables.pop_back();
+	}
+	return entry.table;
+}
+
+// --------------------------------------------------------------------------
+// Parallel filtering
+
+/**
+Arguments of a filter pass, shared by the threads filtering its rows or columns
+*/
+typedef struct tagFilterParams {
+	CResizeEngine *engine;
+	FIBITMAP *src;
+	unsigned size;
+	unsigned src_size;
+	unsigned src_offset_x;
+	unsigned src_offset_y;
+	const RGBQUAD *src_pal;
+	FIBITMAP *dst;
+	unsigned dst_size;
+	const CWeightsTable *weights;
+} FilterParams;
+
+// minimum number of destination pixels per chunk, below that a thread costs more than it saves
+static const unsigned FILTER_CHUNK_PIXELS = 65536;
+
+void CResizeEngine::horizontalFilterProc(void *param, unsigned begin, unsigned end) {
+	FilterParams *p = (FilterParams*)param;
+	p->engine->horizontalFilterRows(p->src, p->src_size, p->src_offset_x, p->src_offset_y, p->src_pal, p->dst, p->dst_size, *p->weights, begin, end);
+}
+
+void CResizeEngine::verticalFilterProc(void *param, unsigned begin, unsigned end) {
+	FilterParams *p = (FilterParams*)param;
+	p->engine->verticalFilterColumns(p->src, p->size, p->src_offset_x, p->src_offset_y, p->src_pal, p->dst, p->dst_size, *p->weights, begin, end);
+}
+
 void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsigned src_width, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_width) {
 
-	// allocate and calculate the contributions
-	CWeightsTable weightsTable(m_pFilter, dst_width, src_width);
+	// get the contributions
+	std::shared_ptr<const CWeightsTable> weightsTable = GetWeightsTable(m_pFilter, dst_width, src_width);
+
+	FilterParams params = { this, src, height, src_width, src_offset_x, src_offset_y, src_pal, dst, dst_width, weightsTable.get() };
+
+	// rows are independent, split them between threads
+	const unsigned grain = MAX(1U, FILTER_CHUNK_PIXELS / MAX(1U, dst_width));
+	FreeImage_ParallelFor(height, grain, horizontalFilterProc, &params);
+}
+
+void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned src_height, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_height) {
+
+	// get the contributions
+	std::shared_ptr<const CWeightsTable> weightsTable = GetWeightsTable(m_pFilter, dst_height, src_height);
+
+	FilterParams params = { this, src, width, src_height, src_offset_x, src_offset_y, src_pal, dst, dst_height, weightsTable.get() };
+
+	// columns are independent, split them between threads
+	// (at least 64 columns per chunk, so that threads do not write to the same cache lines)
+	const unsigned grain = MAX(64U, FILTER_CHUNK_PIXELS / MAX(1U, dst_height));
+	FreeImage_ParallelFor(width, grain, verticalFilterProc, &params);
+}
+
+void CResizeEngine::horizontalFilterRows(FIBITMAP *const src, unsigned src_width, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_width, const CWeightsTable &weightsTable, unsigned y_begin, unsigned y_end) {
 
 	// step through rows
 	switch(FreeImage_GetImageType(src)) {
@@ -524,7 +634,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							src_offset_x >>= 3;
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
 									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE * const dst_bits = FreeImage_GetScanLine(dst, y);
@@ -548,7 +658,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
 									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE * const dst_bits = FreeImage_GetScanLine(dst, y);
@@ -581,7 +691,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							src_offset_x >>= 3;
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
 									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -612,7 +722,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
 									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -649,7 +759,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// we always have got a palette here
 							src_offset_x >>= 3;
 
-							for (unsigned y = 0; y < height; y++) {
+							for (unsigned y = y_begin; y < y_end; y++) {
 								// scale each row
 								const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 								BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -695,7 +805,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// we always have got a palette for 4-bit images
 							src_offset_x >>= 1;
 
-							for (unsigned y = 0; y < height; y++) {
+							for (unsigned y = y_begin; y < y_end; y++) {
 								// scale each row
 								const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 								BYTE * const dst_bits = FreeImage_GetScanLine(dst, y);
@@ -726,7 +836,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// we always have got a palette for 4-bit images
 							src_offset_x >>= 1;
 
-							for (unsigned y = 0; y < height; y++) {
+							for (unsigned y = y_begin; y < y_end; y++) {
 								// scale each row
 								const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 								BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -764,7 +874,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// we always have got a palette for 4-bit images
 							src_offset_x >>= 1;
 
-							for (unsigned y = 0; y < height; y++) {
+							for (unsigned y = y_begin; y < y_end; y++) {
 								// scale each row
 								const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 								BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -810,7 +920,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// into an 8 bpp destination image
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
 									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE * const dst_bits = FreeImage_GetScanLine(dst, y);
@@ -835,7 +945,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
 									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE * const dst_bits = FreeImage_GetScanLine(dst, y);
@@ -867,7 +977,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 							// transparently convert the non-transparent 8-bit image to 24 bpp
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
 									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -899,7 +1009,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned y = 0; y < height; y++) {
+								for (unsigned y = y_begin; y < y_end; y++) {
 									// scale each row
 									const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 									BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -935,7 +1045,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 						{
 							// transparently convert the transparent 8-bit image to 32 bpp; 
 							// we always have got a palette here
-							for (unsigned y = 0; y < height; y++) {
+							for (unsigned y = y_begin; y < y_end; y++) {
 								// scale each row
 								const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 								BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -978,7 +1088,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 					// transparently convert the 16-bit non-transparent image to 24 bpp
 					if (IS_FORMAT_RGB565(src)) {
 						// image has 565 format
-						for (unsigned y = 0; y < height; y++) {
+						for (unsigned y = y_begin; y < y_end; y++) {
 							// scale each row
 							const WORD * const src_bits = (WORD *)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(WORD);
 							BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -1010,7 +1120,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 						}
 					} else {
 						// image has 555 format
-						for (unsigned y = 0; y < height; y++) {
+						for (unsigned y = y_begin; y < y_end; y++) {
 							// scale each row
 							const WORD * const src_bits = (WORD *)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x;
 							BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -1047,7 +1157,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 				case 24:
 				{
 					// scale the 24-bit non-transparent image into a 24 bpp destination image
-					for (unsigned y = 0; y < height; y++) {
+					for (unsigned y = y_begin; y < y_end; y++) {
 						// scale each row
 						const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x * 3;
 						BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -1083,7 +1193,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 				case 32:
 				{
 					// scale the 32-bit transparent image into a 32 bpp destination image
-					for (unsigned y = 0; y < height; y++) {
+					for (unsigned y = y_begin; y < y_end; y++) {
 						// scale each row
 						const BYTE * const src_bits = FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x * 4;
 						BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
@@ -1126,7 +1236,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 			// Calculate the number of words per pixel (1 for 16-bit, 3 for 48-bit or 4 for 64-bit)
 			const unsigned wordspp = (FreeImage_GetLine(src) / src_width) / sizeof(WORD);
 
-			for (unsigned y = 0; y < height; y++) {
+			for (unsigned y = y_begin; y < y_end; y++) {
 				// scale each row
 				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(WORD);
 				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
@@ -1160,7 +1270,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 			// Calculate the number of words per pixel (1 for 16-bit, 3 for 48-bit or 4 for 64-bit)
 			const unsigned wordspp = (FreeImage_GetLine(src) / src_width) / sizeof(WORD);
 
-			for (unsigned y = 0; y < height; y++) {
+			for (unsigned y = y_begin; y < y_end; y++) {
 				// scale each row
 				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(WORD);
 				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
@@ -1198,7 +1308,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 			// Calculate the number of words per pixel (1 for 16-bit, 3 for 48-bit or 4 for 64-bit)
 			const unsigned wordspp = (FreeImage_GetLine(src) / src_width) / sizeof(WORD);
 
-			for (unsigned y = 0; y < height; y++) {
+			for (unsigned y = y_begin; y < y_end; y++) {
 				// scale each row
 				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(WORD);
 				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
@@ -1240,7 +1350,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 			// Calculate the number of floats per pixel (1 for 32-bit, 3 for 96-bit or 4 for 128-bit)
 			const unsigned floatspp = (FreeImage_GetLine(src) / src_width) / sizeof(float);
 
-			for(unsigned y = 0; y < height; y++) {
+			for(unsigned y = y_begin; y < y_end; y++) {
 				// scale each row
 				const float *src_bits = (float*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(float);
 				float *dst_bits = (float*)FreeImage_GetScanLine(dst, y);
@@ -1276,10 +1386,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 }
 
 /// Performs vertical image filtering
-void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned src_height, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_height) {
-
-	// allocate and calculate the contributions
-	CWeightsTable weightsTable(m_pFilter, dst_height, src_height);
+void CResizeEngine::verticalFilterColumns(FIBITMAP *const src, unsigned width, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_height, const CWeightsTable &weightsTable, unsigned x_begin, unsigned x_end) {
 
 	// step through columns
 	switch(FreeImage_GetImageType(src)) {
@@ -1300,7 +1407,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 							// transparently convert the 1-bit non-transparent greyscale image to 8 bpp
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x;
 									const unsigned index = x >> 3;
@@ -1330,7 +1437,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x;
 									const unsigned index = x >> 3;
@@ -1366,7 +1473,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 							// transparently convert the non-transparent 1-bit image to 24 bpp
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x * 3;
 									const unsigned index = x >> 3;
@@ -1401,7 +1508,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x * 3;
 									const unsigned index = x >> 3;
@@ -1439,7 +1546,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						{
 							// transparently convert the transparent 1-bit image to 32 bpp; 
 							// we always have got a palette here
-							for (unsigned x = 0; x < width; x++) {
+							for (unsigned x = x_begin; x < x_end; x++) {
 								// work on column x in dst
 								BYTE *dst_bits = dst_base + x * 4;
 								const unsigned index = x >> 3;
@@ -1490,7 +1597,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						{
 							// transparently convert the non-transparent 4-bit greyscale image to 8 bpp; 
 							// we always have got a palette for 4-bit images
-							for (unsigned x = 0; x < width; x++) {
+							for (unsigned x = x_begin; x < x_end; x++) {
 								// work on column x in dst
 								BYTE *dst_bits = dst_base + x;
 								const unsigned index = x >> 1;
@@ -1523,7 +1630,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						{
 							// transparently convert the non-transparent 4-bit image to 24 bpp; 
 							// we always have got a palette for 4-bit images
-							for (unsigned x = 0; x < width; x++) {
+							for (unsigned x = x_begin; x < x_end; x++) {
 								// work on column x in dst
 								BYTE *dst_bits = dst_base + x * 3;
 								const unsigned index = x >> 1;
@@ -1562,7 +1669,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						{
 							// transparently convert the transparent 4-bit image to 32 bpp; 
 							// we always have got a palette for 4-bit images
-							for (unsigned x = 0; x < width; x++) {
+							for (unsigned x = x_begin; x < x_end; x++) {
 								// work on column x in dst
 								BYTE *dst_bits = dst_base + x * 4;
 								const unsigned index = x >> 1;
@@ -1613,7 +1720,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 							// scale the 8-bit non-transparent greyscale image into an 8 bpp destination image
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x;
 
@@ -1639,7 +1746,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x;
 
@@ -1672,7 +1779,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 							// transparently convert the non-transparent 8-bit image to 24 bpp
 							if (src_pal) {
 								// we have got a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x * 3;
 
@@ -1704,7 +1811,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 								}
 							} else {
 								// we do not have a palette
-								for (unsigned x = 0; x < width; x++) {
+								for (unsigned x = x_begin; x < x_end; x++) {
 									// work on column x in dst
 									BYTE *dst_bits = dst_base + x * 3;
 
@@ -1739,7 +1846,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						{
 							// transparently convert the transparent 8-bit image to 32 bpp; 
 							// we always have got a palette here
-							for (unsigned x = 0; x < width; x++) {
+							for (unsigned x = x_begin; x < x_end; x++) {
 								// work on column x in dst
 								BYTE *dst_bits = dst_base + x * 4;
 
@@ -1785,7 +1892,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 
 					if (IS_FORMAT_RGB565(src)) {
 						// image has 565 format
-						for (unsigned x = 0; x < width; x++) {
+						for (unsigned x = x_begin; x < x_end; x++) {
 							// work on column x in dst
 							BYTE *dst_bits = dst_base + x * 3;
 
@@ -1816,7 +1923,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						}
 					} else {
 						// image has 555 format
-						for (unsigned x = 0; x < width; x++) {
+						for (unsigned x = x_begin; x < x_end; x++) {
 							// work on column x in dst
 							BYTE *dst_bits = dst_base + x * 3;
 
@@ -1855,7 +1962,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 					const unsigned src_pitch = FreeImage_GetPitch(src);
 					const BYTE *const src_base = FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x * 3;
 
-					for (unsigned x = 0; x < width; x++) {
+					for (unsigned x = x_begin; x < x_end; x++) {
 						// work on column x in dst
 						const unsigned index = x * 3;
 						BYTE *dst_bits = dst_base + index;
@@ -1894,7 +2001,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 					const unsigned src_pitch = FreeImage_GetPitch(src);
 					const BYTE *const src_base = FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x * 4;
 
-					for (unsigned x = 0; x < width; x++) {
+					for (unsigned x = x_begin; x < x_end; x++) {
 						// work on column x in dst
 						const unsigned index = x * 4;
 						BYTE *dst_bits = dst_base + index;
@@ -1943,7 +2050,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 			const unsigned src_pitch = FreeImage_GetPitch(src) / sizeof(WORD);
 			const WORD *const src_base = (WORD *)FreeImage_GetBits(src)	+ src_offset_y * src_pitch + src_offset_x * wordspp;
 
-			for (unsigned x = 0; x < width; x++) {
+			for (unsigned x = x_begin; x < x_end; x++) {
 				// work on column x in dst
 				const unsigned index = x * wordspp;	// pixel index
 				WORD *dst_bits = dst_base + index;
@@ -1984,7 +2091,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 			const unsigned src_pitch = FreeImage_GetPitch(src) / sizeof(WORD);
 			const WORD *const src_base = (WORD *)FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x * wordspp;
 
-			for (unsigned x = 0; x < width; x++) {
+			for (unsigned x = x_begin; x < x_end; x++) {
 				// work on column x in dst
 				const unsigned index = x * wordspp;	// pixel index
 				WORD *dst_bits = dst_base + index;
@@ -2030,7 +2137,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 			const unsigned src_pitch = FreeImage_GetPitch(src) / sizeof(WORD);
 			const WORD *const src_base = (WORD *)FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x * wordspp;
 
-			for (unsigned x = 0; x < width; x++) {
+			for (unsigned x = x_begin; x < x_end; x++) {
 				// work on column x in dst
 				const unsigned index = x * wordspp;	// pixel index
 				WORD *dst_bits = dst_base + index;
@@ -2080,7 +2187,7 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 			const unsigned src_pitch = FreeImage_GetPitch(src) / sizeof(float);
 			const float *const src_base = (float *)FreeImage_GetBits(src) + src_offset_y * src_pitch + src_offset_x * floatspp;
 
-			for (unsigned x = 0; x < width; x++) {
+			for (unsigned x = x_begin; x < x_end; x++) {
 				// work on column x in dst
 				const unsigned index = x * floatspp;	// pixel index
 				float *dst_bits = (float *)dst_base + index;
@@ -74,7 +74,7 @@ public:
 	@param src_pos Pixel position in source line buffer
 	@return Returns the filter weight
 	*/
-	double getWeight(unsigned dst_pos, unsigned src_pos) {
+	double getWeight(unsigned dst_pos, unsigned src_pos) const {
 		return m_WeightTable[dst_pos].Weights[src_pos];
 	}
 
@@ -82,7 +82,7 @@ public:
 	@param dst_pos Pixel position in destination line buffer
 	@return Returns the left boundary of source line buffer
 	*/
-	unsigned getLeftBoundary(unsigned dst_pos) {
+	unsigned getLeftBoundary(unsigned dst_pos) const {
 		return m_WeightTable[dst_pos].Left;
 	}
 
@@ -90,7 +90,7 @@ public:
 	@param dst_pos Pixel position in destination line buffer
 	@return Returns the right boundary of source line buffer
 	*/
-	unsigned getRightBoundary(unsigned dst_pos) {
+	unsigned getRightBoundary(unsigned dst_pos) const {
 		return m_WeightTable[dst_pos].Right;
 	}
 };
@@ -162,7 +162,9 @@ public:
 private:
 
 	/**
-	Performs horizontal image filtering
+	Performs horizontal image filtering.<br>
+	Rows are filtered in parallel (see FreeImage_SetThreadCount), 
+	the weights table is shared with the previous calls using the same filter and sizes
 
 	@param src Source image
 	@param height Source / Destination image height
@@ -178,7 +180,10 @@ private:
 			FIBITMAP * const dst, const unsigned dst_width);
 
 	/**
-	Performs vertical image filtering
+	Performs vertical image filtering.<br>
+	Columns are filtered in parallel (see FreeImage_SetThreadCount), 
+	the weights table is shared with the previous calls using the same filter and sizes
+
 	@param src Source image
 	@param width Source / Destination image width
 	@param src_height Source image height
@@ -191,6 +196,51 @@ private:
 	void verticalFilter(FIBITMAP * const src, const unsigned width, const unsigned src_height,
 			const unsigned src_offset_x, const unsigned src_offset_y, const RGBQUAD * const src_pal,
 			FIBITMAP * const dst, const unsigned dst_height);
+
+	/// Parallel loop body of horizontalFilter
+	static void horizontalFilterProc(void *param, unsigned begin, unsigned end);
+
+	/// Parallel loop body of verticalFilter
+	static void verticalFilterProc(void *param, unsigned begin, unsigned end);
+
+	/**
+	Performs horizontal image filtering of the rows [y_begin, y_end)
+
+	@param src Source image
+	@param height Source / Destination image height
+	@param src_width Source image width
+	@param src_offset_x
+	@param src_offset_y
+	@param src_pal
+	@param dst Destination image
+	@param dst_width Destination image width
+	@param weightsTable Contributions of the source pixels
+	@param y_begin First row
+	@param y_end Row after the last one
+	*/
+	void horizontalFilterRows(FIBITMAP * const src, const unsigned src_width,
+			const unsigned src_offset_x, const unsigned src_offset_y, const RGBQUAD * const src_pal,
+			FIBITMAP * const dst, const unsigned dst_width, const CWeightsTable &weightsTable, 
+			const unsigned y_begin, const unsigned y_end);
+
+	/**
+	Performs vertical image filtering of the columns [x_begin, x_end)
+	@param src Source image
+	@param width Source / Destination image width
+	@param src_height Source image height
+	@param src_offset_x
+	@param src_offset_y
+	@param src_pal
+	@param dst Destination image
+	@param dst_height Destination image height
+	@param weightsTable Contributions of the source pixels
+	@param x_begin First column
+	@param x_end Column after the last one
+	*/
+	void verticalFilterColumns(FIBITMAP * const src, const unsigned width,
+			const unsigned src_offset_x, const unsigned src_offset_y, const RGBQUAD * const src_pal,
+			FIBITMAP * const dst, const unsigned dst_height, const CWeightsTable &weightsTable, 
+			const unsigned x_begin, const unsigned x_end);
 };
 
 #endif //   _RESIZE_H_
@@ -125,6 +125,94 @@ DLL_API BOOL DLL_CALLCONV FreeImage_HasRGBMasks(FIBITMAP *dib);
 }
 #endif
 
+// ==========================================================
+//   Multithreading
+// ==========================================================
+
+/**
+Body of a parallel loop, processes the items [begin, end)
+*/
+typedef void (*FI_ParallelForProc)(void *param, unsigned begin, unsigned end);
+
+/**
+Run proc over [0, count) in chunks of grain items, spread over FreeImage_GetThreadCount() threads 
+(the calling thread included). Chunks never overlap, so results do not depend on the thread count.
+defined in FreeImage.cpp
+@param count Number of items
+@param grain Minimum number of items per chunk
+@param proc Loop body
+@param param User parameter passed to proc
+*/
+void FreeImage_ParallelFor(unsigned count, unsigned grain, FI_ParallelForProc proc, void *param);
+
+/// Adapts a functor to FI_ParallelForProc
+template <class Body> void FreeImage_ParallelForBody(void *param, unsigned begin, unsigned end) {
+	(*(Body*)param)(begin, end);
+}
+
+/**
+Run body(begin, end) over [0, count), see above
+*/
+template <class Body> void FreeImage_ParallelFor(unsigned count, unsigned grain, Body &body) {
+	FreeImage_ParallelFor(count, grain, FreeImage_ParallelForBody<Body>, &body);
+}
+
+/**
+Number of rows of an image band given to a thread. 
+Bands of less than 64K pixels cost more to hand over than they save.
+*/
+inline unsigned FreeImage_GetBandHeight(unsigned width) {
+	return ((width == 0) || (width >= 65536)) ? 1 : 65536 / width;
+}
+
+/**
+Converts every scanline of src into the same scanline of dst, by bands of rows on several threads
+@param dst Destination image
+@param src Source image, with the same height as dst
+@param proc Called as proc(dst_scanline, src_scanline)
+*/
+template <class LineProc> void FreeImage_ConvertLines(FIBITMAP *dst, FIBITMAP *src, LineProc proc) {
+	auto body = [dst, src, &proc](unsigned begin, unsigned end) {
+		for (unsigned rows = begin; rows < end; rows++) {
+			proc(FreeImage_GetScanLine(dst, rows), FreeImage_GetScanLine(src, rows));
+		}
+	};
+	FreeImage_ParallelFor(FreeImage_GetHeight(src), FreeImage_GetBandHeight(FreeImage_GetWidth(src)), body);
+}
+
+// ==========================================================
+//   SIMD
+// ==========================================================
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define FI_SIMD_X86
+// functions using instructions above SSE2 are compiled for them one by one 
+// and only called when FreeImage_GetCPUFeatures reports them
+#if defined(_MSC_VER)
+#define FI_TARGET_SSSE3
+#define FI_TARGET_AVX2
+#else
+#define FI_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define FI_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif // x86
+
+/**
+Instruction sets the conversion kernels can use
+*/
+enum FI_CPUFeature {
+	FI_CPU_SSE2  = 0x01,
+	FI_CPU_SSSE3 = 0x02,
+	FI_CPU_AVX2  = 0x04
+};
+
+/**
+Instruction sets of the running CPU (and OS), as a combination of FI_CPUFeature. 
+Returns 0 when SIMD is disabled with FreeImage_EnableSIMD(FALSE).
+defined in FreeImage.cpp
+*/
+unsigned FreeImage_GetCPUFeatures();
+
 
 // ==========================================================
 //   File I/O structs
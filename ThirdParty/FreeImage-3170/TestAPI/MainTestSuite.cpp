@@ -59,6 +59,16 @@ int main(int argc, char *argv[]) {
 	// initialize our own FreeImage error handler
 	FreeImage_SetOutputMessage(FreeImageErrorHandler);
 
+	// time the multipage cache modes on the texture array workload instead of running the tests
+	if((argc > 1) && (strcmp(argv[1], "--bench-mpage-cache") == 0)) {
+		benchMultiPageCacheModes(1024, 32);
+
+#if defined(FREEIMAGE_LIB) || !defined(WIN32)
+		FreeImage_DeInitialise();
+#endif
+		return 0;
+	}
+
 	// test plugins capabilities
 	showPlugins();
 
@@ -84,6 +94,9 @@ int main(int argc, char *argv[]) {
 	// test multipage streaming with memory IO
 	testMultiPageMemory("sample.tif");
 
+	// test the multipage cache modes
+	testMultiPageCacheModes("sample.png");
+
 	// test JPEG lossless transform & cropping
 	testJPEG();
 
@@ -102,6 +115,12 @@ int main(int argc, char *argv[]) {
 	// test wrapped user buffer
 	testWrappedBuffer("exif.jpg", 0);
 
+	// test multithreaded rescaling of a 8K image
+	testResizeThreads(7680, 4320, 0);
+
+	// test SIMD and multithreaded conversions of a 8K image
+	testConvertThreads(7680, 4320, 0);
+
 #if defined(FREEIMAGE_LIB) || !defined(WIN32)
 	FreeImage_DeInitialise();
 #endif
@@ -29,6 +29,7 @@
 #include <assert.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if (defined(WIN32) || defined(__WIN32__))
 #if (defined(_DEBUG))
@@ -40,6 +41,8 @@
 // Some useful tools
 // ==========================================================
 FIBITMAP* createZonePlateImage(unsigned width, unsigned height, int scale);
+FIBITMAP* createColorTestImage(FREE_IMAGE_TYPE image_type, unsigned bpp, unsigned width, unsigned height);
+BOOL isSameImage(FIBITMAP *dib1, FIBITMAP *dib2);
 
 // Test plugins capabilities
 // ==========================================================
@@ -71,6 +74,8 @@ void testMemIO(const char *lpszPathName);
 void testMultiPage(const char *lpszPathName);
 void testStreamMultiPage(const char *lpszPathName);
 void testMultiPageMemory(const char *lpszPathName);
+void testMultiPageCacheModes(const char *lpszPathName);
+void benchMultiPageCacheModes(unsigned size, int page_count);
 
 // JPEG test suite
 // ==========================================================
@@ -92,6 +97,16 @@ void testThumbnail(const char *lpszPathName, int flags);
 
 void testWrappedBuffer(const char *lpszPathName, int flags);
 
+// Resize test suite
+// ==========================================================
+
+void testResizeThreads(unsigned width, unsigned height, unsigned max_threads);
+
+// Conversion test suite
+// ==========================================================
+
+void testConvertThreads(unsigned width, unsigned height, unsigned max_threads);
+
 #endif // TEST_FREEIMAGE_API_H
 
 
@@ -0,0 +1,138 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// Design and implementation by
+// - Herv Drolon (drolon@infonie.fr)
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+#include <chrono>
+
+// Local test functions
+// ----------------------------------------------------------
+
+typedef FIBITMAP* (DLL_CALLCONV *ConvertProc)(FIBITMAP *dib);
+
+/**
+Time a conversion (best of 3 runs, to leave out the first touch of the allocated pixels), 
+returns the converted image
+*/
+static FIBITMAP* timeConversion(FIBITMAP *src, ConvertProc convert, double &time) {
+	FIBITMAP *dst = NULL;
+	for(int run = 0; run < 3; run++) {
+		if(dst) FreeImage_Unload(dst);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		dst = convert(src);
+		const double run_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		assert(dst != NULL);
+
+		time = (run == 0) ? run_time : ((run_time < time) ? run_time : time);
+	}
+	return dst;
+}
+
+/**
+Convert an image with the scalar code on 1 thread, then with SIMD on 1, 2, 4 ... up to max_threads threads.<br>
+Every result must be identical to the scalar one.
+*/
+static void testConvertImage(const char *name, FIBITMAP *src, ConvertProc convert, unsigned max_threads, BOOL bVerbose) {
+	double scalar_time = 0;
+	FreeImage_SetThreadCount(1);
+	FreeImage_EnableSIMD(FALSE);
+	FIBITMAP *reference = timeConversion(src, convert, scalar_time);
+	FreeImage_EnableSIMD(TRUE);
+
+	if(bVerbose) {
+		printf("... %s %ux%u, scalar : %.1f ms\n", name, FreeImage_GetWidth(src), FreeImage_GetHeight(src), scalar_time);
+	}
+
+	for(unsigned threads = 1; ; threads *= 2) {
+		if(threads > max_threads) {
+			threads = max_threads;
+		}
+		FreeImage_SetThreadCount(threads);
+
+		double time = 0;
+		FIBITMAP *dst = timeConversion(src, convert, time);
+		BOOL bResult = isSameImage(reference, dst);
+		assert(bResult);
+		FreeImage_Unload(dst);
+
+		if(bVerbose) {
+			printf("... %s %ux%u, SIMD %u thread(s) : %.1f ms (x%.2f)\n", name, FreeImage_GetWidth(src), FreeImage_GetHeight(src), threads, time, scalar_time / time);
+		}
+
+		if(threads == max_threads) {
+			break;
+		}
+	}
+
+	FreeImage_Unload(reference);
+}
+
+/**
+Run every conversion pair on a width x height image
+*/
+static void testConvertPairs(unsigned width, unsigned height, unsigned max_threads, BOOL bVerbose) {
+	FIBITMAP *src8 = createColorTestImage(FIT_BITMAP, 8, width, height);
+	FIBITMAP *src24 = createColorTestImage(FIT_BITMAP, 24, width, height);
+	FIBITMAP *src32 = createColorTestImage(FIT_BITMAP, 32, width, height);
+	FIBITMAP *src48 = FreeImage_ConvertToType(src24, FIT_RGB16);
+	assert(src8 && src24 && src32 && src48);
+
+	testConvertImage("8 -> 24", src8, FreeImage_ConvertTo24Bits, max_threads, bVerbose);
+	testConvertImage("8 -> 32", src8, FreeImage_ConvertTo32Bits, max_threads, bVerbose);
+	testConvertImage("24 -> 32", src24, FreeImage_ConvertTo32Bits, max_threads, bVerbose);
+	testConvertImage("32 -> 24", src32, FreeImage_ConvertTo24Bits, max_threads, bVerbose);
+	testConvertImage("24 -> RGBF", src24, FreeImage_ConvertToRGBF, max_threads, bVerbose);
+	testConvertImage("32 -> RGBF", src32, FreeImage_ConvertToRGBF, max_threads, bVerbose);
+	testConvertImage("RGB16 -> 24", src48, FreeImage_ConvertTo24Bits, max_threads, bVerbose);
+	testConvertImage("RGB16 -> RGBF", src48, FreeImage_ConvertToRGBF, max_threads, bVerbose);
+
+	FreeImage_Unload(src8);
+	FreeImage_Unload(src24);
+	FreeImage_Unload(src32);
+	FreeImage_Unload(src48);
+}
+
+// Main test functions
+// ----------------------------------------------------------
+
+void testConvertThreads(unsigned width, unsigned height, unsigned max_threads) {
+	printf("testConvertThreads ...\n");
+
+	// by default, up to one thread per hardware thread (and at least 4 so that the split is tested)
+	if(max_threads == 0) {
+		max_threads = FreeImage_GetThreadCount();
+		if(max_threads < 4) {
+			max_threads = 4;
+		}
+	}
+
+	// odd sizes, so that the scalar code finishes the SIMD kernels lines
+	testConvertPairs(1, 3, max_threads, FALSE);
+	testConvertPairs(37, 29, max_threads, FALSE);
+
+	// benchmark
+	testConvertPairs(width, height, max_threads, TRUE);
+
+	// back to the default thread count
+	FreeImage_SetThreadCount(0);
+}
@@ -22,6 +22,8 @@
 
 #include "TestSuite.h"
 
+#include <chrono>
+
 void  
 testBuildMPage(const char *src_filename, const char *dst_filename, FREE_IMAGE_FORMAT dst_fif, unsigned bpp) {
 	// get the file type
@@ -174,6 +176,160 @@ void testLockDeleteMultiPage(const char *input) {
 
 // --------------------------------------------------------------------------
 
+// the multipage cache modes: stdio and memory mapped, with blocks smaller and larger than the default
+static const struct {
+	const char *name;
+	FREE_IMAGE_CACHE_MODE mode;
+	unsigned block_size;
+} s_cache_modes[] = {
+	{ "file I/O, 64 KB blocks", FICM_FILE_IO, 0 },
+	{ "file I/O, 4 KB blocks", FICM_FILE_IO, 4096 },
+	{ "file I/O, 1 MB blocks", FICM_FILE_IO, 1024 * 1024 },
+	{ "memory mapped, 64 KB blocks", FICM_MEMORY_MAPPED, 0 },
+	{ "memory mapped, 4 KB blocks", FICM_MEMORY_MAPPED, 4096 },
+	{ "memory mapped, 1 MB blocks", FICM_MEMORY_MAPPED, 1024 * 1024 },
+	{ "memory mapped, 4 MB blocks", FICM_MEMORY_MAPPED, 4 * 1024 * 1024 }
+};
+
+static const unsigned s_cache_mode_count = sizeof(s_cache_modes) / sizeof(s_cache_modes[0]);
+
+static double elapsedMilliseconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+Create page_count different 24-bit pages (zone plates of increasing scale), 
+so that a page read back from the blocks of another page does not match
+*/
+static void createCachePages(FIBITMAP **pages, int page_count, unsigned width, unsigned height) {
+	for(int i = 0; i < page_count; i++) {
+		FIBITMAP *plate = createZonePlateImage(width, height, 32 + 24 * i);
+		assert(plate != NULL);
+		pages[i] = FreeImage_ConvertTo24Bits(plate);
+		FreeImage_Unload(plate);
+		assert(pages[i] != NULL);
+	}
+}
+
+/**
+Append the pages to a new TIFF multipage bitmap (written to the cache), 
+then save the file (every page read back from the cache)
+*/
+static void writeCachePages(const char *dst_filename, FIBITMAP **pages, int page_count, double *append_time, double *save_time) {
+	FIMULTIBITMAP *out = FreeImage_OpenMultiBitmap(FIF_TIFF, dst_filename, TRUE, FALSE, FALSE);
+	assert(out != NULL);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(int i = 0; i < page_count; i++) {
+		FreeImage_AppendPage(out, pages[i]);
+	}
+	if(append_time) {
+		*append_time = elapsedMilliseconds(start);
+	}
+	assert(FreeImage_GetPageCount(out) == page_count);
+
+	start = std::chrono::steady_clock::now();
+	BOOL bResult = FreeImage_CloseMultiBitmap(out, 0);
+	assert(bResult);
+	if(save_time) {
+		*save_time = elapsedMilliseconds(start);
+	}
+}
+
+/**
+Load the pages of a saved TIFF multipage file
+*/
+static void readCachePages(const char *src_filename, FIBITMAP **pages, int page_count) {
+	FIMULTIBITMAP *in = FreeImage_OpenMultiBitmap(FIF_TIFF, src_filename, FALSE, TRUE, TRUE);
+	assert(in != NULL);
+	assert(FreeImage_GetPageCount(in) == page_count);
+	for(int i = 0; i < page_count; i++) {
+		FIBITMAP *dib = FreeImage_LockPage(in, i);
+		assert(dib != NULL);
+		pages[i] = FreeImage_Clone(dib);
+		FreeImage_UnlockPage(in, dib, FALSE);
+	}
+	FreeImage_CloseMultiBitmap(in, 0);
+}
+
+/**
+Run the multipage workloads with every cache mode, 
+and check that every mode saves the same pages as the ones appended
+*/
+void testMultiPageCacheModes(const char *lpszPathName) {
+	printf("testMultiPageCacheModes ...\n");
+
+	// a few small pages, larger than the 4 KB blocks so that they are chained
+	const int page_count = 4;
+	FIBITMAP *pages[page_count];
+	FIBITMAP *first_mode_pages[page_count];
+	createCachePages(pages, page_count, 97, 61);
+
+	for(unsigned m = 0; m < s_cache_mode_count; m++) {
+		FreeImage_SetMultiBitmapCache(s_cache_modes[m].mode, s_cache_modes[m].block_size);
+
+		// the multipage tests workload
+		testBuildMPage(lpszPathName, "sample.tif", FIF_TIFF, 24);
+		testCloneMultiPage(FIF_TIFF, "sample.tif", "clone.tif", TIFF_LZW);
+		testLockDeleteMultiPage("clone.tif");
+
+		// the cache round trip is lossless and the same in every mode
+		FIBITMAP *saved_pages[page_count];
+		writeCachePages("mpages_cache.tif", pages, page_count, NULL, NULL);
+		readCachePages("mpages_cache.tif", saved_pages, page_count);
+		for(int i = 0; i < page_count; i++) {
+			BOOL bResult = isSameImage(saved_pages[i], pages[i]);
+			assert(bResult);
+			if(m == 0) {
+				first_mode_pages[i] = saved_pages[i];
+			} else {
+				bResult = isSameImage(saved_pages[i], first_mode_pages[i]);
+				assert(bResult);
+				FreeImage_Unload(saved_pages[i]);
+			}
+		}
+	}
+
+	for(int i = 0; i < page_count; i++) {
+		FreeImage_Unload(pages[i]);
+		FreeImage_Unload(first_mode_pages[i]);
+	}
+
+	// back to the default cache
+	FreeImage_SetMultiBitmapCache(FICM_FILE_IO, 0);
+}
+
+/**
+Time appending page_count pages of size x size to a multipage file and saving it with every cache mode
+(the texture array workload is 32 pages of 1024x1024)
+*/
+void benchMultiPageCacheModes(unsigned size, int page_count) {
+	printf("benchMultiPageCacheModes, %d x %ux%u pages ...\n", page_count, size, size);
+
+	FIBITMAP **pages = (FIBITMAP **)malloc(page_count * sizeof(FIBITMAP *));
+	assert(pages != NULL);
+	createCachePages(pages, page_count, size, size);
+
+	for(unsigned m = 0; m < s_cache_mode_count; m++) {
+		FreeImage_SetMultiBitmapCache(s_cache_modes[m].mode, s_cache_modes[m].block_size);
+
+		double append_time, save_time;
+		writeCachePages("mpages_bench.tif", pages, page_count, &append_time, &save_time);
+
+		printf("... %s : append %.1f ms, save %.1f ms\n", s_cache_modes[m].name, append_time, save_time);
+	}
+
+	for(int i = 0; i < page_count; i++) {
+		FreeImage_Unload(pages[i]);
+	}
+	free(pages);
+
+	// back to the default cache
+	FreeImage_SetMultiBitmapCache(FICM_FILE_IO, 0);
+}
+
+// --------------------------------------------------------------------------
+
 void testMultiPage(const char *lpszPathName) {
 	printf("testMultiPage ...\n");
 
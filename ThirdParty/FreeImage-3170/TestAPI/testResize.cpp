@@ -0,0 +1,107 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// Design and implementation by
+// - Herv Drolon (drolon@infonie.fr)
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+#include <chrono>
+
+// Local test functions
+// ----------------------------------------------------------
+
+/**
+Rescale an image with 1 thread, then with 2, 4, ... up to max_threads threads.<br>
+Every result must be identical to the single threaded one.
+*/
+static void testResizeImage(const char *name, FIBITMAP *src, unsigned dst_width, unsigned dst_height, FREE_IMAGE_FILTER filter, unsigned max_threads) {
+	FIBITMAP *reference = NULL;
+	double reference_time = 0;
+
+	for(unsigned threads = 1; ; threads *= 2) {
+		if(threads > max_threads) {
+			threads = max_threads;
+		}
+		FreeImage_SetThreadCount(threads);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		FIBITMAP *dst = FreeImage_Rescale(src, dst_width, dst_height, filter);
+		double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		assert(dst != NULL);
+
+		if(!reference) {
+			reference = dst;
+			reference_time = time;
+		} else {
+			BOOL bResult = isSameImage(reference, dst);
+			assert(bResult);
+			FreeImage_Unload(dst);
+		}
+
+		printf("... %s %ux%u -> %ux%u, %u thread(s) : %.1f ms (x%.2f)\n", name, 
+			FreeImage_GetWidth(src), FreeImage_GetHeight(src), dst_width, dst_height, threads, time, reference_time / time);
+
+		if(threads == max_threads) {
+			break;
+		}
+	}
+
+	FreeImage_Unload(reference);
+}
+
+// Main test functions
+// ----------------------------------------------------------
+
+void testResizeThreads(unsigned width, unsigned height, unsigned max_threads) {
+	printf("testResizeThreads ...\n");
+
+	// by default, up to one thread per hardware thread (and at least 4 so that the split is tested)
+	if(max_threads == 0) {
+		max_threads = FreeImage_GetThreadCount();
+		if(max_threads < 4) {
+			max_threads = 4;
+		}
+	}
+
+	struct {
+		const char *name;
+		FREE_IMAGE_TYPE image_type;
+		unsigned bpp;
+	} formats[] = {
+		{ "8-bit", FIT_BITMAP, 8 },
+		{ "24-bit", FIT_BITMAP, 24 },
+		{ "32-bit", FIT_BITMAP, 32 },
+		{ "RGBF", FIT_RGBF, 96 }
+	};
+
+	for(unsigned i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		FIBITMAP *src = createColorTestImage(formats[i].image_type, formats[i].bpp, width, height);
+		assert(src != NULL);
+
+		// downscale (texture preprocessing), then upscale to check the other weights
+		testResizeImage(formats[i].name, src, width / 2, height / 2, FILTER_LANCZOS3, max_threads);
+		testResizeImage(formats[i].name, src, width / 3 + 1, height * 5 / 4, FILTER_CATMULLROM, max_threads);
+
+		FreeImage_Unload(src);
+	}
+
+	// back to the default thread count
+	FreeImage_SetThreadCount(0);
+}
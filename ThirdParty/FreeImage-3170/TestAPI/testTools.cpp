@@ -80,3 +80,59 @@ FIBITMAP* createZonePlateImage(unsigned width, unsigned height, int scale) {
 	return dst;
 }
 
+/**
+Create a test image of the requested type from a zone plate, 
+with the channels shifted so that they all differ
+*/
+FIBITMAP* createColorTestImage(FREE_IMAGE_TYPE image_type, unsigned bpp, unsigned width, unsigned height) {
+	FIBITMAP *src = createZonePlateImage(width, height, 128);
+	if(!src) return NULL;
+
+	FIBITMAP *dst = NULL;
+	if(image_type == FIT_RGBF) {
+		dst = FreeImage_ConvertToRGBF(src);
+	} else if(bpp == 32) {
+		dst = FreeImage_ConvertTo32Bits(src);
+	} else if(bpp == 24) {
+		dst = FreeImage_ConvertTo24Bits(src);
+	} else {
+		dst = FreeImage_Clone(src);
+	}
+	FreeImage_Unload(src);
+	if(!dst) return NULL;
+
+	if((image_type == FIT_BITMAP) && (bpp >= 24)) {
+		const unsigned bytespp = bpp / 8;
+		for(unsigned y = 0; y < height; y++) {
+			BYTE *bits = FreeImage_GetScanLine(dst, y);
+			for(unsigned x = 0; x < width; x++) {
+				bits[FI_RGBA_RED] = (BYTE)(bits[FI_RGBA_RED] + x);
+				bits[FI_RGBA_BLUE] = (BYTE)(bits[FI_RGBA_BLUE] + y);
+				if(bpp == 32) {
+					bits[FI_RGBA_ALPHA] = (BYTE)(x ^ y);
+				}
+				bits += bytespp;
+			}
+		}
+	}
+
+	return dst;
+}
+
+/**
+Compare the pixels of two images of the same type and size
+*/
+BOOL isSameImage(FIBITMAP *dib1, FIBITMAP *dib2) {
+	const unsigned width = FreeImage_GetWidth(dib1);
+	const unsigned height = FreeImage_GetHeight(dib1);
+	if((width != FreeImage_GetWidth(dib2)) || (height != FreeImage_GetHeight(dib2)) || (FreeImage_GetBPP(dib1) != FreeImage_GetBPP(dib2))) {
+		return FALSE;
+	}
+	const unsigned line = FreeImage_GetLine(dib1);
+	for(unsigned y = 0; y < height; y++) {
+		if(memcmp(FreeImage_GetScanLine(dib1, y), FreeImage_GetScanLine(dib2, y), line) != 0) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}